@@ -7,6 +7,10 @@ import select
 import logging
 import ctypes
 import mmap
+import time
+import heapq
+import collections
+import subprocess
 
 class can_filter(ctypes.Structure):
     """
@@ -95,6 +99,16 @@ class can_raw_sock(object):
 
         return (can_id, length, data[:length])
 
+    # Change bit rate of the interface (requires CAP_NET_ADMIN, virtual CAN has no bit rate).
+    def set_bit_rate(self, bit_rate:int):
+        if self.__interface.startswith("vcan"):
+            return True
+        for args in (["down"], ["type", "can", "bitrate", str(bit_rate)], ["up"]):
+            if subprocess.run(["ip", "link", "set", self.__interface] + args).returncode != 0:
+                logging.error("Unable to set bit rate of '{}'".format(self.__interface))
+                return False
+        return True
+
     def try_select_recv_for(self, timeout_secs):
         rtr, rtw, ie = select.select([self.__cansock], [], [], timeout_secs)
         return True if len(rtr) > 0 else False
@@ -137,6 +151,28 @@ class acs_can_proto(object):
     FC_LEARN_USER_OK = 8
     # m->s
     FC_LEARN_USER_FAIL = 9
+    # m->s
+    FC_CACHE_XFER_FIRST = 10
+    # m->s
+    FC_CACHE_XFER_CONSEC = 11
+    # s->m
+    FC_CACHE_XFER_FLOW = 12
+    # m->s
+    FC_CACHE_UPDATE = 13
+    # M -> S (request), S -> M (response)
+    FC_DIAG = 14
+    # M -> S (broadcast), S -> M (acknowledge)
+    FC_BIT_RATE = 15
+    # M -> S (command), S -> M (status)
+    FC_FW_UPDATE = 16
+    # M -> S (broadcast)
+    FC_FW_DATA = 17
+    # M -> S (request), S -> M (response)
+    FC_CONFIG = 18
+    # S -> M (batch), M -> S (acknowledge)
+    FC_EVENT_LOG = 19
+    # S -> M
+    FC_EVENT_DATA = 20
 
     # priorities
     PRIO_RESERVED = 0
@@ -149,10 +185,22 @@ class acs_can_proto(object):
     PRIO_LEARN_USER = 2
     PRIO_LEARN_USER_FAIL = 2
     PRIO_LEARN_USER_OK = 2
+    PRIO_CACHE_XFER = 5
+    PRIO_CACHE_UPDATE = 3
+    PRIO_DIAG = 6
+    PRIO_BIT_RATE = 1
+    PRIO_FW_UPDATE = 6
+    PRIO_FW_DATA = 7
+    PRIO_CONFIG = 6
+    PRIO_EVENT_LOG = 5
 
     MASTER_ALIVE_PERIOD = 5  # seconds
     MASTER_ALIVE_TIMEOUT = 12
 
+    # Panel writes each applied cache update to its journal (one frame queues up to two changes
+    # in the journal queue of 32), updates are spaced to let the journal keep up.
+    CACHE_UPDATE_GAP = 0.05  # seconds
+
     # Data for FC_DOOR_CTRL
     DATA_DOOR_CTRL_REMOTE_UNLCK = b'\x01'
     DATA_DOOR_CTRL_CLR_CACHE = b'\x02'
@@ -162,6 +210,102 @@ class acs_can_proto(object):
     # Data for FC_DOOR_STATUS
     DATA_DOOR_STATUS_CLOSED = b'\x01'
     DATA_DOOR_STATUS_OPEN = b'\x02'
+    DATA_DOOR_STATUS_FORCED = b'\x03'  # alarm - opened while locked
+    DATA_DOOR_STATUS_HELD = b'\x04'  # alarm - open for too long
+
+    # Data for FC_CACHE_XFER_FLOW
+    DATA_XFER_FLOW_CTS = 0
+    DATA_XFER_FLOW_WAIT = 1
+    DATA_XFER_FLOW_ABORT = 2
+    DATA_XFER_FLOW_DONE = 3
+    DATA_XFER_FLOW_REQ = 4
+
+    # Pages of FC_DIAG (first byte of request and response)
+    DATA_DIAG_PAGE_SYSTEM = 0x00
+    DATA_DIAG_PAGE_CAN = 0x01
+    DATA_DIAG_PAGE_READER = 0x02
+    DATA_DIAG_PAGE_CAN_RECOVERY = 0x03
+    DATA_DIAG_PAGE_BOOT = 0x04
+    DATA_DIAG_PAGE_FIRMWARE = 0x05
+    DATA_DIAG_PAGE_TIME = 0x06
+    DATA_DIAG_PAGE_FAILOVER = 0x07
+    DATA_DIAG_PAGE_JOURNAL = 0x08  # panel built with CACHE_JOURNAL_ENABLED
+    DATA_DIAG_PAGE_TASK = 0x10  # + task number
+    DATA_DIAG_PAGE_PROFILE = 0x20  # + profiler site (panel built with PROFILER_ENABLED)
+    DATA_DIAG_PAGE_PROFILE_HIST = 0x30  # + profiler site
+    DIAG_PROFILE_SITES = ("isr can", "isr gpio", "isr weigand", "isr osdp tmr", "isr osdp uart", "isr storage",
+                          "crit reconfig", "crit cache", "crit master", "crit can send")
+    # Commands of FC_BIT_RATE (first byte)
+    DATA_BIT_RATE_PREPARE = 0
+    DATA_BIT_RATE_COMMIT = 1
+    DATA_BIT_RATE_UNSUPPORTED = 2  # acknowledge only
+    # Panel returns to previous bit rate without FC_ALIVE in this time after the switch.
+    BIT_RATE_CONFIRM_TIMEOUT = 10  # seconds
+
+    # Commands of FC_FW_UPDATE (first byte), status is sent by boot loader of the panel from its first door
+    DATA_FW_ENTER = 0
+    DATA_FW_START = 1
+    DATA_FW_WINDOW = 2  # broadcast
+    DATA_FW_FINISH = 3
+    DATA_FW_QUERY = 4
+    DATA_FW_STATUS = 5  # s->m
+    # States in DATA_FW_STATUS
+    DATA_FW_STATE_IDLE = 0
+    DATA_FW_STATE_RECEIVING = 1
+    DATA_FW_STATE_VERIFIED = 2
+    DATA_FW_STATE_ERROR = 3
+    DATA_FW_STATE_ROLLBACK = 4  # trial image failed, panel waits for the previous one
+    FW_STATE_NAMES = ("idle", "receiving", "verified", "error", "rollback")
+    # Image is sent in windows, FC_FW_DATA carries sequence number in window and 7 bytes
+    FW_WINDOW_SIZE = 1024
+    FW_FRAME_DATA = 7
+    FW_APP_SIZE = 0x7000  # application region of panel flash
+    # Commands of FC_CONFIG (first byte), door answers one request at a time
+    DATA_CONFIG_GET = 0
+    DATA_CONFIG_SET = 1
+    DATA_CONFIG_VALUE = 2  # s->m
+    DATA_CONFIG_INVALID = 3  # s->m (unknown parameter or value out of range)
+    # Parameters of FC_CONFIG (index is the parameter number)
+    CONFIG_PARAMS = ("enabled", "open_time_ms", "ok_gled_time_ms", "beep_on_success", "ok_led_on_success",
+                     "sensor_type")
+    # Commands of FC_EVENT_LOG (first byte), panel uploads events logged while master was offline
+    DATA_EVENT_BATCH = 0  # s->m, followed by FC_EVENT_DATA frames
+    DATA_EVENT_ACK = 1  # m->s
+    # Event types in FC_EVENT_DATA
+    DATA_EVENT_CARD = 0x01  # card read, not authorized (panel without cache)
+    DATA_EVENT_CARD_ALLOWED = 0x02  # authorized from panel cache
+    DATA_EVENT_CARD_DENIED = 0x03  # rejected from panel cache
+    DATA_EVENT_DOOR = 0x10  # + DATA_DOOR_STATUS_...
+    # Flags in FC_EVENT_DATA
+    DATA_EVENT_FLAG_TIME_UNKNOWN = 0x01
+    # States in DATA_DIAG_PAGE_FIRMWARE
+    DATA_DIAG_FW_CONFIRMED = 0
+    DATA_DIAG_FW_TRIAL = 1
+
+    # Flags in DATA_DIAG_PAGE_TIME
+    DATA_DIAG_TIME_SYNCED = 0x01
+    DATA_DIAG_TIME_DRIFT = 0x02
+    # Reason of the last failover in DATA_DIAG_PAGE_FAILOVER
+    DATA_DIAG_FAILOVER_NONE = 0x00
+    DATA_DIAG_FAILOVER_HEARTBEAT = 0x01
+    DATA_DIAG_FAILOVER_AUTH = 0x02
+    # Flags in DATA_DIAG_PAGE_JOURNAL
+    DATA_DIAG_JOURNAL_STALE = 0x01
+
+    # Flags in DATA_DIAG_PAGE_CAN
+    DATA_DIAG_CAN_WARN = 0x01
+    DATA_DIAG_CAN_PASSIVE = 0x02
+
+    # Items in FC_CACHE_XFER_CONSEC (upper bits carry sequence number)
+    XFER_KEY_MASK = 0x3FFFFFFF
+    XFER_SN_OFFSET = 30
+    XFER_SN_MASK = 0xF
+    XFER_MAX_ITEMS = 0xFFFF
+
+    # Cache epoch in FC_ALIVE and FC_CACHE_UPDATE
+    CACHE_EPOCH_MASK = 0xFFFF
+    # Sequence number in FC_ALIVE (panel counts gaps as missed heartbeats)
+    ALIVE_SEQ_MASK = 0xFF
 
     # Sizes of partitions in message header (CAN_ID)
     ACS_PRIO_BITS = 3
@@ -175,6 +319,10 @@ class acs_can_proto(object):
     ACS_MSTR_LAST_ADDR = 3
     ACS_PNL_FIRST_ADDR = 4
     ACS_PNL_LAST_ADDR = ACS_BROADCAST_ADDR - 1
+    # Doors of one panel, panel base address is aligned to this from ACS_PNL_FIRST_ADDR
+    # (default for panels which did not report it in DATA_DIAG_PAGE_BOOT)
+    ACS_READER_MAXCOUNT = 2
+    ACS_READER_LIMIT = 4
 
     # msg head offsets
     ACS_SRC_ADDR_OFFSET = 0
@@ -195,7 +343,8 @@ class acs_can_proto(object):
 
     CAN_ID_MASK = 0xFFFFFFFF
 
-    def __init__(self, master_addr:int, cb_user_auth_req, cb_door_status_update, cb_learn_user):
+    def __init__(self, master_addr:int, cb_user_auth_req, cb_door_status_update, cb_learn_user,
+                 cb_cache_user_list=None, cb_event_log=None, door_count:int=ACS_READER_MAXCOUNT):
         # create socket
         self.can_sock = can_raw_sock()
 
@@ -203,6 +352,44 @@ class acs_can_proto(object):
         self.cb_user_auth_req = cb_user_auth_req
         self.cb_door_status_update = cb_door_status_update
         self.cb_learn_user = cb_learn_user
+        self.cb_cache_user_list = cb_cache_user_list
+        self.cb_event_log = cb_event_log
+
+        # active cache transfers (door address -> [items, position, sequence number])
+        self.cache_xfers = {}
+
+        # frames waiting for their send time (heap of (time, sequence, door address, can_id, dlc, data),
+        # door address is None for cache updates)
+        self.send_queue = []
+        self.send_seq = 0
+
+        # epochs of queued cache updates (in send order) and time of the next one
+        self.cache_update_epochs = collections.deque()
+        self.cache_update_next = 0
+
+        # last diagnostics of doors (door address -> dict of received values)
+        self.diag = {}
+
+        # doors of the panel reported by the door (door address -> count), others use the default
+        if not 1 <= door_count <= self.ACS_READER_LIMIT:
+            raise Exception("Invalid door count '{}'\n".format(door_count))
+        self.door_count = door_count
+        self.door_counts = {}
+
+        # acknowledges of bit rate change (door address -> (command, bit rate))
+        self.bit_rate_acks = {}
+
+        # last response to configuration request (door address -> (command, parameter, value, time))
+        self.config_resp = {}
+
+        # last status of firmware update (panel base address -> (state, next window, crc, time))
+        self.fw_status = {}
+
+        # sequence number of the next FC_ALIVE
+        self.alive_seq = 0
+
+        # event batch being received (panel base address -> [batch, count, base time, {index: event}])
+        self.event_batches = {}
 
         if self.ACS_MSTR_LAST_ADDR >= master_addr >= self.ACS_MSTR_FIRST_ADDR:
             self.addr = master_addr
@@ -247,9 +434,32 @@ class acs_can_proto(object):
         return (self.__msg(self.PRIO_DOOR_CTRL, self.FC_DOOR_CTRL, reader_addr),
                 1, self.DATA_DOOR_CTRL_CLR_CACHE)
 
-    def msg_master_alive(self):
+    # Panels compare the cache epoch with their own (no epoch means the cache is cleared on master change).
+    # Time (UTC, current by default) keeps panel clocks, sequence number tells panels about missed heartbeats.
+    # Epoch of queued cache updates is announced after they are sent (panels would reload their caches).
+    def msg_master_alive(self, cache_epoch:int=None, now:float=None):
+        if cache_epoch is None:
+            return (self.__msg(self.PRIO_ALIVE, self.FC_ALIVE, self.ACS_BROADCAST_ADDR),
+                    0, b'\x00')
+        if len(self.cache_update_epochs) > 0:
+            cache_epoch = self.cache_update_epochs[0] - 1
+        if now is None:
+            now = time.time()
+        seq = self.alive_seq
+        self.alive_seq = (seq + 1) & self.ALIVE_SEQ_MASK
         return (self.__msg(self.PRIO_ALIVE, self.FC_ALIVE, self.ACS_BROADCAST_ADDR),
-                0, b'\x00')
+                8, struct.pack("<HIBB", cache_epoch & self.CACHE_EPOCH_MASK, int(now) & 0xFFFFFFFF,
+                               int((now % 1) * 256), seq))
+
+    # Update permission of user for a door in all panel caches.
+    # Broadcast door address invalidates the user on all doors.
+    def msg_cache_update(self, user_id:int, epoch:int, door_addr:int=ACS_BROADCAST_ADDR, allow:bool=False):
+        door = (door_addr & ((1 << self.ACS_ADDR_BITS) - 1)) | ((1 if allow else 0) << self.ACS_ADDR_BITS)
+        data = (user_id & 0xFFFFFFFF).to_bytes(4, "little")
+        data += (epoch & self.CACHE_EPOCH_MASK).to_bytes(2, "little")
+        data += door.to_bytes(2, "little")
+        return (self.__msg(self.PRIO_CACHE_UPDATE, self.FC_CACHE_UPDATE, self.ACS_BROADCAST_ADDR),
+                8, data)
 
     def msg_reader_normal_mode(self, reader_addr):
         return (self.__msg(self.PRIO_DOOR_CTRL, self.FC_DOOR_CTRL, reader_addr),
@@ -267,6 +477,261 @@ class acs_can_proto(object):
         return (self.__msg(self.PRIO_LEARN_USER_FAIL, self.FC_LEARN_USER_FAIL, reader_addr),
                 4, user_id.to_bytes(4, "little", signed=True))
 
+    def msg_cache_xfer_first(self, reader_addr, item_count:int):
+        return (self.__msg(self.PRIO_CACHE_XFER, self.FC_CACHE_XFER_FIRST, reader_addr),
+                2, item_count.to_bytes(2, "little"))
+
+    # Consecutive frame carries one or two items, sequence number is in their upper bits.
+    def msg_cache_xfer_consec(self, reader_addr, sn:int, items):
+        data = b''
+        for i, user_id in enumerate(items[:2]):
+            item = (user_id & self.XFER_KEY_MASK) | (((sn >> (2 * i)) & 0x3) << self.XFER_SN_OFFSET)
+            data += item.to_bytes(4, "little")
+        return (self.__msg(self.PRIO_CACHE_XFER, self.FC_CACHE_XFER_CONSEC, reader_addr),
+                len(data), data)
+
+    # Request one page of panel diagnostics (statistics are also per door).
+    def msg_diag_request(self, reader_addr, page:int):
+        return (self.__msg(self.PRIO_DIAG, self.FC_DIAG, reader_addr),
+                1, bytes([page & 0xFF]))
+
+    # Ask all panels if they support the bit rate (each answers from its first door).
+    def msg_bit_rate_prepare(self, bit_rate:int):
+        self.bit_rate_acks = {}
+        return (self.__msg(self.PRIO_BIT_RATE, self.FC_BIT_RATE, self.ACS_BROADCAST_ADDR),
+                5, struct.pack("<BHH", self.DATA_BIT_RATE_PREPARE, bit_rate // 1000, 0))
+
+    # Make prepared panels switch to the bit rate after the delay.
+    def msg_bit_rate_commit(self, bit_rate:int, delay_ms:int):
+        return (self.__msg(self.PRIO_BIT_RATE, self.FC_BIT_RATE, self.ACS_BROADCAST_ADDR),
+                5, struct.pack("<BHH", self.DATA_BIT_RATE_COMMIT, bit_rate // 1000, delay_ms))
+
+    # Make the panel reset to its boot loader (any door of the panel).
+    def msg_fw_enter(self, reader_addr):
+        return (self.__msg(self.PRIO_FW_UPDATE, self.FC_FW_UPDATE, reader_addr),
+                1, bytes([self.DATA_FW_ENTER]))
+
+    # Erase application of the panel and prepare for the image (to the first door).
+    def msg_fw_start(self, panel_addr, size:int, crc:int):
+        return (self.__msg(self.PRIO_FW_UPDATE, self.FC_FW_UPDATE, panel_addr),
+                7, struct.pack("<BHI", self.DATA_FW_START, size, crc))
+
+    # Following data frames belong to the window (all updated panels).
+    def msg_fw_window(self, window:int):
+        return (self.__msg(self.PRIO_FW_UPDATE, self.FC_FW_UPDATE, self.ACS_BROADCAST_ADDR),
+                3, struct.pack("<BH", self.DATA_FW_WINDOW, window))
+
+    def msg_fw_data(self, seq:int, data:bytes):
+        return (self.__msg(self.PRIO_FW_DATA, self.FC_FW_DATA, self.ACS_BROADCAST_ADDR),
+                1 + len(data), bytes([seq]) + data)
+
+    # Verify the image and start it.
+    def msg_fw_finish(self, panel_addr):
+        return (self.__msg(self.PRIO_FW_UPDATE, self.FC_FW_UPDATE, panel_addr),
+                1, bytes([self.DATA_FW_FINISH]))
+
+    def msg_fw_query(self, panel_addr):
+        return (self.__msg(self.PRIO_FW_UPDATE, self.FC_FW_UPDATE, panel_addr),
+                1, bytes([self.DATA_FW_QUERY]))
+
+    # Read parameter of the door (see CONFIG_PARAMS).
+    def msg_config_get(self, reader_addr, param:int):
+        return (self.__msg(self.PRIO_CONFIG, self.FC_CONFIG, reader_addr),
+                2, bytes([self.DATA_CONFIG_GET, param]))
+
+    # Write parameter of the door, panel applies and stores it.
+    def msg_config_set(self, reader_addr, param:int, value:int):
+        return (self.__msg(self.PRIO_CONFIG, self.FC_CONFIG, reader_addr),
+                4, struct.pack("<BBH", self.DATA_CONFIG_SET, param, value))
+
+    # Acknowledge stored batch of events (to the first door of the panel).
+    def msg_event_ack(self, panel_addr, batch:int):
+        return (self.__msg(self.PRIO_EVENT_LOG, self.FC_EVENT_LOG, panel_addr),
+                2, bytes([self.DATA_EVENT_ACK, batch]))
+
+    # Return True if the door reported the door count of its panel.
+    def has_door_count(self, reader_addr):
+        return reader_addr in self.door_counts
+
+    # Address of the first door of the panel (used by boot loader of the panel).
+    def panel_base(self, reader_addr):
+        door_count = self.door_counts.get(reader_addr, self.door_count)
+        return reader_addr - ((reader_addr - self.ACS_PNL_FIRST_ADDR) % door_count)
+
+    # Return last diagnostics of the door (empty if nothing received).
+    def get_diag(self, reader_addr):
+        return self.diag.get(reader_addr, {})
+
+    # Start transfer of authorized users to the panel cache. Return first frame.
+    def start_cache_xfer(self, reader_addr):
+        if self.cb_cache_user_list is None:
+            return self.NO_MESSAGE
+        # longer IDs would be truncated in consecutive frame (panel asks master for them)
+        items = [user_id for user_id in self.cb_cache_user_list(reader_addr)
+                 if 0 < user_id <= self.XFER_KEY_MASK][:self.XFER_MAX_ITEMS]
+        self.__drop_queued(reader_addr)
+        if len(items) == 0:
+            # empty transfer is still answered by DONE (panel logs its cache epoch after all doors)
+            self.cache_xfers.pop(reader_addr, None)
+            return self.msg_cache_xfer_first(reader_addr, 0)
+        self.cache_xfers[reader_addr] = [items, 0, 1]
+        return self.msg_cache_xfer_first(reader_addr, len(items))
+
+    # Queue frame to be sent at the given time (see send_due).
+    def __queue_send(self, when, reader_addr, can_id, dlc, data):
+        self.send_seq += 1
+        heapq.heappush(self.send_queue, (when, self.send_seq, reader_addr, can_id, dlc, data))
+
+    # Queue cache update (see msg_cache_update) after the previously queued ones, spaced by CACHE_UPDATE_GAP.
+    def queue_cache_update(self, user_id:int, epoch:int, door_addr:int=ACS_BROADCAST_ADDR, allow:bool=False):
+        when = max(time.monotonic(), self.cache_update_next)
+        self.cache_update_next = when + self.CACHE_UPDATE_GAP
+        self.cache_update_epochs.append(epoch)
+        can_id, dlc, data = self.msg_cache_update(user_id, epoch, door_addr, allow)
+        self.__queue_send(when, None, can_id, dlc, data)
+
+    # Remove queued frames of the door.
+    def __drop_queued(self, reader_addr):
+        self.send_queue = [entry for entry in self.send_queue if entry[2] != reader_addr]
+        heapq.heapify(self.send_queue)
+
+    # Send queued frames which are due. Return seconds to the next queued frame (None if there is none).
+    # Called from the main loop which waits for received messages at most the returned time.
+    def send_due(self):
+        now = time.monotonic()
+        while len(self.send_queue) > 0 and self.send_queue[0][0] <= now:
+            _, _, reader_addr, can_id, dlc, data = heapq.heappop(self.send_queue)
+            if reader_addr is None:
+                self.cache_update_epochs.popleft()
+            self.can_sock.send(can_id, dlc, data)
+        return max(0, self.send_queue[0][0] - now) if len(self.send_queue) > 0 else None
+
+    # Queue block of consecutive frames of active transfer (separated by st_min).
+    def __send_cache_xfer_block(self, reader_addr, block_size, st_min_ms):
+        xfer = self.cache_xfers.get(reader_addr)
+        if xfer is None:
+            return
+        items, pos, sn = xfer
+        when = time.monotonic()
+        frames = 0
+        while pos < len(items) and (block_size == 0 or frames < block_size):
+            can_id, dlc, data = self.msg_cache_xfer_consec(reader_addr, sn, items[pos:pos + 2])
+            self.__queue_send(when, reader_addr, can_id, dlc, data)
+            pos += 2
+            sn = (sn + 1) & self.XFER_SN_MASK
+            frames += 1
+            when += st_min_ms / 1000
+        xfer[1] = pos
+        xfer[2] = sn
+
+    # Process flow control of cache transfer.
+    def __process_cache_xfer_flow(self, reader_addr, msg_data):
+        status = msg_data[0] if len(msg_data) > 0 else self.DATA_XFER_FLOW_ABORT
+        if status == self.DATA_XFER_FLOW_REQ:
+            return self.start_cache_xfer(reader_addr)
+        elif status == self.DATA_XFER_FLOW_CTS:
+            block_size = msg_data[1] if len(msg_data) > 1 else 0
+            st_min_ms = msg_data[2] if len(msg_data) > 2 else 0
+            self.__send_cache_xfer_block(reader_addr, block_size, st_min_ms)
+        elif status == self.DATA_XFER_FLOW_ABORT:
+            self.__drop_queued(reader_addr)
+            if self.cache_xfers.pop(reader_addr, None) is not None:
+                logging.warning("Cache transfer to {} aborted".format(reader_addr))
+        elif status == self.DATA_XFER_FLOW_DONE:
+            self.cache_xfers.pop(reader_addr, None)
+            logging.info("Cache transfer to {} done".format(reader_addr))
+        return self.NO_MESSAGE
+
+    # Store diagnostic page received from panel.
+    def __process_diag(self, reader_addr, msg_data):
+        if len(msg_data) < 1:
+            return self.NO_MESSAGE
+        page = msg_data[0]
+        diag = self.diag.setdefault(reader_addr, {"tasks": {}})
+        diag["time"] = time.monotonic()
+        if page == self.DATA_DIAG_PAGE_SYSTEM and len(msg_data) >= 8:
+            reset, uptime, task_count, cpu_load = struct.unpack_from("<BIBB", msg_data, 1)
+            diag.update(reset_reason=reset, uptime_sec=uptime, task_count=task_count, cpu_load=cpu_load)
+        elif page == self.DATA_DIAG_PAGE_CAN and len(msg_data) >= 6:
+            tx_errors, rx_errors, flags, error_count = struct.unpack_from("<BBBH", msg_data, 1)
+            diag.update(can_tx_errors=tx_errors, can_rx_errors=rx_errors, can_flags=flags,
+                        can_error_count=error_count)
+            if len(msg_data) >= 8:
+                diag.update(can_bit_rate=struct.unpack_from("<H", msg_data, 6)[0] * 1000)
+        elif page == self.DATA_DIAG_PAGE_CAN_RECOVERY and len(msg_data) >= 7:
+            bus_off, passive, restarts = struct.unpack_from("<HHH", msg_data, 1)
+            diag.update(can_bus_off_count=bus_off, can_passive_count=passive, can_restart_count=restarts)
+        elif page == self.DATA_DIAG_PAGE_BOOT and len(msg_data) >= 7:
+            startup_ms, master_ms = struct.unpack_from("<HI", msg_data, 1)
+            diag.update(boot_startup_ms=startup_ms, boot_master_ms=master_ms)
+            if len(msg_data) >= 8 and 1 <= msg_data[7] <= self.ACS_READER_LIMIT:
+                self.door_counts[reader_addr] = msg_data[7]
+        elif page == self.DATA_DIAG_PAGE_FIRMWARE and len(msg_data) >= 8:
+            state, version, crc = struct.unpack_from("<BHI", msg_data, 1)
+            diag.update(fw_trial=(state == self.DATA_DIAG_FW_TRIAL), fw_version=version, fw_crc=crc)
+        elif page == self.DATA_DIAG_PAGE_TIME and len(msg_data) >= 8:
+            flags, drift_ppm, missed, since_sync = struct.unpack_from("<BhHH", msg_data, 1)
+            diag.update(time_synced=bool(flags & self.DATA_DIAG_TIME_SYNCED),
+                        time_drift_ppm=drift_ppm if flags & self.DATA_DIAG_TIME_DRIFT else None,
+                        alive_missed=missed, time_since_sync=since_sync)
+        elif page == self.DATA_DIAG_PAGE_FAILOVER and len(msg_data) >= 8:
+            reason, count, last_ms, max_ms = struct.unpack_from("<BHHH", msg_data, 1)
+            diag.update(failover_reason=reason, failover_count=count, failover_last_ms=last_ms,
+                        failover_max_ms=max_ms)
+        elif page == self.DATA_DIAG_PAGE_JOURNAL and len(msg_data) >= 8:
+            flags, dropped, passes, queue_peak = struct.unpack_from("<BHHB", msg_data, 1)
+            diag.update(journal_stale=bool(flags & self.DATA_DIAG_JOURNAL_STALE), journal_dropped=dropped,
+                        journal_passes=passes, journal_queue_peak=queue_peak)
+        elif page == self.DATA_DIAG_PAGE_READER and len(msg_data) >= 7:
+            parity_errors, lookups, hits = struct.unpack_from("<HHH", msg_data, 1)
+            diag.update(parity_errors=parity_errors, cache_lookups=lookups, cache_hits=hits)
+            if len(msg_data) >= 8:
+                diag.update(cache_tombstones=msg_data[7])
+        elif page & 0xF0 == self.DATA_DIAG_PAGE_PROFILE and len(msg_data) >= 5:
+            max_us, count = struct.unpack_from("<HH", msg_data, 1)
+            site = diag.setdefault("profile", {}).setdefault(page & 0x0F, {})
+            site.update(max_us=max_us, count=count)
+        elif page & 0xF0 == self.DATA_DIAG_PAGE_PROFILE_HIST and len(msg_data) >= 8:
+            # bins hold bit length of the count - keep the lower bound
+            hist = [0 if n == 0 else 1 << (n - 1) for n in msg_data[1:8]]
+            site = diag.setdefault("profile", {}).setdefault(page & 0x0F, {})
+            site.update(hist=hist)
+        elif page >= self.DATA_DIAG_PAGE_TASK and page < self.DATA_DIAG_PAGE_PROFILE and len(msg_data) >= 8:
+            name, cpu_load, stack_free = struct.unpack_from("<4sBH", msg_data, 1)
+            diag["tasks"][page - self.DATA_DIAG_PAGE_TASK] = {
+                "name": name.rstrip(b"\x00").decode(errors="replace"),
+                "cpu_load": cpu_load, "stack_free": stack_free}
+        return self.NO_MESSAGE
+
+    # Start receiving batch of events.
+    def __process_event_log(self, panel_addr, msg_data):
+        if len(msg_data) < 7 or msg_data[0] != self.DATA_EVENT_BATCH:
+            return self.NO_MESSAGE
+        batch, count, base = struct.unpack_from("<BBI", msg_data, 1)
+        self.event_batches[panel_addr] = [batch, count, base, {}]
+        return self.NO_MESSAGE
+
+    # Collect event of the batch, store complete batch and acknowledge it.
+    # Batch is identified by (batch, count, base time) - panel repeats the batch until it gets acknowledge,
+    # possibly to another master, so the callback must ignore batch which was stored already.
+    def __process_event_data(self, panel_addr, msg_data):
+        rx = self.event_batches.get(panel_addr)
+        if rx is None or len(msg_data) < 8:
+            return self.NO_MESSAGE
+        batch, count, base, events = rx
+        bits, event_type, offset, user_id = struct.unpack_from("<BBHI", msg_data)
+        index, door, flags = bits & 0x0F, (bits >> 4) & 0x03, bits >> 6
+        if index >= count:
+            return self.NO_MESSAGE
+        event_time = None if flags & self.DATA_EVENT_FLAG_TIME_UNKNOWN else base + offset
+        events[index] = (panel_addr + door, event_type, event_time, user_id)
+        if len(events) < count:
+            return self.NO_MESSAGE
+        del self.event_batches[panel_addr]
+        if self.cb_event_log is not None:
+            self.cb_event_log(panel_addr, (batch, count, base), [events[i] for i in range(count)])
+        return self.msg_event_ack(panel_addr, batch)
+
     # Parse arbitration ID
     def __parse_msg_head(self, msg_head):
         prio = (msg_head & self.ACS_PRIO_MASK) >> self.ACS_PRIO_OFFSET
@@ -305,8 +770,34 @@ class acs_can_proto(object):
                         return self.msg_learn_user_fail(src, user_id)
             elif fc == self.FC_DOOR_STATUS:
                 if self.cb_door_status_update is not None:
-                    self.cb_door_status_update(src, msg_data[:1] == self.DATA_DOOR_STATUS_OPEN)
+                    status = msg_data[:1]
+                    self.cb_door_status_update(src, status != self.DATA_DOOR_STATUS_CLOSED, status)
                     return self.NO_MESSAGE
+            elif fc == self.FC_CACHE_XFER_FLOW:
+                return self.__process_cache_xfer_flow(src, msg_data)
+            elif fc == self.FC_DIAG:
+                return self.__process_diag(src, msg_data)
+            elif fc == self.FC_BIT_RATE:
+                if len(msg_data) >= 3:
+                    command, bit_rate_kbps = struct.unpack_from("<BH", msg_data)
+                    self.bit_rate_acks[src] = (command, bit_rate_kbps * 1000)
+                return self.NO_MESSAGE
+            elif fc == self.FC_CONFIG:
+                if len(msg_data) >= 4:
+                    command, param, value = struct.unpack_from("<BBH", msg_data)
+                    self.config_resp[src] = (command, param, value, time.monotonic())
+                return self.NO_MESSAGE
+            elif fc == self.FC_EVENT_LOG:
+                return self.__process_event_log(src, msg_data)
+            elif fc == self.FC_EVENT_DATA:
+                return self.__process_event_data(src, msg_data)
+            elif fc == self.FC_FW_UPDATE:
+                if len(msg_data) >= 8 and msg_data[0] == self.DATA_FW_STATUS:
+                    state, window, crc = struct.unpack_from("<BHI", msg_data, 1)
+                    self.fw_status[src] = (state, window, crc, time.monotonic())
+                    if state == self.DATA_FW_STATE_ROLLBACK:
+                        logging.warning("Panel {} rolled back firmware update (waits for image)".format(src))
+                return self.NO_MESSAGE
             else:
                 return self.NO_MESSAGE
 
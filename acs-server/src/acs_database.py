@@ -1,5 +1,7 @@
 import redis
 import logging
+import time
+import json
 
 class acs_database(object):
     """
@@ -20,6 +22,14 @@ class acs_database(object):
         Door database
             - value is list containing mode and status
             - key must be door address (unique)
+            - special key "__cache_epoch" is version of panel caches (incremented with each update)
+            - special keys "__master_<addr>" are live masters (server identification, expire without refresh)
+            - special keys "__events_<addr>" are the last stored event batch of the panel
+
+        Several servers (masters) can share one database, each panel talks to one of the live masters.
+
+        Changes of user permissions are published as updates of panel caches on channel "__cache_updates"
+        (see poll_cache_updates) so every server updates panels also after changes done by other clients.
     """
 
     __ALL_GRP = b"__all"  # Special group representing all doors.
@@ -31,6 +41,15 @@ class acs_database(object):
     __DEFAULT_PORT = 6379
     __DOOR_MODE_IDX = 0
     __DOOR_STATUS_IDX = 1
+    __CACHE_EPOCH_KEY = "__cache_epoch"
+    __CACHE_EPOCH_MASK = 0xFFFF
+    __MASTER_KEY_PREFIX = "__master_"
+    __EVENTS_KEY_PREFIX = "__events_"
+    __CACHE_UPDATE_CHANNEL = "__cache_updates"
+
+    # Above this number of updates a group change is announced only by a new cache epoch (panels reload
+    # their caches). Each update queues up to two changes in the journal of a panel (queue of 32).
+    CACHE_UPDATE_MAX = 12
 
     # user auth types
     USER_AUTH_FAIL = 0
@@ -55,11 +74,97 @@ class acs_database(object):
         self.__rclient_door = redis.Redis(host, port, db=2, password=None, encoding='utf-8',
             socket_timeout=10, socket_keepalive=True, retry_on_timeout=True)
 
+        # subscription to cache updates (see subscribe_cache_updates)
+        self.__pubsub = None
+        self.__updates_lost = False
+
         # create basic groups (if not present)
         self.add_doors_to_group(self.__ALL_GRP, self.__RESERVED_ADDR)
         self.add_doors_to_group(self.__EMPTY_GRP, self.__RESERVED_ADDR)
         self.add_doors_to_group(self.__LEARN_GRP, self.__RESERVED_ADDR)
 
+    # Subscribe to cache updates published by all clients of the database (see poll_cache_updates).
+    def subscribe_cache_updates(self):
+        self.__pubsub = self.__rclient_door.pubsub(ignore_subscribe_messages=True)
+        self.__pubsub.subscribe(self.__CACHE_UPDATE_CHANNEL)
+
+    # Return cache updates published since the last call, list of (user_id, epoch, door_addr, allow)
+    # where door_addr None invalidates the user on all doors. Updates published while the subscription
+    # was disconnected are lost - cache epoch is skipped after reconnection so panels reload their caches.
+    def poll_cache_updates(self):
+        updates = []
+        try:
+            message = self.__pubsub.get_message()
+            if self.__updates_lost:
+                self.__updates_lost = False
+                logging.warning("Cache updates lost while disconnected, epoch {} reloads panel caches".format(
+                                self.next_cache_epoch()))
+            while message is not None:
+                updates.extend(tuple(update) for update in json.loads(message["data"]))
+                message = self.__pubsub.get_message()
+        except redis.ConnectionError:
+            self.__updates_lost = True
+            raise
+        return updates
+
+    def __publish_cache_updates(self, updates):
+        self.__rclient_door.publish(self.__CACHE_UPDATE_CHANNEL, json.dumps(updates))
+
+    # User lost permissions (removed or moved to other group) - invalidate the user on all doors.
+    def __publish_user_changed(self, user_id):
+        self.__publish_cache_updates([(int(user_id), self.next_cache_epoch(), None, False)])
+
+    # Members of the group got or lost access to doors. Epochs of all updates are allocated at once
+    # (servers send them in this order).
+    def __publish_group_changed(self, group, doors, allow:bool):
+        if isinstance(group, str):
+            group = group.encode()
+        doors = [int(door) for door in doors if int(door) != self.__RESERVED_ADDR]
+        if group.startswith(b"__") or len(doors) == 0:
+            return
+        users = self.get_users_in_group(group)
+        count = len(users) * len(doors)
+        if count == 0:
+            return
+        if count > self.CACHE_UPDATE_MAX:
+            # skipped epoch makes panels reload whole cache
+            self.next_cache_epoch()
+            return
+        epoch = self.__rclient_door.incrby(self.__CACHE_EPOCH_KEY, count) - count
+        updates = []
+        for user_id in users:
+            for door_addr in doors:
+                epoch += 1
+                updates.append((user_id, epoch & self.__CACHE_EPOCH_MASK, door_addr, allow))
+        self.__publish_cache_updates(updates)
+
+    # Return current version of panel caches.
+    def get_cache_epoch(self) -> int:
+        epoch = self.__rclient_door.get(self.__CACHE_EPOCH_KEY)
+        return 0 if epoch is None else (int(epoch) & self.__CACHE_EPOCH_MASK)
+
+    # Increment version of panel caches and return the new one.
+    def next_cache_epoch(self) -> int:
+        return self.__rclient_door.incr(self.__CACHE_EPOCH_KEY) & self.__CACHE_EPOCH_MASK
+
+    # Refresh record of live master (expires after ttl seconds).
+    def set_master_alive(self, addr:int, owner:str, ttl:int):
+        self.__rclient_door.set(self.__MASTER_KEY_PREFIX + str(addr), owner, ex=ttl)
+
+    # Return live masters (address -> server identification).
+    def get_live_masters(self):
+        masters = {}
+        for key in self.__rclient_door.scan_iter(match=self.__MASTER_KEY_PREFIX + "*", count=100):
+            owner = self.__rclient_door.get(key)
+            if owner is not None:
+                masters[int(key[len(self.__MASTER_KEY_PREFIX):])] = owner.decode(errors="replace")
+        return masters
+
+    # Remember the last stored event batch of the panel. Return False if it was stored already.
+    def set_event_batch(self, panel_addr:int, batch:str) -> bool:
+        old = self.__rclient_door.getset(self.__EVENTS_KEY_PREFIX + str(panel_addr), batch)
+        return old is None or old.decode() != batch
+
     # Return user's group name or None if user does not exist.
     def get_user_group(self, user_id:int) -> str:
         group = self.__rclient_user.get(user_id)
@@ -69,21 +174,29 @@ class acs_database(object):
     def add_user(self, user_id:int, group:str=__ALL_GRP, expire_secs:int=0) -> bool:
         if self.__rclient_group.exists(group) == 0:
             return False
+        old_group = self.get_user_group(user_id)
         if expire_secs > 0:
             self.__rclient_user.set(user_id, group, ex=expire_secs)
         else:
             self.__rclient_user.set(user_id, group)
+        if old_group is not None and old_group != group:
+            self.__publish_user_changed(user_id)
         return True
 
     # Return True if user was removed.
     def remove_user(self, user_id) -> bool:
         status = self.__rclient_user.delete(user_id)
+        if status > 0:
+            self.__publish_user_changed(user_id)
         return True if (status > 0) else False
 
     # Return True if group was removed.
     def remove_group(self, group, only_empty) -> bool:
         if not only_empty or (only_empty and (self.__rclient_group.scard(group) == 0)):
+            doors = self.__rclient_group.smembers(group)
             status = self.__rclient_group.delete(group)
+            if status > 0:
+                self.__publish_group_changed(group, doors, False)
         return True if (status > 0) else False
 
     # Return portition of users (depending on the cursor value).
@@ -110,19 +223,57 @@ class acs_database(object):
         for door_addr in doors:
             if self.__rclient_door.llen(door_addr) == 0:
                 self.__rclient_door.rpush(door_addr, self.DOOR_MODE_ENABLED, self.DOOR_STATUS_CLOSED)
-        return self.__rclient_group.sadd(group, *doors)
+        added = self.__rclient_group.sadd(group, *doors)
+        if added > 0:
+            self.__publish_group_changed(group, doors, True)
+        return added
 
     # Return the number of doors that were removed from the set,
     # not including non existing doors.
     def remove_doors_from_group(self, group:str, *doors) -> int:
         for door_addr in doors:
             self.__rclient_door.delete(door_addr)
-        return self.__rclient_group.srem(group, doors)
+        removed = self.__rclient_group.srem(group, *doors)
+        if removed > 0:
+            self.__publish_group_changed(group, doors, False)
+        return removed
 
     # Return all doors in a group. Note that this can be a demanding operation.
     def get_doors_in_group(self, group:str):
         return self.__rclient_group.smembers(group)
 
+    # Return users authorized to use the door. Note that this can be a demanding operation.
+    def get_users_for_door(self, door_addr:int):
+        groups = {self.__ALL_GRP}
+        for group in self.__rclient_group.scan_iter(count=100):
+            if not group.startswith(b"__") and self.__rclient_group.sismember(group, door_addr):
+                groups.add(group)
+        users = []
+        for user_id in self.__rclient_user.scan_iter(count=100):
+            if not user_id.isdigit() or int(user_id) == self.__RESERVED_ADDR:
+                continue
+            if self.__rclient_user.get(user_id) in groups:
+                users.append(int(user_id))
+        return users
+
+    # Return users in the group. Note that this can be a demanding operation.
+    def get_users_in_group(self, group):
+        if isinstance(group, str):
+            group = group.encode()
+        users = []
+        for user_id in self.__rclient_user.scan_iter(count=100):
+            if user_id.isdigit() and self.__rclient_user.get(user_id) == group:
+                users.append(int(user_id))
+        return users
+
+    # Return addresses of all doors in database.
+    def get_doors(self):
+        doors = []
+        for door_addr in self.__rclient_door.scan_iter(count=100):
+            if door_addr.isdigit() and int(door_addr) != self.__RESERVED_ADDR:
+                doors.append(int(door_addr))
+        return doors
+
     # Return true if door is in database
     def is_door_registered(self, door_addr:int) -> bool:
         self.__rclient_door.llen(door_addr) == 2
@@ -143,15 +294,27 @@ class acs_database(object):
         else:
             return self.USER_AUTH_FAIL
 
-    # Log that user accessed a door/door.
-    def log_user_access(self, user_id, door_addr, allowed):
+    # Log that user accessed a door/door (offline access is logged by panel with time if it was known).
+    def log_user_access(self, user_id, door_addr, allowed, offline=False, event_time=None):
         group = self.get_user_group(user_id)
         if group is None:
             group = ""
         if allowed:
-            logging.info("User \"{}\" from \"{}\" access to \"{}\" allowed".format(user_id, group, door_addr))
+            msg = "User \"{}\" from \"{}\" access to \"{}\" allowed".format(user_id, group, door_addr)
         else:
-            logging.info("User \"{}\" from \"{}\" access to \"{}\" denied".format(user_id, group, door_addr))
+            msg = "User \"{}\" from \"{}\" access to \"{}\" denied".format(user_id, group, door_addr)
+        if offline:
+            msg += " at {} (offline)".format("unknown time" if event_time is None else self.__format_time(event_time))
+        logging.info(msg)
+
+    # Log event which happened on the door while master was offline (time is None if panel did not know it).
+    def log_offline_event(self, door_addr, what, event_time):
+        when = "unknown time" if event_time is None else self.__format_time(event_time)
+        logging.info("Door \"{}\" {} at {} (offline)".format(door_addr, what, when))
+
+    @staticmethod
+    def __format_time(event_time):
+        return time.strftime("%Y-%m-%d %H:%M:%S UTC", time.gmtime(event_time))
 
     # Mode is one of DOOR_MODE_...
     def set_door_mode(self, door_addr, mode):
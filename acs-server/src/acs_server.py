@@ -4,6 +4,8 @@ import sys
 import os
 import logging
 import time
+import zlib
+import socket
 # For remote debugging add firewall exception e.g. iptables -A INPUT -p tcp -m state --state NEW -m tcp --dport 5678 -j ACCEPT
 # import ptvsd
 
@@ -22,13 +24,52 @@ class acs_server(object):
 
     __running = True
 
-    def __init__(self, can_if, addr, r_host, r_port, debug):
+    # Cache updates published by database clients are picked up at least this often.
+    CACHE_UPDATE_POLL_PERIOD = 0.5  # seconds
+
+    # Period of diagnostics polling (one page for each door per period).
+    DIAG_POLL_PERIOD = 10  # seconds
+    # Panel answers one request of a door at a time (next is sent after response or timeout).
+    DIAG_RESPONSE_TIMEOUT = 3  # seconds
+    # Limits for health warnings.
+    DIAG_CPU_LOAD_WARN = 80  # percent
+    DIAG_STACK_FREE_WARN = 16  # words
+    DIAG_TOMBSTONES_WARN = 64  # cache slots of erased users (panel reclaims them continuously)
+
+    # Bit rate change - panels acknowledge prepare in this time and switch after the delay.
+    BIT_RATE_ACK_TIMEOUT = 1  # seconds
+    BIT_RATE_SWITCH_DELAY_MS = 500
+    # Prepare is repeated for panels which did not acknowledge it (change is aborted after that).
+    BIT_RATE_PREPARE_RETRIES = 2
+    # Commit is repeated because panel which misses it stays at the old bit rate. Repeats are spaced
+    # so one disturbance of the bus does not hit all of them.
+    BIT_RATE_COMMIT_REPEAT = 3
+    BIT_RATE_COMMIT_SPACING = 0.1  # seconds
+
+    # Configuration - door answers each parameter in its processing loop (about 1 s).
+    CONFIG_RESPONSE_TIMEOUT = 3  # seconds
+    CONFIG_RETRIES = 3
+
+    # Firmware update - panels reset to boot loader and report status in this time.
+    FW_ENTER_TIMEOUT = 3  # seconds
+    # Erase of application flash takes up to 100 ms per sector.
+    FW_START_TIMEOUT = 2  # seconds
+    # Panels acknowledge each window after it is written to flash.
+    FW_WINDOW_TIMEOUT = 1  # seconds
+    FW_WINDOW_RETRIES = 5
+    # Data frames are paced to leave bus time for other traffic (about 1/2 of bus).
+    FW_FRAME_GAP = 0.0005  # seconds
+
+    def __init__(self, can_if, addr, r_host, r_port, debug, panel_doors=acs_can_proto.ACS_READER_MAXCOUNT):
         self.can_if = can_if
         self.addr = addr
         try:
             self.proto = acs_can_proto(addr, cb_user_auth_req=self._resp_to_auth_req,
                                        cb_door_status_update=self._door_status_update,
-                                       cb_learn_user=self._learn_user)
+                                       cb_learn_user=self._learn_user,
+                                       cb_cache_user_list=self._cache_user_list,
+                                       cb_event_log=self._event_log,
+                                       door_count=panel_doors)
             self.proto.bind(can_if)
         except Exception as e:
             logging.exception("Unable to start the server: %s", e)
@@ -36,6 +77,7 @@ class acs_server(object):
 
         try:
             self.db = acs_database(r_host, r_port)
+            self.db.subscribe_cache_updates()
         except Exception as e:
             logging.exception("Unable to connect to Redis server: %s", e)
             sys.exit(1)
@@ -46,6 +88,26 @@ class acs_server(object):
 
         self.debug = debug
 
+        # identification of this server in the list of live masters (shared through database)
+        self.master_id = "{}:{}".format(socket.gethostname(), os.getpid())
+
+        # next diagnostic page for each door
+        self.diag_pages = {}
+        # requested pages waiting to be sent (door address -> list of pages)
+        self.diag_queue = {}
+        # time of last sent request (door address -> time)
+        self.diag_sent = {}
+        # last reported bus-off count (door address -> count)
+        self.diag_bus_off = {}
+        # last reported boot time (door address -> ms)
+        self.diag_boot = {}
+        # last reported count of missed master alive messages (door address -> count)
+        self.diag_alive_missed = {}
+        # last reported count of failovers to standby master (door address -> count)
+        self.diag_failover = {}
+        # last reported cache journal state (door address -> (dropped changes, stale))
+        self.diag_journal = {}
+
     # OS signals handler
     def sigterm(self, signum, frame):
         if self.__running:
@@ -139,30 +201,448 @@ class acs_server(object):
         else:
             return False
 
+    # callback to build list of users for panel cache transfer
+    def _cache_user_list(self, reader_addr):
+        if self.debug:
+            logging.debug("cache_user_list: reader={}".format(reader_addr))
+        if self.db.get_door_mode(reader_addr) != self.db.DOOR_MODE_ENABLED:
+            return []
+        return self.db.get_users_for_door(reader_addr)
+
+    # Queue cache updates published by database clients (this or other server, administration).
+    # All servers send them - panels ignore updates they already got from other master.
+    def _queue_cache_updates(self):
+        for user_id, epoch, door_addr, allow in self.db.poll_cache_updates():
+            if self.debug:
+                logging.debug("cache_update: user={} epoch={} door={} allow={}".format(
+                              user_id, epoch, door_addr, allow))
+            if door_addr is None:
+                self.proto.queue_cache_update(user_id, epoch)
+            else:
+                self.proto.queue_cache_update(user_id, epoch, door_addr, allow)
+
     # callback for door status update
-    def _door_status_update(self, reader_addr, is_open:bool):
+    def _door_status_update(self, reader_addr, is_open:bool, status=None):
         if self.debug:
             logging.debug("door_status_update: reader={} open={}".format(reader_addr, is_open))
+        if status == self.proto.DATA_DOOR_STATUS_FORCED:
+            logging.warning("Door \"{}\" forced open".format(reader_addr))
+        elif status == self.proto.DATA_DOOR_STATUS_HELD:
+            logging.warning("Door \"{}\" held open".format(reader_addr))
         self.db.set_door_is_open(reader_addr, is_open)
 
+    # callback for events logged by panel while master was offline (list of (door, type, time, user_id))
+    # Batch repeated to this or another master (last batch of the panel is in database) is skipped.
+    def _event_log(self, panel_addr, batch_key, events):
+        if not self.db.set_event_batch(panel_addr, "{}:{}:{}".format(*batch_key)):
+            if self.debug:
+                logging.debug("event_log: panel={} batch={} repeated".format(panel_addr, batch_key[0]))
+            return
+        for door_addr, event_type, event_time, user_id in events:
+            if self.debug:
+                logging.debug("event_log: reader={} type={} time={} user={}".format(door_addr, event_type,
+                              event_time, user_id))
+            if event_type == self.proto.DATA_EVENT_CARD_ALLOWED:
+                self.db.log_user_access(user_id, door_addr, True, offline=True, event_time=event_time)
+            elif event_type == self.proto.DATA_EVENT_CARD_DENIED:
+                self.db.log_user_access(user_id, door_addr, False, offline=True, event_time=event_time)
+            elif event_type == self.proto.DATA_EVENT_CARD:
+                self.db.log_offline_event(door_addr, "card {} read (no decision)".format(user_id), event_time)
+            elif event_type > self.proto.DATA_EVENT_DOOR:
+                status = bytes([event_type - self.proto.DATA_EVENT_DOOR])
+                names = {self.proto.DATA_DOOR_STATUS_CLOSED: "closed", self.proto.DATA_DOOR_STATUS_OPEN: "opened",
+                         self.proto.DATA_DOOR_STATUS_FORCED: "forced open", self.proto.DATA_DOOR_STATUS_HELD: "held open"}
+                self.db.log_offline_event(door_addr, "door {}".format(names.get(status, "status " + status.hex())),
+                                          event_time)
+
+    # Request next diagnostic page from each door and check health of the last received values.
+    def poll_diag(self):
+        for door_addr in self.db.get_doors():
+            diag = self.proto.get_diag(door_addr)
+            page = self.diag_pages.get(door_addr, self.proto.DATA_DIAG_PAGE_SYSTEM)
+            self.diag_queue.setdefault(door_addr, []).append(page)
+
+            # cycle system, CAN, reader, CAN recovery, boot, time, failover, journal and then all tasks of the panel
+            if page == self.proto.DATA_DIAG_PAGE_BOOT:
+                page = self.proto.DATA_DIAG_PAGE_TIME
+            elif page == self.proto.DATA_DIAG_PAGE_JOURNAL:
+                page = self.proto.DATA_DIAG_PAGE_TASK
+            else:
+                page += 1
+            if page >= self.proto.DATA_DIAG_PAGE_TASK + diag.get("task_count", 0):
+                page = self.proto.DATA_DIAG_PAGE_SYSTEM
+            self.diag_pages[door_addr] = page
+
+            if diag.get("cache_tombstones", 0) >= self.DIAG_TOMBSTONES_WARN:
+                logging.warning("Door \"{}\" cache has {} slots of erased users".format(
+                                door_addr, diag["cache_tombstones"]))
+            if diag.get("cpu_load", 0) > self.DIAG_CPU_LOAD_WARN:
+                logging.warning("Door \"{}\" CPU load {}%".format(door_addr, diag["cpu_load"]))
+            if diag.get("can_flags", 0) & self.proto.DATA_DIAG_CAN_PASSIVE:
+                logging.warning("Door \"{}\" CAN error passive".format(door_addr))
+            bus_off = diag.get("can_bus_off_count", 0)
+            if bus_off > self.diag_bus_off.get(door_addr, 0):
+                logging.warning("Door \"{}\" CAN bus-off {} times ({} restarts)".format(
+                                door_addr, bus_off, diag.get("can_restart_count")))
+            self.diag_bus_off[door_addr] = bus_off
+            boot_ms = diag.get("boot_master_ms", 0)
+            if boot_ms != 0 and boot_ms != self.diag_boot.get(door_addr):
+                logging.info("Door \"{}\" online {} ms after reset (start-up {} ms)".format(
+                             door_addr, boot_ms, diag.get("boot_startup_ms")))
+            self.diag_boot[door_addr] = boot_ms
+            missed = diag.get("alive_missed", 0)
+            if missed > self.diag_alive_missed.get(door_addr, 0):
+                logging.warning("Door \"{}\" missed {} master alive messages (clock drift {} ppm)".format(
+                                door_addr, missed, diag.get("time_drift_ppm")))
+            self.diag_alive_missed[door_addr] = missed
+            failovers = diag.get("failover_count", 0)
+            if failovers > self.diag_failover.get(door_addr, 0):
+                reason = {self.proto.DATA_DIAG_FAILOVER_HEARTBEAT: "heartbeat missed",
+                          self.proto.DATA_DIAG_FAILOVER_AUTH: "requests not answered"}
+                logging.warning("Door \"{}\" failed over to standby master {} times ({}, last {} ms, max {} ms)".format(
+                                door_addr, failovers, reason.get(diag.get("failover_reason"), "unknown"),
+                                diag.get("failover_last_ms"), diag.get("failover_max_ms")))
+            self.diag_failover[door_addr] = failovers
+            journal = (diag.get("journal_dropped", 0), diag.get("journal_stale", False))
+            last_dropped, last_stale = self.diag_journal.get(door_addr, (0, False))
+            if journal[0] > last_dropped or (journal[1] and not last_stale):
+                logging.warning("Door \"{}\" cache journal dropped {} changes (stale {}, queue peak {})".format(
+                                door_addr, journal[0], journal[1], diag.get("journal_queue_peak")))
+            self.diag_journal[door_addr] = journal
+            for task in diag.get("tasks", {}).values():
+                if task["stack_free"] < self.DIAG_STACK_FREE_WARN:
+                    logging.warning("Door \"{}\" task \"{}\" low stack ({} words)".format(
+                                    door_addr, task["name"], task["stack_free"]))
+
+    # Request profiler statistics of the panel (answers are stored with diagnostics of the door).
+    def request_profile(self, reader_addr):
+        queue = self.diag_queue.setdefault(reader_addr, [])
+        for site in range(len(self.proto.DIAG_PROFILE_SITES)):
+            queue += [self.proto.DATA_DIAG_PAGE_PROFILE + site, self.proto.DATA_DIAG_PAGE_PROFILE_HIST + site]
+
+    # Send next queued diagnostic request of each door when the previous one was answered.
+    def send_diag_requests(self):
+        now = time.monotonic()
+        for door_addr, queue in self.diag_queue.items():
+            if len(queue) == 0:
+                continue
+            sent = self.diag_sent.get(door_addr)
+            answered = sent is not None and self.proto.get_diag(door_addr).get("time", 0) >= sent
+            if sent is None or answered or (now - sent) >= self.DIAG_RESPONSE_TIMEOUT:
+                can_id, dlc, data = self.proto.msg_diag_request(door_addr, queue.pop(0))
+                self.proto.can_sock.send(can_id, dlc, data)
+                self.diag_sent[door_addr] = now
+
+    # Log profiler statistics received from the panel.
+    def log_profile(self, reader_addr):
+        profile = self.proto.get_diag(reader_addr).get("profile", {})
+        for site, stats in sorted(profile.items()):
+            name = self.proto.DIAG_PROFILE_SITES[site] if site < len(self.proto.DIAG_PROFILE_SITES) else site
+            logging.info("Door \"{}\" {}: max {} us, count {}, histogram >= {}".format(
+                         reader_addr, name, stats.get("max_us"), stats.get("count"), stats.get("hist")))
+
+    # Request door count of the panel from doors which did not report it yet (panels which do not
+    # answer keep the default, see --panel_doors). Panel base addresses are aligned to the count.
+    def _learn_door_counts(self, doors):
+        unknown = [door_addr for door_addr in doors if not self.proto.has_door_count(door_addr)]
+        for door_addr in unknown:
+            can_id, dlc, data = self.proto.msg_diag_request(door_addr, self.proto.DATA_DIAG_PAGE_BOOT)
+            self.proto.can_sock.send(can_id, dlc, data)
+        deadline = time.monotonic() + self.DIAG_RESPONSE_TIMEOUT
+        while len(unknown) > 0 and time.monotonic() < deadline:
+            self._process_for(0.05)
+            unknown = [door_addr for door_addr in unknown if not self.proto.has_door_count(door_addr)]
+        if len(unknown) > 0:
+            logging.warning("Doors {} did not report door count of their panels (using {})".format(
+                            unknown, self.proto.door_count))
+
+    # Receive and process messages for the given time.
+    def _process_for(self, secs):
+        deadline = time.monotonic() + secs
+        while time.monotonic() < deadline:
+            timeout = deadline - time.monotonic()
+            send_delay = self.proto.send_due()
+            if send_delay is not None:
+                timeout = min(timeout, send_delay)
+            if self.proto.can_sock.try_select_recv_for(max(0, timeout)):
+                can_id, dlc, data = self.proto.process_msg(*self.proto.can_sock.recv())
+                if can_id != 0:
+                    self.proto.can_sock.send(can_id, dlc, data)
+
+    # Switch bit rate of the whole bus. Panels which do not hear the master at the new
+    # bit rate return to the previous one (see BIT_RATE_CONFIRM_TIMEOUT). Bit rate is
+    # committed only when panels of all doors in database acknowledged it.
+    def change_bit_rate(self, bit_rate):
+        # panel answers from address of its first door
+        doors = self.db.get_doors()
+        self._learn_door_counts(doors)
+        panels = {self.proto.panel_base(door_addr) for door_addr in doors}
+        if len(panels) == 0:
+            logging.error("Bit rate {} not changed (no doors in database)".format(bit_rate))
+            return False
+
+        can_id, dlc, data = self.proto.msg_bit_rate_prepare(bit_rate)
+        acks = self.proto.bit_rate_acks
+        for attempt in range(1 + self.BIT_RATE_PREPARE_RETRIES):
+            missing = sorted(panels - set(acks))
+            if len(missing) == 0:
+                break
+            if attempt > 0:
+                logging.warning("Bit rate {} not acknowledged by panels {} (retry {})".format(
+                                bit_rate, missing, attempt))
+            self.proto.can_sock.send(can_id, dlc, data)
+            self._process_for(self.BIT_RATE_ACK_TIMEOUT)
+
+        missing = sorted(panels - set(acks))
+        unsupported = [addr for addr, (cmd, rate) in acks.items()
+                       if cmd != self.proto.DATA_BIT_RATE_PREPARE or rate != bit_rate]
+        # panel acknowledges from its base address - other door of database means wrong door count
+        misplaced = sorted(addr for addr in acks if addr in doors and addr not in panels)
+        if len(missing) > 0 or len(unsupported) > 0 or len(misplaced) > 0:
+            logging.error("Bit rate {} not accepted (acknowledged by {}, missing {}, refused by {}, "
+                          "not panel base {})".format(bit_rate, len(acks), missing, unsupported, misplaced))
+            return False
+        foreign = sorted(set(acks) - panels)
+        if len(foreign) > 0:
+            logging.warning("Bit rate {} acknowledged by panels {} without doors in database".format(bit_rate, foreign))
+
+        # all panels switch at the same time (delay of repeated commit is shorter)
+        switch_time = time.monotonic() + self.BIT_RATE_SWITCH_DELAY_MS / 1000
+        for repeat in range(self.BIT_RATE_COMMIT_REPEAT):
+            if repeat > 0:
+                self._process_for(self.BIT_RATE_COMMIT_SPACING)
+            delay_ms = int((switch_time - time.monotonic()) * 1000)
+            if delay_ms <= 0:
+                break
+            can_id, dlc, data = self.proto.msg_bit_rate_commit(bit_rate, delay_ms)
+            self.proto.can_sock.send(can_id, dlc, data)
+        self._process_for(max(0, switch_time - time.monotonic()))
+
+        if not self.proto.can_sock.set_bit_rate(bit_rate):
+            return False
+        # confirm the new bit rate to panels
+        can_id, dlc, data = self.proto.msg_master_alive(self.db.get_cache_epoch())
+        self.proto.can_sock.send(can_id, dlc, data)
+        logging.info("Bit rate switched to {} ({} panels)".format(bit_rate, len(acks)))
+        return True
+
+    # Set parameters (name -> value, see CONFIG_PARAMS) of the doors (all doors in database
+    # by default). Door answers one request at a time - doors are configured in parallel,
+    # parameters of each door one after another.
+    def push_config(self, params, doors=None):
+        if doors is None:
+            doors = self.db.get_doors()
+        for name in params:
+            if name not in self.proto.CONFIG_PARAMS:
+                logging.error("Unknown door parameter \"{}\" (known: {})".format(name, ", ".join(self.proto.CONFIG_PARAMS)))
+                return False
+        queue = {door_addr: [(self.proto.CONFIG_PARAMS.index(name), value) for name, value in params.items()]
+                 for door_addr in doors}
+        sent = {}
+        retries = {}
+        failed = {}
+
+        while any(len(q) > 0 for q in queue.values()):
+            now = time.monotonic()
+            for door_addr, q in queue.items():
+                if len(q) == 0:
+                    continue
+                param, value = q[0]
+                resp = self.proto.config_resp.get(door_addr)
+                if door_addr in sent and resp is not None and resp[3] >= sent[door_addr] and resp[1] == param:
+                    if resp[0] != self.proto.DATA_CONFIG_VALUE or resp[2] != value:
+                        failed.setdefault(door_addr, []).append(self.proto.CONFIG_PARAMS[param])
+                    q.pop(0)
+                    del sent[door_addr]
+                    retries[door_addr] = 0
+                    continue
+                if door_addr in sent and (now - sent[door_addr]) < self.CONFIG_RESPONSE_TIMEOUT:
+                    continue
+                if door_addr in sent:
+                    retries[door_addr] = retries.get(door_addr, 0) + 1
+                    if retries[door_addr] > self.CONFIG_RETRIES:
+                        # door is not responding - drop the rest of its parameters
+                        failed.setdefault(door_addr, []).extend(self.proto.CONFIG_PARAMS[p] for p, _ in q)
+                        q.clear()
+                        continue
+                can_id, dlc, data = self.proto.msg_config_set(door_addr, param, value)
+                self.proto.can_sock.send(can_id, dlc, data)
+                sent[door_addr] = now
+            self._process_for(0.05)
+
+        for door_addr, names in failed.items():
+            logging.error("Door \"{}\" configuration failed ({})".format(door_addr, ", ".join(names)))
+        logging.info("Configuration {} pushed to {} doors ({} failed)".format(params, len(queue), len(failed)))
+        return len(failed) == 0
+
+    # Wait for status of the panels (panel base -> status) newer than since in given states.
+    def _fw_wait_status(self, panels, since, states, timeout):
+        deadline = time.monotonic() + timeout
+        while True:
+            ready = {base for base in panels
+                     if base in self.proto.fw_status and self.proto.fw_status[base][3] >= since and
+                     self.proto.fw_status[base][0] in states}
+            if ready == set(panels) or time.monotonic() >= deadline:
+                return ready
+            self._process_for(min(0.05, deadline - time.monotonic()))
+
+    # Broadcast one window of the image to all panels which are waiting for it.
+    def _fw_send_window(self, window, data):
+        frames = [self.proto.msg_fw_window(window)]
+        for seq, pos in enumerate(range(0, len(data), self.proto.FW_FRAME_DATA)):
+            frames.append(self.proto.msg_fw_data(seq, data[pos:pos + self.proto.FW_FRAME_DATA]))
+        for can_id, dlc, data in frames:
+            while True:
+                try:
+                    self.proto.can_sock.send(can_id, dlc, data)
+                    break
+                except OSError as eos:
+                    # transmit queue of the interface is full
+                    if eos.errno != errno.ENOBUFS:
+                        raise
+                    time.sleep(self.FW_FRAME_GAP * 10)
+            time.sleep(self.FW_FRAME_GAP)
+
+    # Update firmware of all panels with doors in database. All panels receive the same
+    # broadcast data, each window is acknowledged by each panel. Panels which already run
+    # the image (CRC from diagnostics) are skipped. Updated image runs as trial until the
+    # panel hears the master (otherwise previous image is requested again after reset).
+    def update_firmware(self, path):
+        with open(path, "rb") as f:
+            image = f.read()
+        if len(image) == 0 or len(image) > self.proto.FW_APP_SIZE:
+            logging.error("Firmware image {} has invalid size {}".format(path, len(image)))
+            return False
+        crc = zlib.crc32(image) & 0xFFFFFFFF
+        windows = (len(image) + self.proto.FW_WINDOW_SIZE - 1) // self.proto.FW_WINDOW_SIZE
+
+        # firmware page of diagnostics shows the running image
+        doors = self.db.get_doors()
+        self._learn_door_counts(doors)
+        for door_addr in doors:
+            can_id, dlc, data = self.proto.msg_diag_request(door_addr, self.proto.DATA_DIAG_PAGE_FIRMWARE)
+            self.proto.can_sock.send(can_id, dlc, data)
+        self._process_for(self.DIAG_RESPONSE_TIMEOUT)
+        panels = {}
+        for door_addr in doors:
+            base = self.proto.panel_base(door_addr)
+            diag = self.proto.get_diag(door_addr)
+            if diag.get("fw_crc") != crc:
+                panels[base] = door_addr
+        if len(panels) == 0:
+            logging.info("Firmware {:08x} already runs on all panels".format(crc))
+            return True
+
+        since = time.monotonic()
+        for door_addr in panels.values():
+            can_id, dlc, data = self.proto.msg_fw_enter(door_addr)
+            self.proto.can_sock.send(can_id, dlc, data)
+        states = {self.proto.DATA_FW_STATE_IDLE, self.proto.DATA_FW_STATE_ROLLBACK,
+                  self.proto.DATA_FW_STATE_ERROR, self.proto.DATA_FW_STATE_RECEIVING}
+        ready = self._fw_wait_status(panels, since, states, self.FW_ENTER_TIMEOUT)
+
+        since = time.monotonic()
+        for base in ready:
+            can_id, dlc, data = self.proto.msg_fw_start(base, len(image), crc)
+            self.proto.can_sock.send(can_id, dlc, data)
+        active = self._fw_wait_status(ready, since, {self.proto.DATA_FW_STATE_RECEIVING}, self.FW_START_TIMEOUT)
+        failed = set(panels) - active
+
+        for window in range(windows):
+            data = image[window * self.proto.FW_WINDOW_SIZE:(window + 1) * self.proto.FW_WINDOW_SIZE]
+            waiting = set(active)
+            for _ in range(self.FW_WINDOW_RETRIES):
+                since = time.monotonic()
+                self._fw_send_window(window, data)
+                deadline = since + self.FW_WINDOW_TIMEOUT
+                while time.monotonic() < deadline:
+                    waiting = {base for base in waiting if self.proto.fw_status[base][1] <= window}
+                    if len(waiting) == 0:
+                        break
+                    self._process_for(0.05)
+                if len(waiting) == 0:
+                    break
+                # status of window is lost or the panel missed some frames
+                for base in waiting:
+                    can_id, dlc, data_query = self.proto.msg_fw_query(base)
+                    self.proto.can_sock.send(can_id, dlc, data_query)
+                self._process_for(0.1)
+                waiting = {base for base in waiting if self.proto.fw_status[base][1] <= window and
+                           self.proto.fw_status[base][0] == self.proto.DATA_FW_STATE_RECEIVING}
+            active -= waiting
+            failed |= waiting
+            active = {base for base in active if self.proto.fw_status[base][0] == self.proto.DATA_FW_STATE_RECEIVING}
+            if len(active) == 0:
+                break
+
+        since = time.monotonic()
+        for base in active:
+            can_id, dlc, data = self.proto.msg_fw_finish(base)
+            self.proto.can_sock.send(can_id, dlc, data)
+        verified = self._fw_wait_status(active, since, {self.proto.DATA_FW_STATE_VERIFIED}, self.FW_START_TIMEOUT)
+        failed |= active - verified
+
+        # panels start the trial image, master alive confirms it
+        self._process_for(self.FW_ENTER_TIMEOUT)
+        can_id, dlc, data = self.proto.msg_master_alive(self.db.get_cache_epoch())
+        self.proto.can_sock.send(can_id, dlc, data)
+
+        if len(failed) > 0:
+            logging.error("Firmware {:08x} not updated on panels {} (updated {})".format(
+                          crc, sorted(failed), len(verified)))
+            return False
+        logging.info("Firmware {:08x} updated on {} panels ({} bytes)".format(crc, len(verified), len(image)))
+        return True
+
+    # Refresh own record of live masters and log masters which joined or left (panels move between them).
+    def _check_masters(self, masters):
+        self.db.set_master_alive(self.addr, self.master_id, self.proto.MASTER_ALIVE_TIMEOUT)
+        live = self.db.get_live_masters()
+        if set(live) != set(masters):
+            logging.info("Live masters: {}".format(", ".join("{} ({})".format(addr, owner)
+                                                             for addr, owner in sorted(live.items()))))
+        return live
+
     # main processing loop
     def run(self):
         logging.info("ACS server has started")
         logging.info("Listening on {} with address {}".format(self.can_if, self.addr))
 
         last_alive = time.monotonic()
+        last_diag = last_alive
+        masters = self.db.get_live_masters()
+        if self.addr in masters:
+            logging.warning("Master address {} is registered by {} (another server with the same address?)".format(
+                            self.addr, masters[self.addr]))
+        self.db.set_master_alive(self.addr, self.master_id, self.proto.MASTER_ALIVE_TIMEOUT)
 
         while self.__running:
             try:
+                # cache updates (before alive which announces their epoch)
+                self._queue_cache_updates()
+
                 # alive msg
                 this_alive = time.monotonic()
                 if (this_alive - last_alive) >= self.proto.MASTER_ALIVE_PERIOD:
                     last_alive = this_alive
-                    can_id, dlc, data = self.proto.msg_master_alive()
+                    can_id, dlc, data = self.proto.msg_master_alive(self.db.get_cache_epoch())
                     self.proto.can_sock.send(can_id, dlc, data)
+                    masters = self._check_masters(masters)
+
+                # diagnostics
+                if (this_alive - last_diag) >= self.DIAG_POLL_PERIOD:
+                    last_diag = this_alive
+                    self.poll_diag()
+                self.send_diag_requests()
+
+                # queued frames which are due (wait for messages until the next one)
+                timeout = self.CACHE_UPDATE_POLL_PERIOD
+                send_delay = self.proto.send_due()
+                if send_delay is not None:
+                    timeout = min(timeout, send_delay)
 
                 # try recv
-                if self.proto.can_sock.try_select_recv_for(5):
+                if self.proto.can_sock.try_select_recv_for(timeout):
                     can_id, dlc, data = self.proto.can_sock.recv()
 
                     if can_id == 0:
@@ -210,7 +690,15 @@ def main():
     if pargs.log_dir:
         logname = "{}/{}_{}.log".format(pargs.log_dir, pargs.interface, pargs.id)
     setup_logging(logname, pargs.verbose)
-    acs_server(pargs.interface, pargs.id, pargs.redis_hostname, pargs.redis_port, pargs.verbose).run()
+    server = acs_server(pargs.interface, pargs.id, pargs.redis_hostname, pargs.redis_port, pargs.verbose,
+                        pargs.panel_doors)
+    if pargs.bit_rate:
+        server.change_bit_rate(pargs.bit_rate)
+    if pargs.config:
+        server.push_config(pargs.config, pargs.doors)
+    if pargs.firmware:
+        server.update_firmware(pargs.firmware)
+    server.run()
 
 if __name__ == "__main__":
     main()
@@ -6,6 +6,16 @@ def format_data(data) -> str:
     # return "".join([hex(byte)[2:] for byte in data])
     return "".join('%02x'%byte for byte in data)
 
+# Parse "name=value,name=value" (door parameters).
+def parse_params(text:str) -> dict:
+    params = {}
+    for item in text.split(","):
+        name, sep, value = item.partition("=")
+        if not sep:
+            raise argparse.ArgumentTypeError("expected name=value, got '{}'".format(item))
+        params[name.strip()] = int(value, 0)
+    return params
+
 def parse_args():
     parser = argparse.ArgumentParser(description='Access control system server')
 
@@ -14,6 +24,13 @@ def parse_args():
     parser.add_argument('redis_hostname', type=str, default='localhost', help='Redis server hostname')
     parser.add_argument('redis_port', type=int, default='6379', help='Redis server port')
     parser.add_argument("-v", "--verbose", help="increase output verbosity", action="store_true")
+    parser.add_argument("-b", "--bit_rate", type=int, help="switch CAN bus (panels and interface) to this bit rate")
+    parser.add_argument("-c", "--config", type=parse_params,
+                        help="set door parameters (name=value,...) e.g. open_time_ms=3000,beep_on_success=0")
+    parser.add_argument("-d", "--doors", type=int, nargs="+", help="doors for --config (all doors by default)")
+    parser.add_argument("-f", "--firmware", type=str, help="update firmware of panels from this binary image")
+    parser.add_argument("-p", "--panel_doors", type=int, choices=range(1, 5), default=2,
+                        help="doors of one panel (default 2, used for panels which did not report their count)")
     parser.add_argument("-l", "--log_dir", type=str, help="path to dir for log (after init it will not output to console)")
 
     args = parser.parse_args()
@@ -48,19 +48,18 @@ extern uint32_t SystemCoreClock;
 
 #define configUSE_PREEMPTION			1
 #define configUSE_IDLE_HOOK				1
-#define configUSE_TICK_HOOK				0
+#define configUSE_TICK_HOOK				1
 #define configCPU_CLOCK_HZ				( SystemCoreClock )
 #define configTICK_RATE_HZ				( ( TickType_t ) 1000 )
 #define configMAX_PRIORITIES			( 5 )
 #define configMINIMAL_STACK_SIZE		( ( unsigned short ) 64 )
-#define configTOTAL_HEAP_SIZE			( ( size_t ) ( 2048 + 1024 ) )
 #define configMAX_TASK_NAME_LEN			( 5 )
 #define configUSE_16_BIT_TICKS			0
 #define configIDLE_SHOULD_YIELD			1
 #define configUSE_MUTEXES				    0
 #define configQUEUE_REGISTRY_SIZE		8
 #define configUSE_RECURSIVE_MUTEXES		0
-#define configUSE_MALLOC_FAILED_HOOK	1
+#define configUSE_MALLOC_FAILED_HOOK	0
 #define configUSE_APPLICATION_TASK_TAG	0
 #define configUSE_COUNTING_SEMAPHORES	0
 #define configRECORD_STACK_HIGH_ADDRESS 1 // for max stack usage
@@ -75,24 +74,23 @@ extern uint32_t SystemCoreClock;
 
 /* Run time and task stats gathering related definitions. */
 extern void vConfigureTimerForRunTimeStats(void);
-//#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() vConfigureTimerForRunTimeStats()
-//#define portGET_RUN_TIME_COUNTER_VALUE() Chip_TIMER_ReadCount(LPC_TIMER32_0)
-#define configGENERATE_RUN_TIME_STATS           0
+extern uint32_t ulGetRunTimeCounterValue(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() vConfigureTimerForRunTimeStats()
+#define portGET_RUN_TIME_COUNTER_VALUE() ulGetRunTimeCounterValue()
+#define configGENERATE_RUN_TIME_STATS           1
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
-/* heap implementation */
-#define configFRTOS_MEMORY_SCHEME 1 // scheme 1 - allocate only
+/* Memory allocation - all kernel objects are allocated statically (no heap). */
+#define configSUPPORT_STATIC_ALLOCATION   1
+#define configSUPPORT_DYNAMIC_ALLOCATION  0
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 			0
 #define configMAX_CO_ROUTINE_PRIORITIES ( 2 )
 
-/* Software timer definitions. */
-#define configUSE_TIMERS				  1
-#define configTIMER_TASK_PRIORITY		( tskIDLE_PRIORITY + 2UL )
-#define configTIMER_QUEUE_LENGTH		8
-#define configTIMER_TASK_STACK_DEPTH	( 80 )
+/* Software timers are not used - timeouts are served by timer wheel (bsp/timer_wheel.h). */
+#define configUSE_TIMERS				  0
 
 /* Set the following definitions to 1 to include the API function, or zero
 to exclude the API function. */
@@ -105,6 +103,9 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay				1
 #define INCLUDE_eTaskGetState			1
 #define INCLUDE_xTaskGetCurrentTaskHandle 1
+#define INCLUDE_xTaskGetIdleTaskHandle	1
+#define INCLUDE_uxTaskGetStackHighWaterMark 1
+#define INCLUDE_xTaskGetSchedulerState 1
 
 /* Normal assert() semantics without relying on the provision of an assert.h
 header file. */
@@ -13,12 +13,17 @@
 #ifndef ACS_CAN_PROTOCOL_H_
 #define ACS_CAN_PROTOCOL_H_
 
-// Used Message object numbers.
-#define ACS_MSGOBJ_SEND_DOOR_A 0
-#define ACS_MSGOBJ_SEND_DOOR_B 1
-#define ACS_MSGOBJ_RECV_DOOR_A 2
-#define ACS_MSGOBJ_RECV_DOOR_B 3
-#define ACS_MSGOBJ_RECV_BCAST 4
+// Used Message object numbers (one object of each kind per door, add door index).
+#define ACS_MSGOBJ_DOOR_LIMIT 4
+#define ACS_MSGOBJ_SEND_DOOR   0
+#define ACS_MSGOBJ_RECV_DOOR   (ACS_MSGOBJ_SEND_DOOR + ACS_MSGOBJ_DOOR_LIMIT)
+#define ACS_MSGOBJ_RECV_BCAST  (ACS_MSGOBJ_RECV_DOOR + ACS_MSGOBJ_DOOR_LIMIT)
+#define ACS_MSGOBJ_SEND_FLOW   (ACS_MSGOBJ_RECV_BCAST + 1)
+#define ACS_MSGOBJ_SEND_STATUS (ACS_MSGOBJ_SEND_FLOW + ACS_MSGOBJ_DOOR_LIMIT)
+#define ACS_MSGOBJ_SEND_DIAG   (ACS_MSGOBJ_SEND_STATUS + ACS_MSGOBJ_DOOR_LIMIT)
+#define ACS_MSGOBJ_SEND_BIT_RATE (ACS_MSGOBJ_SEND_DIAG + ACS_MSGOBJ_DOOR_LIMIT) // One for the panel.
+#define ACS_MSGOBJ_SEND_CONFIG (ACS_MSGOBJ_SEND_BIT_RATE + 1)
+#define ACS_MSGOBJ_SEND_EVENT  (ACS_MSGOBJ_SEND_CONFIG + ACS_MSGOBJ_DOOR_LIMIT) // One for the panel.
 
 // Message head partition sizes (29b total).
 #define ACS_PRIO_BITS   3
@@ -56,6 +61,17 @@
 #define FC_LEARN_USER          0x7 // S -> M
 #define FC_LEARN_USER_OK       0x8 // M -> S
 #define FC_LEARN_USER_FAIL     0x9 // M -> S
+#define FC_CACHE_XFER_FIRST    0xA // M -> S
+#define FC_CACHE_XFER_CONSEC   0xB // M -> S
+#define FC_CACHE_XFER_FLOW     0xC // S -> M
+#define FC_CACHE_UPDATE        0xD // M -> S (broadcast)
+#define FC_DIAG                0xE // M -> S (request), S -> M (response)
+#define FC_BIT_RATE            0xF // M -> S (broadcast), S -> M (acknowledge)
+#define FC_FW_UPDATE           0x10 // M -> S (command), S -> M (status)
+#define FC_FW_DATA             0x11 // M -> S (broadcast)
+#define FC_CONFIG              0x12 // M -> S (request), S -> M (response)
+#define FC_EVENT_LOG           0x13 // S -> M (batch), M -> S (acknowledge)
+#define FC_EVENT_DATA          0x14 // S -> M
 
 // Priority range.
 #define ACS_MAX_PRIO  0
@@ -72,6 +88,14 @@
 #define PRIO_LEARN_USER          0x2
 #define PRIO_LEARN_USER_FAIL     0x2
 #define PRIO_LEARN_USER_OK       0x2
+#define PRIO_CACHE_XFER          0x5
+#define PRIO_CACHE_UPDATE        0x3
+#define PRIO_DIAG                0x6
+#define PRIO_BIT_RATE            0x1
+#define PRIO_FW_UPDATE           0x6
+#define PRIO_FW_DATA             0x7
+#define PRIO_CONFIG              0x6
+#define PRIO_EVENT_LOG           0x5
 
 // Data for FC_DOOR_CTRL.
 #define DATA_DOOR_CTRL_REMOTE_UNLCK 0x01
@@ -82,10 +106,147 @@
 // Data for FC_DOOR_STATUS.
 #define DATA_DOOR_STATUS_CLOSED   0x01
 #define DATA_DOOR_STATUS_OPEN     0x02
+#define DATA_DOOR_STATUS_FORCED   0x03 // Opened while locked (alarm).
+#define DATA_DOOR_STATUS_HELD     0x04 // Open for too long (alarm).
+
+// Data for FC_CACHE_XFER_FLOW.
+#define DATA_XFER_FLOW_CTS    0x00 // Continue to send next block.
+#define DATA_XFER_FLOW_WAIT   0x01 // Wait for next flow control.
+#define DATA_XFER_FLOW_ABORT  0x02 // Transfer failed.
+#define DATA_XFER_FLOW_DONE   0x03 // All items received.
+#define DATA_XFER_FLOW_REQ    0x04 // Request transfer from master.
+
+// Data for FC_DIAG (page is the first byte of request and response).
+#define DATA_DIAG_PAGE_SYSTEM 0x00
+#define DATA_DIAG_PAGE_CAN    0x01
+#define DATA_DIAG_PAGE_READER 0x02
+#define DATA_DIAG_PAGE_CAN_RECOVERY 0x03
+#define DATA_DIAG_PAGE_BOOT   0x04
+#define DATA_DIAG_PAGE_FIRMWARE 0x05
+#define DATA_DIAG_PAGE_TIME   0x06
+#define DATA_DIAG_PAGE_FAILOVER 0x07
+#define DATA_DIAG_PAGE_JOURNAL 0x08 // Requires CACHE_JOURNAL_ENABLED.
+#define DATA_DIAG_PAGE_TASK   0x10 // Add task number (response has only page if there is no such task).
+#define DATA_DIAG_PAGE_PROFILE      0x20 // Add profiler site (requires PROFILER_ENABLED).
+#define DATA_DIAG_PAGE_PROFILE_HIST 0x30 // Add profiler site (requires PROFILER_ENABLED).
+
+// Data for FC_BIT_RATE (command is the first byte).
+// Master broadcasts PREPARE and each panel acknowledges it from its first door with the same
+// command (or UNSUPPORTED). Then master broadcasts COMMIT (repeatedly) and all panels switch
+// after the delay. Panel which does not receive FC_ALIVE at the new bit rate in time
+// ACS_BIT_RATE_CONFIRM_MS returns to the previous bit rate.
+#define DATA_BIT_RATE_PREPARE     0x00
+#define DATA_BIT_RATE_COMMIT      0x01
+#define DATA_BIT_RATE_UNSUPPORTED 0x02 // Acknowledge only.
+
+// Data for FC_FW_UPDATE (command is the first byte).
+// Update is received by boot loader of the panel. Master sends ENTER to any door of the panel
+// (application resets to boot loader) and boot loader reports STATUS from the first door.
+// START (to the first door) erases the application. Then master broadcasts WINDOW and the window
+// of image in FC_FW_DATA frames to all updated panels at once. Panel writes complete window and
+// reports STATUS with the next expected window (master repeats the window if it was not received).
+// FINISH verifies CRC of the image and starts it. New image runs on trial until it receives
+// FC_ALIVE - after FW_TRIAL_BOOTS (terminal_config.h) resets without it the boot loader waits for update again
+// (STATUS with DATA_FW_STATE_ROLLBACK) and master sends the previous image. Without master the trial image
+// is started again after FW_ENTER_TIMEOUT_MS (it stays unconfirmed - DATA_DIAG_FW_TRIAL).
+#define DATA_FW_ENTER   0x00
+#define DATA_FW_START   0x01
+#define DATA_FW_WINDOW  0x02 // Broadcast.
+#define DATA_FW_FINISH  0x03
+#define DATA_FW_QUERY   0x04 // Request of STATUS.
+#define DATA_FW_STATUS  0x05 // S -> M
+
+// State in DATA_FW_STATUS.
+#define DATA_FW_STATE_IDLE      0x00 // Waiting for START.
+#define DATA_FW_STATE_RECEIVING 0x01
+#define DATA_FW_STATE_VERIFIED  0x02 // Image is complete, starting it.
+#define DATA_FW_STATE_ERROR     0x03 // Flash or CRC failed (START again).
+#define DATA_FW_STATE_ROLLBACK  0x04 // Trial image was not confirmed (waiting for START).
+
+// Image is transferred in windows of fixed size (frames carry sequence number within the window).
+#define ACS_FW_WINDOW_SIZE  1024
+#define ACS_FW_FRAME_DATA   7
+#define ACS_FW_WINDOW_FRAMES ((ACS_FW_WINDOW_SIZE + ACS_FW_FRAME_DATA - 1) / ACS_FW_FRAME_DATA)
+
+// Data for FC_CONFIG (command is the first byte).
+// Master reads (GET) or writes (SET) one parameter of the door and the door responds with
+// VALUE (current value) or INVALID (unknown parameter or value out of range). SET is applied
+// without reset and stored to external storage. Door answers one request at a time.
+#define DATA_CONFIG_GET     0x00
+#define DATA_CONFIG_SET     0x01
+#define DATA_CONFIG_VALUE   0x02 // S -> M
+#define DATA_CONFIG_INVALID 0x03 // S -> M
+
+// Parameters in FC_CONFIG (defaults are ACS_READER_x_... settings in terminal_config.h).
+#define DATA_CONFIG_ENABLED         0x00 // Reader is used (0 or 1).
+#define DATA_CONFIG_OPEN_TIME_MS    0x01 // Door is unlocked for this time.
+#define DATA_CONFIG_OK_GLED_TIME_MS 0x02 // Green LED is on for this time.
+#define DATA_CONFIG_BEEP_ON_SUCCESS 0x03 // 0 or 1.
+#define DATA_CONFIG_OK_LED_ON_SUCCESS 0x04 // 0 or 1.
+#define DATA_CONFIG_SENSOR_TYPE     0x05 // SENSOR_IS_NO or SENSOR_IS_NC.
+#define DATA_CONFIG_PARAM_COUNT     6
+
+// Data for FC_EVENT_LOG (command is the first byte).
+// Panel logs events which happened while master was offline and uploads them when master
+// is online again. Panel sends BATCH from its first door followed by count FC_EVENT_DATA frames.
+// Master stores complete batch and acknowledges it with ACK (the same batch number) to the first
+// door. Batch which is not acknowledged is sent again (master ignores repeated batch).
+#define DATA_EVENT_BATCH  0x00 // S -> M
+#define DATA_EVENT_ACK    0x01 // M -> S
+
+// Event types in FC_EVENT_DATA.
+#define DATA_EVENT_CARD         0x01 // Card was read, not authorized (no cache).
+#define DATA_EVENT_CARD_ALLOWED 0x02 // Card was authorized from cache.
+#define DATA_EVENT_CARD_DENIED  0x03 // Card was rejected from cache.
+#define DATA_EVENT_DOOR         0x10 // Add DATA_DOOR_STATUS_...
+
+// Flags in FC_EVENT_DATA.
+#define DATA_EVENT_FLAG_TIME_UNKNOWN 0x01 // Event happened before panel received time (offset is not valid).
+
+// Range of time parameters.
+#define ACS_CONFIG_TIME_MIN_MS 10
+#define ACS_CONFIG_TIME_MAX_MS 60000
+
+// State in DATA_DIAG_PAGE_FIRMWARE.
+#define DATA_DIAG_FW_CONFIRMED 0x00
+#define DATA_DIAG_FW_TRIAL     0x01 // Waiting for FC_ALIVE.
+
+// Flags in DATA_DIAG_PAGE_TIME.
+#define DATA_DIAG_TIME_SYNCED 0x01 // Time was received from master.
+#define DATA_DIAG_TIME_DRIFT  0x02 // Drift of panel clock was measured.
+
+// Reason of the last failover in DATA_DIAG_PAGE_FAILOVER.
+#define DATA_DIAG_FAILOVER_NONE      0x00 // No failover since reset.
+#define DATA_DIAG_FAILOVER_HEARTBEAT 0x01 // Heartbeat of active master was missed.
+#define DATA_DIAG_FAILOVER_AUTH      0x02 // Authorization requests were not answered.
+
+// Flags in DATA_DIAG_PAGE_JOURNAL.
+#define DATA_DIAG_JOURNAL_STALE 0x01 // Changes were dropped - cache epoch is invalid until next reload.
+
+// Flags in DATA_DIAG_PAGE_CAN.
+#define DATA_DIAG_CAN_WARN    0x01 // Error counter reached warning limit (96).
+#define DATA_DIAG_CAN_PASSIVE 0x02 // Error passive state.
+
+// Item in FC_CACHE_XFER_CONSEC.
+// Bits [31:30] of items carry sequence number (first item SN[1:0], second item SN[3:2]).
+#define ACS_XFER_KEY_MASK   0x3FFFFFFFUL
+#define ACS_XFER_SN_OFFSET  30
+#define ACS_XFER_SN_MASK    0xF
 
 // Setting for master communication status.
+// Heartbeat is missed when it does not come in period + jitter. Master is offline after
+// ACS_MASTER_ALIVE_MISSED_MAX heartbeats are missed in a row.
+// Several masters can be online at once. Panel sends its requests to the live master with the highest
+// score for the panel address (rendezvous hashing), so panels are spread over masters and only
+// panels of a dead master move to the others.
+// When another master is live, panel fails over after the first missed heartbeat or after
+// authorization requests are not answered, and does not return to the failed master for
+// a while (see DATA_DIAG_PAGE_FAILOVER).
 #define ACS_MASTER_ALIVE_PERIOD_MS  5000
+#define ACS_MASTER_ALIVE_JITTER_MS  1000
+#define ACS_MASTER_ALIVE_MISSED_MAX 2
 #define ACS_MASTER_ALIVE_TIMEOUT_MS 10000
+#define ACS_BIT_RATE_CONFIRM_MS     ACS_MASTER_ALIVE_TIMEOUT_MS
 
 
 /*
@@ -126,6 +287,229 @@ typedef struct
   uint8_t ctrl_command;
 } acs_msg_data_door_ctrl_t;
 
+// Structure of data sent with FC_ALIVE (masters without cache epoch send no data,
+// masters without time send only cache epoch, masters without sequence number send 6 bytes).
+typedef struct
+{
+  uint16_t cache_epoch; // Incremented with each FC_CACHE_UPDATE.
+  uint32_t time;        // Master time (seconds since 1970-01-01 UTC).
+  uint8_t time_frac;    // Fraction of second (1/256 s).
+  uint8_t seq;          // Incremented with each FC_ALIVE of the master (gap is a missed heartbeat).
+} acs_msg_data_alive_t;
+
+// Structure of data sent with FC_CACHE_UPDATE.
+// Panel which missed an update (epoch gap) drops its cache, older updates (from other master) are ignored.
+typedef struct
+{
+  uint32_t user_id;
+  uint16_t epoch;                     // Cache epoch after this update.
+  uint16_t door_addr : ACS_ADDR_BITS; // Updated door or ACS_BROADCAST_ADDR to invalidate user on all doors.
+  uint16_t allow : 1;                 // New permission for the door.
+  uint16_t : 5;
+} acs_msg_data_cache_update_t;
+
+// Structure of data sent with FC_CACHE_XFER_FIRST.
+// Starts transfer of users authorized for the target door.
+typedef struct
+{
+  uint16_t item_count;
+} acs_msg_data_xfer_first_t;
+
+// Structure of data sent with FC_CACHE_XFER_CONSEC (one or two items).
+// Sequence number starts at 1 and wraps around after 15 to 0.
+typedef struct
+{
+  uint32_t item[2];
+} acs_msg_data_xfer_consec_t;
+
+// Structure of data sent with FC_CACHE_XFER_FLOW.
+typedef struct
+{
+  uint8_t status;
+  uint8_t block_size; // Number of consecutive frames before next flow control.
+  uint8_t st_min_ms;  // Minimal separation time between consecutive frames.
+} acs_msg_data_xfer_flow_t;
+
+// Structure of data sent with FC_BIT_RATE.
+typedef struct
+{
+  uint8_t command;       // DATA_BIT_RATE_...
+  uint16_t bit_rate_kbps;
+  uint16_t delay_ms;     // Time to switch (COMMIT only).
+} acs_msg_data_bit_rate_t;
+
+// Structure of data sent with FC_FW_UPDATE (START uses size and crc, WINDOW uses window).
+typedef struct
+{
+  uint8_t command;       // DATA_FW_...
+  union
+  {
+    struct
+    {
+      uint16_t size;     // Image size in bytes.
+      uint32_t crc;      // CRC-32 (IEEE 802.3) of the image.
+    };
+    uint16_t window;     // Window number (offset / ACS_FW_WINDOW_SIZE).
+  };
+} acs_msg_data_fw_cmd_t;
+
+// Structure of data sent with FC_FW_UPDATE (DATA_FW_STATUS).
+typedef struct
+{
+  uint8_t command;       // DATA_FW_STATUS
+  uint8_t state;         // DATA_FW_STATE_...
+  uint16_t window;       // Next expected window.
+  uint32_t crc;          // CRC of image being received (of the image started last in IDLE).
+} acs_msg_data_fw_status_t;
+
+// Structure of data sent with FC_FW_DATA.
+typedef struct
+{
+  uint8_t seq;           // Frame in window (0 to ACS_FW_WINDOW_FRAMES - 1).
+  uint8_t data[ACS_FW_FRAME_DATA];
+} acs_msg_data_fw_data_t;
+
+// Structure of data sent with FC_CONFIG (request and response).
+typedef struct
+{
+  uint8_t command;       // DATA_CONFIG_...
+  uint8_t param;         // DATA_CONFIG_... parameter.
+  uint16_t value;        // Ignored in GET.
+} acs_msg_data_config_t;
+
+// Structure of data sent with FC_EVENT_LOG (ACK has only command and batch).
+typedef struct
+{
+  uint8_t command;       // DATA_EVENT_...
+  uint8_t batch;         // Batch number.
+  uint8_t count;         // FC_EVENT_DATA frames of the batch.
+  uint32_t base_time;    // Master time (seconds since 1970-01-01 UTC) of offset 0.
+} acs_msg_data_event_log_t;
+
+// Structure of data sent with FC_EVENT_DATA.
+typedef struct
+{
+  uint8_t index : 4;     // Event in batch (0 to count - 1).
+  uint8_t door : 2;      // Door index in the panel (add to address of the first door).
+  uint8_t flags : 2;     // DATA_EVENT_FLAG_...
+  uint8_t type;          // DATA_EVENT_...
+  uint16_t offset;       // Seconds from base time.
+  uint32_t user_id;      // Card of the event (0 for door events).
+} acs_msg_data_event_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_SYSTEM.
+// Load is measured between two requests of this page.
+typedef struct
+{
+  uint8_t page;
+  uint8_t reset_reason;  // Reset status bits (POR 0x1, EXT 0x2, WDT 0x4, BOD 0x8, SYS 0x10).
+  uint32_t uptime_sec;   // Time since reset (wraps after 49 days).
+  uint8_t task_count;
+  uint8_t cpu_load;      // Percent of time not spent in idle task.
+} acs_msg_data_diag_system_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_CAN.
+typedef struct
+{
+  uint8_t page;
+  uint8_t tx_errors;     // Transmit error counter.
+  uint8_t rx_errors;     // Receive error counter.
+  uint8_t flags;         // DATA_DIAG_CAN_...
+  uint16_t error_count;  // Errors reported by CAN controller since reset.
+  uint16_t bit_rate_kbps;
+} acs_msg_data_diag_can_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_CAN_RECOVERY.
+typedef struct
+{
+  uint8_t page;
+  uint16_t bus_off_count;  // Bus-off events since reset.
+  uint16_t passive_count;  // Entries to error passive state since reset.
+  uint16_t restart_count;  // Restarts of controller after bus-off.
+} acs_msg_data_diag_can_recovery_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_BOOT.
+typedef struct
+{
+  uint8_t page;
+  uint16_t startup_ms;   // Reset to start of scheduler.
+  uint32_t master_ms;    // Reset to first FC_ALIVE received (0 if none yet).
+  uint8_t door_count;    // ACS_READER_MAXCOUNT (panel base address is aligned to it).
+} acs_msg_data_diag_boot_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_FIRMWARE.
+typedef struct
+{
+  uint8_t page;
+  uint8_t state;         // DATA_DIAG_FW_...
+  uint16_t version;      // ACS_FW_VERSION
+  uint32_t crc;          // CRC of the image written by boot loader (0xFFFFFFFF if flashed by debugger).
+} acs_msg_data_diag_firmware_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_TIME.
+typedef struct
+{
+  uint8_t page;
+  uint8_t flags;           // DATA_DIAG_TIME_...
+  int16_t drift_ppm;       // Correction of panel clock (positive if panel is slow).
+  uint16_t missed_alive;   // FC_ALIVE of active master which were not received.
+  uint16_t since_sync_sec; // Time since the last FC_ALIVE with time (saturated).
+} acs_msg_data_diag_time_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_FAILOVER.
+typedef struct
+{
+  uint8_t page;
+  uint8_t reason;          // DATA_DIAG_FAILOVER_... of the last failover.
+  uint16_t count;          // Failovers to standby master since reset.
+  uint16_t last_ms;        // Duration of the last failover (saturated).
+  uint16_t max_ms;         // Longest failover since reset (saturated).
+} acs_msg_data_diag_failover_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_JOURNAL.
+typedef struct
+{
+  uint8_t page;
+  uint8_t flags;           // DATA_DIAG_JOURNAL_...
+  uint16_t dropped;        // Cache changes dropped on full queue since reset (saturated).
+  uint16_t passes;         // Snapshot passes over the cache since reset.
+  uint8_t queue_peak;      // Highest fill of the change queue.
+} acs_msg_data_diag_journal_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_READER (for the addressed door).
+typedef struct
+{
+  uint8_t page;
+  uint16_t parity_errors;  // Rejected card frames.
+  uint16_t cache_lookups;  // Offline authorizations.
+  uint16_t cache_hits;     // Offline authorizations with user found in cache.
+  uint8_t tombstones;      // Cache slots of erased users not reclaimed yet (saturated, cache is shared).
+} acs_msg_data_diag_reader_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_TASK.
+typedef struct
+{
+  uint8_t page;
+  char name[4];          // Not terminated if 4 characters long.
+  uint8_t cpu_load;      // Percent of time (see acs_msg_data_diag_system_t).
+  uint16_t stack_free;   // Minimal free stack since start (words).
+} acs_msg_data_diag_task_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_PROFILE (see profiler.h).
+typedef struct
+{
+  uint8_t page;
+  uint16_t max_us;       // Longest duration of the site.
+  uint16_t count;        // Number of runs (saturated).
+} acs_msg_data_diag_profile_t;
+
+// Structure of data sent with FC_DIAG for DATA_DIAG_PAGE_PROFILE_HIST.
+typedef struct
+{
+  uint8_t page;
+  uint8_t hist_log2[7];  // Runs in each bin as bit length (0 = none, n = 2^(n-1) to 2^n - 1).
+} acs_msg_data_diag_profile_hist_t;
+
 #pragma pack(pop)
 
 #endif /* ACS_CAN_PROTOCOL_H_ */
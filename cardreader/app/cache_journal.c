@@ -0,0 +1,431 @@
+/**
+ *  @file
+ *  @brief Journal of static cache changes in external storage.
+ *
+ *  Journal is a circular array of fixed size records. Each record carries sequence number
+ *  so the newest record (head) can be found on startup - it is the only valid record which
+ *  is not followed by its successor. Replay starts right after the head (oldest record).
+ *
+ *  Snapshot pass walks homes of the cache and writes one item (or skips one home) per step.
+ *  Its position is the last snapshot record, so the pass continues after reset. Pass end
+ *  and epoch records carry state of the journal (epoch and flags) which is not in the cache.
+ *
+ *  Record:
+ *  | cache item or state (4B) | sequence number (2B) | operation (1B) | checksum (1B) |
+ *
+ *  State:
+ *  | cache epoch (2B) | JOURNAL_STATE_... flags (2B) |
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "cache_journal.h"
+#include "storage.h"
+#include "storage_service.h"
+#include "watchdog.h"
+#include "profiler.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if CACHING_ENABLED && CACHE_JOURNAL_ENABLED
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define JOURNAL_REC_SIZE  8
+#define JOURNAL_REC_COUNT ((PTR_CACHE_JOURNAL_END - PTR_CACHE_JOURNAL_FIRST) / JOURNAL_REC_SIZE)
+
+#if (STORE_PAGE_SIZE % JOURNAL_REC_SIZE) != 0 || (PTR_CACHE_JOURNAL_FIRST % JOURNAL_REC_SIZE) != 0
+#error "Journal records must not cross storage page boundary."
+#endif
+
+// Changes written during one pass. Each change is followed by CACHE_JOURNAL_PASS_STEPS steps, pass takes
+// a step for every item (items inserted meanwhile included), every home and its end.
+#define JOURNAL_PASS_CHANGES \
+  ((STATIC_CACHE_CAPACITY + STATIC_CACHE_HOMES + 1 + CACHE_JOURNAL_PASS_STEPS - 2) / (CACHE_JOURNAL_PASS_STEPS - 1) + 1)
+
+// Item is copied again before its record is overwritten.
+#if (STATIC_CACHE_CAPACITY + 1 + 2 * JOURNAL_PASS_CHANGES) > JOURNAL_REC_COUNT
+#error "Cache journal cannot hold the whole cache (larger storage or more CACHE_JOURNAL_PASS_STEPS needed)."
+#endif
+
+// Flags of journal state.
+#define JOURNAL_STATE_NO_EPOCH 0x10000UL // Epoch is not known.
+#define JOURNAL_STATE_STALE    0x20000UL // Changes were dropped since the cache was cleared.
+
+#pragma pack(push,1)
+
+typedef union
+{
+  struct
+  {
+    uint32_t item;  // Cache item or journal state.
+    uint16_t seq;   // Sequence number.
+    uint8_t op;     // Operation (cache_journal_op).
+    uint8_t check;  // Checksum of previous bytes.
+  };
+  uint8_t raw[JOURNAL_REC_SIZE];
+} journal_rec_t;
+
+#pragma pack(pop)
+
+typedef struct
+{
+  cache_item_t kv;
+  uint8_t op;
+} journal_change_t;
+
+// Queue of changes waiting for write.
+static journal_change_t _queue[CACHE_JOURNAL_QUEUE_LEN];
+static uint8_t _queue_head = 0;
+static uint8_t _queue_tail = 0;
+static uint8_t _queue_peak = 0;
+static uint8_t _flushes = 0; // Queue was flushed by clear.
+
+// Change was dropped - stale state is to be written.
+static volatile bool _lost = false;
+static uint16_t _dropped = 0;
+
+// Position of next record.
+static uint16_t _next_slot = 0;
+static uint16_t _next_seq = 0;
+
+// Writes are allowed only when position in journal is known.
+static bool _restored = false;
+
+// Sync job is queued in storage service.
+static volatile bool _sync_pending = false;
+
+// Journal state (as written to storage).
+static uint16_t _epoch = 0;
+static bool _epoch_known = false;
+static bool _stale = false;
+
+// Position of snapshot pass (next key above the last copied one in the home).
+static uint16_t _pass_home = 0;
+static uint32_t _pass_key = 0;
+// Steps of the pass to be done before the next change is written.
+static uint8_t _pass_debt = 0;
+static uint16_t _passes = 0;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Rotate and XOR checksum (neither erased nor zeroed record is valid).
+static uint8_t _checksum(const journal_rec_t * ptr_rec)
+{
+  uint8_t sum = 0xA5;
+  for (int i = 0; i < JOURNAL_REC_SIZE - 1; ++i)
+  {
+    sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ ptr_rec->raw[i];
+  }
+  return sum;
+}
+
+static inline uint16_t _slot_addr(uint16_t slot)
+{
+  return PTR_CACHE_JOURNAL_FIRST + slot * JOURNAL_REC_SIZE;
+}
+
+static bool _read_rec(uint16_t slot, journal_rec_t * ptr_rec, bool * ptr_valid)
+{
+  if (!storage_read(_slot_addr(slot), ptr_rec->raw, JOURNAL_REC_SIZE)) return false;
+
+  *ptr_valid = (ptr_rec->check == _checksum(ptr_rec) &&
+                ptr_rec->op >= cache_journal_op_insert &&
+                ptr_rec->op <= cache_journal_op_pass_end);
+  return true;
+}
+
+// Queue write of the next record (consecutive records are merged into one page write).
+static bool _append_rec(uint8_t op, uint32_t item)
+{
+  journal_rec_t rec;
+  rec.item = item;
+  rec.seq = _next_seq;
+  rec.op = op;
+  rec.check = _checksum(&rec);
+
+  if (!storage_service_write(_slot_addr(_next_slot), rec.raw, JOURNAL_REC_SIZE, NULL, NULL)) return false;
+
+  _next_seq++;
+  _next_slot = (_next_slot + 1) % JOURNAL_REC_COUNT;
+  return true;
+}
+
+static inline uint32_t _state(void)
+{
+  return _epoch | (_epoch_known ? 0 : JOURNAL_STATE_NO_EPOCH) | (_stale ? JOURNAL_STATE_STALE : 0);
+}
+
+static inline void _set_state(uint32_t state)
+{
+  _epoch = (uint16_t)state;
+  _epoch_known = !(state & JOURNAL_STATE_NO_EPOCH);
+  _stale = (state & JOURNAL_STATE_STALE) != 0;
+}
+
+// Copy the next item of the cache to the journal (or skip empty home).
+// Return false if the record could not be queued.
+static bool _pass_step(void)
+{
+  if (_pass_home >= STATIC_CACHE_HOMES)
+  {
+    if (!_append_rec(cache_journal_op_pass_end, _state())) return false;
+    _pass_home = 0;
+    _pass_key = 0;
+    _passes++;
+    return true;
+  }
+
+  cache_item_t kv = {.scalar = 0};
+  kv.key = _pass_key;
+  portENTER_CRITICAL(); // Cache is also modified from interrupt.
+  PROFILER_BEGIN(profiler_crit_cache);
+  bool found = static_cache_next(_pass_home, &kv);
+  PROFILER_END(profiler_crit_cache);
+  portEXIT_CRITICAL();
+
+  if (!found)
+  {
+    _pass_home++;
+    _pass_key = 0;
+    return true;
+  }
+
+  if (!_append_rec(cache_journal_op_snapshot, kv.scalar)) return false;
+  _pass_key = kv.key;
+  return true;
+}
+
+// Write the change (or stale state if some were dropped).
+// Return false if the record could not be queued (change stays in the queue).
+static bool _write_change(void)
+{
+  bool written;
+
+  portENTER_CRITICAL();
+  bool lost = _lost;
+  _lost = false;
+  portEXIT_CRITICAL();
+
+  if (lost)
+  {
+    bool stale = _stale;
+    _stale = true;
+    written = _append_rec(cache_journal_op_epoch, _state());
+    if (!written)
+    {
+      _stale = stale;
+      _lost = true;
+    }
+    return written;
+  }
+
+  journal_change_t change = {0};
+  portENTER_CRITICAL();
+  bool pending = (_queue_tail != _queue_head);
+  uint8_t flushes = _flushes;
+  if (pending) change = _queue[_queue_tail];
+  portEXIT_CRITICAL();
+  if (!pending) return false;
+
+  uint32_t item = change.kv.scalar;
+  if (change.op == cache_journal_op_epoch) item = (uint16_t)item | (_stale ? JOURNAL_STATE_STALE : 0);
+
+  written = _append_rec(change.op, item);
+  if (written)
+  {
+    if (change.op == cache_journal_op_clear) _set_state(JOURNAL_STATE_NO_EPOCH); // Epoch follows loaded cache.
+    else if (change.op == cache_journal_op_epoch) _set_state(item);
+
+    portENTER_CRITICAL();
+    if (flushes == _flushes) _queue_tail = (_queue_tail + 1) % CACHE_JOURNAL_QUEUE_LEN; // Not flushed by clear meanwhile.
+    portEXIT_CRITICAL();
+  }
+  return written;
+}
+
+static inline bool _has_work(void)
+{
+  return _queue_tail != _queue_head || _lost || _pass_debt > 0;
+}
+
+// Executed by storage task.
+static void _sync_job(void * ptr_arg)
+{
+  (void)ptr_arg;
+
+  // One request is left for the next run of the job.
+  while (true)
+  {
+    // Pass keeps pace with changes - live item is copied before its record is overwritten.
+    while (_pass_debt > 0 && storage_service_free() > 1)
+    {
+      if (!_pass_step()) break;
+      _pass_debt--;
+    }
+    if (_pass_debt > 0 || storage_service_free() <= 1) break;
+
+    if (!_write_change()) break;
+    _pass_debt = CACHE_JOURNAL_PASS_STEPS;
+  }
+
+  // Continue when queued records are written (other requests are served meanwhile).
+  if (_has_work() && storage_service_call(_sync_job, NULL)) return;
+
+  _sync_pending = false;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool cache_journal_restore(void)
+{
+  journal_rec_t rec, prev;
+  bool valid, prev_valid;
+  uint16_t newest = JOURNAL_REC_COUNT; // Not found.
+
+  // Find the newest record.
+  if (!_read_rec(JOURNAL_REC_COUNT - 1, &prev, &prev_valid)) return false;
+
+  for (uint16_t slot = 0; slot < JOURNAL_REC_COUNT; ++slot)
+  {
+    WDT_Feed();
+    if (!_read_rec(slot, &rec, &valid)) return false;
+
+    if (prev_valid && !(valid && rec.seq == (uint16_t)(prev.seq + 1)))
+    {
+      newest = (slot == 0 ? JOURNAL_REC_COUNT - 1 : slot - 1);
+      _next_seq = prev.seq + 1;
+      break;
+    }
+    prev = rec;
+    prev_valid = valid;
+  }
+
+  if (newest == JOURNAL_REC_COUNT)
+  {
+    // Empty journal.
+    _next_slot = 0;
+    _restored = true;
+    return true;
+  }
+
+  _next_slot = (newest + 1) % JOURNAL_REC_COUNT;
+
+  // Replay from the oldest record.
+  for (uint16_t i = 0, slot = _next_slot; i < JOURNAL_REC_COUNT; ++i, slot = (slot + 1) % JOURNAL_REC_COUNT)
+  {
+    WDT_Feed();
+    if (!_read_rec(slot, &rec, &valid)) return false;
+    if (!valid) continue;
+
+    cache_item_t kv = {.scalar = rec.item};
+    switch (rec.op)
+    {
+      case cache_journal_op_insert:
+        static_cache_insert(kv);
+        break;
+      case cache_journal_op_snapshot:
+        static_cache_insert(kv);
+        _pass_home = static_cache_home(kv);
+        _pass_key = kv.key;
+        break;
+      case cache_journal_op_erase:
+        static_cache_erase(kv);
+        break;
+      case cache_journal_op_clear:
+        static_cache_reset();
+        _set_state(JOURNAL_STATE_NO_EPOCH);
+        break;
+      case cache_journal_op_epoch:
+        _set_state(rec.item);
+        break;
+      case cache_journal_op_pass_end:
+        _set_state(rec.item);
+        _pass_home = 0;
+        _pass_key = 0;
+        break;
+      default:
+        break;
+    }
+  }
+
+  _restored = true;
+  return true;
+}
+
+bool cache_journal_get_epoch(uint16_t * ptr_epoch)
+{
+  *ptr_epoch = _epoch;
+  return _epoch_known && !_stale;
+}
+
+void cache_journal_log(uint8_t op, const cache_item_t kv)
+{
+  UBaseType_t irq_state = portSET_INTERRUPT_MASK_FROM_ISR();
+
+  // Pending changes are obsolete after clear.
+  if (op == cache_journal_op_clear)
+  {
+    _queue_tail = _queue_head;
+    _flushes++;
+    _lost = false;
+  }
+
+  uint8_t next = (_queue_head + 1) % CACHE_JOURNAL_QUEUE_LEN;
+  if (next != _queue_tail)
+  {
+    _queue[_queue_head].kv = kv;
+    _queue[_queue_head].op = op;
+    _queue_head = next;
+
+    uint8_t pending = (_queue_head + CACHE_JOURNAL_QUEUE_LEN - _queue_tail) % CACHE_JOURNAL_QUEUE_LEN;
+    if (pending > _queue_peak) _queue_peak = pending;
+  }
+  else
+  {
+    // Full - journal does not match the cache until it is cleared.
+    _lost = true;
+    if (_dropped < UINT16_MAX) _dropped++;
+  }
+
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(irq_state);
+}
+
+uint8_t cache_journal_room(void)
+{
+  UBaseType_t irq_state = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint8_t room = (_queue_tail + CACHE_JOURNAL_QUEUE_LEN - _queue_head - 1) % CACHE_JOURNAL_QUEUE_LEN;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(irq_state);
+
+  return room;
+}
+
+bool cache_journal_get_stats(uint16_t * ptr_dropped, uint16_t * ptr_passes, uint8_t * ptr_queue_peak)
+{
+  portENTER_CRITICAL();
+  *ptr_dropped = _dropped;
+  *ptr_passes = _passes;
+  *ptr_queue_peak = _queue_peak;
+  bool stale = _stale || _lost;
+  portEXIT_CRITICAL();
+
+  return stale;
+}
+
+void cache_journal_sync(void)
+{
+  if (!_restored || _sync_pending || !_has_work()) return;
+
+  _sync_pending = true;
+  if (!storage_service_call(_sync_job, NULL)) _sync_pending = false; // Retry on the next call.
+}
+
+#endif
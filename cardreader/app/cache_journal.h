@@ -0,0 +1,108 @@
+/**
+ *  @file
+ *  @brief Journal of static cache changes in external storage.
+ *
+ *  Cache inserts and erases are appended to a circular journal in external storage
+ *  and replayed into the cache on startup. Writes go around the whole journal area
+ *  so the wear is spread evenly. Each written change is followed by a few steps of
+ *  snapshot pass, which copies the whole cache to the journal in order of homes (see
+ *  static_cache_next). The journal holds a whole pass with changes written meanwhile,
+ *  so no item present in the cache is overwritten before it is copied again.
+ *
+ *  Changes are logged to RAM queue (safe from interrupt) and written to storage
+ *  later by storage task (see @ref cache_journal_sync). Change dropped because the
+ *  queue is full is counted and the journal is stale until the cache is cleared -
+ *  restored cache has no epoch, so master loads it again.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef CACHE_JOURNAL_H_
+#define CACHE_JOURNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "static_cache.h"
+
+/** Configuration of the cache journal. */
+#define CACHE_JOURNAL_QUEUE_LEN  32 // Pending changes waiting for write (more than one block of cache transfer).
+#define CACHE_JOURNAL_PASS_STEPS 8  // Steps of snapshot pass (item or home) per written change.
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+// Journal operations.
+enum cache_journal_op
+{
+  cache_journal_op_insert = 0x1,
+  cache_journal_op_erase = 0x2,
+  cache_journal_op_clear = 0x3,
+  cache_journal_op_epoch = 0x4,    // Item is cache epoch (see FC_CACHE_UPDATE).
+  cache_journal_op_snapshot = 0x5, // Item copied by snapshot pass (written by journal only).
+  cache_journal_op_pass_end = 0x6  // End of snapshot pass (written by journal only).
+};
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+/**
+* @brief Replay the journal into the cache.
+*
+*        Must be called before scheduler start (blocking storage access).
+*
+* @return true if journal was read successfully.
+*/
+bool cache_journal_restore(void);
+
+/**
+* @brief Get cache epoch restored from the journal or last logged.
+*
+* @param ptr_epoch ... Cache epoch.
+*
+* @return true if epoch is known.
+*/
+bool cache_journal_get_epoch(uint16_t * ptr_epoch);
+
+/**
+* @brief Log cache change.
+*
+*        Can be called from interrupt.
+*
+* @param op ... operation (cache_journal_op)
+* @param kv ... Changed item (not used for clear, epoch in scalar for epoch).
+*/
+void cache_journal_log(uint8_t op, const cache_item_t kv);
+
+/**
+* @brief Get number of changes which can be logged without loss.
+*
+*        Can be called from interrupt.
+*
+* @return free entries of the change queue.
+*/
+uint8_t cache_journal_room(void);
+
+/**
+* @brief Get statistics of the journal.
+*
+* @param ptr_dropped ... Changes dropped because the queue was full (since reset, saturated).
+* @param ptr_passes ... Finished snapshot passes (since reset, wraps around).
+* @param ptr_queue_peak ... Highest number of pending changes.
+*
+* @return true if the journal is stale (some changes were dropped since the cache was cleared).
+*/
+bool cache_journal_get_stats(uint16_t * ptr_dropped, uint16_t * ptr_passes, uint8_t * ptr_queue_peak);
+
+/**
+* @brief Queue write of pending changes to storage.
+*
+*        Must be called from task context. Does not wait for storage - records are
+*        written by storage task (storage_service.h).
+*/
+void cache_journal_sync(void);
+
+#endif /* CACHE_JOURNAL_H_ */
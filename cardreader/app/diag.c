@@ -0,0 +1,361 @@
+/**
+ *  @file
+ *  @brief Runtime statistics and health of the panel.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "diag.h"
+#include "board.h"
+#include "reader.h"
+#include "task.h"
+#include "can/can_term_driver.h"
+#include "profiler.h"
+#include "panel_time.h"
+#include "acs_can_protocol.h"
+#include "static_cache.h"
+#include "cache_journal.h"
+#include <string.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Error counter limit for warning (CAN specification).
+#define CAN_ERROR_WARN_LIMIT 96
+
+// Monitored tasks (idle and timer service task are added on first use).
+static TaskHandle_t _tasks[DIAG_TASK_LIMIT];
+static uint8_t _task_count = 0;
+
+// Run time of tasks at last sample and load between last two samples.
+static uint32_t _task_time[DIAG_TASK_LIMIT];
+static uint8_t _task_load[DIAG_TASK_LIMIT];
+static uint32_t _sample_time = 0;
+
+static uint16_t _can_errors = 0;
+static uint16_t _can_bus_off = 0;
+static uint16_t _can_passive = 0;
+static uint16_t _can_restarts = 0;
+static bool _can_is_passive = false;
+// Boot time.
+static uint16_t _startup_ms = 0;
+static uint32_t _master_ms = 0;
+// Heartbeats of active master.
+static uint16_t _alive_missed = 0;
+// Failovers to standby master.
+static uint16_t _failover_count = 0;
+static uint16_t _failover_last_ms = 0;
+static uint16_t _failover_max_ms = 0;
+static uint8_t _failover_reason = DATA_DIAG_FAILOVER_NONE;
+
+static uint16_t _cache_lookups[ACS_READER_MAXCOUNT];
+static uint16_t _cache_hits[ACS_READER_MAXCOUNT];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Add kernel tasks which exist only after scheduler start.
+static void _add_kernel_tasks(void)
+{
+  static bool added = false;
+  if (added) return;
+  added = true;
+
+  diag_register_task(xTaskGetIdleTaskHandle());
+}
+
+static uint8_t _percent(uint32_t part, uint32_t total)
+{
+  if (total < 100) return 0;
+  uint32_t pct = part / (total / 100); // Avoid overflow for long intervals.
+  return (pct > 100 ? 100 : pct);
+}
+
+// Measure CPU load of tasks since last sample.
+static void _sample_tasks(void)
+{
+  uint32_t now = portGET_RUN_TIME_COUNTER_VALUE();
+  uint32_t span = now - _sample_time;
+  _sample_time = now;
+
+  for (uint8_t i = 0; i < _task_count; ++i)
+  {
+    TaskStatus_t status;
+    vTaskGetInfo(_tasks[i], &status, pdFALSE, eRunning); // State is not needed.
+    _task_load[i] = _percent(status.ulRunTimeCounter - _task_time[i], span);
+    _task_time[i] = status.ulRunTimeCounter;
+  }
+}
+
+#if PROFILER_ENABLED
+static uint8_t _bit_length(uint16_t value)
+{
+  uint8_t len = 0;
+  while (value != 0)
+  {
+    value >>= 1;
+    len++;
+  }
+  return len;
+}
+#endif
+
+static uint8_t _get_idle_load(void)
+{
+  TaskHandle_t idle = xTaskGetIdleTaskHandle();
+  for (uint8_t i = 0; i < _task_count; ++i)
+  {
+    if (_tasks[i] == idle) return _task_load[i];
+  }
+  return 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void diag_register_task(TaskHandle_t task)
+{
+  if (task != NULL && _task_count < DIAG_TASK_LIMIT)
+  {
+    _tasks[_task_count++] = task;
+  }
+}
+
+void diag_boot_init(uint16_t startup_ms)
+{
+  _startup_ms = startup_ms;
+}
+
+void diag_boot_master_alive(void)
+{
+  // Ticks do not run before scheduler start.
+  if (_master_ms == 0) _master_ms = _startup_ms + xTaskGetTickCountFromISR() * portTICK_PERIOD_MS;
+}
+
+void diag_master_alive_missed(uint8_t count)
+{
+  _alive_missed = (UINT16_MAX - _alive_missed > count ? _alive_missed + count : UINT16_MAX);
+}
+
+void diag_master_failover(uint8_t reason, uint32_t duration_ms)
+{
+  const uint16_t ms = (duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms);
+
+  portENTER_CRITICAL();
+  if (_failover_count < UINT16_MAX) _failover_count++;
+  _failover_last_ms = ms;
+  if (ms > _failover_max_ms) _failover_max_ms = ms;
+  _failover_reason = reason;
+  portEXIT_CRITICAL();
+}
+
+void diag_can_error(uint32_t error_info)
+{
+  if (error_info != CAN_ERROR_NONE && _can_errors < UINT16_MAX) _can_errors++;
+  if ((error_info & CAN_ERROR_BOFF) && _can_bus_off < UINT16_MAX) _can_bus_off++;
+
+  // Passive flag is reported with each error while the state lasts.
+  bool passive = (error_info & CAN_ERROR_PASS) != 0;
+  if (passive && !_can_is_passive && _can_passive < UINT16_MAX) _can_passive++;
+  _can_is_passive = passive;
+}
+
+void diag_can_restart(void)
+{
+  if (_can_restarts < UINT16_MAX) _can_restarts++;
+  _can_is_passive = false; // Error counters are cleared.
+}
+
+void diag_cache_lookup(uint8_t reader_idx, bool hit)
+{
+  if (reader_idx >= ACS_READER_MAXCOUNT) return;
+
+  if (_cache_lookups[reader_idx] < UINT16_MAX)
+  {
+    _cache_lookups[reader_idx]++;
+    if (hit) _cache_hits[reader_idx]++;
+  }
+}
+
+uint8_t diag_get_page(uint8_t page, uint8_t reader_idx, uint8_t * ptr_data)
+{
+  _add_kernel_tasks();
+
+  if (page == DATA_DIAG_PAGE_SYSTEM)
+  {
+    _sample_tasks();
+
+    acs_msg_data_diag_system_t sys =
+    {
+      .page = page,
+      .reset_reason = Board_Get_Reset_Reason(),
+      .uptime_sec = xTaskGetTickCount() / configTICK_RATE_HZ,
+      .task_count = _task_count,
+      .cpu_load = 100 - _get_idle_load()
+    };
+    memcpy(ptr_data, &sys, sizeof(sys));
+    return sizeof(sys);
+  }
+  else if (page == DATA_DIAG_PAGE_CAN)
+  {
+    acs_msg_data_diag_can_t can =
+    {
+      .page = page,
+      .flags = 0,
+      .error_count = _can_errors,
+      .bit_rate_kbps = (uint16_t)(CAN_get_bit_rate() / 1000)
+    };
+    bool passive = CAN_get_error_counters(&can.tx_errors, &can.rx_errors);
+
+    if (can.tx_errors >= CAN_ERROR_WARN_LIMIT || can.rx_errors >= CAN_ERROR_WARN_LIMIT) can.flags |= DATA_DIAG_CAN_WARN;
+    if (passive) can.flags |= DATA_DIAG_CAN_PASSIVE;
+
+    memcpy(ptr_data, &can, sizeof(can));
+    return sizeof(can);
+  }
+  else if (page == DATA_DIAG_PAGE_CAN_RECOVERY)
+  {
+    acs_msg_data_diag_can_recovery_t rec =
+    {
+      .page = page,
+      .bus_off_count = _can_bus_off,
+      .passive_count = _can_passive,
+      .restart_count = _can_restarts
+    };
+    memcpy(ptr_data, &rec, sizeof(rec));
+    return sizeof(rec);
+  }
+  else if (page == DATA_DIAG_PAGE_BOOT)
+  {
+    acs_msg_data_diag_boot_t boot =
+    {
+      .page = page,
+      .startup_ms = _startup_ms,
+      .master_ms = _master_ms,
+      .door_count = ACS_READER_MAXCOUNT
+    };
+    memcpy(ptr_data, &boot, sizeof(boot));
+    return sizeof(boot);
+  }
+  else if (page == DATA_DIAG_PAGE_FIRMWARE)
+  {
+    acs_msg_data_diag_firmware_t fw =
+    {
+      .page = page,
+      .state = (get_fw_state() == FW_STATE_TRIAL ? DATA_DIAG_FW_TRIAL : DATA_DIAG_FW_CONFIRMED),
+      .version = FW_VERSION,
+      .crc = get_fw_crc()
+    };
+    memcpy(ptr_data, &fw, sizeof(fw));
+    return sizeof(fw);
+  }
+  else if (page == DATA_DIAG_PAGE_TIME)
+  {
+    uint32_t since_sync = panel_time_since_sync();
+    int16_t drift_ppm;
+    bool drift_valid = panel_time_get_drift(&drift_ppm);
+    acs_msg_data_diag_time_t tm =
+    {
+      .page = page,
+      .flags = (drift_valid ? DATA_DIAG_TIME_DRIFT : 0),
+      .drift_ppm = drift_ppm,
+      .missed_alive = _alive_missed,
+      .since_sync_sec = (since_sync > UINT16_MAX ? UINT16_MAX : since_sync)
+    };
+    if (since_sync != UINT32_MAX) tm.flags |= DATA_DIAG_TIME_SYNCED;
+
+    memcpy(ptr_data, &tm, sizeof(tm));
+    return sizeof(tm);
+  }
+  else if (page == DATA_DIAG_PAGE_FAILOVER)
+  {
+    portENTER_CRITICAL();
+    acs_msg_data_diag_failover_t fo =
+    {
+      .page = page,
+      .reason = _failover_reason,
+      .count = _failover_count,
+      .last_ms = _failover_last_ms,
+      .max_ms = _failover_max_ms
+    };
+    portEXIT_CRITICAL();
+
+    memcpy(ptr_data, &fo, sizeof(fo));
+    return sizeof(fo);
+  }
+#if CACHING_ENABLED && CACHE_JOURNAL_ENABLED
+  else if (page == DATA_DIAG_PAGE_JOURNAL)
+  {
+    acs_msg_data_diag_journal_t jr = {.page = page};
+    if (cache_journal_get_stats(&jr.dropped, &jr.passes, &jr.queue_peak)) jr.flags |= DATA_DIAG_JOURNAL_STALE;
+
+    memcpy(ptr_data, &jr, sizeof(jr));
+    return sizeof(jr);
+  }
+#endif
+  else if (page == DATA_DIAG_PAGE_READER && reader_idx < ACS_READER_MAXCOUNT)
+  {
+    acs_msg_data_diag_reader_t rdr =
+    {
+      .page = page,
+      .parity_errors = reader_get_parity_errors(reader_idx),
+      .cache_lookups = _cache_lookups[reader_idx],
+      .cache_hits = _cache_hits[reader_idx]
+    };
+#if CACHING_ENABLED
+    portENTER_CRITICAL();
+    const uint16_t tombstones = static_cache_tombstones();
+    portEXIT_CRITICAL();
+    rdr.tombstones = (tombstones > UINT8_MAX ? UINT8_MAX : tombstones);
+#endif
+    memcpy(ptr_data, &rdr, sizeof(rdr));
+    return sizeof(rdr);
+  }
+  else if (page >= DATA_DIAG_PAGE_TASK && page < DATA_DIAG_PAGE_TASK + _task_count)
+  {
+    uint8_t i = page - DATA_DIAG_PAGE_TASK;
+    TaskStatus_t status;
+    vTaskGetInfo(_tasks[i], &status, pdTRUE, eRunning);
+
+    acs_msg_data_diag_task_t task =
+    {
+      .page = page,
+      .cpu_load = _task_load[i],
+      .stack_free = status.usStackHighWaterMark
+    };
+    // Name is not terminated if it fills the field (struct is zeroed by initializer).
+    size_t name_len = strlen(status.pcTaskName);
+    memcpy(task.name, status.pcTaskName, (name_len < sizeof(task.name) ? name_len : sizeof(task.name)));
+    memcpy(ptr_data, &task, sizeof(task));
+    return sizeof(task);
+  }
+
+#if PROFILER_ENABLED
+  profiler_stats_t stats;
+  if ((page & 0xF0) == DATA_DIAG_PAGE_PROFILE && profiler_get(page & 0x0F, &stats))
+  {
+    acs_msg_data_diag_profile_t prof = {.page = page, .max_us = stats.max_us, .count = stats.count};
+    memcpy(ptr_data, &prof, sizeof(prof));
+    return sizeof(prof);
+  }
+  else if ((page & 0xF0) == DATA_DIAG_PAGE_PROFILE_HIST && profiler_get(page & 0x0F, &stats))
+  {
+    acs_msg_data_diag_profile_hist_t hist = {.page = page};
+    for (uint8_t bin = 0; bin < PROFILER_HIST_BINS; ++bin)
+    {
+      hist.hist_log2[bin] = _bit_length(stats.hist[bin]);
+    }
+    memcpy(ptr_data, &hist, sizeof(hist));
+    return sizeof(hist);
+  }
+#endif
+
+  // Unknown page.
+  ptr_data[0] = page;
+  return 1;
+}
@@ -0,0 +1,105 @@
+/**
+ *  @file
+ *  @brief Runtime statistics and health of the panel.
+ *
+ *  Statistics are read by master with FC_DIAG (one page per request).
+ *  CPU time of tasks is measured by run time counter (CT32B0, 10kHz).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef DIAG_H_
+#define DIAG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+/** Configuration of diagnostics. */
+#define DIAG_TASK_LIMIT 6 // Idle and timer wheel task included.
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+/**
+* @brief Add task to statistics.
+*
+* @param task ... Task handle.
+*/
+void diag_register_task(TaskHandle_t task);
+
+/**
+* @brief Set duration of start-up (reset to start of scheduler).
+*
+* @param startup_ms ... Time in ms.
+*/
+void diag_boot_init(uint16_t startup_ms);
+
+/**
+* @brief Measure boot time when the first master alive message is received.
+*
+*        Called from interrupt.
+*/
+void diag_boot_master_alive(void);
+
+/**
+* @brief Count heartbeats of active master which were not received.
+*
+*        Called from interrupt.
+*
+* @param count ... Missed heartbeats (gap in sequence number).
+*/
+void diag_master_alive_missed(uint8_t count);
+
+/**
+* @brief Count failover from active master to standby master.
+*
+*        Called from task context.
+*
+* @param reason ... DATA_DIAG_FAILOVER_...
+* @param duration_ms ... Time from the first missed response of failed master to the switch.
+*/
+void diag_master_failover(uint8_t reason, uint32_t duration_ms);
+
+/**
+* @brief Count CAN error.
+*
+*        Called from interrupt.
+*
+* @param error_info ... Error code from CAN driver.
+*/
+void diag_can_error(uint32_t error_info);
+
+/**
+* @brief Count restart of CAN controller after bus-off.
+*
+*        Called from timer task.
+*/
+void diag_can_restart(void);
+
+/**
+* @brief Count user lookup in the cache (master offline).
+*
+* @param reader_idx ... Index of the reader.
+* @param hit ... true if user was found in the cache.
+*/
+void diag_cache_lookup(uint8_t reader_idx, bool hit);
+
+/**
+* @brief Fill diagnostic page.
+*
+*        Must be called from task context.
+*
+* @param page ... Requested page (DATA_DIAG_PAGE_...).
+* @param reader_idx ... Index of the addressed reader.
+* @param ptr_data ... Buffer for message data (8 bytes).
+*
+* @return length of the data
+*/
+uint8_t diag_get_page(uint8_t page, uint8_t reader_idx, uint8_t * ptr_data);
+
+#endif /* DIAG_H_ */
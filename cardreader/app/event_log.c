@@ -0,0 +1,418 @@
+/**
+ *  @file
+ *  @brief Log of events which happened while master was offline.
+ *
+ *  Storage log is a circular array of fixed size records with sequence number (as cache
+ *  journal). Records from the tail (sequence number in PTR_EVENT_LOG_TAIL) to the head
+ *  are waiting for upload.
+ *
+ *  Record:
+ *  | time (4B) | user ID (4B) | sequence number (2B) | type (1B) | reader (1B) | flags (1B) |
+ *  | reserved (2B) | checksum (1B) |
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "event_log.h"
+#include "panel_time.h"
+#include "terminal_config.h"
+#include "storage.h"
+#include "storage_service.h"
+#include "watchdog.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define EVENT_REC_SIZE  16
+#define EVENT_REC_COUNT ((PTR_EVENT_LOG_END - PTR_EVENT_LOG_FIRST) / EVENT_REC_SIZE)
+
+#if (STORE_PAGE_SIZE % EVENT_REC_SIZE) != 0 || (PTR_EVENT_LOG_FIRST % EVENT_REC_SIZE) != 0
+#error "Event records must not cross storage page boundary."
+#endif
+
+#pragma pack(push,1)
+
+typedef union
+{
+  struct
+  {
+    uint32_t time;
+    uint32_t user_id;
+    uint16_t seq;      // Sequence number.
+    uint8_t type;
+    uint8_t reader_idx;
+    uint8_t flags;
+    uint8_t reserved[2];
+    uint8_t check;     // Checksum of previous bytes.
+  };
+  uint8_t raw[EVENT_REC_SIZE];
+} event_rec_t;
+
+#pragma pack(pop)
+
+// Source of unacknowledged batch.
+typedef enum
+{
+  event_batch_none,
+  event_batch_storage,
+  event_batch_ram
+} event_batch_source_t;
+
+// RAM ring (head and tail are free running counters).
+static event_log_item_t _ram[EVENT_LOG_RAM_LEN];
+static uint16_t _ram_head = 0;
+static uint16_t _ram_tail = 0;
+
+// Position of next record and the oldest record waiting for upload.
+static uint16_t _next_slot = 0;
+static uint16_t _next_seq = 0;
+static uint16_t _tail_seq = 0;
+// Records before this one were written before reset.
+static uint16_t _boot_seq = 0;
+
+// Writes are allowed only when position in storage is known.
+static bool _restored = false;
+
+// Records read from the tail for the next batch.
+static event_log_item_t _loaded[EVENT_LOG_BATCH];
+static uint8_t _loaded_count = 0;
+static uint16_t _loaded_seq = 0;   // Sequence number of the first read record.
+static uint8_t _loaded_span = 0;   // Read records (invalid ones are skipped).
+static uint8_t _loaded_end[EVENT_LOG_BATCH]; // Read records up to each loaded one.
+static volatile bool _loaded_valid = false;
+static volatile bool _load_pending = false;
+
+// Unacknowledged batch.
+static uint8_t _batch_source = event_batch_none;
+static uint8_t _batch_number = 0;
+static uint8_t _batch_count = 0;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Rotate and XOR checksum (neither erased nor zeroed record is valid).
+static uint8_t _checksum(const event_rec_t * ptr_rec)
+{
+  uint8_t sum = 0x5A;
+  for (int i = 0; i < EVENT_REC_SIZE - 1; ++i)
+  {
+    sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ ptr_rec->raw[i];
+  }
+  return sum;
+}
+
+static inline uint16_t _slot_addr(uint16_t slot)
+{
+  return PTR_EVENT_LOG_FIRST + slot * EVENT_REC_SIZE;
+}
+
+// Slot of record which is not older than EVENT_REC_COUNT records.
+static inline uint16_t _seq_slot(uint16_t seq)
+{
+  return (_next_slot + EVENT_REC_COUNT - (uint16_t)(_next_seq - seq)) % EVENT_REC_COUNT;
+}
+
+static inline uint16_t _stored_count(void)
+{
+  return (uint16_t)(_next_seq - _tail_seq);
+}
+
+static bool _read_rec(uint16_t slot, event_rec_t * ptr_rec, bool * ptr_valid)
+{
+  if (!storage_read(_slot_addr(slot), ptr_rec->raw, EVENT_REC_SIZE)) return false;
+
+  *ptr_valid = (ptr_rec->check == _checksum(ptr_rec));
+  return true;
+}
+
+static void _write_tail(void)
+{
+  const uint8_t data[] = {(uint8_t)_tail_seq, (uint8_t)(_tail_seq >> 8)}; // little-endian
+  storage_service_write(PTR_EVENT_LOG_TAIL, data, sizeof(data), NULL, NULL);
+}
+
+// Queue write of the oldest RAM event to the next record.
+static bool _spill(void)
+{
+  event_rec_t rec;
+  memset(&rec, 0, sizeof(rec));
+
+  taskENTER_CRITICAL();
+  const event_log_item_t * ptr_item = &_ram[_ram_tail % EVENT_LOG_RAM_LEN];
+  rec.time = ptr_item->time;
+  rec.user_id = ptr_item->user_id;
+  rec.type = ptr_item->type;
+  rec.reader_idx = ptr_item->reader_idx;
+  rec.flags = ptr_item->flags;
+  taskEXIT_CRITICAL();
+
+  rec.seq = _next_seq;
+  rec.check = _checksum(&rec);
+
+  if (!storage_service_write(_slot_addr(_next_slot), rec.raw, EVENT_REC_SIZE, NULL, NULL)) return false;
+
+  taskENTER_CRITICAL();
+  _ram_tail++;
+  taskEXIT_CRITICAL();
+
+  _next_seq++;
+  _next_slot = (_next_slot + 1) % EVENT_REC_COUNT;
+
+  // The oldest record is overwritten.
+  if (_stored_count() > EVENT_REC_COUNT)
+  {
+    _tail_seq = _next_seq - EVENT_REC_COUNT;
+    _write_tail();
+  }
+  return true;
+}
+
+// Read records from the tail. Executed by storage task.
+static void _load_job(void * ptr_arg)
+{
+  (void)ptr_arg;
+  const uint16_t stored = _stored_count();
+  uint8_t count = 0;
+  uint8_t span = 0;
+
+  _loaded_seq = _tail_seq;
+
+  while (count < EVENT_LOG_BATCH && span < stored)
+  {
+    const uint16_t seq = _loaded_seq + span;
+    event_rec_t rec;
+    bool valid;
+
+    if (!_read_rec(_seq_slot(seq), &rec, &valid)) break;
+    span++;
+    if (!valid || rec.seq != seq) continue; // Lost record.
+
+    _loaded_end[count] = span;
+    event_log_item_t * ptr_item = &_loaded[count++];
+    ptr_item->time = rec.time;
+    ptr_item->user_id = rec.user_id;
+    ptr_item->type = rec.type;
+    ptr_item->reader_idx = rec.reader_idx;
+    ptr_item->flags = rec.flags;
+    // Uptime of previous boot can not be converted.
+    if ((ptr_item->flags & EVENT_LOG_FLAG_UPTIME) && (int16_t)(seq - _boot_seq) < 0)
+    {
+      ptr_item->flags = EVENT_LOG_FLAG_UNKNOWN;
+    }
+  }
+
+  _loaded_count = count;
+  _loaded_span = span;
+  _loaded_valid = (span > 0);
+  _load_pending = false;
+}
+
+// Convert uptime of this boot to master time if it is known.
+static void _convert_time(event_log_item_t * ptr_item)
+{
+  uint32_t now;
+
+  if (!(ptr_item->flags & EVENT_LOG_FLAG_UPTIME) || !panel_time_get(&now)) return;
+
+  ptr_item->time = now - (panel_time_uptime() - ptr_item->time);
+  ptr_item->flags &= ~EVENT_LOG_FLAG_UPTIME;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool event_log_restore(void)
+{
+  event_rec_t rec, prev;
+  bool valid, prev_valid;
+  bool found = false;
+  uint16_t tail;
+
+  // Find the newest record.
+  if (!_read_rec(EVENT_REC_COUNT - 1, &prev, &prev_valid)) return false;
+
+  for (uint16_t slot = 0; slot < EVENT_REC_COUNT; ++slot)
+  {
+    WDT_Feed();
+    if (!_read_rec(slot, &rec, &valid)) return false;
+
+    if (prev_valid && !(valid && rec.seq == (uint16_t)(prev.seq + 1)))
+    {
+      _next_slot = slot;
+      _next_seq = prev.seq + 1;
+      found = true;
+      break;
+    }
+    prev = rec;
+    prev_valid = valid;
+  }
+
+  if (!storage_read_word_le(PTR_EVENT_LOG_TAIL, &tail)) return false;
+
+  _tail_seq = tail;
+  if (!found)
+  {
+    // Empty log.
+    _next_slot = 0;
+    _tail_seq = _next_seq;
+  }
+  else if (_stored_count() > EVENT_REC_COUNT)
+  {
+    // Tail points to overwritten record (or it was never written).
+    _tail_seq = _next_seq - EVENT_REC_COUNT;
+  }
+
+  _boot_seq = _next_seq;
+  _restored = true;
+  return true;
+}
+
+void event_log_add(uint8_t type, uint8_t reader_idx, uint32_t user_id)
+{
+  event_log_item_t item =
+  {
+    .user_id = user_id,
+    .type = type,
+    .reader_idx = reader_idx,
+    .flags = 0
+  };
+
+  if (!panel_time_get(&item.time))
+  {
+    item.time = panel_time_uptime();
+    item.flags = EVENT_LOG_FLAG_UPTIME;
+  }
+
+  taskENTER_CRITICAL();
+  if ((uint16_t)(_ram_head - _ram_tail) < EVENT_LOG_RAM_LEN) // Drop event if full.
+  {
+    _ram[_ram_head % EVENT_LOG_RAM_LEN] = item;
+    _ram_head++;
+  }
+  taskEXIT_CRITICAL();
+}
+
+void event_log_sync(bool offline)
+{
+  if (!_restored) return;
+
+  if (offline)
+  {
+    // Batch is sent again from start.
+    _batch_source = event_batch_none;
+    _loaded_valid = false;
+
+    // Each record needs place for tail update too.
+    while ((uint16_t)(_ram_head - _ram_tail) > EVENT_LOG_SPILL_AT && storage_service_free() > 1)
+    {
+      if (!_spill()) break;
+    }
+  }
+  else if (_stored_count() > 0 && !_loaded_valid && !_load_pending && _batch_source == event_batch_none)
+  {
+    _load_pending = true;
+    if (!storage_service_call(_load_job, NULL)) _load_pending = false; // Retry on the next call.
+  }
+}
+
+uint8_t event_log_batch(event_log_item_t * ptr_items, uint8_t * ptr_batch)
+{
+  const bool form = (_batch_source == event_batch_none);
+
+  if (form)
+  {
+    if (_stored_count() > 0)
+    {
+      // Storage records are older than RAM.
+      if (!_loaded_valid || _load_pending) return 0;
+      if (_loaded_count == 0)
+      {
+        // Only lost records were read.
+        _tail_seq = _loaded_seq + _loaded_span;
+        _loaded_valid = false;
+        _write_tail();
+        return 0;
+      }
+      _batch_source = event_batch_storage;
+      _batch_count = _loaded_count;
+    }
+    else
+    {
+      uint16_t count = (uint16_t)(_ram_head - _ram_tail);
+      if (count == 0) return 0;
+      _batch_source = event_batch_ram;
+      _batch_count = (count < EVENT_LOG_BATCH ? count : EVENT_LOG_BATCH);
+    }
+    _batch_number++;
+  }
+
+  uint32_t base = 0;
+  bool base_known = false;
+
+  for (uint8_t i = 0; i < _batch_count; ++i)
+  {
+    if (_batch_source == event_batch_storage)
+    {
+      ptr_items[i] = _loaded[i];
+    }
+    else
+    {
+      taskENTER_CRITICAL();
+      ptr_items[i] = _ram[(uint16_t)(_ram_tail + i) % EVENT_LOG_RAM_LEN];
+      taskEXIT_CRITICAL();
+    }
+    _convert_time(&ptr_items[i]);
+
+    // Known times of new batch must fit in EVENT_LOG_SPAN_MAX from the first one.
+    if (form && !(ptr_items[i].flags & (EVENT_LOG_FLAG_UPTIME | EVENT_LOG_FLAG_UNKNOWN)))
+    {
+      if (!base_known)
+      {
+        base = ptr_items[i].time;
+        base_known = true;
+      }
+      else if (ptr_items[i].time < base || ptr_items[i].time - base > EVENT_LOG_SPAN_MAX)
+      {
+        _batch_count = i;
+        break;
+      }
+    }
+  }
+
+  *ptr_batch = _batch_number;
+  return _batch_count;
+}
+
+void event_log_ack(uint8_t batch)
+{
+  if (_batch_source == event_batch_none || batch != _batch_number) return;
+
+  if (_batch_source == event_batch_storage)
+  {
+    // Tail could move over the batch when records were overwritten.
+    uint16_t tail = _loaded_seq + _loaded_end[_batch_count - 1];
+    if ((int16_t)(tail - _tail_seq) > 0) _tail_seq = tail;
+    _loaded_valid = false;
+    _write_tail();
+  }
+  else
+  {
+    taskENTER_CRITICAL();
+    _ram_tail += _batch_count;
+    taskEXIT_CRITICAL();
+  }
+  _batch_source = event_batch_none;
+}
+
+uint16_t event_log_pending(void)
+{
+  return (uint16_t)(_ram_head - _ram_tail) + _stored_count();
+}
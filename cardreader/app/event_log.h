@@ -0,0 +1,115 @@
+/**
+ *  @file
+ *  @brief Log of events which happened while master was offline.
+ *
+ *  Events are kept in RAM ring and older ones are moved to circular log in external
+ *  storage (see PTR_EVENT_LOG_FIRST). Log is uploaded to master in batches (FC_EVENT_LOG)
+ *  when master is online again - storage records first, then RAM. Up to EVENT_LOG_SPILL_AT
+ *  newest events are lost on reset.
+ *
+ *  Events are stamped with master time (panel_time.h). Events from before the first
+ *  FC_ALIVE are stamped with uptime and converted when time is known (events of previous
+ *  boot are uploaded with DATA_EVENT_FLAG_TIME_UNKNOWN).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Configuration of the event log. */
+#define EVENT_LOG_RAM_LEN   16 // Events in RAM (newest are dropped when full).
+#define EVENT_LOG_SPILL_AT  4  // Older events are moved to storage above this count (master offline).
+#define EVENT_LOG_BATCH     8  // Events in one upload (up to 16, see acs_msg_data_event_t).
+#define EVENT_LOG_SPAN_MAX  0xFFFF // Known times in one upload are within this from the first one (seconds).
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+// Flags of event.
+#define EVENT_LOG_FLAG_UPTIME 0x01 // Time is uptime of this boot (master time was not known).
+#define EVENT_LOG_FLAG_UNKNOWN 0x02 // Time is not known (uptime of previous boot).
+
+#pragma pack(push,1)
+
+typedef struct
+{
+  uint32_t time;      // Master time or uptime (see flags), seconds.
+  uint32_t user_id;   // Card of the event (0 for door events).
+  uint8_t type;       // DATA_EVENT_...
+  uint8_t reader_idx;
+  uint8_t flags;      // EVENT_LOG_FLAG_...
+} event_log_item_t;
+
+#pragma pack(pop)
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+/**
+* @brief Find position of the log in external storage.
+*
+*        Must be called before scheduler start (blocking storage access).
+*
+* @return true if the log was read successfully.
+*/
+bool event_log_restore(void);
+
+/**
+* @brief Log event.
+*
+*        Must be called from task context.
+*
+* @param type ... DATA_EVENT_...
+* @param reader_idx ... Index of the reader.
+* @param user_id ... Card of the event (0 for door events).
+*/
+void event_log_add(uint8_t type, uint8_t reader_idx, uint32_t user_id);
+
+/**
+* @brief Move events between RAM and storage.
+*
+*        Must be called from task context. Does not wait for storage (storage_service.h).
+*
+* @param offline ... true if master is offline (unacknowledged batch is returned to the log
+*                    and events are moved to storage), otherwise the next batch is read
+*                    from storage.
+*/
+void event_log_sync(bool offline);
+
+/**
+* @brief Get batch of events to upload.
+*
+*        The same batch is returned until it is acknowledged or master goes offline.
+*
+* @param ptr_items ... Buffer for EVENT_LOG_BATCH events (oldest first).
+* @param ptr_batch ... Batch number.
+*
+* @return number of events (0 if there is nothing to upload now)
+*/
+uint8_t event_log_batch(event_log_item_t * ptr_items, uint8_t * ptr_batch);
+
+/**
+* @brief Remove uploaded batch from the log.
+*
+*        Must be called from task context.
+*
+* @param batch ... Batch number acknowledged by master.
+*/
+void event_log_ack(uint8_t batch);
+
+/**
+* @brief Get number of events waiting for upload.
+*
+* @return events in RAM and storage
+*/
+uint16_t event_log_pending(void);
+
+#endif /* EVENT_LOG_H_ */
@@ -0,0 +1,123 @@
+/**
+ *  @file
+ *  @brief Wall-clock time of the panel.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "panel_time.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Master time and tick count when it was received.
+static uint32_t _time = 0;
+static uint16_t _time_ms = 0;
+static TickType_t _time_tick = 0;
+static bool _time_valid = false;
+
+// Start of drift measurement.
+static uint32_t _ref_time = 0;
+static uint16_t _ref_ms = 0;
+static TickType_t _ref_tick = 0;
+
+// Correction of tick counter (smoothed).
+static int32_t _drift_ppm = 0;
+static bool _drift_valid = false;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Update drift from master time elapsed since the reference.
+static void _measure_drift(uint32_t time, uint16_t ms, TickType_t tick)
+{
+  const uint32_t local_ms = (tick - _ref_tick) * portTICK_PERIOD_MS;
+
+  if (local_ms < PANEL_TIME_DRIFT_WINDOW_MS) return;
+
+  // Master time going backwards gives large difference too.
+  const int64_t master_ms = (int64_t)(uint32_t)(time - _ref_time) * 1000 + ms - _ref_ms;
+  const int64_t ppm = (master_ms - local_ms) * 1000000 / local_ms;
+
+  if (ppm >= -PANEL_TIME_DRIFT_MAX_PPM && ppm <= PANEL_TIME_DRIFT_MAX_PPM)
+  {
+    _drift_ppm = (_drift_valid ? _drift_ppm + ((int32_t)ppm - _drift_ppm) / 4 : (int32_t)ppm);
+    _drift_valid = true;
+  }
+
+  _ref_time = time;
+  _ref_ms = ms;
+  _ref_tick = tick;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void panel_time_set(uint32_t time, uint8_t frac)
+{
+  const uint16_t ms = (uint16_t)(((uint32_t)frac * 1000) >> 8);
+
+  UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+  const TickType_t tick = xTaskGetTickCountFromISR();
+
+  if (_time_valid)
+  {
+    _measure_drift(time, ms, tick);
+  }
+  else
+  {
+    _ref_time = time;
+    _ref_ms = ms;
+    _ref_tick = tick;
+  }
+
+  _time = time;
+  _time_ms = ms;
+  _time_tick = tick;
+  _time_valid = true;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+}
+
+bool panel_time_get(uint32_t * ptr_time)
+{
+  portENTER_CRITICAL();
+  const bool valid = _time_valid;
+  const uint32_t time = _time;
+  const uint32_t elapsed_ms = _time_ms + (xTaskGetTickCount() - _time_tick) * portTICK_PERIOD_MS;
+  const int32_t drift_ppm = _drift_ppm;
+  portEXIT_CRITICAL();
+
+  // Correction is less than elapsed time (PANEL_TIME_DRIFT_MAX_PPM).
+  const int32_t correction_ms = (int32_t)((int64_t)elapsed_ms * drift_ppm / 1000000);
+  *ptr_time = time + (elapsed_ms + correction_ms) / 1000;
+
+  return valid;
+}
+
+bool panel_time_get_drift(int16_t * ptr_drift_ppm)
+{
+  portENTER_CRITICAL();
+  *ptr_drift_ppm = (int16_t)_drift_ppm;
+  const bool valid = _drift_valid;
+  portEXIT_CRITICAL();
+
+  return valid;
+}
+
+uint32_t panel_time_since_sync(void)
+{
+  if (!_time_valid) return UINT32_MAX;
+  return (xTaskGetTickCount() - _time_tick) / configTICK_RATE_HZ;
+}
+
+uint32_t panel_time_uptime(void)
+{
+  return xTaskGetTickCount() / configTICK_RATE_HZ;
+}
@@ -0,0 +1,72 @@
+/**
+ *  @file
+ *  @brief Wall-clock time of the panel.
+ *
+ *  Time is received from master (FC_ALIVE) and kept by tick counter between
+ *  broadcasts. Panel has no time after reset until the first broadcast.
+ *
+ *  Drift of the tick counter (internal oscillator) is estimated from broadcasts
+ *  at least PANEL_TIME_DRIFT_WINDOW_MS apart and corrected while master is offline.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef PANEL_TIME_H_
+#define PANEL_TIME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Configuration of the panel time. */
+#define PANEL_TIME_DRIFT_WINDOW_MS (5 * 60 * 1000UL) // Minimal interval of drift measurement.
+#define PANEL_TIME_DRIFT_MAX_PPM   20000 // Larger difference is step of master clock (not drift).
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+/**
+* @brief Set time received from master.
+*
+*        Called from interrupt.
+*
+* @param time ... Master time (seconds since 1970-01-01 UTC).
+* @param frac ... Fraction of second (1/256 s).
+*/
+void panel_time_set(uint32_t time, uint8_t frac);
+
+/**
+* @brief Get current time.
+*
+* @param ptr_time ... Current time (seconds since 1970-01-01 UTC).
+*
+* @return false if time was not received since reset
+*/
+bool panel_time_get(uint32_t * ptr_time);
+
+/**
+* @brief Get drift correction of the tick counter.
+*
+* @param ptr_drift_ppm ... Correction in ppm (positive if tick counter is slow).
+*
+* @return false if drift was not measured yet
+*/
+bool panel_time_get_drift(int16_t * ptr_drift_ppm);
+
+/**
+* @brief Get time since the last broadcast.
+*
+* @return seconds (UINT32_MAX if time was not received since reset)
+*/
+uint32_t panel_time_since_sync(void);
+
+/**
+* @brief Get time since reset.
+*
+* @return seconds since reset (wraps after 49 days)
+*/
+uint32_t panel_time_uptime(void);
+
+#endif /* PANEL_TIME_H_ */
@@ -15,15 +15,21 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
-#include "timers.h"
 #include "watchdog.h"
 #include "brownout.h"
 #include "storage.h"
+#include "storage_service.h"
+#include "timer_wheel.h"
+#include "profiler.h"
+#include "diag.h"
 
 /*****************************************************************************
  * Private types/enumerations/variables
  ****************************************************************************/
 
+// Memory for kernel tasks (no heap is used).
+static StaticTask_t _idle_task_tcb;
+static StackType_t _idle_task_stack[configMINIMAL_STACK_SIZE];
 
 /*****************************************************************************
  * Public types/enumerations/variables
@@ -46,8 +52,8 @@ static void _check_system_stack_size(void)
 	Note - this is separate to the stacks that are used by tasks.  The stacks
 	that are used by tasks are automatically checked if
 	configCHECK_FOR_STACK_OVERFLOW is not 0 in FreeRTOSConfig.h - but the stack
-	used by interrupts is not.  Reducing the conifgTOTAL_HEAP_SIZE setting will
-	increase the stack available to main() and interrupts. */
+	used by interrupts is not.  All RAM is allocated statically, so the stack
+	size is set in the linker script. */
 	ulInterruptStackSize = ( ( unsigned long ) _vStackTop ) - ( ( unsigned long ) _pvHeapStart );
 	configASSERT( ulInterruptStackSize > 350UL );
 
@@ -70,9 +76,18 @@ int main(void)
 
   Board_Print_Reset_Reason();
 
+  // Run time counter (10kHz) measures start-up until scheduler restarts it.
+  vConfigureTimerForRunTimeStats();
+
+#if PROFILER_ENABLED
+  profiler_init();
+#endif
+
   WDT_Init(HW_WATCHDOG_TIMEOUT);
 
   storage_init();
+  storage_service_init();
+  timer_wheel_init();
 
   __enable_irq();
 
@@ -84,6 +99,8 @@ int main(void)
 
   _check_system_stack_size();
 
+  diag_boot_init(ulGetRunTimeCounterValue() / 10);
+
   // Start the kernel.  From here on, only tasks and interrupts will run.
   vTaskStartScheduler();
 
@@ -108,20 +125,18 @@ void vConfigureTimerForRunTimeStats(void)
   Chip_TIMER_Enable(LPC_TIMER32_0);
 }
 
-void vApplicationMallocFailedHook(void)
+uint32_t ulGetRunTimeCounterValue(void)
 {
-	/* vApplicationMallocFailedHook() will only be called if
-	configUSE_MALLOC_FAILED_HOOK is set to 1 in FreeRTOSConfig.h.  It is a hook
-	function that will get called if a call to pvPortMalloc() fails.
-	pvPortMalloc() is called internally by the kernel whenever a task, queue,
-	timer or semaphore is created.  It is also called by various parts of the
-	demo application.  If heap_1.c or heap_2.c are used, then the size of the
-	heap available to pvPortMalloc() is defined by configTOTAL_HEAP_SIZE in
-	FreeRTOSConfig.h, and the xPortGetFreeHeapSize() API function can be used
-	to query the size of free heap space that remains (although it does not
-	provide information on how the remaining heap might be fragmented). */
-	taskDISABLE_INTERRUPTS();
-	for( ;; );
+  return Chip_TIMER_ReadCount(LPC_TIMER32_0);
+}
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize)
+{
+	/* Memory for the idle task is provided by application when
+	configSUPPORT_STATIC_ALLOCATION is set to 1 in FreeRTOSConfig.h. */
+	*ppxIdleTaskTCBBuffer = &_idle_task_tcb;
+	*ppxIdleTaskStackBuffer = _idle_task_stack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
 }
 
 void vApplicationIdleHook(void)
@@ -156,5 +171,6 @@ void vApplicationTickHook( void )
 	added here, but the tick hook is called from an interrupt context, so
 	code must not attempt to block, and only the interrupt safe FreeRTOS API
 	functions can be used (those that end in FromISR()). */
+	timer_wheel_tick();
 }
 
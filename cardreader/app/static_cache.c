@@ -1,9 +1,9 @@
 /**
  *  @file
- *  @brief Statically allocated cache for user IDs.
+ *  @brief Statically allocated cache for user IDs (set associative engine).
  *
  *  It is similar to Set Associative Cache.
- *  Place key and value into sets by key hash. Each set is a sorted array.
+ *  Place key and value into sets by low key bits. Each set is a sorted array.
  *
  *  @author Petr Elexa
  *  @see LICENSE
@@ -13,7 +13,7 @@
 #include "static_cache.h"
 #include <string.h>
 
-#if CACHING_ENABLED
+#if CACHING_ENABLED && (STATIC_CACHE_ENGINE == STATIC_CACHE_ENGINE_SET_ASSOC)
 
 /*****************************************************************************
  * Private types/enumerations/variables
@@ -21,23 +21,12 @@
 
 typedef struct
 {
-  cache_item_t * const ptr_items;
+  cache_item_t items[STATIC_CACHE_SET_CAP];
   int length;
 } cache_set_t;
 
 // Allocate cache in memory.
-static cache_item_t _cache_set_0[STATIC_CACHE_SET_CAP];
-static cache_item_t _cache_set_1[STATIC_CACHE_SET_CAP];
-static cache_item_t _cache_set_2[STATIC_CACHE_SET_CAP];
-static cache_item_t _cache_set_3[STATIC_CACHE_SET_CAP];
-
-static cache_set_t _cache_sets[STATIC_CACHE_SETS]
-                                       = {
-                                           {_cache_set_0, 0},
-                                           {_cache_set_1, 0},
-                                           {_cache_set_2, 0},
-                                           {_cache_set_3, 0}
-                                       };
+static cache_set_t _cache_sets[STATIC_CACHE_SETS];
 
 /*****************************************************************************
  * Private functions
@@ -52,9 +41,10 @@ static bool _binary_search(const cache_set_t * ptr_set, const cache_item_t kv, i
 
   while (down <= top)
   {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_SEARCH);
     mid = (down + top) / 2;
-    if (ptr_set->ptr_items[mid].key > kv.key) top = mid - 1;
-    else if (ptr_set->ptr_items[mid].key < kv.key) down = mid + 1;
+    if (ptr_set->items[mid].key > kv.key) top = mid - 1;
+    else if (ptr_set->items[mid].key < kv.key) down = mid + 1;
     else
     {
       *ptr_idx = mid;
@@ -65,11 +55,11 @@ static bool _binary_search(const cache_set_t * ptr_set, const cache_item_t kv, i
   return false; // Not found.
 }
 
-// Retrieve cache set the key should be in. Decide from first two bits.
+// Retrieve cache set the key should be in. Decide from low key bits.
 // O(1)
 static inline cache_set_t * _get_cache_set(const cache_item_t kv)
 {
-  return &_cache_sets[(kv.key & 0x3)];
+  return &_cache_sets[(kv.key & (STATIC_CACHE_SETS - 1))];
 }
 
 /*****************************************************************************
@@ -84,7 +74,7 @@ bool static_cache_get(cache_item_t * ptr_kv)
   if (_binary_search(ptr_set, *ptr_kv, &idx))
   {
     // Found.
-    *ptr_kv = ptr_set->ptr_items[idx];
+    *ptr_kv = ptr_set->items[idx];
     return true;
   }
   else
@@ -101,23 +91,25 @@ void static_cache_insert(const cache_item_t kv)
   int idx = 0;
   if (_binary_search(ptr_set, kv, &idx))
   {
-    ptr_set->ptr_items[idx] = kv; // Update existing item.
+    ptr_set->items[idx] = kv; // Update existing item.
   }
   else
   {
-    if ( 1 + ptr_set->length >= STATIC_CACHE_SET_CAP)
+    if (ptr_set->length >= STATIC_CACHE_SET_CAP)
     {
-      // Cache set full - replace existing.
-      ptr_set->ptr_items[idx] = kv;
+      // Cache set full - replace neighbour (the set stays sorted).
+      if (idx == ptr_set->length) --idx;
+      ptr_set->items[idx] = kv;
     }
     else
     {
       // Move items and place new one.
       for (int i = ptr_set->length - 1; i >= idx; --i)
       {
-        ptr_set->ptr_items[i + 1] = ptr_set->ptr_items[i];
+        STATIC_CACHE_COUNT(STATIC_CACHE_EV_MOVE);
+        ptr_set->items[i + 1] = ptr_set->items[i];
       }
-      ptr_set->ptr_items[idx] = kv;
+      ptr_set->items[idx] = kv;
       ++ptr_set->length;
     }
   }
@@ -133,7 +125,8 @@ void static_cache_erase(const cache_item_t kv)
     // Key was found - delete and fill the empty position.
     for (int i = idx; i < ptr_set->length - 1; ++i)
     {
-      ptr_set->ptr_items[i] = ptr_set->ptr_items[i + 1];
+      STATIC_CACHE_COUNT(STATIC_CACHE_EV_MOVE);
+      ptr_set->items[i] = ptr_set->items[i + 1];
     }
     --ptr_set->length;
   }
@@ -141,10 +134,52 @@ void static_cache_erase(const cache_item_t kv)
 
 void static_cache_reset(void)
 {
-  for (int i = 0; i < STATIC_CACHE_SETS; ++i)
+  memset(_cache_sets, 0, sizeof(_cache_sets));
+}
+
+bool static_cache_check(void)
+{
+  for (int set_idx = 0; set_idx < STATIC_CACHE_SETS; ++set_idx)
   {
-    memset(_cache_sets[i].ptr_items, 0, STATIC_CACHE_SET_CAP);
+    const cache_set_t * ptr_set = &_cache_sets[set_idx];
+
+    if (ptr_set->length < 0 || ptr_set->length > STATIC_CACHE_SET_CAP) return false;
+
+    for (int i = 0; i < ptr_set->length; ++i)
+    {
+      if (_get_cache_set(ptr_set->items[i]) != ptr_set) return false;
+      if (i > 0 && ptr_set->items[i - 1].key >= ptr_set->items[i].key) return false;
+    }
   }
+  return true;
+}
+
+bool static_cache_compact(void)
+{
+  return false; // Sets have no tombstones.
+}
+
+uint16_t static_cache_tombstones(void)
+{
+  return 0;
+}
+
+uint16_t static_cache_home(const cache_item_t kv)
+{
+  return (uint16_t)(kv.key & (STATIC_CACHE_SETS - 1));
+}
+
+bool static_cache_next(uint16_t home, cache_item_t * ptr_kv)
+{
+  const cache_set_t * ptr_set = &_cache_sets[home];
+
+  // Position of the key or of the first greater key.
+  int idx = 0;
+  if (_binary_search(ptr_set, *ptr_kv, &idx)) ++idx;
+  if (idx >= ptr_set->length) return false;
+
+  *ptr_kv = ptr_set->items[idx];
+  return true;
 }
 
 cache_item_t static_cache_convert(uint32_t key, uint32_t value)
@@ -153,4 +188,13 @@ cache_item_t static_cache_convert(uint32_t key, uint32_t value)
   return kv;
 }
 
+bool static_cache_key(uint32_t id, cache_item_t * ptr_kv)
+{
+  if (id == 0 || id > STATIC_CACHE_KEY_MAX) return false;
+
+  ptr_kv->scalar = 0;
+  ptr_kv->key = id;
+  return true;
+}
+
 #endif
@@ -2,10 +2,16 @@
  *  @file
  *  @brief Statically allocated cache for user IDs.
  *
- *  It is similar to Set Associative Cache.
- *  Divide key and value into sets by key hash. Each set is a sorted array.
+ *  Two engines are available behind the same interface (see STATIC_CACHE_ENGINE):
  *
- *  The key in cache can be up to 30 bits in size.
+ *  Set associative - divide key and value into sets by key bits. Each set is a sorted array.
+ *
+ *  Robin Hood - open addressing hash table with linear probing and Robin Hood displacement.
+ *               Keys are spread by integer mixer so sequentially issued cards do not cluster.
+ *               Probe length is bounded, item with too long probe sequence is evicted.
+ *
+ *  The key in cache can be up to (32 - STATIC_CACHE_VALUE_BITS) bits in size. Key 0 is reserved.
+ *  Longer user ID must not be cached (see static_cache_key) - it would share the key with other ID.
  *
  *  @author Petr Elexa
  *  @see LICENSE
@@ -19,10 +25,48 @@
 #include <stdbool.h>
 #include "terminal_config.h"
 
-/** Configuration of the static cache. */
-#define STATIC_CACHE_SETS     4
+/** Available cache engines. */
+#define STATIC_CACHE_ENGINE_SET_ASSOC  0
+#define STATIC_CACHE_ENGINE_ROBIN_HOOD 1
+
+/** Selected cache engine. */
+#ifndef STATIC_CACHE_ENGINE
+#define STATIC_CACHE_ENGINE STATIC_CACHE_ENGINE_ROBIN_HOOD
+#endif
+
+/** Configuration of the static cache (can be overridden for benchmark, see host/cache_bench.c). */
+#define STATIC_CACHE_VALUE_BITS ACS_READER_MAXCOUNT // Permission bit for each door.
+#define STATIC_CACHE_KEY_MAX    ((1UL << (32 - STATIC_CACHE_VALUE_BITS)) - 1)
+
+#if STATIC_CACHE_ENGINE == STATIC_CACHE_ENGINE_SET_ASSOC
+#ifndef STATIC_CACHE_SETS
+#define STATIC_CACHE_SETS     4    // Power of 2, set is selected by low key bits.
 #define STATIC_CACHE_SET_CAP  128
+#endif
 #define STATIC_CACHE_CAPACITY (STATIC_CACHE_SET_CAP * STATIC_CACHE_SETS)
+#define STATIC_CACHE_HOMES    STATIC_CACHE_SETS // Home of the key is its set.
+#if (STATIC_CACHE_SETS & (STATIC_CACHE_SETS - 1)) != 0
+#error "STATIC_CACHE_SETS must be power of 2."
+#endif
+#else
+#ifndef STATIC_CACHE_CAPACITY
+#define STATIC_CACHE_CAPACITY  576 // RAM left by statically allocated RTOS objects (link fails if exceeded).
+#define STATIC_CACHE_MAX_PROBE 16  // Maximal distance of item from its home slot.
+#endif
+#define STATIC_CACHE_MAX_STEPS (2 * STATIC_CACHE_MAX_PROBE) // Maximal number of slots visited by insert.
+#define STATIC_CACHE_HOMES     STATIC_CACHE_CAPACITY // Home of the key is its home slot.
+#endif
+
+/** Events counted by benchmark (no code is generated in firmware). */
+#define STATIC_CACHE_EV_SEARCH 0  // Binary search step.
+#define STATIC_CACHE_EV_MOVE   1  // Item moved to other position.
+#define STATIC_CACHE_EV_HASH   2  // Key hashed.
+#define STATIC_CACHE_EV_PROBE  3  // Slot visited.
+#define STATIC_CACHE_EV_COUNT  4
+
+#ifndef STATIC_CACHE_COUNT
+#define STATIC_CACHE_COUNT(event)
+#endif
 
 
 /*****************************************************************************
@@ -35,8 +79,8 @@ typedef union
 {
   struct
   {
-    uint32_t value : 2;
-    uint32_t key : 30;
+    uint32_t value : STATIC_CACHE_VALUE_BITS;
+    uint32_t key : 32 - STATIC_CACHE_VALUE_BITS;
   };
   uint32_t scalar;
 } cache_item_t;  ///< Generic type of the item used in cache.
@@ -51,7 +95,8 @@ typedef union
 /**
 * @brief Retrieve item from the cache.
 *
-*        Complexity is O(log(STATIC_CACHE_SET_CAP)).
+*        Complexity is O(log(STATIC_CACHE_SET_CAP)) for set associative engine
+*        and O(STATIC_CACHE_MAX_PROBE) for Robin Hood engine.
 *
 * @param ptr_kv ... Pointer to cache_item_t containing key. The value will be filled in
 *                   if key is found.
@@ -63,10 +108,13 @@ bool static_cache_get(cache_item_t * ptr_kv);
 /**
 * @brief Insert item to the cache.
 *
-*        Will overwrite items already in cache if the cache is full. Will also update item
+*        Will overwrite items already in cache if the cache is full (set associative engine
+*        evicts neighbour of the new key so the set stays sorted). Will also update item
 *        with same key.
 *
-*        Complexity is O(log(STATIC_CACHE_SET_CAP) + 2*(STATIC_CACHE_SET_CAP)).
+*        Complexity is O(log(STATIC_CACHE_SET_CAP) + 2*(STATIC_CACHE_SET_CAP)) for set associative
+*        engine and O(STATIC_CACHE_MAX_PROBE + STATIC_CACHE_MAX_STEPS) for Robin Hood engine
+*        (safe to be called from interrupt).
 *
 * @param kv ... Key and value to be inserted.
 */
@@ -75,7 +123,10 @@ void static_cache_insert(const cache_item_t kv);
 /**
 * @brief Erase item from the cache.
 *
-*        Complexity is O(log(STATIC_CACHE_SET_CAP) + 2*(STATIC_CACHE_SET_CAP)).
+*        Complexity is O(log(STATIC_CACHE_SET_CAP) + 2*(STATIC_CACHE_SET_CAP)) for set associative
+*        engine and O(2*STATIC_CACHE_MAX_PROBE) for Robin Hood engine (backward shift of at most
+*        STATIC_CACHE_MAX_PROBE items, longer probe sequence is kept by tombstone - see
+*        @ref static_cache_compact).
 *
 * @param kv ... Key containing key to be erased. The item will erased
 *                   if key is found.
@@ -91,6 +142,65 @@ void static_cache_erase(const cache_item_t kv);
 */
 void static_cache_reset(void);
 
+/**
+* @brief Reclaim slot of erased item.
+*
+*        Robin Hood erase leaves tombstone when following items can not be moved within its bound.
+*        Each call continues the scan of the table and moves following items back over the first
+*        tombstone found. Visits at most 2 * STATIC_CACHE_MAX_STEPS slots (set associative engine
+*        has no tombstones). Call from task, cache must not be modified meanwhile.
+*
+* @return True if tombstone was found (more of them can follow).
+*/
+bool static_cache_compact(void);
+
+/**
+* @brief Get number of tombstones (slots not usable until they are reclaimed).
+*
+* @return tombstone count (0 for set associative engine).
+*/
+uint16_t static_cache_tombstones(void);
+
+/**
+* @brief Check internal consistency of the cache.
+*
+*        Set associative engine: every set is sorted, within its capacity and holds
+*        only keys which belong to it.
+*        Robin Hood engine: every item is within STATIC_CACHE_MAX_PROBE from its home slot,
+*        can be found and probe sequences are ordered.
+*
+*        Complexity is O(STATIC_CACHE_CAPACITY) - intended for debugging and benchmark.
+*
+* @return true if consistent.
+*/
+bool static_cache_check(void);
+
+/**
+* @brief Get home of the key (set for set associative engine, home slot for Robin Hood engine).
+*
+*        Items are ordered by home and by key within the home. Insert, erase and compaction do not
+*        change this order, so the cache can be walked by @ref static_cache_next while it is modified.
+*
+* @param kv ... Item with the key.
+*
+* @return home (less than STATIC_CACHE_HOMES).
+*/
+uint16_t static_cache_home(const cache_item_t kv);
+
+/**
+* @brief Retrieve item with the lowest key above given key in the home.
+*
+*        Complexity is O(log(STATIC_CACHE_SET_CAP)) for set associative engine
+*        and O(STATIC_CACHE_MAX_PROBE) for Robin Hood engine.
+*
+* @param home ... Home to search (less than STATIC_CACHE_HOMES).
+* @param ptr_kv ... Pointer to cache_item_t containing previous key (0 for the first item of the home).
+*                   The item will be filled in if found.
+*
+* @return true if item is found.
+*/
+bool static_cache_next(uint16_t home, cache_item_t * ptr_kv);
+
 /**
 * @brief Create cache item from key and value parameters.
 *
@@ -102,5 +212,17 @@ void static_cache_reset(void);
 */
 cache_item_t static_cache_convert(uint32_t key, uint32_t value);
 
+/**
+* @brief Create cache item for user ID.
+*
+*        ID above STATIC_CACHE_KEY_MAX does not fit the key (upper bits would be lost).
+*
+* @param id ... User ID.
+* @param ptr_kv ... Pointer to cache_item_t which gets the key (value is zero).
+*
+* @return True if ID can be cached (it fits the key and is not reserved).
+*/
+bool static_cache_key(uint32_t id, cache_item_t * ptr_kv);
+
 
 #endif /* STATIC_CACHE_H_ */
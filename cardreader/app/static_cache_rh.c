@@ -0,0 +1,344 @@
+/**
+ *  @file
+ *  @brief Statically allocated cache for user IDs (Robin Hood engine).
+ *
+ *  Open addressing hash table with linear probing. Item which is further from its
+ *  home slot takes the place of item which is closer to its home slot (Robin Hood).
+ *  This keeps probe sequences short and allows early termination of lookups.
+ *
+ *  Insert visits at most STATIC_CACHE_MAX_STEPS slots and no item is placed further
+ *  than STATIC_CACHE_MAX_PROBE from its home slot. Item which does not fit is evicted.
+ *  Empty slot is marked by zero item (key 0 is reserved).
+ *
+ *  Erase shifts following items of the probe sequence back by at most STATIC_CACHE_MAX_PROBE
+ *  slots (it runs from CAN interrupt). Longer sequence is kept by tombstone - slot which
+ *  does not end lookups and is not reused by insert. Tombstones are reclaimed from task by
+ *  static_cache_compact which moves following items back over them.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "static_cache.h"
+#include <string.h>
+
+#if CACHING_ENABLED && (STATIC_CACHE_ENGINE == STATIC_CACHE_ENGINE_ROBIN_HOOD)
+
+#if STATIC_CACHE_CAPACITY > 0xFFFF
+#error "STATIC_CACHE_CAPACITY must fit in 16 bits."
+#endif
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define CACHE_EMPTY_SLOT 0
+#define CACHE_TOMBSTONE  ((1UL << STATIC_CACHE_VALUE_BITS) - 1) // Key 0 with all permission bits.
+
+// Allocate cache in memory.
+static cache_item_t _cache_table[STATIC_CACHE_CAPACITY];
+
+// Tombstones in the table and next slot to be checked by compaction.
+static uint16_t _tombstones = 0;
+static uint32_t _compact_slot = 0;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Integer mixer (finalizer with good avalanche). Sequential keys are spread over the table.
+static inline uint32_t _hash(uint32_t key)
+{
+  STATIC_CACHE_COUNT(STATIC_CACHE_EV_HASH);
+  key ^= key >> 16;
+  key *= 0x7FEB352DUL;
+  key ^= key >> 15;
+  key *= 0x846CA68BUL;
+  key ^= key >> 16;
+  return key;
+}
+
+// Slot where the key should be placed if there is no collision.
+// Upper hash bits are scaled to table size (no division, capacity need not be power of 2).
+static inline uint32_t _home_slot(uint32_t key)
+{
+  return ((_hash(key) >> 16) * STATIC_CACHE_CAPACITY) >> 16;
+}
+
+// Following slot (wraps around the table).
+static inline uint32_t _next_slot(uint32_t slot)
+{
+  return (slot + 1 < STATIC_CACHE_CAPACITY ? slot + 1 : 0);
+}
+
+// Slot holds an item (not empty and not tombstone).
+static inline bool _is_item(const cache_item_t item)
+{
+  return item.key != 0;
+}
+
+// Distance of the item in slot from its home slot.
+static inline uint32_t _probe_dist(const cache_item_t kv, uint32_t slot)
+{
+  uint32_t home = _home_slot(kv.key);
+  return (slot >= home ? slot - home : slot + STATIC_CACHE_CAPACITY - home);
+}
+
+// Find slot with the key.
+// O(STATIC_CACHE_MAX_PROBE)
+static bool _find_slot(const cache_item_t kv, uint32_t * ptr_slot)
+{
+  uint32_t slot = _home_slot(kv.key);
+
+  for (uint32_t dist = 0; dist <= STATIC_CACHE_MAX_PROBE; ++dist)
+  {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_PROBE);
+    const cache_item_t item = _cache_table[slot];
+
+    if (item.scalar == CACHE_EMPTY_SLOT) return false; // End of probe sequence.
+    if (item.scalar == CACHE_TOMBSTONE)
+    {
+      slot = _next_slot(slot); // Erased item - sequence continues.
+      continue;
+    }
+    if (item.key == kv.key)
+    {
+      *ptr_slot = slot;
+      return true; // Found.
+    }
+    // Key would have displaced this item if it was present.
+    if (_probe_dist(item, slot) < dist) return false;
+
+    slot = _next_slot(slot);
+  }
+  return false; // Not found.
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool static_cache_get(cache_item_t * ptr_kv)
+{
+  uint32_t slot;
+  if (ptr_kv->key != 0 && _find_slot(*ptr_kv, &slot))
+  {
+    // Found.
+    *ptr_kv = _cache_table[slot];
+    return true;
+  }
+  else
+  {
+    // Not found.
+    return false;
+  }
+}
+
+void static_cache_insert(const cache_item_t kv)
+{
+  if (kv.key == 0) return; // Reserved.
+
+  uint32_t slot;
+  if (_find_slot(kv, &slot))
+  {
+    _cache_table[slot] = kv; // Update existing item.
+    return;
+  }
+
+  cache_item_t carry = kv;
+  uint32_t dist = 0;
+  slot = _home_slot(kv.key);
+
+  for (uint32_t step = 0; step < STATIC_CACHE_MAX_STEPS; ++step)
+  {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_PROBE);
+    cache_item_t item = _cache_table[slot];
+
+    if (item.scalar == CACHE_EMPTY_SLOT)
+    {
+      _cache_table[slot] = carry; // Free slot found.
+      return;
+    }
+
+    // Tombstone is passed like item which is never displaced.
+    uint32_t item_dist = (_is_item(item) ? _probe_dist(item, slot) : dist);
+    if (item_dist < dist)
+    {
+      // Take from the rich - continue with the displaced item.
+      STATIC_CACHE_COUNT(STATIC_CACHE_EV_MOVE);
+      _cache_table[slot] = carry;
+      carry = item;
+      dist = item_dist;
+    }
+
+    slot = _next_slot(slot);
+    if (++dist > STATIC_CACHE_MAX_PROBE) break;
+  }
+  // Carried item does not fit - it is evicted from the cache.
+}
+
+void static_cache_erase(const cache_item_t kv)
+{
+  uint32_t slot;
+  if (kv.key == 0 || !_find_slot(kv, &slot)) return;
+
+  // Key was found - shift following items of the probe sequence back by one slot.
+  uint32_t next = _next_slot(slot);
+  for (uint32_t moved = 0; moved < STATIC_CACHE_MAX_PROBE; ++moved)
+  {
+    const cache_item_t item = _cache_table[next];
+    if (!_is_item(item) || _probe_dist(item, next) == 0) break;
+
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_MOVE);
+    _cache_table[slot] = item;
+    slot = next;
+    next = _next_slot(next);
+  }
+
+  // Slot can be empty only at the end of probe sequence.
+  const cache_item_t item = _cache_table[next];
+  if (item.scalar == CACHE_EMPTY_SLOT || (_is_item(item) && _probe_dist(item, next) == 0))
+  {
+    _cache_table[slot].scalar = CACHE_EMPTY_SLOT;
+  }
+  else
+  {
+    _cache_table[slot].scalar = CACHE_TOMBSTONE;
+    _tombstones++;
+  }
+}
+
+void static_cache_reset(void)
+{
+  memset(_cache_table, 0, sizeof(_cache_table));
+  _tombstones = 0;
+}
+
+bool static_cache_check(void)
+{
+  uint32_t tombstones = 0;
+
+  for (uint32_t slot = 0; slot < STATIC_CACHE_CAPACITY; ++slot)
+  {
+    const cache_item_t item = _cache_table[slot];
+    if (item.scalar == CACHE_TOMBSTONE) tombstones++;
+    if (item.scalar == CACHE_EMPTY_SLOT || item.scalar == CACHE_TOMBSTONE) continue;
+
+    uint32_t found_slot;
+    if (item.key == 0) return false;
+    if (_probe_dist(item, slot) > STATIC_CACHE_MAX_PROBE) return false;
+    if (!_find_slot(item, &found_slot) || found_slot != slot) return false; // Lost or duplicate.
+
+    // Distance grows by at most one along the probe sequence.
+    uint32_t next = _next_slot(slot);
+    if (_is_item(_cache_table[next]) &&
+        _probe_dist(_cache_table[next], next) > _probe_dist(item, slot) + 1) return false;
+  }
+  return tombstones == _tombstones;
+}
+
+bool static_cache_compact(void)
+{
+  // Find next tombstone.
+  uint32_t hole = _compact_slot;
+  uint32_t step = 0;
+  for (; step < STATIC_CACHE_MAX_STEPS; ++step)
+  {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_PROBE);
+    if (_cache_table[hole].scalar == CACHE_TOMBSTONE) break;
+    hole = _next_slot(hole);
+  }
+  if (step == STATIC_CACHE_MAX_STEPS)
+  {
+    _compact_slot = hole; // Continue with the next call.
+    return false;
+  }
+  _compact_slot = _next_slot(hole);
+
+  // Move following items of the probe sequence back over tombstones. Items are ordered by home
+  // slot, so the first item which would get before its home ends the sequence of the hole.
+  uint32_t slot = hole;
+  uint32_t gap = 0;
+  for (step = 0; step < STATIC_CACHE_MAX_STEPS; ++step)
+  {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_PROBE);
+    slot = _next_slot(slot);
+    gap++;
+    const cache_item_t item = _cache_table[slot];
+
+    if (item.scalar == CACHE_TOMBSTONE && gap <= STATIC_CACHE_MAX_PROBE) continue;
+    if (!_is_item(item) || _probe_dist(item, slot) < gap)
+    {
+      // No following item has its home at or before the hole (not even behind more than
+      // STATIC_CACHE_MAX_PROBE tombstones).
+      _cache_table[hole].scalar = CACHE_EMPTY_SLOT;
+      _tombstones--;
+      return true;
+    }
+
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_MOVE);
+    _cache_table[hole] = item;
+    _cache_table[slot].scalar = CACHE_TOMBSTONE;
+    hole = slot;
+    gap = 0;
+  }
+  return true; // Tombstone was moved forward - it is reclaimed by later call.
+}
+
+uint16_t static_cache_tombstones(void)
+{
+  return _tombstones;
+}
+
+uint16_t static_cache_home(const cache_item_t kv)
+{
+  return (uint16_t)_home_slot(kv.key);
+}
+
+bool static_cache_next(uint16_t home, cache_item_t * ptr_kv)
+{
+  uint32_t slot = home;
+  bool found = false;
+  cache_item_t next = {.scalar = CACHE_EMPTY_SLOT};
+
+  // Items of the home follow each other in the probe sequence (not in order of keys).
+  for (uint32_t dist = 0; dist <= STATIC_CACHE_MAX_PROBE; ++dist)
+  {
+    STATIC_CACHE_COUNT(STATIC_CACHE_EV_PROBE);
+    const cache_item_t item = _cache_table[slot];
+
+    if (item.scalar == CACHE_EMPTY_SLOT) break; // End of probe sequence.
+    if (_is_item(item))
+    {
+      uint32_t item_dist = _probe_dist(item, slot);
+      if (item_dist < dist) break; // Items of following homes.
+      if (item_dist == dist && item.key > ptr_kv->key && (!found || item.key < next.key))
+      {
+        next = item;
+        found = true;
+      }
+    }
+    slot = _next_slot(slot);
+  }
+
+  if (found) *ptr_kv = next;
+  return found;
+}
+
+cache_item_t static_cache_convert(uint32_t key, uint32_t value)
+{
+  cache_item_t kv = {.key = key, .value = value};
+  return kv;
+}
+
+bool static_cache_key(uint32_t id, cache_item_t * ptr_kv)
+{
+  if (id == 0 || id > STATIC_CACHE_KEY_MAX) return false;
+
+  ptr_kv->scalar = 0;
+  ptr_kv->key = id;
+  return true;
+}
+
+#endif
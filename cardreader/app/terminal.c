@@ -14,14 +14,29 @@
 #include "weigand.h"
 #include "watchdog.h"
 #include "static_cache.h"
+#include "cache_journal.h"
+#include "event_log.h"
+#include "panel_time.h"
+#include "diag.h"
+#include "profiler.h"
+#include "timer_wheel.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "stream_buffer.h"
 #include "can/can_term_driver.h"
 #include "acs_can_protocol.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
+#if ACS_READER_MAXCOUNT > ACS_MSGOBJ_DOOR_LIMIT
+#error "Not enough CAN message objects for all readers."
+#endif
+
+#if DATA_CONFIG_PARAM_COUNT > STORE_DOOR_PARAMS
+#error "Not enough space for door parameters in external storage."
+#endif
+
 /*****************************************************************************
  * Private types/enumerations/variables
  ****************************************************************************/
@@ -29,41 +44,230 @@
 // How long to wait for user request.
 static const uint16_t USER_REQUEST_WAIT_MS = 400;
 // This is minimal period between each request.
-// Also controls intensity of door status messages (sent each SEND_DOOR_STATUS_RATE*period).
 static const uint16_t USER_REQUEST_MIN_PERIOD_MS = 1000;
-// Door status update rate (period multiplier)
-static const uint16_t SEND_DOOR_STATUS_RATE = 5;
 
 // Cache entry type mapping to our type.
 typedef cache_item_t term_cache_item_t;  // 4 bytes
 
-// Available cache values.
+// Available cache values (bit for each reader, see map_reader_idx_to_cache).
 enum term_cache_reader
 {
   cache_reader_none = 0,
-  cache_reader_A = 1,
-  cache_reader_B = 2,
-  cache_reader_all = 3
+  cache_reader_all = (1 << ACS_READER_MAXCOUNT) - 1
 };
 
 // Address for currently active master.
 static uint16_t _act_master = ACS_RESERVED_ADDR;
 
-// Flag for master alive broadcast timeout.
-static bool _master_timeout = true;
+// State of each master address (see _terminal_select_master).
+#define MASTER_COUNT (ACS_MSTR_LAST_ADDR - ACS_MSTR_FIRST_ADDR + 1)
+
+typedef struct
+{
+  TickType_t last_seen;    // Tick of the last heartbeat (FC_ALIVE).
+  TickType_t failed_at;    // Tick of failover from the master.
+  bool alive;
+  bool held;               // Master is not used for MASTER_HOLDOFF_MS after failover.
+  bool has_epoch;          // Master sends cache epoch.
+  bool seq_valid;
+  uint8_t seq;             // Last heartbeat sequence number.
+} term_master_t;
+
+static term_master_t _masters[MASTER_COUNT];
+
+// Master is dead when ACS_MASTER_ALIVE_MISSED_MAX heartbeats in a row are missed.
+static const uint16_t MASTER_DEAD_MS = ACS_MASTER_ALIVE_MISSED_MAX * ACS_MASTER_ALIVE_PERIOD_MS +
+                                       ACS_MASTER_ALIVE_JITTER_MS;
+// Active master is replaced by live standby master after one missed heartbeat.
+static const uint16_t MASTER_FAILOVER_MS = ACS_MASTER_ALIVE_PERIOD_MS + ACS_MASTER_ALIVE_JITTER_MS;
+// Failed master gets its panels back only after this time (no flapping on lossy bus).
+static const uint16_t MASTER_HOLDOFF_MS = 6 * ACS_MASTER_ALIVE_PERIOD_MS;
+static const uint16_t MASTER_CHECK_PERIOD_MS = 500;
+
+// Authorization request waiting for response (one for each door).
+typedef struct
+{
+  bool pending;
+  bool retry;         // Request is sent again to the new master after failover.
+  uint16_t master;
+  uint32_t user_id;
+  TickType_t sent;
+} term_auth_req_t;
+
+static term_auth_req_t _auth_req[ACS_READER_MAXCOUNT];
+
+// Timers for response timeout (one for each door).
+static timer_wheel_timer_t _auth_timer[ACS_READER_MAXCOUNT];
+static const uint32_t _auth_timer_id = TERMINAL_AUTH_TIMER_ID;
+
+// Active master failed when it does not answer AUTH_UNANSWERED_MAX requests in a row.
+static const uint16_t AUTH_RESPONSE_TIMEOUT_MS = 1000;
+static const uint8_t AUTH_UNANSWERED_MAX = 2;
+static uint8_t _auth_unanswered = 0;
+static TickType_t _auth_unanswered_since = 0; // Sent tick of the first unanswered request.
 
-// Timer handle for master timeout.
-static TimerHandle_t _act_timer = NULL;
+// Larger gap of sequence numbers is restart of master.
+static const uint8_t ALIVE_SEQ_GAP_MAX = 0x80;
+
+// Timer for checking heartbeats of masters.
+static timer_wheel_timer_t _act_timer;
 
 // Timer ID for master timeout.
 static const uint32_t _act_timer_id = TERMINAL_TIMER_ID;
 
-// Last door open(true) / close(false) status
-static bool _last_door_state[ACS_READER_MAXCOUNT] = {false, false};
+// State of CAN bit rate switch (see FC_BIT_RATE).
+typedef enum
+{
+  bit_rate_idle,
+  bit_rate_prepared,   // Acknowledged to master.
+  bit_rate_pending,    // Switch is scheduled.
+  bit_rate_confirming  // Switched, waiting for master.
+} term_bit_rate_state_t;
+
+typedef struct
+{
+  term_bit_rate_state_t state;
+  uint32_t bit_rate;       // Prepared bit rate.
+  uint32_t previous;       // Bit rate before the switch.
+  bool alive_seen;         // Master is alive at the new bit rate.
+} term_bit_rate_t;
+
+static term_bit_rate_t _bit_rate = {.state = bit_rate_idle};
+
+// Timer for switch and its confirmation.
+static timer_wheel_timer_t _bit_rate_timer;
+static const uint32_t _bit_rate_timer_id = TERMINAL_BIT_RATE_TIMER_ID;
+
+// State of CAN bus-off recovery.
+typedef enum
+{
+  can_bus_ok,
+  can_bus_off,         // Controller is stopped, restart is scheduled.
+  can_bus_recovering   // Restarted, bus must stay without bus-off for CAN_BUS_OFF_STABLE_MS.
+} term_can_state_t;
+
+typedef struct
+{
+  term_can_state_t state;
+  uint8_t failures;        // Bus-off events during recovery (backoff exponent).
+} term_can_recovery_t;
+
+static term_can_recovery_t _can_recovery = {.state = can_bus_ok};
+
+// Timer for restart of CAN controller and end of recovery.
+static timer_wheel_timer_t _can_timer;
+static const uint32_t _can_timer_id = TERMINAL_CAN_TIMER_ID;
+
+// CAN callback functions of on-chip drivers.
+static CCAN_CALLBACKS_T _can_callbacks =
+{
+  term_can_recv,  // Callback for any message received CAN frame which ID
+                  // matches with any of the message objects' masks.
+  term_can_send,  // Callback for every transmitted CAN frame.
+  term_can_error, // Callback for CAN errors.
+  NULL,           // Not used.
+  NULL,           // Not used.
+  NULL,           // Not used.
+  NULL,           // Not used.
+  NULL,           // Not used.
+};
+
+// State of door status reporting.
+typedef struct
+{
+  TickType_t open_since; // Time when door was opened.
+  bool is_open;          // Last reported state.
+  bool held_alarm;       // Held open alarm was reported.
+} term_door_t;
+
+static term_door_t _door[ACS_READER_MAXCOUNT];
+
+// Memory for terminal task.
+#define TERMINAL_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE + 128)
+static StaticTask_t _terminal_task_tcb;
+static StackType_t _terminal_task_stack[TERMINAL_TASK_STACK_SIZE];
+
+#ifdef DOOR_SENSOR_TYPE
+// Task handling door sensor events.
+#define DOOR_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE + 32)
+static TaskHandle_t _door_task_handle = NULL;
+static StaticTask_t _door_task_tcb;
+static StackType_t _door_task_stack[DOOR_TASK_STACK_SIZE];
+#endif
+
+// Diagnostic request waiting for response (one for each door, master waits for response).
+typedef struct
+{
+  bool pending;
+  uint16_t master;    // Requesting master.
+  uint8_t page;       // Requested page.
+} term_diag_req_t;
+
+static term_diag_req_t _diag_req[ACS_READER_MAXCOUNT];
+
+// Configuration request waiting for response (one for each door, master waits for response).
+typedef struct
+{
+  bool pending;
+  uint16_t master;    // Requesting master.
+  acs_msg_data_config_t cmd;
+} term_config_req_t;
+
+static term_config_req_t _config_req[ACS_READER_MAXCOUNT];
 
 // Signal request to clear cache.
 static bool _cache_clear_req = false;
 
+// Signal requests of firmware update (reset to boot loader) and confirmation of trial image.
+static bool _fw_enter_req = false;
+static bool _fw_confirm_req = false;
+
+// Acknowledge of uploaded event batch (see FC_EVENT_LOG).
+static bool _event_ack_req = false;
+static uint8_t _event_ack_batch = 0;
+
+// Upload of event log waits for acknowledge (batch is sent again after timeout).
+static const uint16_t EVENT_ACK_TIMEOUT_MS = 2000;
+// Gap between frames of the batch (they are sent from one message object).
+static const uint8_t EVENT_FRAME_GAP_MS = 2;
+static bool _event_sent = false;
+static TickType_t _event_sent_tick = 0;
+
+// Cache transfer settings (sent to master in flow control).
+static const uint8_t CACHE_XFER_BLOCK_SIZE = 8;
+static const uint8_t CACHE_XFER_ST_MIN_MS = 1;
+
+#if CACHING_ENABLED
+// Loop period while cache transfer waits for the journal.
+static const uint16_t CACHE_XFER_RESUME_MS = 20;
+// Compaction steps per loop of terminal task (each in own critical section).
+static const uint8_t CACHE_COMPACT_STEPS = 8;
+
+// State of cache transfer from master.
+typedef struct
+{
+  uint16_t remaining;  // Items to be received.
+  uint16_t master;     // Sender of the transfer.
+  uint8_t sn;          // Expected sequence number.
+  uint8_t block_left;  // Frames to be received before next flow control.
+  bool waiting;        // Master was told to wait (next block is requested by terminal task).
+} term_cache_xfer_t;
+
+static term_cache_xfer_t _cache_xfer[ACS_READER_MAXCOUNT];
+
+// Cache epoch of last applied update (valid when known).
+static uint16_t _cache_epoch = 0;
+static bool _cache_epoch_valid = false;
+// All masters send the same updates - master which announces epoch behind the cache by at most
+// this has not sent the updates received from other master yet.
+static const uint16_t CACHE_EPOCH_LAG_MAX = 64;
+
+#if CACHE_JOURNAL_ENABLED
+// Doors (bits) whose transfer after cache clear did not finish - epoch is not logged until then.
+static volatile uint8_t _cache_reload = 0;
+#endif
+#endif
+
 /*****************************************************************************
  * Private functions
  ****************************************************************************/
@@ -71,13 +275,145 @@ static bool _cache_clear_req = false;
 // Map reader index to correct cache value.
 static inline uint8_t map_reader_idx_to_cache(uint8_t reader_idx)
 {
-  return (reader_idx == ACS_READER_A_IDX ? cache_reader_A : cache_reader_B);
+  return (uint8_t)(1 << reader_idx);
+}
+
+#if CACHING_ENABLED
+// Insert user to cache and log the change. Can be called from interrupt.
+static void _terminal_cache_insert(term_cache_item_t user)
+{
+#if CACHE_JOURNAL_ENABLED
+  term_cache_item_t cached = user;
+  if (static_cache_get(&cached) && cached.scalar == user.scalar) return; // No change.
+  cache_journal_log(cache_journal_op_insert, user);
+#endif
+  static_cache_insert(user);
+}
+
+#if CACHE_JOURNAL_ENABLED
+// Log current cache epoch (not while cache is reloaded). Can be called from interrupt.
+static void _terminal_cache_log_epoch(void)
+{
+  if (_cache_reload != 0) return; // Partial cache must not be restored as current.
+
+  term_cache_item_t epoch = {.scalar = _cache_epoch};
+  cache_journal_log(cache_journal_op_epoch, epoch);
+}
+#endif
+
+// Clear the cache and log the change. Epoch is logged when transfers to all given doors are done.
+static void _terminal_cache_reset(uint8_t reload_doors)
+{
+  portENTER_CRITICAL(); // Cache is also modified from interrupt.
+  PROFILER_BEGIN(profiler_crit_cache);
+  static_cache_reset();
+  PROFILER_END(profiler_crit_cache);
+#if CACHE_JOURNAL_ENABLED
+  _cache_reload = reload_doors;
+#endif
+  portEXIT_CRITICAL();
+#if CACHE_JOURNAL_ENABLED
+  cache_journal_log(cache_journal_op_clear, static_cache_convert(0, 0));
+#else
+  (void)reload_doors;
+#endif
+}
+
+// Transfer to the door finished - cache is consistent with current epoch when all doors are loaded.
+// Called from interrupt.
+static void _terminal_cache_loaded(uint8_t reader_idx)
+{
+#if CACHE_JOURNAL_ENABLED
+  const uint8_t door = map_reader_idx_to_cache(reader_idx);
+  if ((_cache_reload & door) == 0) return;
+
+  _cache_reload &= ~door;
+  if (_cache_epoch_valid) _terminal_cache_log_epoch();
+#else
+  (void)reader_idx;
+#endif
+}
+
+// Remove user from cache and log the change. Can be called from interrupt.
+static void _terminal_cache_erase(term_cache_item_t user)
+{
+  static_cache_erase(user);
+#if CACHE_JOURNAL_ENABLED
+  cache_journal_log(cache_journal_op_erase, user);
+#endif
+}
+
+// Epoch announced by master does not follow the local one - some updates were missed.
+// Cache is dropped and loaded again. Called from interrupt.
+static void _terminal_cache_epoch_gap(uint16_t epoch)
+{
+  _cache_epoch = epoch;
+  _cache_epoch_valid = true;
+  _cache_clear_req = true;
 }
 
+// Compare cache epoch from master alive message. Called from interrupt.
+static void _terminal_cache_check_epoch(const CCAN_MSG_OBJ_T * ptr_msg)
+{
+  acs_msg_data_alive_t alive;
+  memcpy(&alive, ptr_msg->data, sizeof(alive));
+
+  const uint16_t lag = (uint16_t)(_cache_epoch - alive.cache_epoch); // Wraps when master is ahead.
+  if (!_cache_epoch_valid || lag > CACHE_EPOCH_LAG_MAX)
+  {
+    DEBUGSTR("cache epoch gap\n");
+    _terminal_cache_epoch_gap(alive.cache_epoch);
+  }
+}
+
+// Apply update of single user. Called from interrupt.
+static void _terminal_cache_update(const CCAN_MSG_OBJ_T * ptr_msg)
+{
+  acs_msg_data_cache_update_t update;
+  if (ptr_msg->dlc < sizeof(update)) return;
+  memcpy(&update, ptr_msg->data, sizeof(update));
+
+  // Already applied (updates are sent by all masters).
+  if (_cache_epoch_valid && (int16_t)(update.epoch - _cache_epoch) <= 0) return;
+
+  if (!_cache_epoch_valid || update.epoch != (uint16_t)(_cache_epoch + 1))
+  {
+    DEBUGSTR("cache epoch gap\n");
+    _terminal_cache_epoch_gap(update.epoch);
+    return;
+  }
+
+  _cache_epoch = update.epoch;
+
+  term_cache_item_t user;
+  const bool cacheable = static_cache_key(update.user_id, &user); // Only epoch advances otherwise.
+
+  if (cacheable && update.door_addr == ACS_BROADCAST_ADDR)
+  {
+    _terminal_cache_erase(user);
+  }
+  else if (cacheable)
+  {
+    uint8_t reader_idx = get_reader_idx(update.door_addr);
+
+    if (reader_idx < ACS_READER_MAXCOUNT && reader_conf[reader_idx].enabled)
+    {
+      if (!static_cache_get(&user)) user.value = cache_reader_none;
+      if (update.allow) user.value |= map_reader_idx_to_cache(reader_idx);
+      else user.value &= ~map_reader_idx_to_cache(reader_idx);
+      _terminal_cache_insert(user);
+    }
+  }
+#if CACHE_JOURNAL_ENABLED
+  _terminal_cache_log_epoch();
+#endif
+}
+#endif
+
 static inline void _terminal_user_authorized(uint8_t reader_idx)
 {
   DEBUGSTR("auth OK\n");
-  reader_unlock(reader_idx, BEEP_ON_SUCCESS, OK_LED_ON_SUCCESS);
+  reader_unlock(reader_idx, reader_conf[reader_idx].beep_on_success, reader_conf[reader_idx].ok_led_on_success);
 }
 
 static inline void __terminal_user_not_authorized(uint8_t reader_idx)
@@ -86,39 +422,485 @@ static inline void __terminal_user_not_authorized(uint8_t reader_idx)
   DEBUGSTR("auth FAIL\n");
 }
 
-// Callback for timer dedicated to master master activity.
-static void _timer_callback(TimerHandle_t pxTimer)
+// Start CAN controller and set up receive filters.
+static bool _terminal_can_start(uint32_t bit_rate)
 {
-  configASSERT(pxTimer);
+  if (!CAN_init(&_can_callbacks, bit_rate)) return false;
 
-  // Which timer expired.
-  uint32_t id = (uint32_t) pvTimerGetTimerID(pxTimer);
+  // CAN msg filter for each door.
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    CAN_recv_filter(ACS_MSGOBJ_RECV_DOOR + idx,
+                    get_reader_addr(idx) << ACS_DST_ADDR_OFFSET,
+                    ACS_DST_ADDR_MASK, true);
+  }
+  // CAN msg filter for broadcast.
+  CAN_recv_filter(ACS_MSGOBJ_RECV_BCAST,
+                  ACS_BROADCAST_ADDR << ACS_DST_ADDR_OFFSET,
+                  ACS_DST_ADDR_MASK, true);
+  return true;
+}
 
-  if (id == _act_timer_id)
+// Initialize CAN controller again. Called from timer wheel task.
+static void _terminal_can_restart(uint32_t bit_rate)
+{
+  // Frames in progress are lost, master repeats them.
+  portENTER_CRITICAL();
+  bool started = _terminal_can_start(bit_rate);
+  portEXIT_CRITICAL();
+  configASSERT(started);
+}
+
+// Restart CAN controller with another bit rate. Called from timer wheel task.
+static void _terminal_bit_rate_switch(uint32_t bit_rate)
+{
+  _terminal_can_restart(bit_rate);
+  if (!set_can_bit_rate(bit_rate)) DEBUGSTR("bit rate store fail\n");
+}
+
+// Scheduled switch or end of confirmation window. Called from timer wheel task.
+static void _terminal_bit_rate_timeout(void)
+{
+  if (_bit_rate.state == bit_rate_pending)
   {
-    // Active master timeout after T = 2 * MASTER_ALIVE_TIMEOUT.
-    portENTER_CRITICAL();
-    if (_master_timeout == true)
+    DEBUGSTR("bit rate switch\n");
+    _bit_rate.previous = CAN_get_bit_rate();
+    _bit_rate.alive_seen = false;
+    _bit_rate.state = bit_rate_confirming;
+    _terminal_bit_rate_switch(_bit_rate.bit_rate);
+
+    timer_wheel_arm(&_bit_rate_timer, pdMS_TO_TICKS(ACS_BIT_RATE_CONFIRM_MS));
+  }
+  else if (_bit_rate.state == bit_rate_confirming)
+  {
+    if (!_bit_rate.alive_seen)
     {
-      _act_master = ACS_RESERVED_ADDR;
-      Board_LED_Set(BOARD_LED_STATUS, false);
+      // Master (or the rest of the bus) did not switch.
+      DEBUGSTR("bit rate revert\n");
+      _terminal_bit_rate_switch(_bit_rate.previous);
     }
-    _master_timeout = true;
-    portEXIT_CRITICAL();
+    _bit_rate.state = bit_rate_idle;
   }
 }
 
+// Bit rate command from master. Called from interrupt.
+static void _terminal_bit_rate_cmd(uint16_t master, const CCAN_MSG_OBJ_T * ptr_msg)
+{
+  acs_msg_data_bit_rate_t cmd = {0};
+  memcpy(&cmd, ptr_msg->data, ptr_msg->dlc < sizeof(cmd) ? ptr_msg->dlc : sizeof(cmd));
+  uint32_t bit_rate = (uint32_t)cmd.bit_rate_kbps * 1000;
+
+  if (cmd.command == DATA_BIT_RATE_PREPARE)
+  {
+    // Switch already in progress is not interrupted.
+    if (_bit_rate.state == bit_rate_pending || _bit_rate.state == bit_rate_confirming) return;
+
+    bool supported = CAN_is_bit_rate_supported(bit_rate);
+    if (supported)
+    {
+      _bit_rate.bit_rate = bit_rate;
+      _bit_rate.state = bit_rate_prepared;
+    }
+
+    acs_msg_data_bit_rate_t ack = {supported ? DATA_BIT_RATE_PREPARE : DATA_BIT_RATE_UNSUPPORTED, cmd.bit_rate_kbps, 0};
+
+    acs_msg_head_t head;
+    head.scalar = CAN_MSGOBJ_EXT;
+    head.prio = PRIO_BIT_RATE;
+    head.fc = FC_BIT_RATE;
+    head.dst = master;
+    head.src = get_reader_addr(0);
+    CAN_send_once(ACS_MSGOBJ_SEND_BIT_RATE, head.scalar, (void *)&ack, sizeof(ack));
+  }
+  else if (cmd.command == DATA_BIT_RATE_COMMIT)
+  {
+    // Commit is repeated by master - only the first one schedules the switch.
+    if (_bit_rate.state != bit_rate_prepared || _bit_rate.bit_rate != bit_rate) return;
+
+    _bit_rate.state = bit_rate_pending;
+    timer_wheel_arm(&_bit_rate_timer, pdMS_TO_TICKS(cmd.delay_ms));
+  }
+}
+
+// Controller is in bus-off state (it does not take part in communication).
+// Restart is delayed - each failed recovery doubles the delay. Called from interrupt.
+static void _terminal_can_bus_off(void)
+{
+  if (_can_recovery.state == can_bus_off) return; // Restart already scheduled.
+
+  if (_can_recovery.state == can_bus_recovering) _can_recovery.failures++;
+  else _can_recovery.failures = 0;
+
+  if (_can_recovery.failures >= CAN_BUS_OFF_MAX_FAILURES)
+  {
+    // Bus does not recover - reset by WDG timeout.
+    WDT_Feed();
+    configASSERT(false);
+  }
+
+  uint32_t backoff_ms = (uint32_t)CAN_BUS_OFF_BACKOFF_MIN_MS << _can_recovery.failures;
+  if (backoff_ms > CAN_BUS_OFF_BACKOFF_MAX_MS) backoff_ms = CAN_BUS_OFF_BACKOFF_MAX_MS;
+
+  _can_recovery.state = can_bus_off;
+  timer_wheel_arm(&_can_timer, pdMS_TO_TICKS(backoff_ms));
+}
+
+// Scheduled restart or end of recovery. Called from timer wheel task.
+static void _terminal_can_recovery_timeout(void)
+{
+  if (_can_recovery.state == can_bus_off)
+  {
+    DEBUGSTR("CAN restart\n");
+    _can_recovery.state = can_bus_recovering;
+    _terminal_can_restart(CAN_get_bit_rate());
+    diag_can_restart();
+
+    timer_wheel_arm(&_can_timer, pdMS_TO_TICKS(CAN_BUS_OFF_STABLE_MS));
+  }
+  else if (_can_recovery.state == can_bus_recovering)
+  {
+    _can_recovery.state = can_bus_ok;
+  }
+}
+
+// Score of master for this panel (highest random weight). Panels of a dead master are spread
+// over the other masters and the rest of panels keeps its master.
+static uint32_t _terminal_master_score(uint16_t master)
+{
+  uint32_t x = ((uint32_t)get_reader_addr(0) << 16) | master;
+  x ^= x >> 16;
+  x *= 0x7FEB352DUL;
+  x ^= x >> 15;
+  x *= 0x846CA68BUL;
+  x ^= x >> 16;
+  return x;
+}
+
+// Select live master with the highest score. Called from critical section.
+static void _terminal_select_master(void)
+{
+  uint16_t best = ACS_RESERVED_ADDR;
+  uint32_t best_score = 0;
+
+  for (uint8_t i = 0; i < MASTER_COUNT; ++i)
+  {
+    if (!_masters[i].alive) continue;
+
+    uint32_t score = _terminal_master_score(ACS_MSTR_FIRST_ADDR + i);
+    if (best == ACS_RESERVED_ADDR || score > best_score)
+    {
+      best = ACS_MSTR_FIRST_ADDR + i;
+      best_score = score;
+    }
+  }
+
+  if (best == _act_master) return;
+
+  _act_master = best;
+  Board_LED_Set(BOARD_LED_STATUS, best != ACS_RESERVED_ADDR);
+
+  // Cache of master without epoch can not be checked.
+  if (best != ACS_RESERVED_ADDR && !_masters[best - ACS_MSTR_FIRST_ADDR].has_epoch)
+  {
+    _cache_clear_req = true;
+#if CACHING_ENABLED
+    _cache_epoch_valid = false;
+#endif
+  }
+}
+
+// Response of master to authorization request. Called from interrupt.
+static void _terminal_auth_answered(uint8_t reader_idx, uint16_t master)
+{
+  portENTER_CRITICAL();
+  if (_auth_req[reader_idx].master == master)
+  {
+    _auth_req[reader_idx].pending = false;
+    timer_wheel_cancel(&_auth_timer[reader_idx]);
+  }
+  if (master == _act_master) _auth_unanswered = 0;
+  portEXIT_CRITICAL();
+}
+
+// Time since the last heartbeat of the master.
+static inline TickType_t _terminal_master_gap(const term_master_t * ptr_master, TickType_t now)
+{
+  return now - ptr_master->last_seen;
+}
+
+// Check live standby master for failover from the active one. Called from critical section.
+static bool _terminal_master_standby(TickType_t now)
+{
+  for (uint8_t i = 0; i < MASTER_COUNT; ++i)
+  {
+    if (ACS_MSTR_FIRST_ADDR + i != _act_master && _masters[i].alive &&
+        _terminal_master_gap(&_masters[i], now) < pdMS_TO_TICKS(MASTER_FAILOVER_MS))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Find dead masters and move to another one. Called from timer wheel task.
+//
+// Active master fails over to live standby master after one missed heartbeat or after
+// AUTH_UNANSWERED_MAX unanswered authorization requests. Without standby master the panel
+// goes offline after MASTER_DEAD_MS.
+static void _terminal_master_check(void)
+{
+  TickType_t now = xTaskGetTickCount();
+  bool changed = false;
+  bool timed_out[ACS_READER_MAXCOUNT] = {false};
+  uint8_t reason = DATA_DIAG_FAILOVER_NONE;
+  TickType_t since = now;
+
+  portENTER_CRITICAL();
+  PROFILER_BEGIN(profiler_crit_master);
+  const uint16_t prev_master = _act_master;
+
+  // Unanswered authorization requests.
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    if (!_auth_req[idx].pending || now - _auth_req[idx].sent < pdMS_TO_TICKS(AUTH_RESPONSE_TIMEOUT_MS)) continue;
+
+    _auth_req[idx].pending = false;
+    if (_auth_req[idx].master != _act_master) continue;
+
+    timed_out[idx] = true;
+    if (_auth_unanswered == 0) _auth_unanswered_since = _auth_req[idx].sent;
+    if (_auth_unanswered < UINT8_MAX) _auth_unanswered++;
+  }
+
+  const bool standby = _terminal_master_standby(now);
+
+  for (uint8_t i = 0; i < MASTER_COUNT; ++i)
+  {
+    term_master_t * ptr_master = &_masters[i];
+    if (!ptr_master->alive) continue;
+
+    const TickType_t gap = _terminal_master_gap(ptr_master, now);
+    const bool is_active = (ACS_MSTR_FIRST_ADDR + i == _act_master);
+
+    if (is_active && standby && gap >= pdMS_TO_TICKS(MASTER_FAILOVER_MS))
+    {
+      reason = DATA_DIAG_FAILOVER_HEARTBEAT;
+      since = ptr_master->last_seen + pdMS_TO_TICKS(ACS_MASTER_ALIVE_PERIOD_MS);
+    }
+    else if (is_active && standby && _auth_unanswered >= AUTH_UNANSWERED_MAX)
+    {
+      reason = DATA_DIAG_FAILOVER_AUTH;
+      since = _auth_unanswered_since;
+    }
+    else if (gap < pdMS_TO_TICKS(MASTER_DEAD_MS))
+    {
+      continue;
+    }
+
+    ptr_master->alive = false;
+    ptr_master->held = (reason != DATA_DIAG_FAILOVER_NONE && is_active);
+    ptr_master->failed_at = now;
+    changed = true;
+  }
+
+  if (changed) _terminal_select_master();
+
+  const bool failover = (_act_master != prev_master && prev_master != ACS_RESERVED_ADDR &&
+                         _act_master != ACS_RESERVED_ADDR && reason != DATA_DIAG_FAILOVER_NONE);
+  if (_act_master != prev_master) _auth_unanswered = 0;
+
+  // User does not have to wait for timeout again.
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    if (failover && timed_out[idx]) _auth_req[idx].retry = true;
+  }
+  PROFILER_END(profiler_crit_master);
+  portEXIT_CRITICAL();
+
+  if (failover) diag_master_failover(reason, (now - since) * portTICK_PERIOD_MS);
+}
+
+// Callback for timers of the terminal. Called from timer wheel task.
+static void _timer_callback(uint32_t id)
+{
+  if (id == _act_timer_id)
+  {
+    _terminal_master_check();
+    timer_wheel_arm(&_act_timer, pdMS_TO_TICKS(MASTER_CHECK_PERIOD_MS));
+  }
+  else if (id >= _auth_timer_id && id < _auth_timer_id + ACS_READER_MAXCOUNT)
+  {
+    // Unanswered request is handled without waiting for the periodic check.
+    _terminal_master_check();
+  }
+  else if (id == _bit_rate_timer_id)
+  {
+    _terminal_bit_rate_timeout();
+  }
+  else if (id == _can_timer_id)
+  {
+    _terminal_can_recovery_timeout();
+  }
+}
+
+// Count heartbeats of active master missed before this one. Called from interrupt.
+static void _terminal_alive_seq(term_master_t * ptr_master, uint8_t seq, bool is_active)
+{
+  uint8_t gap = seq - ptr_master->seq - 1;
+
+  if (is_active && ptr_master->seq_valid && gap != 0 && gap < ALIVE_SEQ_GAP_MAX) diag_master_alive_missed(gap);
+  ptr_master->seq = seq;
+  ptr_master->seq_valid = true;
+}
+
+// Send flow control of cache transfer to master.
+static void terminal_send_xfer_flow(uint8_t reader_idx, uint16_t master, uint8_t status)
+{
+  if (master == ACS_RESERVED_ADDR) return;
+
+  acs_msg_head_t head;
+  head.scalar = CAN_MSGOBJ_EXT;
+  head.prio = PRIO_CACHE_XFER;
+  head.fc = FC_CACHE_XFER_FLOW;
+  head.dst = master;
+
+  acs_msg_data_xfer_flow_t flow =
+  {
+    .status = status,
+    .block_size = CACHE_XFER_BLOCK_SIZE,
+    .st_min_ms = CACHE_XFER_ST_MIN_MS
+  };
+
+  if (reader_idx < ACS_READER_MAXCOUNT)
+  {
+    head.src = get_reader_addr(reader_idx);
+    CAN_send_once(ACS_MSGOBJ_SEND_FLOW + reader_idx, head.scalar, (void *)&flow, sizeof(flow));
+  }
+}
+
+#if CACHING_ENABLED
+// Items of cache transfers which can come before the next flow control.
+static uint16_t _terminal_xfer_expected(void)
+{
+  uint16_t items = 0;
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    const term_cache_xfer_t * ptr_xfer = &_cache_xfer[idx];
+    if (ptr_xfer->remaining > 0 && !ptr_xfer->waiting) items += 2 * ptr_xfer->block_left; // Two items per frame.
+  }
+  return items;
+}
+
+// Next block can come only if the journal has room for its changes. Master waits otherwise
+// and the block is requested by terminal task (see terminal_xfer_resume).
+// Called from interrupt or critical section.
+static bool _terminal_xfer_can_continue(term_cache_xfer_t * ptr_xfer)
+{
+  ptr_xfer->block_left = CACHE_XFER_BLOCK_SIZE;
+  ptr_xfer->waiting = true;
+#if CACHE_JOURNAL_ENABLED
+  if (cache_journal_room() < _terminal_xfer_expected() + 2 * CACHE_XFER_BLOCK_SIZE) return false;
+#endif
+  ptr_xfer->waiting = false;
+  return true;
+}
+#endif
+
+// First frame of cache transfer received. Called from interrupt.
+static void _terminal_xfer_first(uint8_t reader_idx, uint16_t master, const CCAN_MSG_OBJ_T * ptr_msg)
+{
+#if CACHING_ENABLED
+  acs_msg_data_xfer_first_t first = {0};
+  memcpy(&first, ptr_msg->data, MIN(ptr_msg->dlc, sizeof(first)));
+
+  term_cache_xfer_t * ptr_xfer = &_cache_xfer[reader_idx];
+  ptr_xfer->remaining = first.item_count;
+  ptr_xfer->master = master;
+  ptr_xfer->sn = 1;
+
+  if (first.item_count == 0)
+  {
+    _terminal_cache_loaded(reader_idx);
+    terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_DONE);
+  }
+  else if (_terminal_xfer_can_continue(ptr_xfer)) terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_CTS);
+  else terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_WAIT);
+#else
+  (void)ptr_msg;
+  terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_ABORT);
+#endif
+}
+
+// Consecutive frame of cache transfer received. Called from interrupt.
+static void _terminal_xfer_consec(uint8_t reader_idx, uint16_t master, const CCAN_MSG_OBJ_T * ptr_msg)
+{
+#if CACHING_ENABLED
+  term_cache_xfer_t * ptr_xfer = &_cache_xfer[reader_idx];
+
+  if (ptr_xfer->remaining == 0) return; // No transfer in progress.
+
+  acs_msg_data_xfer_consec_t consec = {{0, 0}};
+  uint8_t count = (ptr_xfer->remaining > 1 ? 2 : 1);
+
+  if (ptr_msg->dlc < count * sizeof(consec.item[0]))
+  {
+    ptr_xfer->remaining = 0;
+    terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_ABORT);
+    return;
+  }
+  memcpy(&consec, ptr_msg->data, count * sizeof(consec.item[0]));
+
+  // Check sequence number (only lower half is present in frame with one item).
+  uint8_t sn = (consec.item[0] >> ACS_XFER_SN_OFFSET) | ((consec.item[1] >> ACS_XFER_SN_OFFSET) << 2);
+  uint8_t sn_mask = (count == 2 ? ACS_XFER_SN_MASK : (ACS_XFER_SN_MASK >> 2));
+  if ((sn ^ ptr_xfer->sn) & sn_mask)
+  {
+    ptr_xfer->remaining = 0;
+    terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_ABORT);
+    DEBUGSTR("xfer SN fail\n");
+    return;
+  }
+
+  // Add door permission to the users.
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    term_cache_item_t user;
+    if (!static_cache_key(consec.item[i] & ACS_XFER_KEY_MASK, &user)) continue; // Can not be cached.
+    if (!static_cache_get(&user)) user.value = cache_reader_none;
+    user.value |= map_reader_idx_to_cache(reader_idx);
+    _terminal_cache_insert(user);
+  }
+
+  ptr_xfer->remaining -= count;
+  ptr_xfer->sn = (ptr_xfer->sn + 1) & ACS_XFER_SN_MASK;
+
+  if (ptr_xfer->remaining == 0)
+  {
+    _terminal_cache_loaded(reader_idx);
+    terminal_send_xfer_flow(reader_idx, master, DATA_XFER_FLOW_DONE);
+    DEBUGSTR("xfer done\n");
+  }
+  else if (--ptr_xfer->block_left == 0)
+  {
+    bool cts = _terminal_xfer_can_continue(ptr_xfer);
+    terminal_send_xfer_flow(reader_idx, master, (cts ? DATA_XFER_FLOW_CTS : DATA_XFER_FLOW_WAIT));
+  }
+#else
+  (void)reader_idx;
+  (void)master;
+  (void)ptr_msg;
+#endif
+}
+
 /*****************************************************************************
  * Public functions
  ****************************************************************************/
 
 void term_can_error(uint32_t error_info)
 {
-  if (error_info == CAN_ERROR_BOFF) // if bus off do reset by WDG timeout
-  {
-  	WDT_Feed();
-    configASSERT(false);
-  }
+  diag_can_error(error_info);
+
+  if (error_info & CAN_ERROR_BOFF) _terminal_can_bus_off();
 }
 
 void term_can_send(uint8_t msg_obj_num)
@@ -140,46 +922,122 @@ void term_can_recv(uint8_t msg_obj_num)
 
   uint8_t reader_idx;
 
-  // Get target door if message is for us.
-  if (msg_obj.msgobj == ACS_MSGOBJ_RECV_DOOR_A)
-  {
-    reader_idx = ACS_READER_A_IDX;
-    DEBUGSTR("for door A\n");
-  }
-  else if (msg_obj.msgobj == ACS_MSGOBJ_RECV_DOOR_B)
+  // Get target door if message is for us.
+  if (msg_obj.msgobj >= ACS_MSGOBJ_RECV_DOOR && msg_obj.msgobj < ACS_MSGOBJ_RECV_DOOR + ACS_READER_MAXCOUNT)
   {
-    reader_idx = ACS_READER_B_IDX;
-    DEBUGSTR("for door B\n");
+    reader_idx = msg_obj.msgobj - ACS_MSGOBJ_RECV_DOOR;
+    DEBUGSTR("for door\n");
   }
   else if (msg_obj.msgobj == ACS_MSGOBJ_RECV_BCAST)
   {
     // Broadcast message.
-    if (head.fc == FC_ALIVE &&
-        head.src >= ACS_MSTR_FIRST_ADDR &&
-        head.src <= ACS_MSTR_LAST_ADDR)
+    if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR) return;
+
+    if (head.fc == FC_ALIVE)
     {
-      // Update master address if timeout occurred.
+      acs_msg_data_alive_t alive;
+      memset(&alive, 0, sizeof(alive));
+      memcpy(&alive, msg_obj.data, msg_obj.dlc < sizeof(alive) ? msg_obj.dlc : sizeof(alive));
+
+      // Master with cache epoch tells us whether any update was missed.
+      bool has_epoch = (msg_obj.dlc >= offsetof(acs_msg_data_alive_t, time));
+      // Older masters send time without fraction or no time.
+      bool has_time = (msg_obj.dlc >= offsetof(acs_msg_data_alive_t, time_frac));
+      bool has_seq = (msg_obj.dlc >= sizeof(acs_msg_data_alive_t));
+
       portENTER_CRITICAL();
-      if (_master_timeout == true)
+      term_master_t * ptr_master = &_masters[head.src - ACS_MSTR_FIRST_ADDR];
+      ptr_master->last_seen = xTaskGetTickCountFromISR();
+      ptr_master->has_epoch = has_epoch;
+      if (ptr_master->held && ptr_master->last_seen - ptr_master->failed_at >= pdMS_TO_TICKS(MASTER_HOLDOFF_MS))
       {
-        _act_master = head.src;
-        Board_LED_Set(BOARD_LED_STATUS, true);
-        _cache_clear_req = true;
+        ptr_master->held = false;
+      }
+      if (!ptr_master->alive && !ptr_master->held)
+      {
+        // New master takes its panels immediately.
+        ptr_master->alive = true;
+        ptr_master->seq_valid = false;
+        _terminal_select_master();
       }
-      _master_timeout = false;
+      bool is_active = (head.src == _act_master);
+      if (has_seq) _terminal_alive_seq(ptr_master, alive.seq, is_active);
+      _bit_rate.alive_seen = true;
+      diag_boot_master_alive();
+      if (get_fw_state() == FW_STATE_TRIAL) _fw_confirm_req = true;
+#if CACHING_ENABLED
+      if (has_epoch && head.src == _act_master) _terminal_cache_check_epoch(&msg_obj);
+#endif
       portEXIT_CRITICAL();
+
+      if (is_active && has_time) panel_time_set(alive.time, alive.time_frac);
       DEBUGSTR("master alive\n");
     }
+#if CACHING_ENABLED
+    else if (head.fc == FC_CACHE_UPDATE)
+    {
+      portENTER_CRITICAL();
+      _terminal_cache_update(&msg_obj);
+      portEXIT_CRITICAL();
+    }
+#endif
+    else if (head.fc == FC_BIT_RATE)
+    {
+      _terminal_bit_rate_cmd(head.src, &msg_obj);
+    }
     return;
   }
   else return;
 
+  // Diagnostics are available also for disabled readers.
+  if (head.fc == FC_DIAG)
+  {
+    if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR) return;
+    _diag_req[reader_idx].master = head.src;
+    _diag_req[reader_idx].page = (msg_obj.dlc > 0 ? msg_obj.data[0] : DATA_DIAG_PAGE_SYSTEM);
+    _diag_req[reader_idx].pending = true;
+    return;
+  }
+
+  // Disabled reader can be enabled by master.
+  if (head.fc == FC_CONFIG)
+  {
+    if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR || msg_obj.dlc < 2) return;
+    _config_req[reader_idx].master = head.src;
+    memset(&_config_req[reader_idx].cmd, 0, sizeof(_config_req[reader_idx].cmd));
+    memcpy(&_config_req[reader_idx].cmd, msg_obj.data,
+           msg_obj.dlc < sizeof(acs_msg_data_config_t) ? msg_obj.dlc : sizeof(acs_msg_data_config_t));
+    _config_req[reader_idx].pending = true;
+    return;
+  }
+
+  // Events are uploaded from the first door.
+  if (head.fc == FC_EVENT_LOG)
+  {
+    if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR || msg_obj.dlc < 2) return;
+    if (reader_idx == 0 && msg_obj.data[0] == DATA_EVENT_ACK)
+    {
+      _event_ack_batch = msg_obj.data[1];
+      _event_ack_req = true;
+    }
+    return;
+  }
+
+  // Update is requested from any door of the panel.
+  if (head.fc == FC_FW_UPDATE)
+  {
+    if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR) return;
+    if (msg_obj.dlc > 0 && msg_obj.data[0] == DATA_FW_ENTER) _fw_enter_req = true;
+    return;
+  }
+
   // Stop processing if card reader not configured.
   if (reader_idx >= ACS_READER_MAXCOUNT || !reader_conf[reader_idx].enabled) return;
 
   // Continue deducing action and execute it.
   if (head.fc == FC_USER_AUTH_RESP)
   {
+    _terminal_auth_answered(reader_idx, head.src);
     _terminal_user_authorized(reader_idx);
 
     #if CACHING_ENABLED
@@ -187,13 +1045,16 @@ void term_can_recv(uint8_t msg_obj_num)
       uint8_t len = msg_obj.dlc > sizeof(user_id) ? sizeof(user_id) : msg_obj.dlc;
       memcpy(&user_id, msg_obj.data, len);
       term_cache_item_t user;
-      user.key = user_id;
-      user.value = map_reader_idx_to_cache(reader_idx);
-      static_cache_insert(user);
+      if (static_cache_key(user_id, &user))
+      {
+        user.value = map_reader_idx_to_cache(reader_idx);
+        _terminal_cache_insert(user);
+      }
     #endif
   }
   else if (head.fc == FC_USER_NOT_AUTH_RESP)
   {
+    _terminal_auth_answered(reader_idx, head.src);
     __terminal_user_not_authorized(reader_idx);
 
     #if CACHING_ENABLED
@@ -201,14 +1062,24 @@ void term_can_recv(uint8_t msg_obj_num)
       uint8_t len = msg_obj.dlc >= sizeof(user_id) ? sizeof(user_id) : msg_obj.dlc;
       memcpy(&user_id, msg_obj.data, len);
       term_cache_item_t user;
-      user.key = user_id;
-      user.value = cache_reader_none;
-      static_cache_insert(user);
+      if (static_cache_key(user_id, &user))
+      {
+        user.value = cache_reader_none;
+        _terminal_cache_insert(user);
+      }
     #endif
   }
   else if (head.fc == FC_LEARN_USER_OK)
   {
-      reader_signal_to_user(reader_idx, BEEP_ON_SUCCESS);
+      reader_signal_to_user(reader_idx, reader_conf[reader_idx].beep_on_success);
+  }
+  else if (head.fc == FC_CACHE_XFER_FIRST)
+  {
+    _terminal_xfer_first(reader_idx, head.src, &msg_obj);
+  }
+  else if (head.fc == FC_CACHE_XFER_CONSEC)
+  {
+    _terminal_xfer_consec(reader_idx, head.src, &msg_obj);
   }
   else if (head.fc == FC_DOOR_CTRL)
   {
@@ -216,7 +1087,7 @@ void term_can_recv(uint8_t msg_obj_num)
     {
       case DATA_DOOR_CTRL_REMOTE_UNLCK:
         DEBUGSTR("cmd UNLOCK\n");
-        reader_unlock(reader_idx, BEEP_ON_SUCCESS, OK_LED_ON_SUCCESS);
+        reader_unlock(reader_idx, reader_conf[reader_idx].beep_on_success, reader_conf[reader_idx].ok_led_on_success);
         break;
       case DATA_DOOR_CTRL_CLR_CACHE:
         DEBUGSTR("cmd CLR CACHE\n");
@@ -227,12 +1098,12 @@ void term_can_recv(uint8_t msg_obj_num)
       case DATA_DOOR_CTRL_NORMAL_MODE:
         DEBUGSTR("cmd NORMAL MODE\n");
         reader_conf[reader_idx].learn_mode = false;
-        reader_signal_to_user(reader_idx, BEEP_ON_SUCCESS);
+        reader_signal_to_user(reader_idx, reader_conf[reader_idx].beep_on_success);
         break;
       case DATA_DOOR_CTRL_LEARN_MODE:
         DEBUGSTR("cmd LEARN MODE\n");
         reader_conf[reader_idx].learn_mode = true;
-        reader_signal_to_user(reader_idx, BEEP_ON_SUCCESS);
+        reader_signal_to_user(reader_idx, reader_conf[reader_idx].beep_on_success);
         break;
       default:
         break;
@@ -242,7 +1113,7 @@ void term_can_recv(uint8_t msg_obj_num)
 }
 
 // Send door status update to server
-static void terminal_send_door_status(uint8_t reader_idx, bool is_open)
+static void terminal_send_door_status(uint8_t reader_idx, uint8_t status)
 {
   //check if master online
   if (_act_master == ACS_RESERVED_ADDR)
@@ -258,20 +1129,23 @@ static void terminal_send_door_status(uint8_t reader_idx, bool is_open)
   head.fc = FC_DOOR_STATUS;
   head.dst = _act_master;
 
-  uint8_t status = (is_open ? DATA_DOOR_STATUS_OPEN : DATA_DOOR_STATUS_CLOSED);
-
-  if (reader_idx == ACS_READER_A_IDX)
-  {
-    head.src = get_reader_a_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_A, head.scalar, (void *)&status, sizeof(status));
-  }
-  else if (reader_idx == ACS_READER_B_IDX)
+  // Separate message objects - status is sent from door task.
+  if (reader_idx < ACS_READER_MAXCOUNT)
   {
-    head.src = get_reader_b_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_B, head.scalar, (void *)&status, sizeof(status));
+    head.src = get_reader_addr(reader_idx);
+    CAN_send_once(ACS_MSGOBJ_SEND_STATUS + reader_idx, head.scalar, (void *)&status, sizeof(status));
   }
 }
 
+#ifdef DOOR_SENSOR_TYPE
+// Report change of door state (logged while master is offline).
+static void terminal_door_event(uint8_t reader_idx, uint8_t status)
+{
+  if (_act_master == ACS_RESERVED_ADDR) event_log_add(DATA_EVENT_DOOR + status, reader_idx, 0);
+  terminal_send_door_status(reader_idx, status);
+}
+#endif
+
 // Send command to server that request authorization of user for given reader.
 static void terminal_request_auth(uint32_t user_id, uint8_t reader_idx)
 {
@@ -279,6 +1153,7 @@ static void terminal_request_auth(uint32_t user_id, uint8_t reader_idx)
   if (_act_master == ACS_RESERVED_ADDR)
   {
     DEBUGSTR("master off-line\n");
+    event_log_add(DATA_EVENT_CARD, reader_idx, user_id);
     return;
   }
 
@@ -289,15 +1164,21 @@ static void terminal_request_auth(uint32_t user_id, uint8_t reader_idx)
   head.fc = FC_USER_AUTH_REQ;
   head.dst = _act_master;
 
-  if (reader_idx == ACS_READER_A_IDX)
-  {
-    head.src = get_reader_a_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_A, head.scalar, (void *)&user_id, sizeof(user_id));
-  }
-  else if (reader_idx == ACS_READER_B_IDX)
+  if (reader_idx < ACS_READER_MAXCOUNT)
   {
-    head.src = get_reader_b_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_B, head.scalar, (void *)&user_id, sizeof(user_id));
+    head.src = get_reader_addr(reader_idx);
+
+    // Wait for response (see _terminal_master_check).
+    portENTER_CRITICAL();
+    _auth_req[reader_idx].pending = true;
+    _auth_req[reader_idx].retry = false;
+    _auth_req[reader_idx].master = head.dst;
+    _auth_req[reader_idx].user_id = user_id;
+    _auth_req[reader_idx].sent = xTaskGetTickCount();
+    portEXIT_CRITICAL();
+    timer_wheel_arm(&_auth_timer[reader_idx], pdMS_TO_TICKS(AUTH_RESPONSE_TIMEOUT_MS));
+
+    CAN_send_once(ACS_MSGOBJ_SEND_DOOR + reader_idx, head.scalar, (void *)&user_id, sizeof(user_id));
   }
 }
 
@@ -318,23 +1199,153 @@ static void terminal_request_user_learn(uint32_t user_id, uint8_t reader_idx)
   head.fc = FC_LEARN_USER;
   head.dst = _act_master;
 
-  if (reader_idx == ACS_READER_A_IDX)
+  if (reader_idx < ACS_READER_MAXCOUNT)
+  {
+    head.src = get_reader_addr(reader_idx);
+    CAN_send_once(ACS_MSGOBJ_SEND_DOOR + reader_idx, head.scalar, (void *)&user_id, sizeof(user_id));
+  }
+}
+
+// Send response to pending diagnostic request of the door.
+static void terminal_send_diag(uint8_t reader_idx)
+{
+  term_diag_req_t req;
+
+  portENTER_CRITICAL();
+  req = _diag_req[reader_idx];
+  _diag_req[reader_idx].pending = false;
+  portEXIT_CRITICAL();
+
+  if (!req.pending) return;
+
+  uint8_t data[CAN_DLC_MAX];
+  uint8_t len = diag_get_page(req.page, reader_idx, data);
+
+  acs_msg_head_t head;
+  head.scalar = CAN_MSGOBJ_EXT;
+  head.prio = PRIO_DIAG;
+  head.fc = FC_DIAG;
+  head.dst = req.master;
+  head.src = get_reader_addr(reader_idx);
+
+  CAN_send_once(ACS_MSGOBJ_SEND_DIAG + reader_idx, head.scalar, data, len);
+}
+
+// Set configuration parameter (DATA_CONFIG_...) of the reader.
+//
+// Return false if the parameter is unknown or the value is out of range.
+static bool _terminal_param_apply(reader_conf_t * ptr_conf, uint8_t param, uint16_t value)
+{
+  const bool is_time = (value >= ACS_CONFIG_TIME_MIN_MS && value <= ACS_CONFIG_TIME_MAX_MS);
+
+  switch (param)
+  {
+    case DATA_CONFIG_ENABLED:
+      if (value > 1) return false;
+      ptr_conf->enabled = (uint8_t)value;
+      break;
+    case DATA_CONFIG_OPEN_TIME_MS:
+      if (!is_time) return false;
+      ptr_conf->open_time_sec = value;
+      break;
+    case DATA_CONFIG_OK_GLED_TIME_MS:
+      if (!is_time) return false;
+      ptr_conf->gled_time_sec = value;
+      break;
+    case DATA_CONFIG_BEEP_ON_SUCCESS:
+      if (value > 1) return false;
+      ptr_conf->beep_on_success = (uint8_t)value;
+      break;
+    case DATA_CONFIG_OK_LED_ON_SUCCESS:
+      if (value > 1) return false;
+      ptr_conf->ok_led_on_success = (uint8_t)value;
+      break;
+    case DATA_CONFIG_SENSOR_TYPE:
+      if (value != SENSOR_IS_NO && value != SENSOR_IS_NC) return false;
+      ptr_conf->sensor_type = (uint8_t)value;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+// Get configuration parameter (DATA_CONFIG_...) of the reader.
+static uint16_t _terminal_param_get(const reader_conf_t * ptr_conf, uint8_t param)
+{
+  switch (param)
+  {
+    case DATA_CONFIG_ENABLED: return ptr_conf->enabled;
+    case DATA_CONFIG_OPEN_TIME_MS: return ptr_conf->open_time_sec;
+    case DATA_CONFIG_OK_GLED_TIME_MS: return ptr_conf->gled_time_sec;
+    case DATA_CONFIG_BEEP_ON_SUCCESS: return ptr_conf->beep_on_success;
+    case DATA_CONFIG_OK_LED_ON_SUCCESS: return ptr_conf->ok_led_on_success;
+    case DATA_CONFIG_SENSOR_TYPE: return ptr_conf->sensor_type;
+    default: return 0;
+  }
+}
+
+// Process pending configuration request of the door and send response.
+static void terminal_config(uint8_t reader_idx)
+{
+  term_config_req_t req;
+
+  portENTER_CRITICAL();
+  req = _config_req[reader_idx];
+  _config_req[reader_idx].pending = false;
+  portEXIT_CRITICAL();
+
+  if (!req.pending) return;
+
+  acs_msg_data_config_t resp = req.cmd;
+  resp.command = DATA_CONFIG_VALUE;
+
+  if (req.cmd.command == DATA_CONFIG_SET)
   {
-    head.src = get_reader_a_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_A, head.scalar, (void *)&user_id, sizeof(user_id));
+    reader_conf_t conf = reader_conf[reader_idx];
+
+    if (!_terminal_param_apply(&conf, req.cmd.param, req.cmd.value))
+    {
+      resp.command = DATA_CONFIG_INVALID;
+    }
+    // Master repeats the request if it is not answered.
+    else if (!set_door_param(reader_idx, req.cmd.param, req.cmd.value))
+    {
+      DEBUGSTR("config store fail\n");
+      return;
+    }
+    // Reader which stays disabled is not initialized.
+    else if (conf.enabled || reader_conf[reader_idx].enabled)
+    {
+      terminal_reconfigure(&conf, reader_idx);
+    }
+    else
+    {
+      reader_conf[reader_idx] = conf;
+    }
   }
-  else if (reader_idx == ACS_READER_B_IDX)
+  else if (req.cmd.command != DATA_CONFIG_GET || req.cmd.param >= DATA_CONFIG_PARAM_COUNT)
   {
-    head.src = get_reader_b_addr();
-    CAN_send_once(ACS_MSGOBJ_SEND_DOOR_B, head.scalar, (void *)&user_id, sizeof(user_id));
+    resp.command = DATA_CONFIG_INVALID;
   }
+  if (resp.command == DATA_CONFIG_VALUE) resp.value = _terminal_param_get(&reader_conf[reader_idx], req.cmd.param);
+
+  acs_msg_head_t head;
+  head.scalar = CAN_MSGOBJ_EXT;
+  head.prio = PRIO_CONFIG;
+  head.fc = FC_CONFIG;
+  head.dst = req.master;
+  head.src = get_reader_addr(reader_idx);
+
+  CAN_send_once(ACS_MSGOBJ_SEND_CONFIG + reader_idx, head.scalar, (void *)&resp, sizeof(resp));
 }
 
 // Process user identification on a reader.
 static void terminal_user_identified(uint32_t user_id, uint8_t reader_idx)
 {
 #if CACHING_ENABLED
-  term_cache_item_t user = {.key = user_id};
+  term_cache_item_t user;
+  const bool cacheable = static_cache_key(user_id, &user);
 #endif
 
   if (reader_idx < ACS_READER_MAXCOUNT && reader_conf[reader_idx].enabled)
@@ -344,20 +1355,198 @@ static void terminal_user_identified(uint32_t user_id, uint8_t reader_idx)
       terminal_request_user_learn(user_id, reader_idx);
     }
 #if CACHING_ENABLED
-  	// Read from cache online if master is offline.
-    else if ((_act_master == ACS_RESERVED_ADDR) && static_cache_get(&user))
+    // Read from cache if master is offline.
+    else if (_act_master == ACS_RESERVED_ADDR)
     {
-      if (map_reader_idx_to_cache(reader_idx) & user.value)
+      // Cache is also modified from CAN interrupt.
+      portENTER_CRITICAL();
+      PROFILER_BEGIN(profiler_crit_cache);
+      bool found = cacheable && static_cache_get(&user);
+      PROFILER_END(profiler_crit_cache);
+      portEXIT_CRITICAL();
+      diag_cache_lookup(reader_idx, found);
+
+      if (found && (map_reader_idx_to_cache(reader_idx) & user.value))
       {
         _terminal_user_authorized(reader_idx);
+        event_log_add(DATA_EVENT_CARD_ALLOWED, reader_idx, user_id);
+      }
+      else
+      {
+        __terminal_user_not_authorized(reader_idx);
+        event_log_add(DATA_EVENT_CARD_DENIED, reader_idx, user_id);
       }
     }
-#else
+#endif
     else
     {
       terminal_request_auth(user_id, reader_idx);
     }
+  }
+}
+
+// State for boot loader is written - reset to it. Called from storage task.
+static void _terminal_fw_enter_done(bool ok, void * ptr_arg)
+{
+  (void)ptr_arg;
+  if (!ok)
+  {
+    DEBUGSTR("fw enter fail\n");
+    return;
+  }
+  Board_Reset();
+}
+
+// Act on firmware update requests from master.
+static void terminal_fw_update(void)
+{
+  if (_fw_enter_req)
+  {
+    _fw_enter_req = false;
+    DEBUGSTR("fw update\n");
+    if (!set_fw_state(FW_STATE_UPDATE, _terminal_fw_enter_done)) DEBUGSTR("fw enter fail\n");
+  }
+  if (_fw_confirm_req)
+  {
+    // Request comes again with next FC_ALIVE if the write is not queued.
+    _fw_confirm_req = false;
+    if (set_fw_state(FW_STATE_CONFIRMED, NULL)) DEBUGSTR("fw confirmed\n");
+  }
+}
+
+#if CACHING_ENABLED
+// Request next block of cache transfers which wait for the journal.
+static bool terminal_xfer_resume(void)
+{
+  bool waiting = false;
+
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    term_cache_xfer_t * ptr_xfer = &_cache_xfer[idx];
+    bool resume = false;
+
+    portENTER_CRITICAL(); // Transfer is received in interrupt.
+    if (ptr_xfer->remaining > 0 && ptr_xfer->waiting)
+    {
+      resume = _terminal_xfer_can_continue(ptr_xfer);
+      waiting |= !resume;
+    }
+    const uint16_t master = ptr_xfer->master;
+    portEXIT_CRITICAL();
+
+    if (resume) terminal_send_xfer_flow(idx, master, DATA_XFER_FLOW_CTS);
+  }
+
+  return waiting;
+}
+#endif
+
+#if CACHING_ENABLED
+// Reclaim cache slots left by erase from interrupt.
+static void terminal_cache_compact(void)
+{
+  for (uint8_t step = 0; step < CACHE_COMPACT_STEPS; ++step)
+  {
+    portENTER_CRITICAL(); // Cache is also modified from interrupt.
+    PROFILER_BEGIN(profiler_crit_cache);
+    const bool pending = (static_cache_tombstones() > 0);
+    if (pending) (void)static_cache_compact();
+    PROFILER_END(profiler_crit_cache);
+    portEXIT_CRITICAL();
+
+    if (!pending) break;
+  }
+}
 #endif
+
+// Upload events logged while master was offline.
+static void terminal_event_upload(void)
+{
+  const uint16_t master = _act_master;
+  bool ack_req;
+  uint8_t batch;
+
+  portENTER_CRITICAL();
+  ack_req = _event_ack_req;
+  batch = _event_ack_batch;
+  _event_ack_req = false;
+  portEXIT_CRITICAL();
+
+  if (ack_req)
+  {
+    event_log_ack(batch);
+    _event_sent = false;
+  }
+
+  event_log_sync(master == ACS_RESERVED_ADDR);
+
+  if (master == ACS_RESERVED_ADDR)
+  {
+    _event_sent = false;
+    return;
+  }
+  if (_event_sent && xTaskGetTickCount() - _event_sent_tick < pdMS_TO_TICKS(EVENT_ACK_TIMEOUT_MS)) return;
+
+  event_log_item_t items[EVENT_LOG_BATCH];
+  uint8_t count = event_log_batch(items, &batch);
+  if (count == 0) return;
+
+  acs_msg_data_event_log_t log = {.command = DATA_EVENT_BATCH, .batch = batch, .count = count, .base_time = 0};
+
+  // Base is the first known time (event log keeps the rest within the offset range).
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    if (!(items[i].flags & (EVENT_LOG_FLAG_UPTIME | EVENT_LOG_FLAG_UNKNOWN)))
+    {
+      log.base_time = items[i].time;
+      break;
+    }
+  }
+
+  acs_msg_head_t head;
+  head.scalar = CAN_MSGOBJ_EXT;
+  head.prio = PRIO_EVENT_LOG;
+  head.fc = FC_EVENT_LOG;
+  head.dst = master;
+  head.src = get_reader_addr(0);
+
+  CAN_send_once(ACS_MSGOBJ_SEND_EVENT, head.scalar, (void *)&log, sizeof(log));
+
+  head.fc = FC_EVENT_DATA;
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    const bool known = !(items[i].flags & (EVENT_LOG_FLAG_UPTIME | EVENT_LOG_FLAG_UNKNOWN));
+    acs_msg_data_event_t event =
+    {
+      .index = i,
+      .door = items[i].reader_idx,
+      .flags = (known ? 0 : DATA_EVENT_FLAG_TIME_UNKNOWN),
+      .type = items[i].type,
+      .offset = (known && items[i].time > log.base_time ? (uint16_t)(items[i].time - log.base_time) : 0),
+      .user_id = items[i].user_id
+    };
+
+    vTaskDelay(pdMS_TO_TICKS(EVENT_FRAME_GAP_MS));
+    CAN_send_once(ACS_MSGOBJ_SEND_EVENT, head.scalar, (void *)&event, sizeof(event));
+  }
+
+  _event_sent = true;
+  _event_sent_tick = xTaskGetTickCount();
+}
+
+// Send authorization request again after failover from master which did not answer.
+static void terminal_auth_retry(uint8_t reader_idx)
+{
+  portENTER_CRITICAL();
+  const bool retry = _auth_req[reader_idx].retry;
+  const uint32_t user_id = _auth_req[reader_idx].user_id;
+  _auth_req[reader_idx].retry = false;
+  portEXIT_CRITICAL();
+
+  if (retry && reader_conf[reader_idx].enabled)
+  {
+    DEBUGSTR("user req retry\n");
+    terminal_user_identified(user_id, reader_idx);
   }
 }
 
@@ -369,12 +1558,16 @@ static void terminal_task(void *pvParameters)
   (void)pvParameters;
 
   // start timer for detecting master timeout
-  configASSERT(xTimerStart(_act_timer, 0));
-
-  uint8_t send_door_status = SEND_DOOR_STATUS_RATE;
+  timer_wheel_arm(&_act_timer, pdMS_TO_TICKS(MASTER_CHECK_PERIOD_MS));
 
   WDT_Feed(); // Feed HW watchdog
 
+#if PROFILER_ENABLED
+  TickType_t profiler_print_time = xTaskGetTickCount();
+#endif
+
+  uint16_t request_wait_ms = USER_REQUEST_WAIT_MS;
+
   while (true)
   {
     TickType_t begin_time = xTaskGetTickCount();
@@ -385,7 +1578,7 @@ static void terminal_task(void *pvParameters)
       if (!reader_conf[i].enabled) continue;
 
       uint32_t user_id;
-      uint8_t reader_idx = reader_get_request_from_buffer(&user_id, USER_REQUEST_WAIT_MS);
+      uint8_t reader_idx = reader_get_request_from_buffer(&user_id, request_wait_ms);
 
       if (reader_idx < ACS_READER_MAXCOUNT && reader_conf[reader_idx].enabled)
       {
@@ -398,7 +1591,43 @@ static void terminal_task(void *pvParameters)
     if (_cache_clear_req)
     {
     	_cache_clear_req = false;
-      static_cache_reset();
+
+      uint8_t reload_doors = 0;
+      for (size_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+      {
+        if (reader_conf[idx].enabled) reload_doors |= map_reader_idx_to_cache(idx);
+      }
+      _terminal_cache_reset(reload_doors);
+
+      // Request bulk transfer of authorized users.
+      for (size_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+      {
+        if (reader_conf[idx].enabled) terminal_send_xfer_flow(idx, _act_master, DATA_XFER_FLOW_REQ);
+      }
+    }
+  #if CACHE_JOURNAL_ENABLED
+    cache_journal_sync();
+  #endif
+    terminal_cache_compact();
+    // Transfer waiting for the journal is resumed soon.
+    request_wait_ms = (terminal_xfer_resume() ? CACHE_XFER_RESUME_MS : USER_REQUEST_WAIT_MS);
+#endif
+
+    for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+    {
+      terminal_auth_retry(idx);
+      terminal_send_diag(idx);
+      terminal_config(idx);
+    }
+
+    terminal_fw_update();
+    terminal_event_upload();
+
+#if PROFILER_ENABLED
+    if (xTaskGetTickCount() - profiler_print_time >= pdMS_TO_TICKS(PROFILER_PRINT_PERIOD_MS))
+    {
+      profiler_print_time = xTaskGetTickCount();
+      profiler_print();
     }
 #endif
 
@@ -406,67 +1635,158 @@ static void terminal_task(void *pvParameters)
 		TickType_t proces_time = xTaskGetTickCount() - begin_time;
 
     // Protect against brute-force attack by limiting processing frequency.
-    // Also controls frequency of door status update.
     if (proces_time < pdMS_TO_TICKS(USER_REQUEST_MIN_PERIOD_MS))
 		{
       vTaskDelay(pdMS_TO_TICKS(USER_REQUEST_MIN_PERIOD_MS) - proces_time);
 		}
 
     WDT_Feed(); // Feed HW watchdog
+  }
+}
+
+#ifdef DOOR_SENSOR_TYPE
+// Wait time limited by deadline.
+static inline void _door_wait_until(TickType_t * ptr_wait, TickType_t now, TickType_t since, TickType_t period)
+{
+  TickType_t left = period - (now - since);
+  if (left < *ptr_wait) *ptr_wait = left;
+}
+
+// Task for door status reporting.
+//
+// Waked by door sensor edge, after debounce window, for alarm or status heartbeat.
+static void door_task(void *pvParameters)
+{
+  (void)pvParameters;
 
-    if (send_door_status == SEND_DOOR_STATUS_RATE)
+  const TickType_t debounce = pdMS_TO_TICKS(DOOR_SENSOR_DEBOUNCE_MS);
+  const TickType_t held_open = pdMS_TO_TICKS(DOOR_HELD_OPEN_ALARM_MS);
+  const TickType_t heartbeat = pdMS_TO_TICKS(DOOR_STATUS_HEARTBEAT_MS);
+
+  TickType_t last_heartbeat = xTaskGetTickCount() - heartbeat; // Report initial state.
+
+  for (size_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    _door[idx].is_open = reader_is_door_open(idx);
+    _door[idx].open_since = xTaskGetTickCount();
+    _door[idx].held_alarm = false;
+  }
+
+  while (true)
+  {
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = heartbeat;
+    bool send_all = (now - last_heartbeat >= heartbeat);
+
+    if (send_all) last_heartbeat = now;
+    _door_wait_until(&wait, now, last_heartbeat, heartbeat);
+
+    for (size_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
     {
-      send_door_status = 0;
-
-			// Check if door open/close state changed
-			for (size_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
-			{
-				if (reader_conf[idx].enabled && (reader_is_door_open(idx) != _last_door_state[idx]))
-				{
-					DEBUGSTR("new door state\n");
-					_last_door_state[idx] = !_last_door_state[idx];
-					terminal_send_door_status(idx, _last_door_state[idx]);
-				}
-			}
+      if (!reader_conf[idx].enabled) continue;
+
+      term_door_t * ptr_door = &_door[idx];
+      TickType_t edge = reader_get_door_edge_tick(idx);
+      bool is_open = reader_is_door_open(idx);
+
+      if (is_open != ptr_door->is_open)
+      {
+        if (now - edge >= debounce)
+        {
+          // Stable new state.
+          DEBUGSTR("new door state\n");
+          ptr_door->is_open = is_open;
+          if (is_open)
+          {
+            ptr_door->open_since = edge;
+            ptr_door->held_alarm = false;
+            terminal_door_event(idx, reader_is_unlocked(idx) ? DATA_DOOR_STATUS_OPEN : DATA_DOOR_STATUS_FORCED);
+          }
+          else
+          {
+            terminal_door_event(idx, DATA_DOOR_STATUS_CLOSED);
+          }
+          continue;
+        }
+        _door_wait_until(&wait, now, edge, debounce);
+      }
+
+      if (ptr_door->is_open && !ptr_door->held_alarm)
+      {
+        if (now - ptr_door->open_since >= held_open)
+        {
+          DEBUGSTR("door held open\n");
+          ptr_door->held_alarm = true;
+          terminal_door_event(idx, DATA_DOOR_STATUS_HELD);
+          continue;
+        }
+        _door_wait_until(&wait, now, ptr_door->open_since, held_open);
+      }
+
+      if (send_all)
+      {
+        terminal_send_door_status(idx, ptr_door->is_open ? DATA_DOOR_STATUS_OPEN : DATA_DOOR_STATUS_CLOSED);
+      }
     }
-    send_door_status++;
+
+    // Sleep until next deadline or sensor edge.
+    xTaskNotifyWait(0, UINT32_MAX, NULL, wait);
   }
 }
+#endif
 
 void terminal_init(void)
 {
   // Initialize configuration for terminal.
   configASSERT(terminal_config_init());
 
-  // Assign CAN callback functions of on-chip drivers.
-  CCAN_CALLBACKS_T term_can_callbacks =
-  {
-    term_can_recv,  // Callback for any message received CAN frame which ID
-                    // matches with any of the message objects' masks.
-    term_can_send,  // Callback for every transmitted CAN frame.
-    term_can_error, // Callback for CAN errors.
-    NULL,           // Not used.
-    NULL,           // Not used.
-    NULL,           // Not used.
-    NULL,           // Not used.
-    NULL,           // Not used.
-  };
+  // Set up timer for CAN bit rate switch before commands can come.
+  timer_wheel_setup(&_bit_rate_timer, _timer_callback, _bit_rate_timer_id, TIMER_WHEEL_TASK);
+  timer_wheel_setup(&_can_timer, _timer_callback, _can_timer_id, TIMER_WHEEL_TASK);
 
-  // Init CAN driver.
-  CAN_init(&term_can_callbacks, CAN_BAUD_RATE);
+  // Init CAN driver (bit rate from storage, default if it is not supported).
+  // Controller joins the bus early but received frames wait in message objects
+  // until the rest of the panel is initialized.
+  __disable_irq();
+  if (!_terminal_can_start(get_can_bit_rate()))
+  {
+    DEBUGSTR("bit rate not supported\n");
+    bool started = _terminal_can_start(CAN_BAUD_RATE);
+    configASSERT(started);
+  }
+  CAN_set_irq(false);
+  __enable_irq();
 
-  // CAN msg filter for door A.
-  CAN_recv_filter(ACS_MSGOBJ_RECV_DOOR_A,
-                  get_reader_a_addr() << ACS_DST_ADDR_OFFSET,
-                  ACS_DST_ADDR_MASK, true);
-  // CAN msg filter for door B.
-  CAN_recv_filter(ACS_MSGOBJ_RECV_DOOR_B,
-                  get_reader_b_addr() << ACS_DST_ADDR_OFFSET,
-                  ACS_DST_ADDR_MASK, true);
-  // CAN msg filter for broadcast.
-  CAN_recv_filter(ACS_MSGOBJ_RECV_BCAST,
-                  ACS_BROADCAST_ADDR << ACS_DST_ADDR_OFFSET,
-                  ACS_DST_ADDR_MASK, true);
+#if CACHING_ENABLED && CACHE_JOURNAL_ENABLED
+  // Restore cache content before communication starts.
+  if (!cache_journal_restore())
+  {
+    DEBUGSTR("cache restore fail\n");
+  }
+#ifdef DEBUG
+  configASSERT(static_cache_check());
+#endif
+  _cache_epoch_valid = cache_journal_get_epoch(&_cache_epoch);
+#endif
+
+  // Events which were not uploaded before reset.
+  if (!event_log_restore())
+  {
+    DEBUGSTR("event log restore fail\n");
+  }
+
+  // Parameters set by master replace defaults from terminal_config.h.
+  for (uint8_t id = 0; id < ACS_READER_MAXCOUNT; ++id)
+  {
+    for (uint8_t param = 0; param < DATA_CONFIG_PARAM_COUNT; ++param)
+    {
+      uint16_t value;
+      if (get_door_param(id, param, &value) && !_terminal_param_apply(&reader_conf[id], param, value))
+      {
+        DEBUGSTR("door config invalid\n");
+      }
+    }
+  }
 
   // Initialize card readers.
   for (size_t id = 0; id < ACS_READER_MAXCOUNT; ++id)
@@ -475,13 +1795,28 @@ void terminal_init(void)
     if (reader_conf[id].enabled) terminal_reconfigure(NULL, id);
   }
 
-  // Create timer for master alive status timeout.
-  _act_timer = xTimerCreate("MAT", (ACS_MASTER_ALIVE_TIMEOUT_MS / portTICK_PERIOD_MS),
-               pdTRUE, (void *)_act_timer_id, _timer_callback);
-  configASSERT(_act_timer);
+  // Set up timer for checking heartbeats of masters (started by terminal task).
+  timer_wheel_setup(&_act_timer, _timer_callback, _act_timer_id, TIMER_WHEEL_TASK);
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    timer_wheel_setup(&_auth_timer[idx], _timer_callback, _auth_timer_id + idx, TIMER_WHEEL_TASK);
+  }
+
+  // Last frame of each message object (e.g. master alive) is processed now.
+  CAN_set_irq(true);
 
   // Create task for terminal loop.
-  xTaskCreate(terminal_task, "term_tsk", configMINIMAL_STACK_SIZE + 128, NULL, (tskIDLE_PRIORITY + 1UL), NULL);
+  diag_register_task(xTaskCreateStatic(terminal_task, "term_tsk", TERMINAL_TASK_STACK_SIZE, NULL,
+                                       (tskIDLE_PRIORITY + 1UL), _terminal_task_stack, &_terminal_task_tcb));
+
+#ifdef DOOR_SENSOR_TYPE
+  // Create task for door status reporting (higher priority for fast alarms).
+  _door_task_handle = xTaskCreateStatic(door_task, "door", DOOR_TASK_STACK_SIZE, NULL, (tskIDLE_PRIORITY + 2UL),
+                                        _door_task_stack, &_door_task_tcb);
+  configASSERT(_door_task_handle);
+  diag_register_task(_door_task_handle);
+  reader_set_door_event_task(_door_task_handle);
+#endif
 }
 
 void terminal_reconfigure(reader_conf_t * reader_cfg, uint8_t reader_idx)
@@ -489,6 +1824,7 @@ void terminal_reconfigure(reader_conf_t * reader_cfg, uint8_t reader_idx)
   if (reader_idx >= ACS_READER_MAXCOUNT) return;
 
   portENTER_CRITICAL(); // Effectively disables interrupts.
+  PROFILER_BEGIN(profiler_crit_reconfigure);
 
   if (reader_cfg != NULL)
   {
@@ -513,5 +1849,6 @@ void terminal_reconfigure(reader_conf_t * reader_cfg, uint8_t reader_idx)
     reader_init(reader_idx);
   }
 
+  PROFILER_END(profiler_crit_reconfigure);
   portEXIT_CRITICAL();
 }
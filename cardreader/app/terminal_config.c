@@ -9,120 +9,271 @@
 
 #include "terminal_config.h"
 #include "storage.h"
+#include "storage_service.h"
 #include "watchdog.h"
 #include "acs_can_protocol.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
 
 // Network address mask.
 #define ACS_ADDR_BIT_MASK ((1 << ACS_ADDR_BITS) - 1)
 
-// Door addresses in ACS.
-uint16_t _READER_A_ADDR = ACS_PNL_FIRST_ADDR;     // even
-uint16_t _READER_B_ADDR = ACS_PNL_FIRST_ADDR + 1; // odd
+// Address of the first door in ACS (following doors have consecutive addresses).
+uint16_t _READER_BASE_ADDR = ACS_PNL_FIRST_ADDR;
 
+// CAN bit rate (b/s).
+static uint32_t _CAN_BIT_RATE = CAN_BAUD_RATE;
 
-inline uint16_t get_reader_a_addr(void)
+// Application image state and CRC (written by boot loader).
+static uint8_t _FW_STATE = FW_STATE_CONFIRMED;
+static uint32_t _FW_CRC = UINT32_MAX;
+
+// Door parameters set by master (UINT16_MAX if not set), whole block as stored.
+static uint16_t _DOOR_PARAMS[ACS_READER_LIMIT][STORE_DOOR_PARAMS];
+
+// Write of door parameters is queued in storage service.
+static bool _door_params_save_queued = false;
+
+
+inline uint16_t get_reader_addr(uint8_t reader_idx)
 {
-  return _READER_A_ADDR;
+  return _READER_BASE_ADDR + reader_idx;
 }
 
-inline uint16_t get_reader_b_addr(void)
+inline uint8_t get_reader_idx(uint16_t acs_addr)
 {
- return _READER_B_ADDR;
+  uint16_t offset = acs_addr - _READER_BASE_ADDR;
+  return (acs_addr >= _READER_BASE_ADDR && offset < ACS_READER_MAXCOUNT ? offset : ACS_READER_MAXCOUNT);
 }
 
-static bool _load_acs_addrs_from_ext_stor(void)
+// Read whole configuration by one transfer (see organization in terminal_config.h).
+static bool _load_config_from_ext_stor(bool * ptr_setup_req)
 {
-  bool ret_val = true;
+  uint8_t conf[STORE_CONFIG_SIZE];
+
+  if (!storage_read(PTR_READER_FIRST_ADDR, conf, sizeof(conf))) return false;
 
-  uint16_t first_addr = 0;
+  set_reader_addr(conf[PTR_READER_FIRST_ADDR] | (conf[PTR_READER_FIRST_ADDR + 1] << 8));
 
-  ret_val &= storage_read_word_le(PTR_READER_FIRST_ADDR, &first_addr);
+  // Erased storage keeps the default bit rate.
+  uint16_t bit_rate_kbps = conf[PTR_CAN_BIT_RATE] | (conf[PTR_CAN_BIT_RATE + 1] << 8);
+  if (bit_rate_kbps != 0 && bit_rate_kbps != UINT16_MAX) _CAN_BIT_RATE = (uint32_t)bit_rate_kbps * 1000;
+
+  *ptr_setup_req = (conf[PTR_BOOT_SETUP] == BOOT_SETUP_REQUEST);
+
+  _FW_STATE = conf[PTR_FW_STATE];
+  _FW_CRC = conf[PTR_FW_CRC] | (conf[PTR_FW_CRC + 1] << 8) | (conf[PTR_FW_CRC + 2] << 16) |
+            ((uint32_t)conf[PTR_FW_CRC + 3] << 24);
+
+  return true;
+}
+
+// CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF).
+static uint16_t _crc16(const uint8_t * data, uint8_t len)
+{
+  uint16_t crc = 0xFFFF;
 
-  if (ret_val)
+  while (len--)
   {
-    set_reader_addr(first_addr);
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+    }
   }
+  return crc;
+}
 
-  return ret_val;
+// Read door configuration block. Parameters of invalid block (other version, interrupted
+// write or erased storage) are not set.
+static bool _load_door_params_from_ext_stor(void)
+{
+  uint8_t block[STORE_DOOR_CONFIG_SIZE];
+
+  memset(_DOOR_PARAMS, 0xFF, sizeof(_DOOR_PARAMS));
+
+  if (!storage_read(PTR_DOOR_CONFIG, block, sizeof(block))) return false;
+
+  const uint8_t len = sizeof(block) - 2;
+  if (block[0] != STORE_DOOR_CONFIG_VERSION || _crc16(block, len) != (block[len] | (block[len + 1] << 8)))
+  {
+    return true;
+  }
+
+  const uint8_t * ptr_param = &block[1];
+  for (uint8_t idx = 0; idx < ACS_READER_LIMIT; ++idx)
+  {
+    for (uint8_t param = 0; param < STORE_DOOR_PARAMS; ++param, ptr_param += 2)
+    {
+      _DOOR_PARAMS[idx][param] = ptr_param[0] | (ptr_param[1] << 8);
+    }
+  }
+  return true;
+}
+
+// Write door configuration block. Executed by storage task.
+static void _save_door_params_to_ext_stor(void * ptr_arg)
+{
+  (void)ptr_arg;
+  uint8_t block[STORE_DOOR_CONFIG_SIZE];
+  uint8_t * ptr_param = &block[1];
+
+  // Parameters set from now on need another write.
+  taskENTER_CRITICAL();
+  _door_params_save_queued = false;
+  for (uint8_t idx = 0; idx < ACS_READER_LIMIT; ++idx)
+  {
+    for (uint8_t param = 0; param < STORE_DOOR_PARAMS; ++param, ptr_param += 2)
+    {
+      ptr_param[0] = (uint8_t)_DOOR_PARAMS[idx][param];
+      ptr_param[1] = (uint8_t)(_DOOR_PARAMS[idx][param] >> 8);
+    }
+  }
+  taskEXIT_CRITICAL();
+
+  block[0] = STORE_DOOR_CONFIG_VERSION;
+  const uint8_t len = sizeof(block) - 2;
+  const uint16_t crc = _crc16(block, len);
+  block[len] = (uint8_t)crc;
+  block[len + 1] = (uint8_t)(crc >> 8);
+
+  // Block starts at page boundary.
+  for (uint8_t pos = 0; pos < sizeof(block); pos += STORE_PAGE_SIZE)
+  {
+    uint8_t chunk = (sizeof(block) - pos < STORE_PAGE_SIZE ? sizeof(block) - pos : STORE_PAGE_SIZE);
+    if (!storage_write_page(PTR_DOOR_CONFIG + pos, &block[pos], chunk))
+    {
+      DEBUGSTR("door config write fail\n");
+      return;
+    }
+  }
 }
 
 static bool _save_acs_addrs_to_ext_stor(void)
 {
   bool ret_val = true;
 
-  ret_val &= storage_write_word_le(PTR_READER_FIRST_ADDR, _READER_A_ADDR);
+  ret_val &= storage_write_word_le(PTR_READER_FIRST_ADDR, _READER_BASE_ADDR);
 
   return ret_val;
 }
 
+uint32_t get_can_bit_rate(void)
+{
+  return _CAN_BIT_RATE;
+}
+
+bool set_can_bit_rate(uint32_t bit_rate)
+{
+  const uint16_t bit_rate_kbps = (uint16_t)(bit_rate / 1000);
+  const uint8_t data[] = {(uint8_t)bit_rate_kbps, (uint8_t)(bit_rate_kbps >> 8)}; // little-endian
+
+  if (!storage_service_write(PTR_CAN_BIT_RATE, data, sizeof(data), NULL, NULL)) return false;
+
+  _CAN_BIT_RATE = bit_rate;
+  return true;
+}
+
+uint8_t get_fw_state(void)
+{
+  return _FW_STATE;
+}
+
+uint32_t get_fw_crc(void)
+{
+  return _FW_CRC;
+}
+
+bool set_fw_state(uint8_t state, void (*done)(bool ok, void * ptr_arg))
+{
+  if (!storage_service_write(PTR_FW_STATE, &state, sizeof(state), done, NULL)) return false;
+
+  _FW_STATE = state;
+  return true;
+}
+
+bool get_door_param(uint8_t reader_idx, uint8_t param, uint16_t * ptr_value)
+{
+  if (reader_idx >= ACS_READER_MAXCOUNT || param >= STORE_DOOR_PARAMS) return false;
+
+  *ptr_value = _DOOR_PARAMS[reader_idx][param];
+  return (*ptr_value != UINT16_MAX);
+}
+
+bool set_door_param(uint8_t reader_idx, uint8_t param, uint16_t value)
+{
+  if (reader_idx >= ACS_READER_MAXCOUNT || param >= STORE_DOOR_PARAMS) return false;
+
+  taskENTER_CRITICAL();
+  _DOOR_PARAMS[reader_idx][param] = value;
+  bool queued = _door_params_save_queued;
+  _door_params_save_queued = true;
+  taskEXIT_CRITICAL();
+
+  if (queued) return true;
+  if (storage_service_call(_save_door_params_to_ext_stor, NULL)) return true;
+
+  _door_params_save_queued = false;
+  return false;
+}
+
 void set_reader_addr(uint16_t acs_addr)
 {
   acs_addr &= ACS_ADDR_BIT_MASK;
 
-  if (acs_addr & 0x1) // even address
-  {
-    _READER_B_ADDR = acs_addr;
-    _READER_A_ADDR = acs_addr - 1;
-  }
-  else // odd address
-  {
-    _READER_A_ADDR = acs_addr;
-    _READER_B_ADDR = acs_addr + 1;
-  }
+  if (acs_addr < ACS_PNL_FIRST_ADDR) acs_addr = ACS_PNL_FIRST_ADDR;
+
+  // Align to the first door of the panel.
+  _READER_BASE_ADDR = acs_addr - ((acs_addr - ACS_PNL_FIRST_ADDR) % ACS_READER_MAXCOUNT);
 }
 
-static inline uint16_t _setup_addr_from_console(void)
+// Read panel address from console. Waits until both bytes are entered.
+static uint16_t _setup_addr_from_console(void)
 {
   uint16_t acs_addr = 0;
 
   while (Board_UARTGetChar() != EOF); // flush read buffer
-  for (volatile uint32_t i = 0; i < SystemCoreClock/4; ++i)
+  Board_UARTPutSTR("Panel address setup (enter in bin format - 2 bytes, MSB first):\n");
+
+  // read address
+  int addr_byte;
+  while ((addr_byte = Board_UARTGetChar()) == EOF) WDT_Feed();
+  acs_addr = addr_byte << 8;
+  while ((addr_byte = Board_UARTGetChar()) == EOF) WDT_Feed();
+  acs_addr |= addr_byte;
+
+  if (acs_addr >= ACS_PNL_FIRST_ADDR && acs_addr <= ACS_PNL_LAST_ADDR)
   {
-    WDT_Feed();
+    Board_UARTPutSTR("ok\n");
   }
-  if (Board_UARTGetChar() == 's')
+  else
   {
-    while (Board_UARTGetChar() != EOF); // flush read buffer
-    Board_UARTPutSTR("Panel address setup (enter in bin format - 2 bytes, MSB first):\n");
-
-    // read address
-    int addr_byte;
-    while ((addr_byte = Board_UARTGetChar()) == EOF) WDT_Feed();
-    acs_addr = addr_byte << 8;
-    while ((addr_byte = Board_UARTGetChar()) == EOF) WDT_Feed();
-    acs_addr = addr_byte;
-
-    if (acs_addr >= ACS_PNL_FIRST_ADDR && acs_addr <= ACS_PNL_LAST_ADDR)
-    {
-      Board_UARTPutSTR("ok\n");
-    }
-    else
-    {
-      acs_addr = 0;
-      Board_UARTPutSTR("fail\n");
-    }
+    acs_addr = 0;
+    Board_UARTPutSTR("fail\n");
   }
   return acs_addr;
 }
 
 bool terminal_config_init(void)
 {
-  bool ret_val = true;
-  uint16_t acs_addr = 0;
-
-  acs_addr = _setup_addr_from_console();
+  bool setup_req = false;
+  bool ret_val = _load_config_from_ext_stor(&setup_req);
+  ret_val &= _load_door_params_from_ext_stor();
 
-  if (acs_addr != 0)
+  // Console setup blocks the boot - it is entered only on request.
+  if (Board_Setup_Strap() || setup_req)
   {
-    set_reader_addr(acs_addr);
+    uint16_t acs_addr = _setup_addr_from_console();
+
+    if (acs_addr != 0)
+    {
+      set_reader_addr(acs_addr);
 #if (ENABLE_LOCAL_ACS_ADDR_WRITE)
-    ret_val &= _save_acs_addrs_to_ext_stor();
+      ret_val &= _save_acs_addrs_to_ext_stor();
 #endif
-  }
-  else
-  {
-  	//Read ACS ID from external storage
-  	ret_val &= _load_acs_addrs_from_ext_stor();
+    }
+    if (setup_req) ret_val &= storage_write_byte(PTR_BOOT_SETUP, 0x00);
   }
 
   return ret_val;
@@ -16,6 +16,7 @@
 //#define DEVEL_BOARD // LPCXpresso11C24 development board
 
 #define FW_VERSION_STR "1.1.1"
+#define FW_VERSION     0x0111 // FW_VERSION_STR in BCD (reported in DATA_DIAG_PAGE_FIRMWARE).
 
 //-------------------------------------------------------------
 // General settings.
@@ -28,19 +29,56 @@
 // Cache expiration is to be handled by master (Not implemented)
 #define CACHING_ENABLED 0
 
+// Enable journal of cache changes in external storage (requires CACHING_ENABLED).
+// Cache is restored from the journal on startup.
+#define CACHE_JOURNAL_ENABLED 1
+
 // CAN bus speed b/s - affects maximum data cable length.
-// Suggested option for common use are 100kbit/s and 125kbit/s.
+// Suggested option for common use are 100kbit/s and 125kbit/s (500kbit/s for short buses).
+// This is the default, master can set another one (FC_BIT_RATE) which is kept in external storage.
+// Supported: 50k, 100k, 125k, 250k, 500k, 800k, 1M (see can_term_driver.c).
 #define CAN_BAUD_RATE 125000
 
+// CAN bus-off recovery. Controller is restarted after backoff which doubles with each bus-off
+// during recovery. Panel is reset after CAN_BUS_OFF_MAX_FAILURES of them.
+#define CAN_BUS_OFF_BACKOFF_MIN_MS 100
+#define CAN_BUS_OFF_BACKOFF_MAX_MS 5000
+#define CAN_BUS_OFF_STABLE_MS      10000 // Recovery ends after this time without bus-off.
+#define CAN_BUS_OFF_MAX_FAILURES   8
+
 // Setting for I2C external storage for door adresses
 // (EEPROM, IO EXPANDER or device with same access).
 #define STORE_I2C_BUS_FREQ   400000 // 100kHz or 400kHz
 #define STORE_I2C_SLAVE_ADDR 0x50   // 7bit address
+#define STORE_SIZE           8192   // bytes (24C64 - cache journal holds the whole cache)
+#define STORE_PAGE_SIZE      16     // bytes (aligned part of 32 B page of 24C64)
+#define STORE_ADDR_SIZE      2      // Bytes of memory address (1 for 24C01 - 24C16 with block select in slave address).
+#define STORE_QUEUE_LEN      8      // Requests waiting for storage task.
+
+// Firmware update over CAN (FC_FW_UPDATE). Boot loader occupies the first flash sector,
+// application is linked after it (see cmake/acs-panel-boot.ld and cmake/acs-panel_*.ld).
+// Updated image runs on trial until master is seen (FC_ALIVE), boot loader waits for
+// the previous image after FW_TRIAL_BOOTS resets without it (and starts the trial image
+// again after FW_ENTER_TIMEOUT_MS).
+#define FW_FLASH_SIZE   0x8000
+#define FW_SECTOR_SIZE  0x1000
+#define FW_APP_BASE     FW_SECTOR_SIZE
+#define FW_APP_SIZE     (FW_FLASH_SIZE - FW_APP_BASE)
+#define FW_TRIAL_BOOTS  3
+#define FW_ENTER_TIMEOUT_MS 60000 // Boot loader returns to application if master does not start update.
+
+// Number of doors (card readers) driven by the panel (1 - ACS_READER_LIMIT).
+// Panel occupies the same number of consecutive network addresses.
+#define ACS_READER_MAXCOUNT 2
 
 // Internal index of card readers (can be only swapped).
 #define ACS_READER_A_IDX 0
 #define ACS_READER_B_IDX 1
+#define ACS_READER_C_IDX 2
+#define ACS_READER_D_IDX 3
 
+// Door parameters (also ENABLED, OPEN_TIME_MS and OK_GLED_TIME_MS of each reader below) are defaults,
+// master can change them at runtime (FC_CONFIG, kept in external storage).
 #define BEEP_ON_SUCCESS true
 #define OK_LED_ON_SUCCESS true
 
@@ -51,6 +89,35 @@
 // If DOOR_SENSOR_TYPE is defined enables door sensor.
 #define DOOR_SENSOR_TYPE SENSOR_IS_NO
 
+// Door status reporting.
+#define DOOR_SENSOR_DEBOUNCE_MS   50    // Sensor must be stable for this time.
+#define DOOR_HELD_OPEN_ALARM_MS   30000 // Door open longer raises alarm.
+#define DOOR_STATUS_HEARTBEAT_MS  60000 // Period of status refresh.
+
+// Reader interfaces.
+#define READER_IF_WEIGAND 0
+#define READER_IF_OSDP    1 // Requires OSDP_ENABLED.
+
+// OSDP readers on RS-485 bus (UART is then not available for debug console).
+#define OSDP_ENABLED           0
+#define OSDP_BAUD_RATE         9600
+#define OSDP_DE_PORT           1    // RS-485 driver enable.
+#define OSDP_DE_PIN            9
+#define OSDP_REPLY_TIMEOUT_MS  200
+#define OSDP_POLL_GAP_MS       20   // Bus idle time between commands.
+#define OSDP_OFFLINE_RETRIES   3    // Commands without reply before reader is offline.
+
+// Profiler of interrupt handlers and critical sections (uses CT16B1, see profiler.h).
+// Statistics are read by master (FC_DIAG) and printed to debug console in DEBUG build.
+#define PROFILER_ENABLED          0
+#define PROFILER_PRINT_PERIOD_MS  60000
+
+// Strap for console setup of panel address at boot (pin tied low at reset, internal pull-up).
+// Setup can also be requested by flag in external storage (PTR_BOOT_SETUP).
+#define SETUP_STRAP_PORT  1
+#define SETUP_STRAP_PIN   0
+#define SETUP_STRAP_FUNC  IOCON_FUNC1 // GPIO function of the pin.
+
 // Communication status led.
 #define ACS_COMM_STATUS_LED_PORT  0
 #define ACS_COMM_STATUS_LED_PIN   6
@@ -66,43 +133,146 @@ extern unsigned int TERMINAL_UID[5]; // 0 - status code, 1 - least significant w
 //-------------------------------------------------------------
 //
 // Read from external storage on startup
-// Designed to be even (address A) and odd (address B)
-// Always true: ADDR_B = ADDR_A + 1
+// Panel base address is aligned to ACS_READER_MAXCOUNT from ACS_PNL_FIRST_ADDR
+// Always true: ADDR = BASE_ADDR + reader index
 
 /**
-* @brief Get network address of door A.
+* @brief Get network address of door.
+*
+* @param reader_idx ... Index of the reader (less than ACS_READER_MAXCOUNT).
+*/
+extern uint16_t get_reader_addr(uint8_t reader_idx);
+/**
+* @brief Get reader index for network address.
+*
+* @param acs_addr ... ACS network address.
+*
+* @return reader index or ACS_READER_MAXCOUNT if the address does not belong to the panel
+*/
+extern uint8_t get_reader_idx(uint16_t acs_addr);
+/**
+* @brief Get CAN bit rate (stored in external storage or default CAN_BAUD_RATE).
 *
+* @return bit rate in b/s
 */
-extern uint16_t get_reader_a_addr(void);
+uint32_t get_can_bit_rate(void);
 /**
-* @brief Get network address of door B.
+* @brief Store CAN bit rate to external storage.
 *
+*        Write is queued in storage service (does not wait for storage).
+*
+* @param bit_rate ... bit rate in b/s (used from next start).
+*
+* @return true if write was queued
+*/
+bool set_can_bit_rate(uint32_t bit_rate);
+/**
+* @brief Get state of application image (see FW_STATE_...).
+*
+* @return state loaded from external storage at boot
 */
-extern uint16_t get_reader_b_addr(void);
+uint8_t get_fw_state(void);
+/**
+* @brief Get CRC of application image written by boot loader.
+*
+* @return CRC-32 or 0xFFFFFFFF if the image was not written by boot loader
+*/
+uint32_t get_fw_crc(void);
+/**
+* @brief Store state of application image to external storage.
+*
+*        Write is queued in storage service (does not wait for storage).
+*
+* @param state ... FW_STATE_... (boot loader acts on it at next start)
+* @param done ... completion callback or NULL (storage_done_t)
+*
+* @return true if write was queued
+*/
+bool set_fw_state(uint8_t state, void (*done)(bool ok, void * ptr_arg));
+/**
+* @brief Get stored configuration parameter of the door.
+*
+* @param reader_idx ... Index of the reader (less than ACS_READER_MAXCOUNT).
+* @param param ... parameter number (less than STORE_DOOR_PARAMS, see DATA_CONFIG_...)
+* @param ptr_value ... stored value
+*
+* @return false if the parameter is not stored (default from this file is used)
+*/
+bool get_door_param(uint8_t reader_idx, uint8_t param, uint16_t * ptr_value);
+/**
+* @brief Store configuration parameter of the door to external storage.
+*
+*        Whole block is written by storage service (does not wait for storage),
+*        parameters set before the write are stored together.
+*
+* @param reader_idx ... Index of the reader (less than ACS_READER_MAXCOUNT).
+* @param param ... parameter number (less than STORE_DOOR_PARAMS, see DATA_CONFIG_...)
+* @param value ... value (applied by caller)
+*
+* @return true if write was queued
+*/
+bool set_door_param(uint8_t reader_idx, uint8_t param, uint16_t value);
 /**
  * @brief Address setter.
  *
- * @param acs_addr ... ACS network address (odd or even).
+ * @param acs_addr ... ACS network address (of any door of the panel).
  */
 void set_reader_addr(const uint16_t acs_addr);
 
 // Expected organization in external address space:
-// | 0x00 | A_ADDR [7:0]
-// | 0x01 | A_ADDR [9:8]
+// | 0x00 | BASE_ADDR [7:0]
+// | 0x01 | BASE_ADDR [9:8]
 //          PADDING [15:10]
+// | 0x02 | CAN bit rate in kbit/s [7:0] (0xFFFF if not set)
+// | 0x03 | CAN bit rate in kbit/s [15:8]
+// | 0x04 | BOOT_SETUP_REQUEST if console setup is requested for the next boot
+// | 0x05 | FW_STATE_... of application image
+// | 0x06 | Boots of trial image
+// | 0x07 - 0x0A | CRC of application image written by boot loader (little-endian)
+// | 0x0B - 0x0C | sequence number of the oldest event log record to upload (little-endian)
+// | 0x10 | STORE_DOOR_CONFIG_VERSION of door configuration block
+// | 0x11 - 0x40 | door parameters (STORE_DOOR_PARAMS for each of ACS_READER_LIMIT doors, little-endian,
+//                 0xFFFF if not set)
+// | 0x41 - 0x42 | CRC-16 (CCITT) of 0x10 - 0x40 (little-endian)
+// | 0x50 - 0x1DFF | cache journal records
+// | 0x1E00 - STORE_SIZE | event log records
 
 // The address actually uses less then 16 bits. See address bit width in ACS protocol.
 
 #define PTR_READER_FIRST_ADDR 0x0 // pointer to external memory
+#define PTR_CAN_BIT_RATE 0x2
+#define PTR_BOOT_SETUP 0x4
+#define PTR_FW_STATE 0x5
+#define PTR_FW_TRIAL 0x6
+#define PTR_FW_CRC   0x7
+#define STORE_CONFIG_SIZE 11 // Bytes 0x00 - 0x0A are read at boot by one transfer.
+#define PTR_EVENT_LOG_TAIL 0xB
+#define PTR_DOOR_CONFIG 0x10 // door configuration block (page aligned)
+#define STORE_DOOR_PARAMS 6
+#define STORE_DOOR_CONFIG_VERSION 1 // Block of other version is ignored.
+#define STORE_DOOR_CONFIG_SIZE (1 + ACS_READER_LIMIT * STORE_DOOR_PARAMS * 2 + 2)
+#define PTR_CACHE_JOURNAL_FIRST 0x50 // start of cache journal (page aligned)
+#define PTR_CACHE_JOURNAL_END   PTR_EVENT_LOG_FIRST // end of cache journal (page aligned)
+#define PTR_EVENT_LOG_FIRST (STORE_SIZE - 0x200) // start of event log (page aligned)
+#define PTR_EVENT_LOG_END   STORE_SIZE // end of event log (page aligned)
 #define STORE_DEV_BUSY_FOR 50 // Number of read commands to try before EEPROM timeout
 
+#define BOOT_SETUP_REQUEST 0xA5 // Erased storage (0xFF) does not request setup.
+
+// Application image states. Any other value (erased storage too) is confirmed image.
+#define FW_STATE_CONFIRMED 0x00
+#define FW_STATE_UPDATE    0xB4 // Boot loader waits for update (until the image is finished).
+#define FW_STATE_TRIAL     0x5A // Updated image is not confirmed yet.
+#define FW_STATE_ROLLBACK  0x3C // Trial failed, boot loader waits for update.
+
 //---------------------------------------------------------------------------------------------------------------------
 // Settings for RFID reader A
 //---------------------------------------------------------------------------------------------------------------------
 #define ACS_READER_A_ENABLED         true
+#define ACS_READER_A_INTERFACE       READER_IF_WEIGAND
+#define ACS_READER_A_OSDP_ADDR       0x00 // Reader address on OSDP bus.
 
-#define ACS_READER_A_DATA_PORT       3 // Port must be unique for each reader
-                                       // Can be only 2 or 3.
+#define ACS_READER_A_DATA_PORT       3 // Can be only 2 or 3.
 #define ACS_READER_A_D0_PIN     2
 #define ACS_READER_A_D1_PIN     1
 #define ACS_READER_A_BEEP_PORT  2
@@ -123,9 +293,10 @@ void set_reader_addr(const uint16_t acs_addr);
 // Settings for RFID reader B
 //---------------------------------------------------------------------------------------------------------------------
 #define ACS_READER_B_ENABLED         true
+#define ACS_READER_B_INTERFACE       READER_IF_WEIGAND
+#define ACS_READER_B_OSDP_ADDR       0x01 // Reader address on OSDP bus.
 
-#define ACS_READER_B_DATA_PORT       2 // Port must be unique for each reader
-                                       // Can be only 2 or 3.
+#define ACS_READER_B_DATA_PORT       2 // Can be only 2 or 3.
 #define ACS_READER_B_D0_PIN     8
 #define ACS_READER_B_D1_PIN     6
 #define ACS_READER_B_BEEP_PORT  2
@@ -142,22 +313,77 @@ void set_reader_addr(const uint16_t acs_addr);
 #define ACS_READER_B_OPEN_TIME_MS         5000
 #define ACS_READER_B_OK_GLED_TIME_MS      500
 
+//---------------------------------------------------------------------------------------------------------------------
+// Settings for RFID reader C (used when ACS_READER_MAXCOUNT > 2, not with DEVEL_BOARD LEDs on PIO0_7 - PIO0_9)
+//---------------------------------------------------------------------------------------------------------------------
+#define ACS_READER_C_ENABLED         true
+#define ACS_READER_C_INTERFACE       READER_IF_WEIGAND
+#define ACS_READER_C_OSDP_ADDR       0x02 // Reader address on OSDP bus.
+
+#define ACS_READER_C_DATA_PORT       2 // Can be only 2 or 3.
+#define ACS_READER_C_D0_PIN     4
+#define ACS_READER_C_D1_PIN     5
+#define ACS_READER_C_BEEP_PORT  3
+#define ACS_READER_C_BEEP_PIN   4
+#define ACS_READER_C_GLED_PORT  3
+#define ACS_READER_C_GLED_PIN   5
+#define ACS_READER_C_RLED_PORT  2
+#define ACS_READER_C_RLED_PIN   9
+#define ACS_READER_C_RELAY_PORT           0
+#define ACS_READER_C_RELAY_PIN            8
+#define ACS_READER_C_SENSOR_PORT          0 // Can be only 0 or 1.
+#define ACS_READER_C_SENSOR_PIN           3
+
+#define ACS_READER_C_OPEN_TIME_MS         5000
+#define ACS_READER_C_OK_GLED_TIME_MS      500
+
+//---------------------------------------------------------------------------------------------------------------------
+// Settings for RFID reader D (used when ACS_READER_MAXCOUNT > 3, not with DEVEL_BOARD LEDs on PIO0_7 - PIO0_9)
+//---------------------------------------------------------------------------------------------------------------------
+#define ACS_READER_D_ENABLED         true
+#define ACS_READER_D_INTERFACE       READER_IF_WEIGAND
+#define ACS_READER_D_OSDP_ADDR       0x03 // Reader address on OSDP bus.
+
+#define ACS_READER_D_DATA_PORT       3 // Can be only 2 or 3.
+#define ACS_READER_D_D0_PIN     0
+#define ACS_READER_D_D1_PIN     3
+#define ACS_READER_D_BEEP_PORT  2
+#define ACS_READER_D_BEEP_PIN   11
+#define ACS_READER_D_GLED_PORT  0
+#define ACS_READER_D_GLED_PIN   9
+#define ACS_READER_D_RLED_PORT  0
+#define ACS_READER_D_RLED_PIN   2
+#define ACS_READER_D_RELAY_PORT           0
+#define ACS_READER_D_RELAY_PIN            7
+#define ACS_READER_D_SENSOR_PORT          1 // Can be only 0 or 1.
+#define ACS_READER_D_SENSOR_PIN           4
+
+#define ACS_READER_D_OPEN_TIME_MS         5000
+#define ACS_READER_D_OK_GLED_TIME_MS      500
+
 
 //---------------------------------------------------------------------------------------------------------------------
 // Internal setting
 //---------------------------------------------------------------------------------------------------------------------
 
 // Not user modifiable.
-#define WEIGAND_DEVICE_LIMIT 4
-#define SERIAL_DEVICE_LIMIT 0
-#define ACS_READER_MAXCOUNT 2
+#define WEIGAND_DEVICE_LIMIT 4 // One timer match register for each device.
+#define SERIAL_DEVICE_LIMIT 4 // OSDP readers.
+#define ACS_READER_LIMIT 4 // Doors per panel (cache value bits, message objects).
 #define TERMINAL_TIMER_ID 15
+#define TERMINAL_BIT_RATE_TIMER_ID 16
+#define TERMINAL_CAN_TIMER_ID 17
+#define TERMINAL_AUTH_TIMER_ID 18 // One for each door.
 
 //---------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------
 
 #define HW_WATCHDOG_TIMEOUT 2 // in seconds
 
+#if ACS_READER_MAXCOUNT < 1 || ACS_READER_MAXCOUNT > ACS_READER_LIMIT
+#error "Unsupported number of readers."
+#endif
+
 //---------------------------------------------------------------------------------------------------------------------
 // IO
 //---------------------------------------------------------------------------------------------------------------------
@@ -172,7 +398,7 @@ void set_reader_addr(const uint16_t acs_addr);
 *
 * @brief Initialize configuration for terminal.
 *
-*        Reads address from storage.
+*        Reads address and CAN bit rate from storage.
 * @note Fails if I2C bus is in invalid state
 * @return true if succeeded
 */
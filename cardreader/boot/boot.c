@@ -0,0 +1,78 @@
+/**
+ *  @file
+ *  @brief Boot loader of the panel (first flash sector).
+ *
+ *         Starts application at FW_APP_BASE or receives new one from master
+ *         (see fw_update.h). Normal boot does not touch clocks and peripherals
+ *         other than I2C of external storage.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "board.h"
+#include "storage.h"
+#include "fw_update.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define BOOT_RAM_BASE 0x10000000UL
+#define BOOT_RAM_SIZE 0x2000
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Vector table of application points to RAM (stack) and to application (reset).
+static bool _app_valid(void)
+{
+  const uint32_t * ptr_vectors = (const uint32_t *)FW_APP_BASE;
+  uint32_t sp = ptr_vectors[0];
+  uint32_t reset = ptr_vectors[1];
+
+  return (sp > BOOT_RAM_BASE && sp <= BOOT_RAM_BASE + BOOT_RAM_SIZE && (sp & 0x3) == 0 &&
+          reset > FW_APP_BASE && reset < FW_APP_BASE + FW_APP_SIZE);
+}
+
+static void _start_app(void)
+{
+  const uint32_t * ptr_vectors = (const uint32_t *)FW_APP_BASE;
+
+  // Application initializes the bus again.
+  Chip_I2C_DeInit(STORE_I2C_DEV);
+  Chip_SYSCTL_AssertPeriphReset(RESET_I2C0);
+
+  __set_MSP(ptr_vectors[0]);
+  ((void (*)(void))ptr_vectors[1])();
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+int main(void)
+{
+  bool app_valid = _app_valid();
+
+  __disable_irq();
+  SystemCoreClockUpdate();
+  storage_init();
+
+  if (fw_update_check(app_valid))
+  {
+    __enable_irq();
+    _start_app();
+  }
+
+  // CAN bit timings need main clock from PLL.
+  Board_SystemInit();
+  SystemCoreClockUpdate();
+  storage_init();
+
+  fw_update_run(app_valid);
+
+  return 0;
+}
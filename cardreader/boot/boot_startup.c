@@ -0,0 +1,99 @@
+/**
+ *  @file
+ *  @brief Startup of boot loader (vector table at address 0).
+ *
+ *         Cortex-M0 has no vector table offset register - all exceptions except reset
+ *         are forwarded to vector table of the application (FW_APP_BASE). Boot loader
+ *         itself runs with interrupts disabled.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "board.h"
+
+#define _STR(x) #x
+#define STR(x) _STR(x)
+
+extern int main(void);
+extern void _vStackTop(void);
+extern void __valid_user_code_checksum(void) __attribute__ ((weak));
+
+extern unsigned int __data_section_table;
+extern unsigned int __data_section_table_end;
+extern unsigned int __bss_section_table;
+extern unsigned int __bss_section_table_end;
+
+void ResetISR(void);
+void ForwardISR(void);
+
+__attribute__ ((used,section(".isr_vector")))
+void (* const g_pfnVectors[])(void) =
+{
+  &_vStackTop,                 // The initial stack pointer
+  ResetISR,                    // The reset handler
+  ForwardISR,                  // The NMI handler
+  ForwardISR,                  // The hard fault handler
+  0,                           // Reserved
+  0,                           // Reserved
+  0,                           // Reserved
+  __valid_user_code_checksum,  // LPC MCU Checksum
+  0,                           // Reserved
+  0,                           // Reserved
+  0,                           // Reserved
+  ForwardISR,                  // SVCall handler
+  0,                           // Reserved
+  0,                           // Reserved
+  ForwardISR,                  // The PendSV handler
+  ForwardISR,                  // The SysTick handler
+  // Wakeup sources (13), C_CAN, SSP1, I2C0, CT16B0, CT16B1, CT32B0, CT32B1, SSP0, UART0,
+  // reserved (2), ADC, WDT, BOD, reserved, PIO INT3 - PIO INT0 (see cr_startup_lpc11xx.c).
+  ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR,
+  ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR,
+  ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR,
+  ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR, ForwardISR,
+};
+
+// Jump to handler in vector table of application (number of exception is in IPSR).
+__attribute__ ((naked, section(".after_vectors")))
+void ForwardISR(void)
+{
+  __asm volatile
+  (
+    "mrs r0, ipsr         \n"
+    "lsls r0, r0, #2      \n"
+    "ldr r1, =" STR(FW_APP_BASE) "\n"
+    "ldr r0, [r1, r0]     \n"
+    "bx r0                \n"
+    ".ltorg               \n"
+  );
+}
+
+__attribute__ ((section(".after_vectors")))
+void ResetISR(void)
+{
+  unsigned int * ptr_table = &__data_section_table;
+
+  // Copy the data sections from flash to SRAM.
+  while (ptr_table < &__data_section_table_end)
+  {
+    unsigned int * ptr_src = (unsigned int *)*ptr_table++;
+    unsigned int * ptr_dest = (unsigned int *)*ptr_table++;
+    unsigned int len = *ptr_table++;
+    for (unsigned int i = 0; i < len; i += 4) *ptr_dest++ = *ptr_src++;
+  }
+
+  // Zero fill the bss segment.
+  while (ptr_table < &__bss_section_table_end)
+  {
+    unsigned int * ptr_dest = (unsigned int *)*ptr_table++;
+    unsigned int len = *ptr_table++;
+    for (unsigned int i = 0; i < len; i += 4) *ptr_dest++ = 0;
+  }
+
+  // Clock is not set up here - application runs its own SystemInit.
+  main();
+
+  while (1);
+}
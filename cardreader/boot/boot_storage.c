@@ -0,0 +1,92 @@
+/**
+ *  @file
+ *  @brief Storage implementation for boot loader.
+ *
+ *         Same as bsp/storage.c without kernel - transfers are polled.
+ *         Only functions used by firmware update are implemented.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "storage.h"
+#include <string.h>
+
+#if STORE_ADDR_SIZE == 2
+// Memory address is sent in two bytes - slave address is fixed.
+#define STORE_BLOCK_SLAVE_ADDR(addr) (STORE_I2C_SLAVE_ADDR)
+#else
+// Slave address including block select bits of the memory address.
+#define STORE_BLOCK_SLAVE_ADDR(addr) (STORE_I2C_SLAVE_ADDR | (((addr) >> 8) & 0x7))
+#endif
+
+// Put memory address to the transmit buffer (in order of sending). Return its length.
+static uint8_t _put_addr(uint8_t * ptr_buff, const uint16_t addr)
+{
+#if STORE_ADDR_SIZE == 2
+  ptr_buff[0] = (uint8_t)(addr >> 8);
+  ptr_buff[1] = (uint8_t)addr;
+#else
+  ptr_buff[0] = (uint8_t)addr;
+#endif
+  return STORE_ADDR_SIZE;
+}
+
+// Poll EEPROM by address until the write cycle ends (acknowledge polling).
+static void _wait_for_dev_ready(void)
+{
+  uint8_t tmp;
+  for (int i = 0; i < STORE_DEV_BUSY_FOR; ++i)
+  {
+    if (Chip_I2C_MasterRead(STORE_I2C_DEV, STORE_I2C_SLAVE_ADDR, &tmp, 0)) break;
+  }
+}
+
+void storage_init(void)
+{
+  Chip_SYSCTL_DeassertPeriphReset(RESET_I2C0);
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[0][4], IOCON_SFI2C_EN, IOCON_FUNC1);
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[0][5], IOCON_SFI2C_EN, IOCON_FUNC1);
+
+  // Clock rate is set from SystemCoreClock (call again after clock setup).
+  Chip_I2C_Init(STORE_I2C_DEV);
+  Chip_I2C_SetClockRate(STORE_I2C_DEV, STORE_I2C_BUS_FREQ);
+  Chip_I2C_SetMasterEventHandler(STORE_I2C_DEV, Chip_I2C_EventHandlerPolling);
+}
+
+bool storage_write_byte(const uint8_t addr, const uint8_t data)
+{
+  return storage_write_page(addr, &data, 1);
+}
+
+bool storage_read(const uint16_t addr, uint8_t * data, const uint8_t len)
+{
+  uint8_t tx_buff[STORE_ADDR_SIZE];
+  I2C_XFER_T xfer =
+  {
+    .slaveAddr = STORE_BLOCK_SLAVE_ADDR(addr),
+    .txBuff = tx_buff,
+    .txSz = _put_addr(tx_buff, addr),
+    .rxBuff = data,
+    .rxSz = len
+  };
+
+  return (Chip_I2C_MasterTransfer(STORE_I2C_DEV, &xfer) == I2C_STATUS_DONE);
+}
+
+bool storage_write_page(const uint16_t addr, const uint8_t * data, const uint8_t len)
+{
+  if (len > STORE_PAGE_SIZE) return false;
+
+  // in order of sending
+  uint8_t tx_buff[STORE_ADDR_SIZE + STORE_PAGE_SIZE];
+  uint8_t addr_len = _put_addr(tx_buff, addr);
+  memcpy(&tx_buff[addr_len], data, len);
+
+  uint8_t n_sent = Chip_I2C_MasterSend(STORE_I2C_DEV, STORE_BLOCK_SLAVE_ADDR(addr), tx_buff, addr_len + len);
+
+  _wait_for_dev_ready();
+
+  return (n_sent == addr_len + len);
+}
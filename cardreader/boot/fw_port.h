@@ -0,0 +1,57 @@
+/**
+ *  @file
+ *  @brief Platform functions used by firmware update.
+ *
+ *         Implemented by boot loader on target (fw_port_iap.c) and by host build
+ *         (host/fw_port_file.c).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BOOT_FW_PORT_H_
+#define BOOT_FW_PORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Erase whole application region (FW_APP_SIZE).
+ *
+ * @return true if succeeded
+ */
+bool fw_port_erase(void);
+
+/**
+ * @brief Write window of application image.
+ *
+ * @param offset ... offset in application region (multiple of ACS_FW_WINDOW_SIZE)
+ * @param data ... ACS_FW_WINDOW_SIZE bytes (word aligned)
+ *
+ * @return true if succeeded
+ */
+bool fw_port_write(uint32_t offset, const uint8_t * data);
+
+/**
+ * @brief Get application region for reading.
+ *
+ * @return first byte of application image
+ */
+const uint8_t * fw_port_image(void);
+
+/**
+ * @brief Get time for timeouts.
+ *
+ *        Called often by the receive loop (target counts ticks of SysTick by polling).
+ *
+ * @return milliseconds from start of update (wraps around)
+ */
+uint32_t fw_port_ms(void);
+
+/**
+ * @brief Reset the panel (starts the boot loader).
+ */
+void fw_port_reset(void);
+
+#endif /* BOOT_FW_PORT_H_ */
@@ -0,0 +1,96 @@
+/**
+ *  @file
+ *  @brief Platform functions of firmware update for boot loader (IAP of on-chip flash).
+ *
+ *         IAP uses 32 bytes at the top of RAM (reserved by cmake/acs-panel-boot.ld)
+ *         and flash is not readable during IAP commands - interrupts stay disabled.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "fw_port.h"
+#include "acs_can_protocol.h"
+#include "board.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// IAP commands and status (UM10398, chapter 26).
+#define IAP_PREPARE_SECTORS 50
+#define IAP_COPY_RAM_TO_FLASH 51
+#define IAP_ERASE_SECTORS 52
+#define IAP_CMD_SUCCESS 0
+
+#define IAP_CCLK_KHZ (SystemCoreClock / 1000)
+
+#define FW_FIRST_SECTOR (FW_APP_BASE / FW_SECTOR_SIZE)
+#define FW_LAST_SECTOR  (FW_FLASH_SIZE / FW_SECTOR_SIZE - 1)
+
+_Static_assert(FW_APP_SIZE % ACS_FW_WINDOW_SIZE == 0, "Application region must consist of windows");
+
+static uint32_t _ms = 0;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static bool _iap(unsigned int cmd, unsigned int p0, unsigned int p1, unsigned int p2, unsigned int p3)
+{
+  unsigned int cmd_param[5] = {cmd, p0, p1, p2, p3};
+  unsigned int status[5] = {0};
+
+  iap_entry(cmd_param, status);
+
+  return (status[0] == IAP_CMD_SUCCESS);
+}
+
+static inline bool _prepare(uint32_t first, uint32_t last)
+{
+  return _iap(IAP_PREPARE_SECTORS, first, last, 0, 0);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool fw_port_erase(void)
+{
+  return _prepare(FW_FIRST_SECTOR, FW_LAST_SECTOR) &&
+         _iap(IAP_ERASE_SECTORS, FW_FIRST_SECTOR, FW_LAST_SECTOR, IAP_CCLK_KHZ, 0);
+}
+
+bool fw_port_write(uint32_t offset, const uint8_t * data)
+{
+  const uint32_t addr = FW_APP_BASE + offset;
+  const uint32_t sector = addr / FW_SECTOR_SIZE;
+
+  return _prepare(sector, sector) &&
+         _iap(IAP_COPY_RAM_TO_FLASH, addr, (unsigned int)(uintptr_t)data, ACS_FW_WINDOW_SIZE, IAP_CCLK_KHZ);
+}
+
+const uint8_t * fw_port_image(void)
+{
+  return (const uint8_t *)FW_APP_BASE;
+}
+
+uint32_t fw_port_ms(void)
+{
+  // SysTick runs without interrupt, counter flag is cleared by read (time is late after long flash operations).
+  if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) == 0)
+  {
+    SysTick->LOAD = SystemCoreClock / 1000 - 1;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+  }
+  if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) _ms++;
+
+  return _ms;
+}
+
+void fw_port_reset(void)
+{
+  NVIC_SystemReset();
+}
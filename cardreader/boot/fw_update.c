@@ -0,0 +1,363 @@
+/**
+ *  @file
+ *  @brief Firmware update over CAN (boot loader side of FC_FW_UPDATE).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "fw_update.h"
+#include "fw_port.h"
+#include "storage.h"
+#include "can/can_term_driver.h"
+#include "acs_can_protocol.h"
+#include <string.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Message objects of boot loader (application is not running).
+#define FW_MSGOBJ_RECV_CMD   0
+#define FW_MSGOBJ_RECV_BCAST 1
+#define FW_MSGOBJ_RECV_DATA  2
+#define FW_MSGOBJ_SEND       3
+
+#define FW_NO_WINDOW UINT16_MAX
+
+// Time to transmit the last status before reset.
+#define FW_SEND_WAIT_MS 100
+
+typedef struct
+{
+  uint8_t state;         // DATA_FW_STATE_...
+  bool erased;           // Application region was erased.
+  bool sent;             // Last status was transmitted.
+  uint16_t base;         // Address of the first door.
+  uint16_t master;       // Master which started the update.
+  uint16_t size;         // Image size.
+  uint32_t crc;          // Expected CRC of the image.
+  uint16_t window;       // Next expected window.
+  uint16_t rx_window;    // Window being received or FW_NO_WINDOW.
+  uint8_t rx_frames;     // Received frames of the window.
+  uint8_t rx_bitmap[(ACS_FW_WINDOW_FRAMES + 7) / 8];
+  uint32_t buffer[ACS_FW_WINDOW_SIZE / sizeof(uint32_t)]; // Word aligned for flash write.
+} fw_update_t;
+
+static fw_update_t _fw;
+
+static void _fw_can_recv(uint8_t msg_obj_num);
+static void _fw_can_send(uint8_t msg_obj_num);
+
+static CCAN_CALLBACKS_T _can_callbacks =
+{
+  _fw_can_recv,
+  _fw_can_send,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+// CRC-32 (reflected polynomial 0xEDB88320) for one nibble.
+static const uint32_t _crc_table[16] =
+{
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static inline uint32_t _get_le32(const uint8_t * data)
+{
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Size of window (the last one is shorter).
+static inline uint16_t _window_bytes(uint16_t window)
+{
+  uint32_t offset = (uint32_t)window * ACS_FW_WINDOW_SIZE;
+  return (_fw.size - offset < ACS_FW_WINDOW_SIZE ? _fw.size - offset : ACS_FW_WINDOW_SIZE);
+}
+
+static inline uint16_t _window_count(void)
+{
+  return (_fw.size + ACS_FW_WINDOW_SIZE - 1) / ACS_FW_WINDOW_SIZE;
+}
+
+static void _send_status(uint16_t master)
+{
+  acs_msg_data_fw_status_t status =
+  {
+    .command = DATA_FW_STATUS,
+    .state = _fw.state,
+    .window = _fw.window,
+    .crc = _fw.crc
+  };
+
+  acs_msg_head_t head;
+  head.scalar = CAN_MSGOBJ_EXT;
+  head.prio = PRIO_FW_UPDATE;
+  head.fc = FC_FW_UPDATE;
+  head.dst = master;
+  head.src = _fw.base;
+
+  _fw.sent = false;
+  CAN_send_once(FW_MSGOBJ_SEND, head.scalar, (void *)&status, sizeof(status));
+}
+
+// Erase application and wait for data.
+static void _start(uint16_t master, const acs_msg_data_fw_cmd_t * ptr_cmd)
+{
+  _fw.master = master;
+  _fw.size = ptr_cmd->size;
+  _fw.crc = ptr_cmd->crc;
+  _fw.window = 0;
+  _fw.rx_window = FW_NO_WINDOW;
+
+  // Interrupted update continues in boot loader after reset.
+  if (!storage_write_byte(PTR_FW_STATE, FW_STATE_UPDATE) || _fw.size == 0 || _fw.size > FW_APP_SIZE)
+  {
+    _fw.state = DATA_FW_STATE_ERROR;
+    return;
+  }
+
+  _fw.erased = true;
+  _fw.state = (fw_port_erase() ? DATA_FW_STATE_RECEIVING : DATA_FW_STATE_ERROR);
+}
+
+// Verify the image and store it as trial.
+static void _finish(void)
+{
+  if (_fw.state != DATA_FW_STATE_RECEIVING || _fw.window != _window_count()) return;
+
+  if (fw_update_crc(0, fw_port_image(), _fw.size) != _fw.crc)
+  {
+    _fw.state = DATA_FW_STATE_ERROR;
+    return;
+  }
+
+  // State, trial counter and CRC are in one page.
+  uint8_t conf[PTR_FW_CRC + sizeof(_fw.crc) - PTR_FW_STATE];
+  conf[0] = FW_STATE_TRIAL;
+  conf[PTR_FW_TRIAL - PTR_FW_STATE] = 0;
+  memcpy(&conf[PTR_FW_CRC - PTR_FW_STATE], &_fw.crc, sizeof(_fw.crc));
+
+  _fw.state = (storage_write_page(PTR_FW_STATE, conf, sizeof(conf)) ? DATA_FW_STATE_VERIFIED : DATA_FW_STATE_ERROR);
+}
+
+static void _command(uint16_t master, bool unicast, const CCAN_MSG_OBJ_T * ptr_msg)
+{
+  acs_msg_data_fw_cmd_t cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  memcpy(&cmd, ptr_msg->data, ptr_msg->dlc < sizeof(cmd) ? ptr_msg->dlc : sizeof(cmd));
+
+  switch (cmd.command)
+  {
+    case DATA_FW_ENTER: // Master restarted the update.
+    case DATA_FW_QUERY:
+      break;
+    case DATA_FW_START:
+      if (!unicast || _fw.state == DATA_FW_STATE_VERIFIED) return;
+      _start(master, &cmd);
+      break;
+    case DATA_FW_WINDOW:
+      // Panel which has the window already waits for the next one.
+      if (_fw.state == DATA_FW_STATE_RECEIVING && cmd.window == _fw.window && cmd.window < _window_count() &&
+          _fw.rx_window != cmd.window)
+      {
+        _fw.rx_window = cmd.window;
+        _fw.rx_frames = 0;
+        memset(_fw.rx_bitmap, 0, sizeof(_fw.rx_bitmap));
+        memset(_fw.buffer, 0xFF, sizeof(_fw.buffer));
+      }
+      return;
+    case DATA_FW_FINISH:
+      if (!unicast) return;
+      _finish();
+      break;
+    default:
+      return;
+  }
+  _send_status(master);
+}
+
+static void _data(const CCAN_MSG_OBJ_T * ptr_msg)
+{
+  if (_fw.state != DATA_FW_STATE_RECEIVING || _fw.rx_window == FW_NO_WINDOW || ptr_msg->dlc < 2) return;
+
+  acs_msg_data_fw_data_t frame;
+  memcpy(&frame, ptr_msg->data, ptr_msg->dlc);
+
+  const uint16_t bytes = _window_bytes(_fw.rx_window);
+  const uint8_t frames = (bytes + ACS_FW_FRAME_DATA - 1) / ACS_FW_FRAME_DATA;
+  const uint16_t offset = (uint16_t)frame.seq * ACS_FW_FRAME_DATA;
+
+  if (frame.seq >= frames || (_fw.rx_bitmap[frame.seq / 8] & (1 << (frame.seq % 8)))) return;
+
+  uint8_t len = ptr_msg->dlc - 1;
+  if (offset + len > bytes) len = bytes - offset;
+  memcpy((uint8_t *)_fw.buffer + offset, frame.data, len);
+  _fw.rx_bitmap[frame.seq / 8] |= (1 << (frame.seq % 8));
+
+  if (++_fw.rx_frames < frames) return;
+
+  // Window is complete - master waits for status before next window.
+  if (fw_port_write((uint32_t)_fw.rx_window * ACS_FW_WINDOW_SIZE, (const uint8_t *)_fw.buffer))
+  {
+    _fw.window++;
+  }
+  else
+  {
+    _fw.state = DATA_FW_STATE_ERROR;
+  }
+  _fw.rx_window = FW_NO_WINDOW;
+  _send_status(_fw.master);
+}
+
+// Called from polled ROM driver.
+static void _fw_can_recv(uint8_t msg_obj_num)
+{
+  CCAN_MSG_OBJ_T msg_obj;
+  msg_obj.msgobj = msg_obj_num;
+  LPC_CCAN_API->can_receive(&msg_obj);
+
+  acs_msg_head_t head;
+  head.scalar = msg_obj.mode_id;
+
+  if (head.src < ACS_MSTR_FIRST_ADDR || head.src > ACS_MSTR_LAST_ADDR) return;
+
+  if (msg_obj.msgobj == FW_MSGOBJ_RECV_DATA) _data(&msg_obj);
+  else _command(head.src, msg_obj.msgobj == FW_MSGOBJ_RECV_CMD, &msg_obj);
+}
+
+static void _fw_can_send(uint8_t msg_obj_num)
+{
+  if (msg_obj_num == FW_MSGOBJ_SEND) _fw.sent = true;
+}
+
+// Read address and bit rate of the panel (see organization in terminal_config.h).
+static uint32_t _load_config(void)
+{
+  uint8_t conf[STORE_CONFIG_SIZE];
+  memset(conf, 0xFF, sizeof(conf));
+  (void)storage_read(PTR_READER_FIRST_ADDR, conf, sizeof(conf));
+
+  uint16_t addr = (conf[PTR_READER_FIRST_ADDR] | (conf[PTR_READER_FIRST_ADDR + 1] << 8)) & ACS_BROADCAST_ADDR;
+  if (addr < ACS_PNL_FIRST_ADDR || addr > ACS_PNL_LAST_ADDR) addr = ACS_PNL_FIRST_ADDR;
+  _fw.base = addr - ((addr - ACS_PNL_FIRST_ADDR) % ACS_READER_MAXCOUNT);
+
+  _fw.state = (conf[PTR_FW_STATE] == FW_STATE_ROLLBACK ? DATA_FW_STATE_ROLLBACK : DATA_FW_STATE_IDLE);
+  _fw.crc = _get_le32(&conf[PTR_FW_CRC]);
+
+  uint16_t bit_rate_kbps = conf[PTR_CAN_BIT_RATE] | (conf[PTR_CAN_BIT_RATE + 1] << 8);
+  return (bit_rate_kbps != 0 && bit_rate_kbps != UINT16_MAX ? (uint32_t)bit_rate_kbps * 1000 : CAN_BAUD_RATE);
+}
+
+static void _can_start(uint32_t bit_rate)
+{
+  if (!CAN_init(&_can_callbacks, bit_rate)) CAN_init(&_can_callbacks, CAN_BAUD_RATE);
+
+  CAN_recv_filter(FW_MSGOBJ_RECV_CMD, (FC_FW_UPDATE << ACS_FC_OFFSET) | (_fw.base << ACS_DST_ADDR_OFFSET),
+                  ACS_FC_MASK | ACS_DST_ADDR_MASK, true);
+  CAN_recv_filter(FW_MSGOBJ_RECV_BCAST, (FC_FW_UPDATE << ACS_FC_OFFSET) | (ACS_BROADCAST_ADDR << ACS_DST_ADDR_OFFSET),
+                  ACS_FC_MASK | ACS_DST_ADDR_MASK, true);
+  CAN_recv_filter(FW_MSGOBJ_RECV_DATA, (FC_FW_DATA << ACS_FC_OFFSET) | (ACS_BROADCAST_ADDR << ACS_DST_ADDR_OFFSET),
+                  ACS_FC_MASK | ACS_DST_ADDR_MASK, true);
+}
+
+// Poll controller until the last status is transmitted (or timeout).
+static void _wait_sent(void)
+{
+  uint32_t since = fw_port_ms();
+  while (!_fw.sent && fw_port_ms() - since < FW_SEND_WAIT_MS)
+  {
+    LPC_CCAN_API->isr();
+  }
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+uint32_t fw_update_crc(uint32_t crc, const uint8_t * data, uint32_t len)
+{
+  crc = ~crc;
+  while (len-- > 0)
+  {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ _crc_table[crc & 0x0F];
+    crc = (crc >> 4) ^ _crc_table[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+bool fw_update_check(bool app_valid)
+{
+  uint8_t conf[PTR_FW_TRIAL - PTR_FW_STATE + 1];
+
+  // Application is started without storage.
+  if (!storage_read(PTR_FW_STATE, conf, sizeof(conf))) return app_valid;
+
+  uint8_t state = conf[0];
+  uint8_t trial = conf[PTR_FW_TRIAL - PTR_FW_STATE];
+
+  if (state == FW_STATE_UPDATE || state == FW_STATE_ROLLBACK || !app_valid) return false;
+
+  if (state == FW_STATE_TRIAL)
+  {
+    // Application confirms the image when it is connected to master.
+    if (trial >= FW_TRIAL_BOOTS)
+    {
+      (void)storage_write_byte(PTR_FW_STATE, FW_STATE_ROLLBACK);
+      return false;
+    }
+    (void)storage_write_byte(PTR_FW_TRIAL, trial + 1);
+  }
+  return true;
+}
+
+void fw_update_run(bool app_valid)
+{
+  memset(&_fw, 0, sizeof(_fw));
+  _fw.rx_window = FW_NO_WINDOW;
+
+  _can_start(_load_config());
+
+  // Master learns about the panel (it is not known which master sent ENTER).
+  _send_status(ACS_BROADCAST_ADDR);
+
+  uint32_t since = fw_port_ms();
+
+  for (;;)
+  {
+    LPC_CCAN_API->isr();
+
+    if (_fw.state == DATA_FW_STATE_VERIFIED)
+    {
+      _wait_sent();
+      fw_port_reset();
+    }
+
+    // Application is kept if master does not come.
+    if (app_valid && !_fw.erased && _fw.state == DATA_FW_STATE_IDLE && fw_port_ms() - since >= FW_ENTER_TIMEOUT_MS)
+    {
+      (void)storage_write_byte(PTR_FW_STATE, FW_STATE_CONFIRMED);
+      fw_port_reset();
+    }
+
+    // Failed trial image is the only one - it is started again (still unconfirmed) if master
+    // does not send other image. Next reset without master returns to the boot loader.
+    if (app_valid && !_fw.erased && _fw.state == DATA_FW_STATE_ROLLBACK && fw_port_ms() - since >= FW_ENTER_TIMEOUT_MS)
+    {
+      (void)storage_write_byte(PTR_FW_TRIAL, FW_TRIAL_BOOTS - 1);
+      (void)storage_write_byte(PTR_FW_STATE, FW_STATE_TRIAL);
+      fw_port_reset();
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/**
+ *  @file
+ *  @brief Firmware update over CAN (boot loader side of FC_FW_UPDATE).
+ *
+ *         Image is received to application region in windows (see acs_can_protocol.h).
+ *         Received window is written at once and acknowledged by status, master sends
+ *         windows to many panels at once and repeats windows which some panel missed.
+ *
+ *         Runs without kernel and interrupts - CAN controller is polled.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BOOT_FW_UPDATE_H_
+#define BOOT_FW_UPDATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Decide at boot whether the application is started.
+ *
+ *        Counts boots of trial image and rolls it back after FW_TRIAL_BOOTS
+ *        (storage must be initialized).
+ *
+ * @param app_valid ... application region holds an image
+ *
+ * @return true if the application is to be started, false to run update
+ */
+bool fw_update_check(bool app_valid);
+
+/**
+ * @brief Receive image from master.
+ *
+ *        Does not return - the panel is reset when the image is verified (or when
+ *        master does not start the update in FW_ENTER_TIMEOUT_MS and application was not erased,
+ *        image which failed its trial is then started for one more unconfirmed boot).
+ *        Main clock must be CAN_TIMING_CLOCK_HZ.
+ *
+ * @param app_valid ... application region holds an image (it can be started again)
+ */
+void fw_update_run(bool app_valid);
+
+/**
+ * @brief Compute CRC-32 (IEEE 802.3, same as zlib crc32).
+ *
+ * @param crc ... CRC of previous data or 0
+ * @param data ... data
+ * @param len ... number of bytes
+ *
+ * @return CRC including the data
+ */
+uint32_t fw_update_crc(uint32_t crc, const uint8_t * data, uint32_t len);
+
+#endif /* BOOT_FW_UPDATE_H_ */
@@ -111,6 +111,9 @@ const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[][12] =
   }
 };
 
+// Reset status of the last reset.
+static uint8_t _reset_status = 0;
+
 /*****************************************************************************
  * Private functions
  ****************************************************************************/
@@ -122,6 +125,10 @@ const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[][12] =
 void Board_Print_Reset_Reason(void)
 {
   uint32_t status = Chip_SYSCTL_GetSystemRSTStatus();
+  // Status is sticky - clear it so next reset is reported correctly.
+  _reset_status = (uint8_t)status;
+  Chip_SYSCTL_ClearSystemRSTStatus(status);
+
   if (status & SYSCTL_RST_SYSRST) Board_UARTPutSTR("SW RST");
   else if (status & SYSCTL_RST_BOD) Board_UARTPutSTR("BOD RST");
   else if (status & SYSCTL_RST_WDT) Board_UARTPutSTR("WTG RST");
@@ -132,11 +139,23 @@ void Board_Print_Reset_Reason(void)
   Board_UARTPutChar('\n');
 }
 
+uint8_t Board_Get_Reset_Reason(void)
+{
+  return _reset_status;
+}
+
+void Board_Reset(void)
+{
+  NVIC_SystemReset();
+}
+
 /* Sends a character on the UART */
 void Board_UARTPutChar(char ch)
 {
 #if defined(CONSOLE_UART)
 	Chip_UART_SendBlocking(CONSOLE_UART, &ch, 1);
+#else
+	(void)ch;
 #endif
 }
 
@@ -160,6 +179,8 @@ void Board_UARTPutSTR(char *str)
 	while (*str != '\0') {
 		Board_UARTPutChar(*str++);
 	}
+#else
+	(void)str;
 #endif
 }
 
@@ -269,6 +290,17 @@ void Board_LED_Toggle(board_led_t led_number)
   }
 }
 
+bool Board_Setup_Strap(void)
+{
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[SETUP_STRAP_PORT][SETUP_STRAP_PIN], IOCON_MODE_PULLUP, SETUP_STRAP_FUNC);
+  Chip_GPIO_SetPinDIRInput(LPC_GPIO, SETUP_STRAP_PORT, SETUP_STRAP_PIN);
+
+  // Let the pull-up charge the pin.
+  for (volatile uint32_t i = 0; i < 100; ++i);
+
+  return !Chip_GPIO_GetPinState(LPC_GPIO, SETUP_STRAP_PORT, SETUP_STRAP_PIN);
+}
+
 /* Set up and initialize all required blocks and functions related to the
    board hardware */
 void Board_Init(void)
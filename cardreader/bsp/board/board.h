@@ -67,11 +67,15 @@ extern "C" {
 
 #endif // DEBUG
 
+#include "terminal_config.h"
+
 /** Board UART used for debug output and input using the DEBUG* macros. This
     is also the port used for Board_UARTPutChar, Board_UARTGetChar, and
-    Board_UARTPutSTR functions.
+    Board_UARTPutSTR functions. UART is used by OSDP bus if enabled.
  */
+#if !OSDP_ENABLED
 #define CONSOLE_UART LPC_USART
+#endif
 
 /* Board name */
 #define BOARD_NXP_XPRESSO_11C24
@@ -80,8 +84,6 @@ extern "C" {
 /* Translator for IOCON */
 extern const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[][12];
 
-#include "terminal_config.h"
-
 #include "board_api.h"
 
 #ifdef __cplusplus
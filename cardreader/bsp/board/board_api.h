@@ -98,6 +98,24 @@ void Board_Console_Init(void);
 
 void Board_Print_Reset_Reason(void);
 
+/**
+ * @brief	Get reset status saved by Board_Print_Reset_Reason
+ * @return	Reset status bits (SYSCTL_RST_...)
+ */
+uint8_t Board_Get_Reset_Reason(void);
+
+/**
+ * @brief	Reset the panel (starts boot loader)
+ * @return	Does not return
+ */
+void Board_Reset(void);
+
+/**
+ * @brief	Read strap which requests console setup at boot (SETUP_STRAP_PORT, SETUP_STRAP_PIN)
+ * @return	true if the strap is closed (pin tied low)
+ */
+bool Board_Setup_Strap(void);
+
 /**
  * @brief	Sends a single character on the UART, required for printf redirection
  * @param	ch	: character to send
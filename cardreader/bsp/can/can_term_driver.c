@@ -35,6 +35,9 @@
  */
 
 #include "can/can_term_driver.h"
+#include "profiler.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include <string.h>
 
 #if defined (  __GNUC__  )
@@ -51,142 +54,91 @@ __BSS(RESERVED) char CAN_driver_memory[184];  /* reserve 184 bytes for CAN drive
 // Time segment 2
 #define CCAN_BCR_TSEG2(x) (((x) & 0x07) << 12)
 
-#define CAN_CALC_SYNC_SEG 1
-
-
-// Sample point = 100 * (tseg1 + CAN_CALC_SYNC_SEG) / (tseg1 + tseg2 + CAN_CALC_SYNC_SEG)
-
-// HW constants
-#define	TSEG1_MIN 1
-#define	TSEG1_MAX 13
-#define TSEG2_MIN 1
-#define TSEG2_MAX 8
-#define SJW_MAX   4
-#define BRP_MIN   1
-#define BRP_MAX   32
-
-
-/*****************************************************************************
- * Private functions
- ****************************************************************************/
+// Error counter register (ROM driver has no access to it).
+#define CCAN_EC (*(volatile uint32_t *)(LPC_CAN0_BASE + 0x008))
+#define CCAN_EC_TEC(x) ((x) & 0xFF)
+#define CCAN_EC_REC(x) (((x) >> 8) & 0x7F)
+#define CCAN_EC_RP     (1 << 15)
 
 /*
- * Integrated CCAN hardware timing calculation from LPC11Cxx CCAN on-chip driver example.
- * Satisfies chapter 8 "BIT TIMING REQUIREMENTS" of the "Bosch CAN Specification version 2.0"
- * at http://www.semiconductors.bosch.de/pdf/can2spec.pdf.
+ * Bit timings for CAN_TIMING_CLOCK_HZ (CANCLKDIV = 1).
+ *
+ * Satisfies chapter 8 "BIT TIMING REQUIREMENTS" of the "Bosch CAN Specification version 2.0".
+ * CiA recommended sample points: 87.5% up to 500kbit/s, 80% at 800kbit/s, 75% at 1Mbit/s.
+ * Sample point = 100 * (1 + tseg1) / (1 + tseg1 + tseg2)
  *
- * Hard coded sample point 50%
+ * Values are in time quanta (register fields are one less).
+ *
+ *         bit rate  BRP  TSEG1  TSEG2  SJW
  */
-static void _timing_calculate(uint32_t baud_rate, uint32_t * can_api_timing_cfg)
+#define CAN_BIT_TIMINGS(X) \
+  X(  50000,  60,   13,     2,    2) \
+  X( 100000,  30,   13,     2,    2) \
+  X( 125000,  24,   13,     2,    2) \
+  X( 250000,  12,   13,     2,    2) \
+  X( 500000,   6,   13,     2,    2) \
+  X( 800000,   4,   11,     3,    3) \
+  X(1000000,   3,   11,     4,    4)
+
+// Bit time must be exact and fields must fit the registers (SJW is not longer than phase segment 2).
+#define CAN_BIT_TIMING_CHECK(rate, brp, tseg1, tseg2, sjw) \
+  _Static_assert(CAN_TIMING_CLOCK_HZ == (rate) * (brp) * (1 + (tseg1) + (tseg2)), "CAN bit rate " #rate " is not exact"); \
+  _Static_assert((brp) >= 1 && (brp) <= 64 && (tseg1) >= 2 && (tseg1) <= 16 && (tseg2) >= 1 && (tseg2) <= 8 && \
+                 (sjw) >= 1 && (sjw) <= 4 && (sjw) <= (tseg2), "CAN bit timing " #rate " is out of range");
+
+#define CAN_BIT_TIMING_ENTRY(rate, brp, tseg1, tseg2, sjw) \
+  {(rate), CCAN_BCR_QUANTA((brp) - 1) | CCAN_BCR_SJW((sjw) - 1) | CCAN_BCR_TSEG1((tseg1) - 1) | CCAN_BCR_TSEG2((tseg2) - 1)},
+
+CAN_BIT_TIMINGS(CAN_BIT_TIMING_CHECK)
+
+typedef struct
 {
-  uint32_t pClk, div, quanta, segs, seg1, seg2, clk_per_bit, can_sjw;
-  pClk = Chip_Clock_GetMainClockRate();
-
-  clk_per_bit = pClk / baud_rate;
+  uint32_t bit_rate;
+  uint32_t btr;       // Bit timing register.
+} can_bit_timing_t;
 
-  for (div = 0; div <= 15; div++)
-  {
-    for (quanta = 1; quanta <= 32; quanta++)
-    {
-      for (segs = 3; segs <= 17; segs++)
-      {
-        if (clk_per_bit == (segs * quanta * (div + 1)))
-        {
-          segs -= 3;
-          seg1 = segs / 2;
-          seg2 = segs - seg1;
-          can_sjw = seg1 > 3 ? 3 : seg1;
-          can_api_timing_cfg[0] = div;
-          can_api_timing_cfg[1] =
-            CCAN_BCR_QUANTA(quanta - 1) | CCAN_BCR_SJW(can_sjw) | CCAN_BCR_TSEG1(seg1) | CCAN_BCR_TSEG2(seg2);
-          return;
-        }
-      }
-    }
-  }
-}
-
-/*
- * Integrated CCAN hardware timing calculation from LPC11Cxx CCAN on-chip driver example.
- * Satisfies chapter 8 "BIT TIMING REQUIREMENTS" of the "Bosch CAN Specification version 2.0"
- * at http://www.semiconductors.bosch.de/pdf/can2spec.pdf.
- *
- * Uses CiA recommended sample points.
- */
-static void _timing_calculate_sp(uint32_t baud_rate, uint32_t * can_api_timing_cfg)
+static const can_bit_timing_t _bit_timings[] =
 {
-  uint32_t pClk, div, quanta, segs, seg1, seg2, clk_per_bit, can_sjw;
-  pClk = Chip_Clock_GetMainClockRate();
+  CAN_BIT_TIMINGS(CAN_BIT_TIMING_ENTRY)
+};
 
-  uint8_t spt_nominal;
+// Bit rate of initialized controller.
+static uint32_t _bit_rate = 0;
 
-  if (baud_rate > 800000)
-  {
-	spt_nominal = 75;
-  }
-  else if (baud_rate > 500000)
-  {
-	spt_nominal = 80;
-  }
-  else
-  {
-	spt_nominal = 87;
-  }
 
-  clk_per_bit = pClk / baud_rate;
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
 
-  for (div = 0; div <= 15; div++)
+static const can_bit_timing_t * _bit_timing_find(uint32_t bit_rate)
+{
+  for (size_t i = 0; i < sizeof(_bit_timings) / sizeof(_bit_timings[0]); ++i)
   {
-    for (quanta = 1; quanta <= 32; quanta++)
-    {
-      for (segs = 3; segs <= 17; segs++)
-      {
-        if (clk_per_bit == (segs * quanta * (div + 1)))
-        {
-          segs -= 3;
-
-          // Sample point
-          seg2 = segs - (spt_nominal * segs) / 100;
-          seg2 = seg2 > TSEG2_MIN ? (seg2 < TSEG2_MAX ? seg2 : TSEG2_MAX) : TSEG2_MIN; // Clamp the value
-          seg1 = segs - seg2;
-
-          can_sjw = seg1 > 3 ? 3 : seg1;
-
-          can_api_timing_cfg[0] = div;
-          can_api_timing_cfg[1] =
-            CCAN_BCR_QUANTA(quanta - 1) | CCAN_BCR_SJW(can_sjw) | CCAN_BCR_TSEG1(seg1) | CCAN_BCR_TSEG2(seg2);
-          return;
-        }
-      }
-    }
+    if (_bit_timings[i].bit_rate == bit_rate) return &_bit_timings[i];
   }
-}
-
-static inline void _125_kbaud_75sp(uint32_t * can_api_timing_cfg)
-{
-  /* 125kb 75%, CAN_CLK tolerance 5% */
-  /* Propagation time for UTP copper cable (0.64c) with maximum distance of 100 meter is 0.55us */
-  /* CANCLKDIV: CAN_CLK=48MHz */
-  /* CANBT register: TSEG1=11, TSEG2=4, SJW=4, BRP=4 (actual value written is -1) */
-  can_api_timing_cfg[0] = 5;
-  can_api_timing_cfg[1] = CCAN_BCR_QUANTA(3) | CCAN_BCR_SJW(3) | CCAN_BCR_TSEG1(10) | CCAN_BCR_TSEG2(3);
+  return NULL;
 }
 
 /*****************************************************************************
  * Public functions
  ****************************************************************************/
 
-void CAN_init(CCAN_CALLBACKS_T * ptr_callbacks, uint32_t baud_rate)
+bool CAN_init(CCAN_CALLBACKS_T * ptr_callbacks, uint32_t bit_rate)
 {
+  const can_bit_timing_t * ptr_timing = _bit_timing_find(bit_rate);
+  if (ptr_timing == NULL) return false;
+
+  // Timings are valid only for this clock.
+  configASSERT(Chip_Clock_GetMainClockRate() == CAN_TIMING_CLOCK_HZ);
+
   // Power up CAN
   Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_CAN);
 
   // Deassert reset
   Chip_SYSCTL_DeassertPeriphReset(RESET_CAN0);
 
-  /* Initialize CAN Controller structure*/
-  uint32_t ClkInitTable[2];
-  _timing_calculate_sp(baud_rate, &ClkInitTable[0]);
+  /* Initialize CAN Controller structure (CANCLKDIV, CANBT) */
+  uint32_t ClkInitTable[2] = {0, ptr_timing->btr};
 
   /* Initialize the CAN controller */
   LPC_CCAN_API->init_can(&ClkInitTable[0], TRUE);
@@ -196,6 +148,25 @@ void CAN_init(CCAN_CALLBACKS_T * ptr_callbacks, uint32_t baud_rate)
 
   /* Enable the CAN Interrupt */
   NVIC_EnableIRQ(CAN_IRQn);
+
+  _bit_rate = bit_rate;
+  return true;
+}
+
+void CAN_set_irq(bool enabled)
+{
+  if (enabled) NVIC_EnableIRQ(CAN_IRQn);
+  else NVIC_DisableIRQ(CAN_IRQn);
+}
+
+bool CAN_is_bit_rate_supported(uint32_t bit_rate)
+{
+  return _bit_timing_find(bit_rate) != NULL;
+}
+
+uint32_t CAN_get_bit_rate(void)
+{
+  return _bit_rate;
 }
 
 void CAN_recv_filter(uint8_t msgobj_num, uint32_t id, uint32_t mask, bool extended)
@@ -237,7 +208,22 @@ void CAN_send_once(uint8_t msgobj_num, uint32_t id, uint8_t * data, uint8_t size
 
   memcpy(msg_obj.data, data, size);
 
+  // Message interface registers are shared - transmit must not be interrupted.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  PROFILER_BEGIN(profiler_crit_can_send);
   LPC_CCAN_API->can_transmit(&msg_obj);
+  PROFILER_END(profiler_crit_can_send);
+  __set_PRIMASK(primask);
+}
+
+bool CAN_get_error_counters(uint8_t * ptr_tx_errors, uint8_t * ptr_rx_errors)
+{
+  // Status register is not read - reading clears pending status interrupt.
+  uint32_t ec = CCAN_EC;
+  *ptr_tx_errors = CCAN_EC_TEC(ec);
+  *ptr_rx_errors = CCAN_EC_REC(ec);
+  return (ec & CCAN_EC_RP) || *ptr_tx_errors >= 128;
 }
 
 void CAN_send_test(void)
@@ -257,6 +243,8 @@ void CAN_send_test(void)
 
 void CAN_IRQHandler(void)
 {
+  PROFILER_BEGIN(profiler_isr_can);
   LPC_CCAN_API->isr();
+  PROFILER_END(profiler_isr_can);
 }
 
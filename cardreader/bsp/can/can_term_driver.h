@@ -20,6 +20,8 @@
 #define CAN_EXT_ID_BIT_MASK 0x1FFFFFFFUL
 // CAN message data maximal length.
 #define CAN_DLC_MAX 8
+// CAN controller clock of bit timing table (main clock).
+#define CAN_TIMING_CLOCK_HZ 48000000UL
 
 /*
  * CCAN_MSG_OBJ_T (Message object) cheat sheet:
@@ -39,11 +41,43 @@
  *
  *        Function should be executed before using the CAN bus.
  *        Initializes the CAN controller, on-chip drivers.
+ *        Can be called again to change bit rate (message objects must be set up again).
  *
  * @param ptr_callbacks ... pointer to callback structure
- * @param baud_rate ... CAN baud rate to use
+ * @param bit_rate ... CAN bit rate to use (50k, 100k, 125k, 250k, 500k, 800k or 1M)
+ *
+ * @return true if succeeded, false if the bit rate is not supported
+ */
+bool CAN_init(CCAN_CALLBACKS_T * ptr_callbacks, uint32_t bit_rate);
+
+
+/**
+ * @brief Enable or disable CAN interrupt.
+ *
+ *        Controller keeps receiving while the interrupt is disabled (message objects hold
+ *        the last matching frame).
+ *
+ * @param enabled ... true to enable
+ */
+void CAN_set_irq(bool enabled);
+
+
+/**
+ * @brief Check if bit rate is in the table of bit timings.
+ *
+ * @param bit_rate ... CAN bit rate
+ *
+ * @return true if supported
  */
-void CAN_init(CCAN_CALLBACKS_T * ptr_callbacks, uint32_t baud_rate);
+bool CAN_is_bit_rate_supported(uint32_t bit_rate);
+
+
+/**
+ * @brief Get bit rate of initialized controller.
+ *
+ * @return bit rate or 0 if not initialized
+ */
+uint32_t CAN_get_bit_rate(void);
 
 
 /**
@@ -75,6 +109,8 @@ void CAN_recv_filter_all_ext(uint8_t msgobj_num);
 /**
  * @brief Send one time CAN message.
  *
+ *        Can be called from interrupt.
+ *
  * @param msgobj_num ... number of message object (0-31).
  * @param id ... CAN arbitration ID.
  * @param data ... pointer to data to send.
@@ -83,6 +119,17 @@ void CAN_recv_filter_all_ext(uint8_t msgobj_num);
 void CAN_send_once(uint8_t msgobj_num, uint32_t id, uint8_t * data, uint8_t size);
 
 
+/**
+* @brief Read error counters of CAN controller.
+*
+* @param ptr_tx_errors ... transmit error counter.
+* @param ptr_rx_errors ... receive error counter.
+*
+* @return true if controller is in error passive state
+*/
+bool CAN_get_error_counters(uint8_t * ptr_tx_errors, uint8_t * ptr_rx_errors);
+
+
 /**
 * @brief Send test message on CAN.
 *
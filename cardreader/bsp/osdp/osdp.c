@@ -0,0 +1,466 @@
+/**
+ *  @file
+ *  @brief OSDP interface driver (control panel side).
+ *
+ *  Bus state machine (runs in UART and CT16B0 interrupts):
+ *  idle --(gap elapsed)--> tx --(FIFO empty)--> drain --(last char sent)--> reply
+ *  reply --(valid reply or timeout)--> idle
+ *
+ *  Driver enable of RS-485 transceiver is held during tx and drain.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "osdp.h"
+#include "board.h"
+#include "profiler.h"
+#include <string.h>
+
+#if OSDP_ENABLED
+
+#if defined(CONSOLE_UART)
+#error "UART is used by OSDP, debug console must be disabled."
+#endif
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define OSDP_TIMER        LPC_TIMER16_0
+#define OSDP_TIMER_IRQn   TIMER_16_0_IRQn
+#define OSDP_TIMER_HZ     10000UL
+#define OSDP_MS_TO_TICKS(ms) ((ms) * (OSDP_TIMER_HZ / 1000UL))
+// Time to send one character (10 bits) from shift register with margin.
+#define OSDP_CHAR_TICKS   ((10UL * OSDP_TIMER_HZ) / OSDP_BAUD_RATE + 2)
+#define OSDP_UART_FIFO    16
+
+#define OSDP_SOM              0x53
+#define OSDP_REPLY_ADDR_FLAG  0x80
+#define OSDP_CTRL_SQN_MASK    0x03
+#define OSDP_CTRL_CRC         0x04
+#define OSDP_HEAD_SIZE        6 // Including command/reply code.
+#define OSDP_CRC_SIZE         2
+#define OSDP_RX_MAX           64
+#define OSDP_TX_MAX           24
+
+// Commands.
+#define OSDP_CMD_POLL 0x60
+#define OSDP_CMD_LED  0x69
+#define OSDP_CMD_BUZ  0x6A
+
+// Replies.
+#define OSDP_REPLY_ACK 0x40
+#define OSDP_REPLY_NAK 0x41
+#define OSDP_REPLY_RAW 0x50
+
+#define OSDP_NAK_SEQUENCE   0x04
+#define OSDP_LED_TEMP_SET   0x02
+#define OSDP_BUZ_TONE_ON    0x02
+
+typedef enum
+{
+  osdp_bus_idle,
+  osdp_bus_tx,
+  osdp_bus_drain,
+  osdp_bus_reply
+} osdp_bus_state_t;
+
+typedef struct
+{
+  StreamBufferHandle_t consumer_buffer;
+  uint8_t addr;
+  uint8_t sqn;       // Sequence number of next command (0 restarts communication).
+  uint8_t failures;  // Consecutive commands without reply.
+  uint8_t sent_cmd;  // Command waiting for reply.
+  uint8_t led_color;
+  uint8_t led_time;  // in 100ms
+  uint8_t buz_time;  // in 100ms
+  bool led_pending;
+  bool buz_pending;
+  bool online;
+} osdp_pd_t;
+
+static osdp_pd_t _pd[SERIAL_DEVICE_LIMIT];
+
+static uint8_t _tx_buf[OSDP_TX_MAX];
+static uint8_t _tx_len = 0;
+static uint8_t _tx_pos = 0;
+
+static uint8_t _rx_buf[OSDP_RX_MAX];
+static uint8_t _rx_len = 0;
+
+static osdp_bus_state_t _state = osdp_bus_idle;
+static uint8_t _cur = 0; // Reader on the bus.
+static bool _bus_running = false;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// CRC-16 (polynomial 0x1021, initial value 0x1D0F).
+static uint16_t _crc16(const uint8_t * data, uint16_t len)
+{
+  uint16_t crc = 0x1D0F;
+  for (uint16_t i = 0; i < len; ++i)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static inline void _driver_enable(bool enable)
+{
+  Chip_GPIO_SetPinState(LPC_GPIO, OSDP_DE_PORT, OSDP_DE_PIN, enable);
+}
+
+static void _timer_schedule(uint32_t ticks)
+{
+  Chip_TIMER_SetMatch(OSDP_TIMER, 0, (Chip_TIMER_ReadCount(OSDP_TIMER) + ticks) & 0xFFFF);
+  Chip_TIMER_ClearMatch(OSDP_TIMER, 0);
+  Chip_TIMER_MatchEnableInt(OSDP_TIMER, 0);
+}
+
+static void _build_packet(const osdp_pd_t * ptr_pd, uint8_t cmd, const uint8_t * data, uint8_t data_len)
+{
+  uint8_t len = OSDP_HEAD_SIZE + data_len + OSDP_CRC_SIZE;
+  configASSERT(len <= OSDP_TX_MAX);
+
+  _tx_buf[0] = OSDP_SOM;
+  _tx_buf[1] = ptr_pd->addr;
+  _tx_buf[2] = len;
+  _tx_buf[3] = 0;
+  _tx_buf[4] = (ptr_pd->sqn & OSDP_CTRL_SQN_MASK) | OSDP_CTRL_CRC;
+  _tx_buf[5] = cmd;
+  memcpy(&_tx_buf[OSDP_HEAD_SIZE], data, data_len);
+
+  uint16_t crc = _crc16(_tx_buf, len - OSDP_CRC_SIZE);
+  _tx_buf[len - 2] = crc & 0xFF;
+  _tx_buf[len - 1] = crc >> 8;
+  _tx_len = len;
+}
+
+static void _fill_fifo(void)
+{
+  for (uint8_t i = 0; i < OSDP_UART_FIFO && _tx_pos < _tx_len; ++i)
+  {
+    Chip_UART_SendByte(LPC_USART, _tx_buf[_tx_pos++]);
+  }
+}
+
+// Send command to next reader. Called from interrupt.
+static void _bus_next(void)
+{
+  for (uint8_t i = 0; i < SERIAL_DEVICE_LIMIT; ++i)
+  {
+    _cur = (_cur + 1) % SERIAL_DEVICE_LIMIT;
+    if (_pd[_cur].consumer_buffer != NULL) break;
+  }
+
+  osdp_pd_t * ptr_pd = &_pd[_cur];
+  if (ptr_pd->consumer_buffer == NULL)
+  {
+    _bus_running = false; // No reader to poll.
+    return;
+  }
+
+  if (ptr_pd->led_pending)
+  {
+    uint8_t led[14] = {0};
+    led[2] = OSDP_LED_TEMP_SET;    // Temporary state.
+    led[3] = ptr_pd->led_time;     // On time.
+    led[5] = ptr_pd->led_color;    // On color.
+    led[7] = ptr_pd->led_time;     // Timer LSB.
+    _build_packet(ptr_pd, OSDP_CMD_LED, led, sizeof(led));
+    ptr_pd->sent_cmd = OSDP_CMD_LED;
+  }
+  else if (ptr_pd->buz_pending)
+  {
+    uint8_t buz[5] = {0, OSDP_BUZ_TONE_ON, ptr_pd->buz_time, 0, 1};
+    _build_packet(ptr_pd, OSDP_CMD_BUZ, buz, sizeof(buz));
+    ptr_pd->sent_cmd = OSDP_CMD_BUZ;
+  }
+  else
+  {
+    _build_packet(ptr_pd, OSDP_CMD_POLL, NULL, 0);
+    ptr_pd->sent_cmd = OSDP_CMD_POLL;
+  }
+
+  _state = osdp_bus_tx;
+  _driver_enable(true);
+  _tx_pos = 0;
+  _fill_fifo();
+  Chip_UART_IntEnable(LPC_USART, UART_IER_THREINT);
+}
+
+// Convert card data to Wiegand frame and pass it to consumer.
+static void _raw_card(osdp_pd_t * ptr_pd, const uint8_t * data, uint8_t data_len, BaseType_t * ptr_task_woken)
+{
+  // | reader (1B) | format (1B) | bit count (2B) | data (MSB of first byte is first bit) |
+  if (data_len < 4) return;
+  uint16_t bits = data[2] | (data[3] << 8);
+  if (bits > WEIGAND_MAX_FRAME_SIZE || data_len < 4 + (bits + 7) / 8) return;
+
+  weigand_buff_item_t item = {.source = _cur, .frame = {.value = 0, .length = bits}};
+  for (uint16_t i = 0; i < bits; ++i)
+  {
+    item.frame.value = (item.frame.value << 1) | ((data[4 + i / 8] >> (7 - i % 8)) & 0x1);
+  }
+
+  if (xStreamBufferIsFull(ptr_pd->consumer_buffer) == pdFALSE)
+  {
+    xStreamBufferSendFromISR(ptr_pd->consumer_buffer, &item, WEIGAND_BUFF_ITEM_SIZE, ptr_task_woken);
+  }
+}
+
+// Complete reply received. Called from interrupt.
+static void _reply_received(void)
+{
+  osdp_pd_t * ptr_pd = &_pd[_cur];
+  uint8_t len = _rx_len;
+  _rx_len = 0;
+
+  uint16_t crc = _rx_buf[len - 2] | (_rx_buf[len - 1] << 8);
+  if (_rx_buf[1] != (ptr_pd->addr | OSDP_REPLY_ADDR_FLAG) ||
+      !(_rx_buf[4] & OSDP_CTRL_CRC) ||
+      (_rx_buf[4] & OSDP_CTRL_SQN_MASK) != ptr_pd->sqn ||
+      crc != _crc16(_rx_buf, len - OSDP_CRC_SIZE))
+  {
+    return; // Wait for valid reply until timeout.
+  }
+
+  BaseType_t task_woken = pdFALSE;
+  const uint8_t * data = &_rx_buf[OSDP_HEAD_SIZE];
+  uint8_t data_len = len - OSDP_HEAD_SIZE - OSDP_CRC_SIZE;
+  bool restart = false;
+
+  switch (_rx_buf[5])
+  {
+    case OSDP_REPLY_ACK:
+      if (ptr_pd->sent_cmd == OSDP_CMD_LED) ptr_pd->led_pending = false;
+      if (ptr_pd->sent_cmd == OSDP_CMD_BUZ) ptr_pd->buz_pending = false;
+      break;
+    case OSDP_REPLY_NAK:
+      restart = (data_len > 0 && data[0] == OSDP_NAK_SEQUENCE);
+      if (!restart)
+      {
+        // Command not supported by reader.
+        if (ptr_pd->sent_cmd == OSDP_CMD_LED) ptr_pd->led_pending = false;
+        if (ptr_pd->sent_cmd == OSDP_CMD_BUZ) ptr_pd->buz_pending = false;
+      }
+      break;
+    case OSDP_REPLY_RAW:
+      _raw_card(ptr_pd, data, data_len, &task_woken);
+      break;
+    default:
+      break;
+  }
+
+  ptr_pd->online = true;
+  ptr_pd->failures = 0;
+  ptr_pd->sqn = (restart ? 0 : (ptr_pd->sqn % 3) + 1);
+
+  _state = osdp_bus_idle;
+  _timer_schedule(OSDP_MS_TO_TICKS(OSDP_POLL_GAP_MS));
+
+  portYIELD_FROM_ISR(task_woken);
+}
+
+static void _rx_byte(uint8_t byte)
+{
+  if (_state != osdp_bus_reply) return;
+  if (_rx_len == 0 && byte != OSDP_SOM) return;
+
+  _rx_buf[_rx_len++] = byte;
+
+  if (_rx_len >= 4)
+  {
+    uint16_t len = _rx_buf[2] | (_rx_buf[3] << 8);
+    if (len < OSDP_HEAD_SIZE + OSDP_CRC_SIZE || len > OSDP_RX_MAX)
+    {
+      _rx_len = 0; // Not a packet start or too long.
+    }
+    else if (_rx_len == len)
+    {
+      _reply_received();
+    }
+  }
+}
+
+static void _bus_init(void)
+{
+  // RS-485 driver enable
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[OSDP_DE_PORT][OSDP_DE_PIN], IOCON_MODE_INACT, IOCON_FUNC0);
+  Chip_GPIO_SetPinDIROutput(LPC_GPIO, OSDP_DE_PORT, OSDP_DE_PIN);
+  _driver_enable(false);
+
+  Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_6, (IOCON_FUNC1 | IOCON_MODE_INACT)); /* RXD */
+  Chip_IOCON_PinMuxSet(LPC_IOCON, IOCON_PIO1_7, (IOCON_FUNC1 | IOCON_MODE_INACT)); /* TXD */
+
+  Chip_UART_Init(LPC_USART);
+  Chip_UART_SetBaud(LPC_USART, OSDP_BAUD_RATE);
+  Chip_UART_ConfigData(LPC_USART, (UART_LCR_WLEN8 | UART_LCR_SBS_1BIT));
+  Chip_UART_SetupFIFOS(LPC_USART, (UART_FCR_FIFO_EN | UART_FCR_RX_RS | UART_FCR_TX_RS | UART_FCR_TRG_LEV2));
+  Chip_UART_TXEnable(LPC_USART);
+  Chip_UART_IntEnable(LPC_USART, (UART_IER_RBRINT | UART_IER_RLSINT));
+  NVIC_ClearPendingIRQ(UART0_IRQn);
+  NVIC_EnableIRQ(UART0_IRQn);
+
+  Chip_TIMER_Init(OSDP_TIMER);
+  Chip_TIMER_Reset(OSDP_TIMER);
+  Chip_TIMER_PrescaleSet(OSDP_TIMER, (SystemCoreClock / OSDP_TIMER_HZ) - 1UL);
+  Chip_TIMER_Enable(OSDP_TIMER);
+  NVIC_ClearPendingIRQ(OSDP_TIMER_IRQn);
+  NVIC_EnableIRQ(OSDP_TIMER_IRQn);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void osdp_init(StreamBufferHandle_t buffer, uint8_t id, uint8_t pd_addr)
+{
+  configASSERT(id < SERIAL_DEVICE_LIMIT);
+  configASSERT(pd_addr < 0x7F);
+
+  static bool bus_initialized = false;
+  if (!bus_initialized)
+  {
+    _bus_init();
+    bus_initialized = true;
+  }
+
+  portENTER_CRITICAL();
+  memset(&_pd[id], 0, sizeof(osdp_pd_t));
+  _pd[id].addr = pd_addr;
+  _pd[id].consumer_buffer = buffer;
+
+  if (!_bus_running)
+  {
+    _bus_running = true;
+    _state = osdp_bus_idle;
+    _timer_schedule(OSDP_MS_TO_TICKS(OSDP_POLL_GAP_MS));
+  }
+  portEXIT_CRITICAL();
+}
+
+void osdp_disable(uint8_t id)
+{
+  configASSERT(id < SERIAL_DEVICE_LIMIT);
+
+  portENTER_CRITICAL();
+  _pd[id].consumer_buffer = NULL;
+  _pd[id].online = false;
+  portEXIT_CRITICAL();
+}
+
+void osdp_signal(uint8_t id, uint8_t color, uint16_t time_ms, bool with_beep)
+{
+  configASSERT(id < SERIAL_DEVICE_LIMIT);
+
+  uint16_t time = (time_ms + 99) / 100;
+  if (time > UINT8_MAX) time = UINT8_MAX;
+
+  portENTER_CRITICAL();
+  _pd[id].led_color = color;
+  _pd[id].led_time = time;
+  _pd[id].led_pending = true;
+  if (with_beep)
+  {
+    _pd[id].buz_time = time;
+    _pd[id].buz_pending = true;
+  }
+  portEXIT_CRITICAL();
+}
+
+bool osdp_is_online(uint8_t id)
+{
+  return id < SERIAL_DEVICE_LIMIT && _pd[id].online;
+}
+
+// Bus timing handler.
+void TIMER16_0_IRQHandler(void)
+{
+  if (!Chip_TIMER_MatchPending(OSDP_TIMER, 0)) return;
+  PROFILER_BEGIN(profiler_isr_osdp_timer);
+  Chip_TIMER_ClearMatch(OSDP_TIMER, 0);
+  Chip_TIMER_MatchDisableInt(OSDP_TIMER, 0);
+
+  switch (_state)
+  {
+    case osdp_bus_drain:
+      // Last character left the transmitter - wait for reply.
+      _driver_enable(false);
+      Chip_UART_SetupFIFOS(LPC_USART, (UART_FCR_FIFO_EN | UART_FCR_RX_RS | UART_FCR_TRG_LEV2));
+      _rx_len = 0;
+      _state = osdp_bus_reply;
+      _timer_schedule(OSDP_MS_TO_TICKS(OSDP_REPLY_TIMEOUT_MS));
+      break;
+    case osdp_bus_reply:
+      // Reply timeout.
+      _rx_len = 0;
+      if (++_pd[_cur].failures >= OSDP_OFFLINE_RETRIES)
+      {
+        _pd[_cur].failures = OSDP_OFFLINE_RETRIES;
+        _pd[_cur].online = false;
+        _pd[_cur].sqn = 0; // Restart communication.
+      }
+      _state = osdp_bus_idle;
+      _bus_next();
+      break;
+    case osdp_bus_idle:
+      _bus_next();
+      break;
+    default:
+      break;
+  }
+
+  PROFILER_END(profiler_isr_osdp_timer);
+}
+
+// UART handler.
+void UART_IRQHandler(void)
+{
+  PROFILER_BEGIN(profiler_isr_osdp_uart);
+  uint32_t int_id;
+  while (!((int_id = Chip_UART_ReadIntIDReg(LPC_USART)) & UART_IIR_INTSTAT_PEND))
+  {
+    switch (int_id & UART_IIR_INTID_MASK)
+    {
+      case UART_IIR_INTID_RLS:
+        (void)Chip_UART_ReadLineStatus(LPC_USART); // Clear error.
+        break;
+      case UART_IIR_INTID_RDA:
+      case UART_IIR_INTID_CTI:
+        while (Chip_UART_ReadLineStatus(LPC_USART) & UART_LSR_RDR)
+        {
+          _rx_byte(Chip_UART_ReadByte(LPC_USART));
+        }
+        break;
+      case UART_IIR_INTID_THRE:
+        if (_tx_pos < _tx_len)
+        {
+          _fill_fifo();
+        }
+        else
+        {
+          // Only shift register is not empty.
+          Chip_UART_IntDisable(LPC_USART, UART_IER_THREINT);
+          _state = osdp_bus_drain;
+          _timer_schedule(OSDP_CHAR_TICKS);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  PROFILER_END(profiler_isr_osdp_uart);
+}
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ *  @file
+ *  @brief OSDP interface driver (control panel side).
+ *
+ *  Readers (peripheral devices) share one RS-485 bus on UART. The bus is driven
+ *  only from interrupts: UART for framing and CT16B0 for turnaround, reply timeout
+ *  and gap between polls. Readers are polled one after another.
+ *
+ *  Packet:
+ *  | SOM (0x53) | ADDR | LEN (2B) | CTRL | CMD/REPLY | DATA | CRC16 (2B) |
+ *
+ *  Only plain packets with CRC are used (no secure channel).
+ *  Card data (osdp_RAW) are passed to consumer as Wiegand frames (see weigand.h).
+ *
+ *  @note UART is not available for debug console when OSDP is enabled.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BSP_OSDP_H_
+#define BSP_OSDP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "stream_buffer.h"
+#include "weigand.h"
+
+// Colors for osdp_signal.
+#define OSDP_COLOR_BLACK 0
+#define OSDP_COLOR_RED   1
+#define OSDP_COLOR_GREEN 2
+#define OSDP_COLOR_AMBER 3
+
+/**
+ * @brief Initialize OSDP reader.
+ *
+ *        Bus is initialized with the first reader.
+ *
+ * @param buffer ... Receive buffer for frames from RFID card/tags.
+ *                   See weigand_buff_item_t
+ * @param id ... interface identification (less than SERIAL_DEVICE_LIMIT)
+ * @param pd_addr ... address of reader on the bus (0x00 - 0x7E)
+ */
+void osdp_init(StreamBufferHandle_t buffer, uint8_t id, uint8_t pd_addr);
+
+/**
+ * @brief Stop polling of OSDP reader.
+ *
+ * @param id ... interface identification
+ */
+void osdp_disable(uint8_t id);
+
+/**
+ * @brief Temporarily switch reader LED (and buzzer).
+ *
+ *        Command is sent with next poll of the reader.
+ *
+ * @param id ... interface identification
+ * @param color ... LED color (OSDP_COLOR_...)
+ * @param time_ms ... signal duration
+ * @param with_beep ... true for sound signal
+ */
+void osdp_signal(uint8_t id, uint8_t color, uint16_t time_ms, bool with_beep);
+
+/**
+ * @brief Check reader communication.
+ *
+ * @param id ... interface identification
+ *
+ * @return true if reader responds to polls
+ */
+bool osdp_is_online(uint8_t id);
+
+#endif /* BSP_OSDP_H_ */
@@ -0,0 +1,104 @@
+/**
+ *  @file
+ *  @brief Profiler of interrupt handlers and critical sections.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "profiler.h"
+
+#if PROFILER_ENABLED
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define PROFILER_TIMER_HZ 1000000UL
+
+static profiler_stats_t _stats[profiler_site_count];
+
+static const char * const _site_names[profiler_site_count] =
+{
+  "isr can",
+  "isr gpio",
+  "isr weigand",
+  "isr osdp tmr",
+  "isr osdp uart",
+  "isr storage",
+  "crit reconfig",
+  "crit cache",
+  "crit master",
+  "crit can send",
+};
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static inline void _inc_saturated(uint16_t * ptr_value)
+{
+  if (*ptr_value < UINT16_MAX) (*ptr_value)++;
+}
+
+// Bins grow by factor of 4 from 4us.
+static inline uint8_t _bin(uint16_t duration_us)
+{
+  uint8_t bin = 0;
+  while (bin < PROFILER_HIST_BINS - 1 && duration_us >= (4U << (2 * bin))) bin++;
+  return bin;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void profiler_init(void)
+{
+  Chip_TIMER_Init(PROFILER_TIMER);
+  Chip_TIMER_Reset(PROFILER_TIMER);
+  Chip_TIMER_PrescaleSet(PROFILER_TIMER, (SystemCoreClock / PROFILER_TIMER_HZ) - 1UL);
+  Chip_TIMER_Enable(PROFILER_TIMER);
+}
+
+void profiler_record(profiler_site_t site, uint16_t begin)
+{
+  uint16_t duration_us = (uint16_t)Chip_TIMER_ReadCount(PROFILER_TIMER) - begin;
+  profiler_stats_t * ptr_stats = &_stats[site];
+
+  if (duration_us > ptr_stats->max_us) ptr_stats->max_us = duration_us;
+  _inc_saturated(&ptr_stats->count);
+  _inc_saturated(&ptr_stats->hist[_bin(duration_us)]);
+}
+
+bool profiler_get(uint8_t site, profiler_stats_t * ptr_stats)
+{
+  if (site >= profiler_site_count) return false;
+
+  // Sites are updated from interrupts.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *ptr_stats = _stats[site];
+  __set_PRIMASK(primask);
+  return true;
+}
+
+void profiler_print(void)
+{
+  DEBUGSTR("site: max us, count | <4 <16 <64 <256 <1k <4k >=4k\n");
+  for (uint8_t site = 0; site < profiler_site_count; ++site)
+  {
+    profiler_stats_t stats;
+    profiler_get(site, &stats);
+
+    DEBUGOUT("%s: %u, %u |", _site_names[site], stats.max_us, stats.count);
+    for (uint8_t bin = 0; bin < PROFILER_HIST_BINS; ++bin)
+    {
+      DEBUGOUT(" %u", stats.hist[bin]);
+    }
+    DEBUGSTR("\n");
+  }
+}
+
+#endif
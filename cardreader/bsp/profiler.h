@@ -0,0 +1,108 @@
+/**
+ *  @file
+ *  @brief Profiler of interrupt handlers and critical sections.
+ *
+ *  Enabled by PROFILER_ENABLED. Each instrumented site measures its duration
+ *  with free running hardware timer (CT16B1, 1MHz) and records maximum,
+ *  number of runs and histogram of durations.
+ *
+ *  Histogram bins (us):
+ *  | <4 | <16 | <64 | <256 | <1024 | <4096 | >=4096 |
+ *
+ *  Durations over 65ms wrap around (watchdog timeout is far longer, see HW_WATCHDOG_TIMEOUT).
+ *  Measurement itself adds about 2us to each site.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BSP_PROFILER_H_
+#define BSP_PROFILER_H_
+
+#include <stdint.h>
+#include "board.h"
+
+#define PROFILER_HIST_BINS 7
+
+// Instrumented sites (at most 16, see DATA_DIAG_PAGE_PROFILE).
+typedef enum
+{
+  profiler_isr_can,          // CAN controller (ROM driver and terminal callbacks).
+  profiler_isr_gpio,         // Wiegand data and door sensor edges.
+  profiler_isr_weigand,      // Wiegand end of frame.
+  profiler_isr_osdp_timer,   // OSDP bus timing.
+  profiler_isr_osdp_uart,    // OSDP bus data.
+  profiler_isr_storage,      // I2C of external storage.
+  profiler_crit_reconfigure, // Reader reconfiguration.
+  profiler_crit_cache,       // Cache access from task.
+  profiler_crit_master,      // Master alive timeout.
+  profiler_crit_can_send,    // CAN transmit.
+  profiler_site_count
+} profiler_site_t;
+
+typedef struct
+{
+  uint16_t max_us;                    // Longest duration.
+  uint16_t count;                     // Number of runs (saturated).
+  uint16_t hist[PROFILER_HIST_BINS];  // Runs in each bin (saturated).
+} profiler_stats_t;
+
+#if PROFILER_ENABLED
+
+#define PROFILER_TIMER LPC_TIMER16_1
+
+/**
+ * @brief Begin measurement of a site.
+ *
+ *        Place after interrupts are masked (critical section) or at the start of handler.
+ */
+#define PROFILER_BEGIN(site) const uint16_t _profiler_begin_##site = (uint16_t)Chip_TIMER_ReadCount(PROFILER_TIMER)
+
+/**
+ * @brief End measurement of a site.
+ *
+ *        Place before interrupts are unmasked or at the end of handler.
+ */
+#define PROFILER_END(site) profiler_record(site, _profiler_begin_##site)
+
+/**
+ * @brief Start profiler timer.
+ *
+ */
+void profiler_init(void);
+
+/**
+ * @brief Record duration of a site.
+ *
+ *        Must be called with the site's interrupts masked (critical section or handler).
+ *
+ * @param site ... measured site
+ * @param begin ... timer value at the beginning
+ */
+void profiler_record(profiler_site_t site, uint16_t begin);
+
+/**
+ * @brief Get statistics of a site.
+ *
+ * @param site ... measured site
+ * @param ptr_stats ... copy of statistics
+ *
+ * @return false if there is no such site
+ */
+bool profiler_get(uint8_t site, profiler_stats_t * ptr_stats);
+
+/**
+ * @brief Print statistics of all sites to debug console.
+ *
+ */
+void profiler_print(void);
+
+#else
+
+#define PROFILER_BEGIN(site)
+#define PROFILER_END(site)
+
+#endif
+
+#endif /* BSP_PROFILER_H_ */
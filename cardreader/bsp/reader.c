@@ -2,7 +2,7 @@
  *  @file
  *  @brief RFID reader driver
  *
- *         This RFID reader implementation uses Weigand26 card reader protocol.
+ *         This RFID reader implementation uses Wiegand card reader protocol.
  *
  *  @author Petr Elexa
  *  @see LICENSE
@@ -10,23 +10,45 @@
  */
 
 #include <reader.h>
+#include "profiler.h"
+#include "timer_wheel.h"
 
-// Define sensor binary value when door is open.
-#if DOOR_SENSOR_TYPE == SENSOR_IS_NC
-#define DOOR_SENSOR_VALUE_OPEN LOG_LOW  // Switch is closed when door is open.
+// Sensor type of doors before configuration from master (any type if sensor is disabled).
+#ifdef DOOR_SENSOR_TYPE
+#define DOOR_SENSOR_DEFAULT DOOR_SENSOR_TYPE
 #else
-#define DOOR_SENSOR_VALUE_OPEN LOG_HIGH // Switch is open when door is open.
+#define DOOR_SENSOR_DEFAULT SENSOR_IS_NO
 #endif
 
 #define DOOR_OPEN 1
 #define DOOR_CLOSED 0
 
+#if !OSDP_ENABLED && (ACS_READER_A_INTERFACE == READER_IF_OSDP || ACS_READER_B_INTERFACE == READER_IF_OSDP || \
+                      ACS_READER_C_INTERFACE == READER_IF_OSDP || ACS_READER_D_INTERFACE == READER_IF_OSDP)
+#error "OSDP reader requires OSDP_ENABLED."
+#endif
+
 // Buffer for user_id received from RFID reader.
+#define READER_BUFFER_SIZE (2 * ACS_READER_MAXCOUNT * WEIGAND_BUFF_ITEM_SIZE)
 static StreamBufferHandle_t _reader_buffer;
+static StaticStreamBuffer_t _reader_buffer_struct;
+static uint8_t _reader_buffer_storage[READER_BUFFER_SIZE + 1]; // One byte is never used by stream buffer.
+
+// Reader timers (not in reader_conf - configuration is copied while timers run).
+static timer_wheel_timer_t _timer_open[ACS_READER_MAXCOUNT]; // Relay release.
+static timer_wheel_timer_t _timer_ok[ACS_READER_MAXCOUNT];   // End of LED and beeper signal.
+
+// Task notified on door sensor edge.
+static TaskHandle_t _door_event_task = NULL;
+
+// Card frames rejected because of parity.
+static uint16_t _parity_errors[ACS_READER_MAXCOUNT];
 
 static const reader_wiring_t _reader_wiring[ACS_READER_MAXCOUNT] =
 {
   {
+    .interface = ACS_READER_A_INTERFACE,
+    .osdp_addr = ACS_READER_A_OSDP_ADDR,
     .data_port = ACS_READER_A_DATA_PORT,
     .d0_pin = ACS_READER_A_D0_PIN,
     .d1_pin = ACS_READER_A_D1_PIN,
@@ -41,7 +63,10 @@ static const reader_wiring_t _reader_wiring[ACS_READER_MAXCOUNT] =
     .sensor_port = ACS_READER_A_SENSOR_PORT,
     .sensor_pin = ACS_READER_A_SENSOR_PIN,
   },
+#if ACS_READER_MAXCOUNT > 1
   {
+    .interface = ACS_READER_B_INTERFACE,
+    .osdp_addr = ACS_READER_B_OSDP_ADDR,
     .data_port = ACS_READER_B_DATA_PORT,
     .d0_pin = ACS_READER_B_D0_PIN,
     .d1_pin = ACS_READER_B_D1_PIN,
@@ -55,40 +80,124 @@ static const reader_wiring_t _reader_wiring[ACS_READER_MAXCOUNT] =
     .relay_pin = ACS_READER_B_RELAY_PIN,
     .sensor_port = ACS_READER_B_SENSOR_PORT,
     .sensor_pin = ACS_READER_B_SENSOR_PIN,
-  }
+  },
+#endif
+#if ACS_READER_MAXCOUNT > 2
+  {
+    .interface = ACS_READER_C_INTERFACE,
+    .osdp_addr = ACS_READER_C_OSDP_ADDR,
+    .data_port = ACS_READER_C_DATA_PORT,
+    .d0_pin = ACS_READER_C_D0_PIN,
+    .d1_pin = ACS_READER_C_D1_PIN,
+    .beep_port = ACS_READER_C_BEEP_PORT,
+    .beep_pin = ACS_READER_C_BEEP_PIN,
+    .gled_port = ACS_READER_C_GLED_PORT,
+    .gled_pin = ACS_READER_C_GLED_PIN,
+    .rled_port = ACS_READER_C_RLED_PORT,
+    .rled_pin = ACS_READER_C_RLED_PIN,
+    .relay_port = ACS_READER_C_RELAY_PORT,
+    .relay_pin = ACS_READER_C_RELAY_PIN,
+    .sensor_port = ACS_READER_C_SENSOR_PORT,
+    .sensor_pin = ACS_READER_C_SENSOR_PIN,
+  },
+#endif
+#if ACS_READER_MAXCOUNT > 3
+  {
+    .interface = ACS_READER_D_INTERFACE,
+    .osdp_addr = ACS_READER_D_OSDP_ADDR,
+    .data_port = ACS_READER_D_DATA_PORT,
+    .d0_pin = ACS_READER_D_D0_PIN,
+    .d1_pin = ACS_READER_D_D1_PIN,
+    .beep_port = ACS_READER_D_BEEP_PORT,
+    .beep_pin = ACS_READER_D_BEEP_PIN,
+    .gled_port = ACS_READER_D_GLED_PORT,
+    .gled_pin = ACS_READER_D_GLED_PIN,
+    .rled_port = ACS_READER_D_RLED_PORT,
+    .rled_pin = ACS_READER_D_RLED_PIN,
+    .relay_port = ACS_READER_D_RELAY_PORT,
+    .relay_pin = ACS_READER_D_RELAY_PIN,
+    .sensor_port = ACS_READER_D_SENSOR_PORT,
+    .sensor_pin = ACS_READER_D_SENSOR_PIN,
+  },
+#endif
 };
 
+// Reader is connected to OSDP bus (LEDs and beeper are controlled by commands).
+static inline bool _is_osdp(uint8_t idx)
+{
+#if OSDP_ENABLED
+  return _reader_wiring[idx].interface == READER_IF_OSDP;
+#else
+  (void)idx;
+  return false;
+#endif
+}
+
 reader_conf_t reader_conf[ACS_READER_MAXCOUNT] =
 {
   {
-    .timer_ok = NULL,
-    .timer_open = NULL,
     .open_time_sec = ACS_READER_A_OPEN_TIME_MS,
     .gled_time_sec = ACS_READER_A_OK_GLED_TIME_MS,
     .enabled = ACS_READER_A_ENABLED,
+    .beep_on_success = BEEP_ON_SUCCESS,
+    .ok_led_on_success = OK_LED_ON_SUCCESS,
+    .sensor_type = DOOR_SENSOR_DEFAULT,
     .learn_mode = false,
-    .door_open = DOOR_CLOSED
+    .door_open = DOOR_CLOSED,
+    .door_edge_tick = 0
   },
+#if ACS_READER_MAXCOUNT > 1
   {
-    .timer_ok = NULL,
-    .timer_open = NULL,
     .open_time_sec = ACS_READER_B_OPEN_TIME_MS,
     .gled_time_sec = ACS_READER_B_OK_GLED_TIME_MS,
     .enabled = ACS_READER_B_ENABLED,
+    .beep_on_success = BEEP_ON_SUCCESS,
+    .ok_led_on_success = OK_LED_ON_SUCCESS,
+    .sensor_type = DOOR_SENSOR_DEFAULT,
     .learn_mode = false,
-    .door_open = DOOR_CLOSED
-  }
+    .door_open = DOOR_CLOSED,
+    .door_edge_tick = 0
+  },
+#endif
+#if ACS_READER_MAXCOUNT > 2
+  {
+    .open_time_sec = ACS_READER_C_OPEN_TIME_MS,
+    .gled_time_sec = ACS_READER_C_OK_GLED_TIME_MS,
+    .enabled = ACS_READER_C_ENABLED,
+    .beep_on_success = BEEP_ON_SUCCESS,
+    .ok_led_on_success = OK_LED_ON_SUCCESS,
+    .sensor_type = DOOR_SENSOR_DEFAULT,
+    .learn_mode = false,
+    .door_open = DOOR_CLOSED,
+    .door_edge_tick = 0
+  },
+#endif
+#if ACS_READER_MAXCOUNT > 3
+  {
+    .open_time_sec = ACS_READER_D_OPEN_TIME_MS,
+    .gled_time_sec = ACS_READER_D_OK_GLED_TIME_MS,
+    .enabled = ACS_READER_D_ENABLED,
+    .beep_on_success = BEEP_ON_SUCCESS,
+    .ok_led_on_success = OK_LED_ON_SUCCESS,
+    .sensor_type = DOOR_SENSOR_DEFAULT,
+    .learn_mode = false,
+    .door_open = DOOR_CLOSED,
+    .door_edge_tick = 0
+  },
+#endif
 };
 
 
-// Timer callback to lock after specified time
-static void _timer_open_callback(TimerHandle_t pxTimer)
+// Define sensor binary value when door is open.
+static inline uint8_t _door_sensor_value_open(uint8_t idx)
 {
-  configASSERT(pxTimer);
-
-  // Which timer expired
-  uint32_t id = (uint32_t) pvTimerGetTimerID(pxTimer);
+  // NC switch is closed when door is open, NO switch is open.
+  return (reader_conf[idx].sensor_type == SENSOR_IS_NC ? LOG_LOW : LOG_HIGH);
+}
 
+// Timer callback to lock after specified time. Called from tick interrupt.
+static void _timer_open_callback(uint32_t id)
+{
   if (id < ACS_READER_MAXCOUNT && reader_conf[id].enabled)
   {
     // Lock state
@@ -96,15 +205,10 @@ static void _timer_open_callback(TimerHandle_t pxTimer)
   }
 }
 
-// Timer callback to stop signaling unlock
-static void _timer_ok_callback(TimerHandle_t pxTimer)
+// Timer callback to stop signaling unlock. Called from tick interrupt.
+static void _timer_ok_callback(uint32_t id)
 {
-  configASSERT(pxTimer);
-
-  // Which timer expired
-  uint32_t id = (uint32_t) pvTimerGetTimerID(pxTimer);
-
-  if (id < ACS_READER_MAXCOUNT && reader_conf[id].enabled)
+  if (id < ACS_READER_MAXCOUNT && reader_conf[id].enabled && !_is_osdp(id))
   {
     // Lock state
     Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[id].beep_port, _reader_wiring[id].beep_pin, LOG_LOW);
@@ -114,31 +218,9 @@ static void _timer_ok_callback(TimerHandle_t pxTimer)
 }
 
 
-void reader_init(uint8_t idx)
+// Setup LEDs and beeper of Wiegand reader.
+static void _reader_signal_init(uint8_t idx)
 {
-  //Create stream buffer to receive idx from all card readers
-  if (_reader_buffer == NULL)
-  {
-    _reader_buffer = xStreamBufferCreate(2 * ACS_READER_MAXCOUNT * WEIGAND26_BUFF_ITEM_SIZE, WEIGAND26_BUFF_ITEM_SIZE);
-  }
-  configASSERT(_reader_buffer);
-
-  //Init interface to reader
-  weigand_init(_reader_buffer, idx, _reader_wiring[idx].data_port, _reader_wiring[idx].d0_pin, _reader_wiring[idx].d1_pin);
-
-  //Create timer only once
-  if (reader_conf[idx].timer_open == NULL)
-  {
-    reader_conf[idx].timer_open = xTimerCreate("PT0", pdMS_TO_TICKS(reader_conf[idx].open_time_sec), pdFALSE, (void *)(uint32_t) idx, _timer_open_callback);
-  }
-  configASSERT(reader_conf[idx].timer_open);
-
-  if (reader_conf[idx].timer_ok == NULL)
-  {
-    reader_conf[idx].timer_ok = xTimerCreate("PT1", pdMS_TO_TICKS(reader_conf[idx].gled_time_sec), pdFALSE, (void *)(uint32_t) idx, _timer_ok_callback);
-  }
-  configASSERT(reader_conf[idx].timer_ok);
-
   //Setup GLED
   Chip_GPIO_SetPinDIROutput(LPC_GPIO, _reader_wiring[idx].gled_port, _reader_wiring[idx].gled_pin);
   Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[_reader_wiring[idx].gled_port][_reader_wiring[idx].gled_pin], IOCON_MODE_INACT, IOCON_FUNC0);
@@ -153,6 +235,38 @@ void reader_init(uint8_t idx)
   Chip_GPIO_SetPinDIROutput(LPC_GPIO, _reader_wiring[idx].beep_port, _reader_wiring[idx].beep_pin);
   Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[_reader_wiring[idx].beep_port][_reader_wiring[idx].beep_pin], IOCON_MODE_INACT, IOCON_FUNC0);
   Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].beep_port, _reader_wiring[idx].beep_pin, LOG_LOW);
+}
+
+void reader_init(uint8_t idx)
+{
+  //Create stream buffer to receive idx from all card readers
+  if (_reader_buffer == NULL)
+  {
+    _reader_buffer = xStreamBufferCreateStatic(READER_BUFFER_SIZE, WEIGAND_BUFF_ITEM_SIZE,
+                                               _reader_buffer_storage, &_reader_buffer_struct);
+  }
+  configASSERT(_reader_buffer);
+
+  //Init interface to reader
+#if OSDP_ENABLED
+  if (_is_osdp(idx))
+  {
+    osdp_init(_reader_buffer, idx, _reader_wiring[idx].osdp_addr);
+  }
+  else
+#endif
+  {
+    weigand_init(_reader_buffer, idx, _reader_wiring[idx].data_port, _reader_wiring[idx].d0_pin, _reader_wiring[idx].d1_pin);
+  }
+
+  // Timers only switch GPIO - served directly from tick interrupt. Period is given on start.
+  timer_wheel_setup(&_timer_open[idx], _timer_open_callback, idx, TIMER_WHEEL_ISR);
+  timer_wheel_setup(&_timer_ok[idx], _timer_ok_callback, idx, TIMER_WHEEL_ISR);
+
+  if (!_is_osdp(idx))
+  {
+    _reader_signal_init(idx);
+  }
 
   //RELAY
   Chip_GPIO_SetPinDIROutput(LPC_GPIO, _reader_wiring[idx].relay_port, _reader_wiring[idx].relay_pin);
@@ -163,6 +277,9 @@ void reader_init(uint8_t idx)
   Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[_reader_wiring[idx].sensor_port][_reader_wiring[idx].sensor_pin], IOCON_MODE_INACT, IOCON_FUNC0);
   Chip_GPIO_SetPinDIRInput(LPC_GPIO, _reader_wiring[idx].sensor_port, _reader_wiring[idx].sensor_pin);
 #ifdef DOOR_SENSOR_TYPE
+  // Initial state.
+  uint8_t sensor_value = Chip_GPIO_ReadPortBit(LPC_GPIO, _reader_wiring[idx].sensor_port, _reader_wiring[idx].sensor_pin);
+  reader_conf[idx].door_open = (sensor_value == _door_sensor_value_open(idx) ? DOOR_OPEN : DOOR_CLOSED);
   Chip_GPIO_SetupPinInt(LPC_GPIO, _reader_wiring[idx].sensor_port, _reader_wiring[idx].sensor_pin, GPIO_INT_BOTH_EDGES);
   Chip_GPIO_ClearInts(LPC_GPIO, _reader_wiring[idx].sensor_port, (1 << _reader_wiring[idx].sensor_pin));
   Chip_GPIO_EnableInt(LPC_GPIO, _reader_wiring[idx].sensor_port, (1 << _reader_wiring[idx].sensor_pin));
@@ -171,43 +288,65 @@ void reader_init(uint8_t idx)
 
 void reader_deinit(uint8_t idx)
 {
-  if (xTimerDelete(reader_conf[idx].timer_open, 0) != pdFAIL)
-  {
-    reader_conf[idx].timer_open = NULL;
-  }
-  if (xTimerDelete(reader_conf[idx].timer_ok, 0) != pdFAIL)
+  // Timers are statically allocated - only stopped and reused on next init.
+  timer_wheel_cancel(&_timer_open[idx]);
+  timer_wheel_cancel(&_timer_ok[idx]);
+
+#if OSDP_ENABLED
+  if (_is_osdp(idx))
   {
-    reader_conf[idx].timer_ok = NULL;
+    osdp_disable(idx);
+    return;
   }
-
-  weigand_disable(_reader_wiring[idx].data_port, _reader_wiring[idx].d0_pin, _reader_wiring[idx].d1_pin);
+#endif
+  weigand_disable(idx);
 }
 
 uint8_t reader_get_request_from_buffer(uint32_t * user_id, uint16_t time_to_wait_ms)
 {
-  weigand26_buff_item_t item;
+  weigand_buff_item_t item;
   size_t bytes_got;
 
   // Suspend if empty
-  bytes_got = xStreamBufferReceive(_reader_buffer, &item, WEIGAND26_BUFF_ITEM_SIZE, pdMS_TO_TICKS(time_to_wait_ms));
+  bytes_got = xStreamBufferReceive(_reader_buffer, &item, WEIGAND_BUFF_ITEM_SIZE, pdMS_TO_TICKS(time_to_wait_ms));
 
-  if (bytes_got == WEIGAND26_BUFF_ITEM_SIZE && weigand_is_parity_ok(item.frame))
+  if (bytes_got == WEIGAND_BUFF_ITEM_SIZE && weigand_is_parity_ok(&item.frame))
   {
-    *user_id = (item.frame.facility_code << 16) | item.frame.card_number;
+    *user_id = weigand_get_id(&item.frame);
     return item.source;
   }
   else
   {
+    if (bytes_got == WEIGAND_BUFF_ITEM_SIZE && item.source < ACS_READER_MAXCOUNT &&
+        _parity_errors[item.source] < UINT16_MAX)
+    {
+      _parity_errors[item.source]++;
+    }
     return UINT8_MAX;
   }
 }
 
+uint16_t reader_get_parity_errors(uint8_t idx)
+{
+  return _parity_errors[idx];
+}
+
 void reader_unlock(uint8_t idx, bool with_beep, bool with_ok_led)
 {
-  configASSERT(xTimerStart(reader_conf[idx].timer_ok, 0));
-  Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].rled_port, _reader_wiring[idx].rled_pin, LOG_LOW);
-  configASSERT(xTimerStart(reader_conf[idx].timer_open, 0));
+  timer_wheel_arm(&_timer_open[idx], pdMS_TO_TICKS(reader_conf[idx].open_time_sec));
   Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].relay_port, _reader_wiring[idx].relay_pin, LOG_LOW);
+#if OSDP_ENABLED
+  if (_is_osdp(idx))
+  {
+    if (with_beep || with_ok_led)
+    {
+      osdp_signal(idx, (with_ok_led ? OSDP_COLOR_GREEN : OSDP_COLOR_BLACK), reader_conf[idx].gled_time_sec, with_beep);
+    }
+    return;
+  }
+#endif
+  timer_wheel_arm(&_timer_ok[idx], pdMS_TO_TICKS(reader_conf[idx].gled_time_sec));
+  Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].rled_port, _reader_wiring[idx].rled_pin, LOG_LOW);
   // Unlock state
   if (with_beep)
   {
@@ -221,7 +360,14 @@ void reader_unlock(uint8_t idx, bool with_beep, bool with_ok_led)
 
 void reader_signal_to_user(uint8_t idx, bool with_beep)
 {
-  configASSERT(xTimerStart(reader_conf[idx].timer_ok, 0));
+#if OSDP_ENABLED
+  if (_is_osdp(idx))
+  {
+    osdp_signal(idx, OSDP_COLOR_AMBER, reader_conf[idx].gled_time_sec, with_beep);
+    return;
+  }
+#endif
+  timer_wheel_arm(&_timer_ok[idx], pdMS_TO_TICKS(reader_conf[idx].gled_time_sec));
   Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].rled_port, _reader_wiring[idx].rled_pin, LOG_HIGH);
   Chip_GPIO_SetPinState(LPC_GPIO, _reader_wiring[idx].gled_port, _reader_wiring[idx].gled_pin, LOG_HIGH);
   if (with_beep)
@@ -235,49 +381,73 @@ bool reader_is_door_open(uint8_t reader_idx)
   return reader_conf[reader_idx].door_open == DOOR_OPEN;
 }
 
+TickType_t reader_get_door_edge_tick(uint8_t reader_idx)
+{
+  return reader_conf[reader_idx].door_edge_tick;
+}
+
+bool reader_is_unlocked(uint8_t reader_idx)
+{
+  // Relay is active low.
+  return Chip_GPIO_GetPinState(LPC_GPIO, _reader_wiring[reader_idx].relay_port, _reader_wiring[reader_idx].relay_pin) == LOG_LOW;
+}
+
+void reader_set_door_event_task(TaskHandle_t task)
+{
+  _door_event_task = task;
+}
+
 // Sensor interrupt handler.
 void reader_sensor_int_handler(uint8_t port, uint32_t int_states)
 {
-  if (_reader_wiring[ACS_READER_A_IDX].sensor_port != port &&
-      _reader_wiring[ACS_READER_B_IDX].sensor_port != port)
-  {
-    return;
-  }
+  TickType_t now = xTaskGetTickCountFromISR();
+  uint32_t events = 0;
 
-  // door sensor A
-  if (int_states & (1 << _reader_wiring[ACS_READER_A_IDX].sensor_pin))
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
   {
+    if (_reader_wiring[idx].sensor_port != port ||
+        !(int_states & (1 << _reader_wiring[idx].sensor_pin)))
+    {
+      continue;
+    }
     // update current state
-    uint8_t sensor_value = Chip_GPIO_ReadPortBit(LPC_GPIO, port, _reader_wiring[ACS_READER_A_IDX].sensor_pin);
-    reader_conf[ACS_READER_A_IDX].door_open = (sensor_value == DOOR_SENSOR_VALUE_OPEN ? DOOR_OPEN : DOOR_CLOSED);
+    uint8_t sensor_value = Chip_GPIO_ReadPortBit(LPC_GPIO, port, _reader_wiring[idx].sensor_pin);
+    reader_conf[idx].door_open = (sensor_value == _door_sensor_value_open(idx) ? DOOR_OPEN : DOOR_CLOSED);
+    reader_conf[idx].door_edge_tick = now;
+    events |= (1 << idx);
   }
-  // door sensor B
-  if (int_states & (1 << _reader_wiring[ACS_READER_B_IDX].sensor_pin))
+
+  // Let the task do debouncing and reporting.
+  if (events != 0 && _door_event_task != NULL)
   {
-    // update current state
-    uint8_t sensor_value = Chip_GPIO_ReadPortBit(LPC_GPIO, port, _reader_wiring[ACS_READER_B_IDX].sensor_pin);
-    reader_conf[ACS_READER_B_IDX].door_open = (sensor_value == DOOR_SENSOR_VALUE_OPEN ? DOOR_OPEN : DOOR_CLOSED);
+    BaseType_t task_woken = pdFALSE;
+    xTaskNotifyFromISR(_door_event_task, events, eSetBits, &task_woken);
+    portYIELD_FROM_ISR(task_woken);
   }
 }
 
 // GPIO port 0 handler.
 void PIOINT0_IRQHandler(void)
 {
+  PROFILER_BEGIN(profiler_isr_gpio);
   NVIC_ClearPendingIRQ(EINT0_IRQn);
   uint32_t int_states = Chip_GPIO_GetMaskedInts(LPC_GPIO, 0);
   //Clear int flag on each pin
   Chip_GPIO_ClearInts(LPC_GPIO, 0, 0xFFFFFFFF);
 
   reader_sensor_int_handler(0, int_states);
+  PROFILER_END(profiler_isr_gpio);
 }
 
 // GPIO port 1 handler.
 void PIOINT1_IRQHandler(void)
 {
+  PROFILER_BEGIN(profiler_isr_gpio);
   NVIC_ClearPendingIRQ(EINT1_IRQn);
   uint32_t int_states = Chip_GPIO_GetMaskedInts(LPC_GPIO, 1);
   //Clear int flag on each pin
   Chip_GPIO_ClearInts(LPC_GPIO, 1, 0xFFFFFFFF);
 
   reader_sensor_int_handler(1, int_states);
+  PROFILER_END(profiler_isr_gpio);
 }
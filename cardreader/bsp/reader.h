@@ -15,22 +15,27 @@
 #include "board.h"
 #include "FreeRTOS.h"
 #include "stream_buffer.h"
-#include "timers.h"
+#include "task.h"
 #include "weigand.h"
+#include "osdp.h"
 
 typedef struct
 {
-  TimerHandle_t timer_open;
-  TimerHandle_t timer_ok;
   uint16_t open_time_sec;
   uint16_t gled_time_sec;
   uint8_t enabled;
+  uint8_t beep_on_success;
+  uint8_t ok_led_on_success;
+  uint8_t sensor_type; // SENSOR_IS_...
   uint8_t learn_mode;
   uint8_t door_open;
+  TickType_t door_edge_tick; // Time of last door sensor edge.
 } reader_conf_t;
 
 typedef struct
 {
+  uint8_t interface; // READER_IF_...
+  uint8_t osdp_addr;
   uint8_t data_port;
   uint8_t d0_pin;
   uint8_t d1_pin;
@@ -68,12 +73,21 @@ void reader_deinit(uint8_t idx);
 /**
  * @brief Disable reader driver.
  *
- * @param user_id ... 24-bit number
+ * @param user_id ... card identification (see weigand_get_id)
  * @param idx ... reader index
  * @param ... time_to_wait_ms ... time to wait for request
  */
 uint8_t reader_get_request_from_buffer(uint32_t * user_id, uint16_t time_to_wait_ms);
 
+/**
+ * @brief Get number of card frames rejected because of parity.
+ *
+ * @param idx ... reader index
+ *
+ * @return number of errors since reset
+ */
+uint16_t reader_get_parity_errors(uint8_t idx);
+
 /**
  * @brief Unlock door belonging to reader.
  *
@@ -100,4 +114,31 @@ void reader_signal_to_user(uint8_t idx, bool with_beep);
  */
 bool reader_is_door_open(uint8_t reader_idx);
 
+/**
+ * @brief Get time of the last door sensor edge.
+ *
+ * @param idx ... reader index
+ *
+ * @return tick count of the edge
+ */
+TickType_t reader_get_door_edge_tick(uint8_t reader_idx);
+
+/**
+ * @brief Check if door lock is released.
+ *
+ * @param idx ... reader index
+ *
+ * @return true if door is unlocked
+ */
+bool reader_is_unlocked(uint8_t reader_idx);
+
+/**
+ * @brief Set task notified on door sensor edge.
+ *
+ *        Task gets notification value with bit (1 << reader index) set.
+ *
+ * @param task ... task handle (NULL to disable notification)
+ */
+void reader_set_door_event_task(TaskHandle_t task);
+
 #endif /* BSP_READER_H_ */
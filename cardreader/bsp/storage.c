@@ -10,8 +10,18 @@
  */
 
 #include "storage.h"
+#include "profiler.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include <string.h>
+
+#if STORE_ADDR_SIZE == 2
+// Memory address is sent in two bytes - slave address is fixed.
+#define STORE_BLOCK_SLAVE_ADDR(addr) (STORE_I2C_SLAVE_ADDR)
+#else
+// Slave address including block select bits of the memory address.
+#define STORE_BLOCK_SLAVE_ADDR(addr) (STORE_I2C_SLAVE_ADDR | (((addr) >> 8) & 0x7))
+#endif
 
 static inline void _init_I2C_pins(void)
 {
@@ -24,6 +34,43 @@ static inline void _init_I2C_pins(void)
 #endif
 }
 
+// Task waiting for end of I2C transfer.
+static TaskHandle_t _xfer_task = NULL;
+
+static inline bool _scheduler_running(void)
+{
+  return (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+}
+
+// Put memory address to the transmit buffer (in order of sending). Return its length.
+static inline uint8_t _put_addr(uint8_t * ptr_buff, const uint16_t addr)
+{
+#if STORE_ADDR_SIZE == 2
+  ptr_buff[0] = (uint8_t)(addr >> 8);
+  ptr_buff[1] = (uint8_t)addr;
+#else
+  ptr_buff[0] = (uint8_t)addr;
+#endif
+  return STORE_ADDR_SIZE;
+}
+
+// Send memory address and read data after repeated start.
+static bool _read(const uint16_t addr, uint8_t * data, const uint8_t len)
+{
+  uint8_t tx_buff[STORE_ADDR_SIZE];
+  I2C_XFER_T xfer =
+  {
+    .slaveAddr = STORE_BLOCK_SLAVE_ADDR(addr),
+    .txBuff = tx_buff,
+    .txSz = _put_addr(tx_buff, addr),
+    .rxBuff = data,
+    .rxSz = len
+  };
+
+  return (Chip_I2C_MasterTransfer(STORE_I2C_DEV, &xfer) == I2C_STATUS_DONE);
+}
+
+// Poll EEPROM by address until the write cycle ends (acknowledge polling).
 static inline void _wait_for_dev_ready(void)
 {
   uint8_t tmp;
@@ -33,6 +80,44 @@ static inline void _wait_for_dev_ready(void)
     {
       break;
     }
+    // Other tasks run during the write cycle.
+    if (_scheduler_running()) vTaskDelay(1);
+  }
+}
+
+// Transfer events - the calling task sleeps until the transfer is done (busy wait before scheduler start).
+static void _i2c_event(I2C_ID_T id, I2C_EVENT_T event)
+{
+  if (!_scheduler_running() && event != I2C_EVENT_DONE)
+  {
+    Chip_I2C_EventHandler(id, event);
+    return;
+  }
+
+  switch (event)
+  {
+    case I2C_EVENT_LOCK:
+      _xfer_task = xTaskGetCurrentTaskHandle();
+      (void)ulTaskNotifyTake(pdTRUE, 0); // Drop stale notification.
+      break;
+    case I2C_EVENT_WAIT:
+      // DONE may come before WAIT - notification is kept.
+      (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      break;
+    case I2C_EVENT_DONE:
+      // Called from interrupt.
+      if (_xfer_task != NULL)
+      {
+        BaseType_t task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(_xfer_task, &task_woken);
+        portYIELD_FROM_ISR(task_woken);
+      }
+      break;
+    case I2C_EVENT_UNLOCK:
+      _xfer_task = NULL;
+      break;
+    default:
+      break;
   }
 }
 
@@ -49,49 +134,54 @@ void storage_init(void)
   Chip_I2C_SetClockRate(STORE_I2C_DEV, freq);
 
   /* Set mode to interrupt */
-  Chip_I2C_SetMasterEventHandler(STORE_I2C_DEV, Chip_I2C_EventHandler);
+  Chip_I2C_SetMasterEventHandler(STORE_I2C_DEV, _i2c_event);
   NVIC_EnableIRQ(I2C0_IRQn);
 }
 
 bool storage_read_word_le(const uint8_t addr, uint16_t * data)
 {
-  const uint8_t len = sizeof(*data);
-
-  uint8_t n_got = Chip_I2C_MasterCmdRead(STORE_I2C_DEV, STORE_I2C_SLAVE_ADDR, addr, (uint8_t *)data, len);
-
-  return (n_got == len);
+  return _read(addr, (uint8_t *)data, sizeof(*data));
 }
 
 bool storage_write_word_le(const uint8_t addr, const uint16_t data)
 {
-  // in order of sending
-  const uint8_t tx_buff[] = {addr, (uint8_t)data, (uint8_t)(data >> 8)};
-
-  uint8_t n_sent = Chip_I2C_MasterSend(STORE_I2C_DEV, STORE_I2C_SLAVE_ADDR, tx_buff, ARRAY_SIZE(tx_buff));
+  const uint8_t bytes[] = {(uint8_t)data, (uint8_t)(data >> 8)};
 
-  _wait_for_dev_ready();
-
-  return (n_sent == ARRAY_SIZE(tx_buff));
+  return storage_write_page(addr, bytes, ARRAY_SIZE(bytes));
 }
 
 bool storage_read_byte(const uint8_t addr, uint8_t * data)
 {
-  const uint8_t len = sizeof(*data);
+  return _read(addr, data, sizeof(*data));
+}
 
-  uint8_t n_got = Chip_I2C_MasterCmdRead(STORE_I2C_DEV, STORE_I2C_SLAVE_ADDR, addr, data, len);
+bool storage_write_byte(const uint8_t addr, const uint8_t data)
+{
+  return storage_write_page(addr, &data, 1);
+}
 
-  return (n_got == len);
+bool storage_read(const uint16_t addr, uint8_t * data, const uint8_t len)
+{
+  configASSERT(addr + len <= STORE_SIZE);
+
+  return _read(addr, data, len);
 }
 
-bool storage_write_byte(const uint8_t addr, const uint8_t data)
+bool storage_write_page(const uint16_t addr, const uint8_t * data, const uint8_t len)
 {
-  const uint8_t tx_buff[] = {addr, data};
+  configASSERT(len <= STORE_PAGE_SIZE && addr + len <= STORE_SIZE);
+  configASSERT((addr / STORE_PAGE_SIZE) == ((addr + len - 1) / STORE_PAGE_SIZE));
+
+  // in order of sending
+  uint8_t tx_buff[STORE_ADDR_SIZE + STORE_PAGE_SIZE];
+  uint8_t addr_len = _put_addr(tx_buff, addr);
+  memcpy(&tx_buff[addr_len], data, len);
 
-  uint8_t n_sent = Chip_I2C_MasterSend(STORE_I2C_DEV, STORE_I2C_SLAVE_ADDR, tx_buff, ARRAY_SIZE(tx_buff));
+  uint8_t n_sent = Chip_I2C_MasterSend(STORE_I2C_DEV, STORE_BLOCK_SLAVE_ADDR(addr), tx_buff, addr_len + len);
 
   _wait_for_dev_ready();
 
-  return (n_sent == ARRAY_SIZE(tx_buff));
+  return (n_sent == addr_len + len);
 }
 
 /**
@@ -100,6 +190,7 @@ bool storage_write_byte(const uint8_t addr, const uint8_t data)
  */
 void I2C_IRQHandler(void)
 {
+  PROFILER_BEGIN(profiler_isr_storage);
   if (Chip_I2C_IsMasterActive(STORE_I2C_DEV))
   {
     Chip_I2C_MasterStateHandler(STORE_I2C_DEV);
@@ -108,4 +199,5 @@ void I2C_IRQHandler(void)
   {
     Chip_I2C_SlaveStateHandler(STORE_I2C_DEV);
   }
+  PROFILER_END(profiler_isr_storage);
 }
@@ -4,6 +4,10 @@
  *
  *         Supports I2C EEPROMs and I/O expanders.
  *
+ *         Functions block until the transfer and the write cycle end (the task sleeps
+ *         after scheduler start). Tasks use storage service (storage_service.h), these
+ *         functions are called directly only before scheduler start or by storage task.
+ *
  *  @author Petr Elexa
  *  @see LICENSE
  *
@@ -54,5 +58,32 @@ bool storage_read_byte(const uint8_t addr, uint8_t * data);
  */
 bool storage_write_byte(const uint8_t addr, const uint8_t data);
 
+/**
+ * @brief Read block of data from address.
+ *
+ *        Address is sent in STORE_ADDR_SIZE bytes (with one byte, address bits above 8th bit
+ *        select memory block of 24C04 to 24C16 EEPROMs).
+ *
+ * @param addr ... address of first byte (up to STORE_SIZE)
+ * @param data ... buffer for data
+ * @param len ... number of bytes to read
+ *
+ * @return true if succeeded
+ */
+bool storage_read(const uint16_t addr, uint8_t * data, const uint8_t len);
+
+/**
+ * @brief Write block of data to address.
+ *
+ *        Data must not cross page boundary (STORE_PAGE_SIZE).
+ *
+ * @param addr ... address of first byte (up to STORE_SIZE)
+ * @param data ... data to write
+ * @param len ... number of bytes to write (up to STORE_PAGE_SIZE)
+ *
+ * @return true if succeeded
+ */
+bool storage_write_page(const uint16_t addr, const uint8_t * data, const uint8_t len);
+
 
 #endif /* BSP_STORAGE_H_ */
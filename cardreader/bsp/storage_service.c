@@ -0,0 +1,225 @@
+/**
+ *  @file
+ *  @brief Asynchronous access to external storage.
+ *
+ *         Write is not done until the queue is empty or a request which cannot be
+ *         merged comes - consecutive writes to the same page are written at once
+ *         (one transfer and one write cycle).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "storage_service.h"
+#include "storage.h"
+#include "diag.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include <string.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define STORE_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE + 64)
+#define STORE_MERGE_MAX 4 // Requests merged into one page write.
+
+typedef enum
+{
+  storage_req_read,
+  storage_req_write,
+  storage_req_call,
+} storage_req_type_t;
+
+typedef struct
+{
+  uint8_t type;  // storage_req_type_t
+  uint8_t len;
+  uint16_t addr;
+  storage_done_t done;
+  void * ptr_arg;
+  union
+  {
+    uint8_t * ptr_dest;             // Read.
+    storage_job_t job;              // Call.
+    uint8_t data[STORE_PAGE_SIZE];  // Write.
+  };
+} storage_req_t;
+
+// Page write which is waiting for merge.
+typedef struct
+{
+  uint16_t addr;
+  uint8_t len;
+  uint8_t n_done;
+  storage_done_t done[STORE_MERGE_MAX];
+  void * ptr_arg[STORE_MERGE_MAX];
+  uint8_t data[STORE_PAGE_SIZE];
+} storage_pending_t;
+
+static QueueHandle_t _queue = NULL;
+static StaticQueue_t _queue_buffer;
+static uint8_t _queue_storage[STORE_QUEUE_LEN * sizeof(storage_req_t)];
+
+static StaticTask_t _task_tcb;
+static StackType_t _task_stack[STORE_TASK_STACK_SIZE];
+
+static storage_pending_t _pending;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static inline uint16_t _page(uint16_t addr)
+{
+  return addr / STORE_PAGE_SIZE;
+}
+
+// Write pending page and report the result to all merged requests.
+static void _flush(void)
+{
+  if (_pending.len == 0) return;
+
+  bool ok = storage_write_page(_pending.addr, _pending.data, _pending.len);
+
+  for (uint8_t i = 0; i < _pending.n_done; ++i)
+  {
+    if (_pending.done[i] != NULL) _pending.done[i](ok, _pending.ptr_arg[i]);
+  }
+  _pending.len = 0;
+  _pending.n_done = 0;
+}
+
+// Add write to pending page if it continues or overlaps pending data.
+static bool _merge(const storage_req_t * ptr_req)
+{
+  uint16_t end = _pending.addr + _pending.len;
+  uint16_t req_end = ptr_req->addr + ptr_req->len;
+
+  if (_pending.len == 0 || _pending.n_done == STORE_MERGE_MAX) return false;
+  if (_page(ptr_req->addr) != _page(_pending.addr)) return false;
+  if (ptr_req->addr > end || req_end < _pending.addr) return false; // Gap - page write is contiguous.
+
+  if (ptr_req->addr < _pending.addr)
+  {
+    memmove(&_pending.data[_pending.addr - ptr_req->addr], _pending.data, _pending.len);
+    _pending.addr = ptr_req->addr;
+  }
+  if (req_end > end) end = req_end;
+  _pending.len = (uint8_t)(end - _pending.addr);
+
+  // The newer data win.
+  memcpy(&_pending.data[ptr_req->addr - _pending.addr], ptr_req->data, ptr_req->len);
+  _pending.done[_pending.n_done] = ptr_req->done;
+  _pending.ptr_arg[_pending.n_done] = ptr_req->ptr_arg;
+  _pending.n_done++;
+  return true;
+}
+
+static void _start_pending(const storage_req_t * ptr_req)
+{
+  _pending.addr = ptr_req->addr;
+  _pending.len = ptr_req->len;
+  memcpy(_pending.data, ptr_req->data, ptr_req->len);
+  _pending.done[0] = ptr_req->done;
+  _pending.ptr_arg[0] = ptr_req->ptr_arg;
+  _pending.n_done = 1;
+}
+
+static void _storage_task(void * pvParameters)
+{
+  (void)pvParameters;
+  storage_req_t req;
+
+  for (;;)
+  {
+    // Pending write waits only while other requests are queued.
+    if (xQueueReceive(_queue, &req, (_pending.len != 0 ? 0 : portMAX_DELAY)) != pdTRUE)
+    {
+      _flush();
+      continue;
+    }
+
+    if (req.type == storage_req_write && _merge(&req)) continue;
+
+    // Requests are served in order.
+    _flush();
+
+    switch (req.type)
+    {
+      case storage_req_write:
+        _start_pending(&req);
+        break;
+      case storage_req_read:
+      {
+        bool ok = storage_read(req.addr, req.ptr_dest, req.len);
+        if (req.done != NULL) req.done(ok, req.ptr_arg);
+        break;
+      }
+      case storage_req_call:
+        req.job(req.ptr_arg);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static bool _send(const storage_req_t * ptr_req)
+{
+  configASSERT(_queue != NULL);
+
+  return (xQueueSend(_queue, ptr_req, 0) == pdTRUE);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void storage_service_init(void)
+{
+  _queue = xQueueCreateStatic(STORE_QUEUE_LEN, sizeof(storage_req_t), _queue_storage, &_queue_buffer);
+  configASSERT(_queue);
+
+  // Same priority as terminal task - storage task sleeps during transfers and write cycles.
+  diag_register_task(xTaskCreateStatic(_storage_task, "store", STORE_TASK_STACK_SIZE, NULL,
+                                       (tskIDLE_PRIORITY + 1UL), _task_stack, &_task_tcb));
+}
+
+bool storage_service_read(uint16_t addr, uint8_t * data, uint8_t len, storage_done_t done, void * ptr_arg)
+{
+  configASSERT(addr + len <= STORE_SIZE);
+
+  storage_req_t req = {.type = storage_req_read, .len = len, .addr = addr, .done = done, .ptr_arg = ptr_arg};
+  req.ptr_dest = data;
+
+  return _send(&req);
+}
+
+bool storage_service_write(uint16_t addr, const uint8_t * data, uint8_t len, storage_done_t done, void * ptr_arg)
+{
+  configASSERT(len > 0 && len <= STORE_PAGE_SIZE && addr + len <= STORE_SIZE);
+  configASSERT(_page(addr) == _page(addr + len - 1));
+
+  storage_req_t req = {.type = storage_req_write, .len = len, .addr = addr, .done = done, .ptr_arg = ptr_arg};
+  memcpy(req.data, data, len);
+
+  return _send(&req);
+}
+
+bool storage_service_call(storage_job_t job, void * ptr_arg)
+{
+  configASSERT(job != NULL);
+
+  storage_req_t req = {.type = storage_req_call, .done = NULL, .ptr_arg = ptr_arg};
+  req.job = job;
+
+  return _send(&req);
+}
+
+uint8_t storage_service_free(void)
+{
+  return (uint8_t)uxQueueSpacesAvailable(_queue);
+}
@@ -0,0 +1,95 @@
+/**
+ *  @file
+ *  @brief Asynchronous access to external storage.
+ *
+ *         Requests are queued and served by storage task - callers never wait for I2C
+ *         transfers or EEPROM write cycles. Adjacent writes to the same page are merged
+ *         into one page write. Requests are served in order (read returns data of all
+ *         previous writes).
+ *
+ *         After scheduler start, storage must be accessed only through this service
+ *         (blocking functions of storage.h can be used from callbacks and jobs).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BSP_STORAGE_SERVICE_H_
+#define BSP_STORAGE_SERVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Completion callback.
+ *
+ *        Called from storage task.
+ *
+ * @param ok ... true if the request succeeded
+ * @param ptr_arg ... argument given with the request
+ */
+typedef void (*storage_done_t)(bool ok, void * ptr_arg);
+
+/**
+ * @brief Job executed by storage task.
+ *
+ * @param ptr_arg ... argument given with the request
+ */
+typedef void (*storage_job_t)(void * ptr_arg);
+
+/**
+ * @brief Create storage task.
+ *
+ *        Must be called before scheduler start (after storage_init).
+ */
+void storage_service_init(void);
+
+/**
+ * @brief Queue read of block of data.
+ *
+ * @param addr ... address of first byte (up to STORE_SIZE)
+ * @param data ... buffer for data (valid until the callback)
+ * @param len ... number of bytes to read
+ * @param done ... completion callback or NULL
+ * @param ptr_arg ... argument of the callback
+ *
+ * @return false if queue is full
+ */
+bool storage_service_read(uint16_t addr, uint8_t * data, uint8_t len, storage_done_t done, void * ptr_arg);
+
+/**
+ * @brief Queue write of block of data.
+ *
+ *        Data are copied. Block must not cross page boundary (STORE_PAGE_SIZE).
+ *
+ * @param addr ... address of first byte (up to STORE_SIZE)
+ * @param data ... data to write
+ * @param len ... number of bytes to write (up to STORE_PAGE_SIZE)
+ * @param done ... completion callback or NULL
+ * @param ptr_arg ... argument of the callback
+ *
+ * @return false if queue is full
+ */
+bool storage_service_write(uint16_t addr, const uint8_t * data, uint8_t len, storage_done_t done, void * ptr_arg);
+
+/**
+ * @brief Queue job which uses storage (e.g. read, decide and write).
+ *
+ *        Job can use blocking functions of storage.h and queue other requests.
+ *
+ * @param job ... function to execute
+ * @param ptr_arg ... argument of the job
+ *
+ * @return false if queue is full
+ */
+bool storage_service_call(storage_job_t job, void * ptr_arg);
+
+/**
+ * @brief Get number of free places in request queue.
+ *
+ * @return number of requests which can be queued
+ */
+uint8_t storage_service_free(void);
+
+#endif /* BSP_STORAGE_SERVICE_H_ */
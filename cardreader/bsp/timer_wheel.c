@@ -0,0 +1,161 @@
+/**
+ *  @file
+ *  @brief Timing wheel for timeouts of the panel.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "timer_wheel.h"
+#include "diag.h"
+#include "task.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define WHEEL_TASK_STACK_SIZE 80
+#define WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+#if (TIMER_WHEEL_SLOTS & WHEEL_SLOT_MASK) != 0
+#error "TIMER_WHEEL_SLOTS must be power of 2."
+#endif
+
+// Timers armed to expire in slot (expiry modulo slot count).
+static timer_wheel_timer_t * _slots[TIMER_WHEEL_SLOTS];
+// Expired timers waiting for wheel task.
+static timer_wheel_timer_t * _expired = NULL;
+// Ticks of the wheel.
+static TickType_t _now = 0;
+
+static TaskHandle_t _task = NULL;
+static StaticTask_t _task_tcb;
+static StackType_t _task_stack[WHEEL_TASK_STACK_SIZE];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+// Interrupts must be masked in all list operations.
+static inline void _link(timer_wheel_timer_t ** pptr_head, timer_wheel_timer_t * ptr_timer)
+{
+  ptr_timer->next = *pptr_head;
+  if (ptr_timer->next != NULL) ptr_timer->next->pprev = &ptr_timer->next;
+  ptr_timer->pprev = pptr_head;
+  *pptr_head = ptr_timer;
+}
+
+static inline void _unlink(timer_wheel_timer_t * ptr_timer)
+{
+  if (ptr_timer->pprev == NULL) return;
+
+  *ptr_timer->pprev = ptr_timer->next;
+  if (ptr_timer->next != NULL) ptr_timer->next->pprev = ptr_timer->pprev;
+  ptr_timer->next = NULL;
+  ptr_timer->pprev = NULL;
+}
+
+// Run callbacks of expired timers.
+static void _wheel_task(void *pvParameters)
+{
+  (void)pvParameters;
+
+  while (true)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (true)
+    {
+      UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+      timer_wheel_timer_t * ptr_timer = _expired;
+      if (ptr_timer != NULL) _unlink(ptr_timer);
+      portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+
+      if (ptr_timer == NULL) break;
+      ptr_timer->callback(ptr_timer->id);
+    }
+  }
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void timer_wheel_init(void)
+{
+  // Priority of former timer service task - timeouts are served before terminal work.
+  _task = xTaskCreateStatic(_wheel_task, "wheel", WHEEL_TASK_STACK_SIZE, NULL, (tskIDLE_PRIORITY + 2UL),
+                            _task_stack, &_task_tcb);
+  configASSERT(_task);
+  diag_register_task(_task);
+}
+
+void timer_wheel_setup(timer_wheel_timer_t * ptr_timer, timer_wheel_callback_t callback, uint32_t id,
+                       uint8_t context)
+{
+  configASSERT(callback != NULL);
+
+  timer_wheel_cancel(ptr_timer);
+  ptr_timer->callback = callback;
+  ptr_timer->id = id;
+  ptr_timer->context = context;
+}
+
+void timer_wheel_arm(timer_wheel_timer_t * ptr_timer, TickType_t delay)
+{
+  configASSERT(ptr_timer->callback != NULL);
+
+  UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+  _unlink(ptr_timer);
+  ptr_timer->expiry = _now + (delay > 0 ? delay : 1);
+  _link(&_slots[ptr_timer->expiry & WHEEL_SLOT_MASK], ptr_timer);
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+}
+
+void timer_wheel_cancel(timer_wheel_timer_t * ptr_timer)
+{
+  UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+  _unlink(ptr_timer);
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+}
+
+void timer_wheel_tick(void)
+{
+  timer_wheel_timer_t * fired = NULL;
+  bool notify = false;
+
+  UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+  _now++;
+
+  // Timers of later turns stay in the slot.
+  timer_wheel_timer_t * ptr_timer = _slots[_now & WHEEL_SLOT_MASK];
+  while (ptr_timer != NULL)
+  {
+    timer_wheel_timer_t * ptr_next = ptr_timer->next;
+    if (ptr_timer->expiry == _now)
+    {
+      _unlink(ptr_timer);
+      if (ptr_timer->context == TIMER_WHEEL_TASK)
+      {
+        _link(&_expired, ptr_timer);
+        notify = true;
+      }
+      else _link(&fired, ptr_timer);
+    }
+    ptr_timer = ptr_next;
+  }
+
+  // Callback can arm or cancel any timer (also the fired ones).
+  while (fired != NULL)
+  {
+    ptr_timer = fired;
+    _unlink(ptr_timer);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+    ptr_timer->callback(ptr_timer->id);
+    saved = portSET_INTERRUPT_MASK_FROM_ISR();
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+
+  if (notify && _task != NULL) vTaskNotifyGiveFromISR(_task, NULL);
+}
@@ -0,0 +1,93 @@
+/**
+ *  @file
+ *  @brief Timing wheel for timeouts of the panel.
+ *
+ *         One wheel advanced by the RTOS tick (tick hook) serves all timeouts of the panel
+ *         instead of software timers. Timers are armed and cancelled in O(1) from tasks and
+ *         interrupts without timer queue (nothing can overflow under burst load).
+ *
+ *         Expired timer calls its callback from the tick interrupt (TIMER_WHEEL_ISR - short
+ *         work only, e.g. GPIO) or from the wheel task (TIMER_WHEEL_TASK).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef BSP_TIMER_WHEEL_H_
+#define BSP_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+
+/** Configuration of the timing wheel. */
+#define TIMER_WHEEL_SLOTS 32 // Power of 2 (longer timeouts take more turns of the wheel).
+
+// Context of timer callback.
+#define TIMER_WHEEL_ISR  0 // Tick interrupt - no critical sections, FromISR API only.
+#define TIMER_WHEEL_TASK 1 // Wheel task.
+
+/**
+ * @brief Timer callback.
+ *
+ * @param id ... identifier given to timer_wheel_setup
+ */
+typedef void (*timer_wheel_callback_t)(uint32_t id);
+
+// Timer (memory is provided by owner, members are private).
+typedef struct timer_wheel_timer
+{
+  struct timer_wheel_timer * next;
+  struct timer_wheel_timer ** pprev; // NULL if timer is not armed.
+  TickType_t expiry;
+  timer_wheel_callback_t callback;
+  uint32_t id;
+  uint8_t context;                   // TIMER_WHEEL_...
+} timer_wheel_timer_t;
+
+/**
+ * @brief Create wheel task.
+ *
+ *        Must be called before scheduler start.
+ */
+void timer_wheel_init(void);
+
+/**
+ * @brief Set callback of stopped timer.
+ *
+ * @param ptr_timer ... timer
+ * @param callback ... function called when timer expires
+ * @param id ... argument of the callback
+ * @param context ... TIMER_WHEEL_ISR or TIMER_WHEEL_TASK
+ */
+void timer_wheel_setup(timer_wheel_timer_t * ptr_timer, timer_wheel_callback_t callback, uint32_t id,
+                       uint8_t context);
+
+/**
+ * @brief Start timer (armed timer is restarted).
+ *
+ *        Can be called from task, interrupt and timer callback.
+ *
+ * @param ptr_timer ... timer
+ * @param delay ... ticks to expiry (at least 1)
+ */
+void timer_wheel_arm(timer_wheel_timer_t * ptr_timer, TickType_t delay);
+
+/**
+ * @brief Stop timer (expired callback which did not run yet is not called).
+ *
+ *        Can be called from task, interrupt and timer callback.
+ *
+ * @param ptr_timer ... timer
+ */
+void timer_wheel_cancel(timer_wheel_timer_t * ptr_timer);
+
+/**
+ * @brief Advance the wheel by one tick.
+ *
+ *        Called from tick hook.
+ */
+void timer_wheel_tick(void);
+
+#endif /* BSP_TIMER_WHEEL_H_ */
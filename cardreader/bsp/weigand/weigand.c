@@ -1,15 +1,15 @@
 /**
  *  @file
- *  @brief Wiegand26 interface driver.
+ *  @brief Wiegand interface driver.
  *
  *  ~490 b/s transfer rate
  *  data pulse nominal 40us (standard 20-100us)
  *  data interval nominal 2ms (standard 200us-20ms)
  *
- *  Only Wiegand 26bit format
- *  Frame:
- *  | even parity (1b) | facility code (8b) | card number (16b) | odd parity (1b) |
- *  transmission duration ~52ms
+ *  Falling edges on data lines are timestamped in GPIO interrupt by free running
+ *  CT32B1 (capture inputs are fixed pins, so the counter is read by software).
+ *  Each device has its own match register which is moved after every edge. Match
+ *  interrupt means that the inter-frame gap elapsed and the frame is complete.
  *
  *  @author Petr Elexa
  *  @see LICENSE
@@ -18,208 +18,296 @@
 
 #include "weigand.h"
 #include "board.h"
-#include "timers.h"
+#include "profiler.h"
 #include <limits.h>
 
+#if WEIGAND_DEVICE_LIMIT > 4
+#error "Wiegand device needs one match register (only 4 available)."
+#endif
+
+#define WEIGAND_TIMER       LPC_TIMER32_1
+#define WEIGAND_TIMER_IRQn  TIMER_32_1_IRQn
+#define WEIGAND_TIMER_HZ    1000000UL
+
+// Frame formats with their own parity rules.
+typedef enum
+{
+  weigand_parity_halves,   // Even parity of the first half, odd parity of the second half.
+  weigand_parity_corp1000  // HID Corporate 1000.
+} weigand_parity_t;
+
+typedef struct
+{
+  uint8_t length;
+  uint8_t parity;  // weigand_parity_t
+} weigand_format_t;
+
 typedef struct
 {
-  weigand26_frame_t frame_buffer;
+  weigand_frame_t frame_buffer;
   StreamBufferHandle_t consumer_buffer;
-  TimerHandle_t timer;
-  uint8_t frame_buffer_ptr;
+  uint32_t last_edge;  // Timestamp of last edge (us).
+  bool overflow;       // Frame is too long.
   uint8_t port;
   uint8_t pin_d0;
   uint8_t pin_d1;
   uint8_t id;
-} weigand26_t;
+} weigand_t;
 
-static weigand26_t device[WEIGAND_DEVICE_LIMIT] = {0};
+static weigand_t device[WEIGAND_DEVICE_LIMIT] = {0};
 
-static void weigand_frame_timeout(TimerHandle_t pxTimer)
+static bool _timer_running = false;
+
+static const weigand_format_t _formats[] =
 {
-  configASSERT(pxTimer);
+  {26, weigand_parity_halves},
+  {34, weigand_parity_halves},
+  {35, weigand_parity_corp1000},
+  {37, weigand_parity_halves},
+};
 
-  // Which timer expired
-  uint32_t id = (int32_t) pvTimerGetTimerID(pxTimer);
+static void _timer_init(void)
+{
+  Chip_TIMER_Init(WEIGAND_TIMER);
+  Chip_TIMER_Reset(WEIGAND_TIMER);
+  Chip_TIMER_PrescaleSet(WEIGAND_TIMER, (SystemCoreClock / WEIGAND_TIMER_HZ) - 1UL);
+  Chip_TIMER_Enable(WEIGAND_TIMER);
+
+  NVIC_ClearPendingIRQ(WEIGAND_TIMER_IRQn);
+  NVIC_EnableIRQ(WEIGAND_TIMER_IRQn);
+  _timer_running = true;
+}
 
-  // Atomicity is guaranteed because when weigand_int_handler is invoked
-  // weigand_frame_timeout will not be called. But we need to prevent
-  // weigand_int_handler from being invoked.
-  portENTER_CRITICAL();
-	// Empty the frame buffer because next bit period expired
-	device[id].frame_buffer.value = 0;
-	device[id].frame_buffer_ptr = WEIGAND26_FRAME_SIZE;
-  portEXIT_CRITICAL();
+static inline void _frame_reset(weigand_t * ptr_dev)
+{
+  ptr_dev->frame_buffer.value = 0;
+  ptr_dev->frame_buffer.length = 0;
+  ptr_dev->overflow = false;
 }
 
 void weigand_init(StreamBufferHandle_t buffer, uint8_t id, uint8_t dx_port, uint8_t d0_pin, uint8_t d1_pin)
 {
-	configASSERT(dx_port == 2 || dx_port == 3);
+  configASSERT(dx_port == 2 || dx_port == 3);
+  configASSERT(id < WEIGAND_DEVICE_LIMIT);
 
-	//Save device information
-	device[dx_port].consumer_buffer = buffer;
-	device[dx_port].port = dx_port;
-	device[dx_port].pin_d0 = d0_pin;
-	device[dx_port].pin_d1 = d1_pin;
-	device[dx_port].frame_buffer.value = 0;
-	device[dx_port].frame_buffer_ptr = WEIGAND26_FRAME_SIZE;
-	device[dx_port].id = id;
+  if (!_timer_running) _timer_init();
 
-	//Normal function
-	Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[dx_port][d0_pin], IOCON_MODE_INACT, IOCON_FUNC0);
-	Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[dx_port][d1_pin], IOCON_MODE_INACT, IOCON_FUNC0);
+  //Save device information
+  device[id].port = dx_port;
+  device[id].pin_d0 = d0_pin;
+  device[id].pin_d1 = d1_pin;
+  device[id].id = id;
+  _frame_reset(&device[id]);
+  device[id].consumer_buffer = buffer;
 
-	// LPC_GPIO is initialized in board.c
+  //Normal function
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[dx_port][d0_pin], IOCON_MODE_INACT, IOCON_FUNC0);
+  Chip_IOCON_PinMux(LPC_IOCON, CHIP_IOCON_PIO[dx_port][d1_pin], IOCON_MODE_INACT, IOCON_FUNC0);
 
-	//Input mode
-	Chip_GPIO_SetPinDIRInput(LPC_GPIO, dx_port, d0_pin);
-	Chip_GPIO_SetPinDIRInput(LPC_GPIO, dx_port, d1_pin);
+  // LPC_GPIO is initialized in board.c
 
-	//Trigger on falling edge
-	Chip_GPIO_SetupPinInt(LPC_GPIO, dx_port, d0_pin, GPIO_INT_FALLING_EDGE);
-	Chip_GPIO_SetupPinInt(LPC_GPIO, dx_port, d1_pin, GPIO_INT_FALLING_EDGE);
+  //Input mode
+  Chip_GPIO_SetPinDIRInput(LPC_GPIO, dx_port, d0_pin);
+  Chip_GPIO_SetPinDIRInput(LPC_GPIO, dx_port, d1_pin);
 
-	//Clear INTs
-	Chip_GPIO_ClearInts(LPC_GPIO, dx_port, (1 << d0_pin));
-	Chip_GPIO_ClearInts(LPC_GPIO, dx_port, (1 << d1_pin));
+  //Trigger on falling edge
+  Chip_GPIO_SetupPinInt(LPC_GPIO, dx_port, d0_pin, GPIO_INT_FALLING_EDGE);
+  Chip_GPIO_SetupPinInt(LPC_GPIO, dx_port, d1_pin, GPIO_INT_FALLING_EDGE);
 
-	//Create timer
-	if (device[dx_port].timer == NULL)
-  {
-	  device[dx_port].timer = xTimerCreate("WG", (WEIGAND26_MAX_BIT_PERIOD / portTICK_PERIOD_MS), pdFALSE, (void *)(uint32_t) dx_port, weigand_frame_timeout);
-  }
-  configASSERT(device[dx_port].timer);
+  //Clear INTs
+  Chip_GPIO_ClearInts(LPC_GPIO, dx_port, (1 << d0_pin));
+  Chip_GPIO_ClearInts(LPC_GPIO, dx_port, (1 << d1_pin));
 
-	//Enable INT for both pins
-	Chip_GPIO_EnableInt(LPC_GPIO, dx_port, (1 << d0_pin) | (1 << d1_pin));
+  //Enable INT for both pins
+  Chip_GPIO_EnableInt(LPC_GPIO, dx_port, (1 << d0_pin) | (1 << d1_pin));
 }
 
-void weigand_disable(uint8_t dx_port, uint8_t d0_pin, uint8_t d1_pin)
+void weigand_disable(uint8_t id)
 {
-  configASSERT(dx_port == 2 || dx_port == 3);
+  configASSERT(id < WEIGAND_DEVICE_LIMIT);
 
-  Chip_GPIO_DisableInt(LPC_GPIO, dx_port, (1 << d0_pin) | (1 << d1_pin));
+  Chip_GPIO_DisableInt(LPC_GPIO, device[id].port, (1 << device[id].pin_d0) | (1 << device[id].pin_d1));
+  Chip_TIMER_MatchDisableInt(WEIGAND_TIMER, id);
+  device[id].consumer_buffer = NULL;
 }
 
-bool weigand_pending_frame(weigand26_t * device)
+// Mask of frame bits from first to last (1 is the first received bit).
+static inline uint64_t _bits(const weigand_frame_t * ptr_frame, uint8_t first, uint8_t last)
 {
-	return device->frame_buffer_ptr == 0;
+  uint8_t count = last - first + 1;
+  uint64_t mask = (count >= 64 ? UINT64_MAX : ((1ULL << count) - 1));
+  return (mask << (ptr_frame->length - last)) & ptr_frame->value;
 }
 
-weigand26_frame_t weigand_get_frame(weigand26_t * device)
+static inline bool _is_even(uint64_t bits)
 {
-	return device->frame_buffer;
+  return __builtin_parityll(bits) == 0;
 }
 
-uint32_t weigand_get_facility(weigand26_frame_t frame)
+static bool _parity_halves(const weigand_frame_t * ptr_frame)
 {
-	return (frame.value & 0x1FE0000) >> 17;
+  uint8_t len = ptr_frame->length;
+  // Odd length frames share the middle bit.
+  return _is_even(_bits(ptr_frame, 1, (len + 1) / 2)) &&
+         !_is_even(_bits(ptr_frame, len / 2 + 1, len));
 }
 
-uint32_t weigand_get_card(weigand26_frame_t frame)
+static bool _parity_corp1000(const weigand_frame_t * ptr_frame)
 {
-	return (frame.value & 0x1FFFE) >> 1;
+  uint64_t even_bits = _bits(ptr_frame, 2, 2);
+  uint64_t odd_bits = _bits(ptr_frame, 35, 35);
+
+  // Bit 2 covers bits 3,4,6,7...33,34 and bit 35 covers bits 2,3,5,6...32,33.
+  for (uint8_t pos = 2; pos <= 34; ++pos)
+  {
+    if (pos >= 3 && (pos % 3) != 2) even_bits |= _bits(ptr_frame, pos, pos);
+    if (pos <= 33 && (pos % 3) != 1) odd_bits |= _bits(ptr_frame, pos, pos);
+  }
+
+  // Bit 1 covers whole frame.
+  return _is_even(even_bits) && !_is_even(odd_bits) && !_is_even(ptr_frame->value);
 }
 
-bool weigand_is_parity_ok(weigand26_frame_t frame)
+bool weigand_is_parity_ok(const weigand_frame_t * ptr_frame)
 {
-	uint8_t even_parity = __builtin_parity(frame.value & 0x1FFE000);
-	uint8_t odd_parity = __builtin_parity(frame.value & 0x1FFE) ^ 1;
-	return even_parity == ((frame.value >> 25) & 0x1) && odd_parity == (frame.value & 0x1);
+  if (ptr_frame->length < WEIGAND_MIN_FRAME_SIZE || ptr_frame->length > WEIGAND_MAX_FRAME_SIZE) return false;
+
+  uint8_t parity = weigand_parity_halves; // Variable length frames.
+  for (size_t i = 0; i < sizeof(_formats) / sizeof(_formats[0]); ++i)
+  {
+    if (_formats[i].length == ptr_frame->length) parity = _formats[i].parity;
+  }
+
+  switch (parity)
+  {
+    case weigand_parity_corp1000:
+      return _parity_corp1000(ptr_frame);
+    case weigand_parity_halves:
+    default:
+      return _parity_halves(ptr_frame);
+  }
 }
 
-static inline void _refresh_frame_time(weigand26_t * device)
+uint32_t weigand_get_id(const weigand_frame_t * ptr_frame)
 {
-  configASSERT(xTimerStart(device->timer, 0)); // Restart frame expiration timer
+  // Drop the last parity bit. The first parity bits are dropped by truncation
+  // if the identification is longer than 32 bits.
+  uint8_t id_bits = ptr_frame->length - (ptr_frame->length == 35 ? 3 : 2);
+  uint64_t id = ptr_frame->value >> 1;
+  if (id_bits < 32) id &= (1ULL << id_bits) - 1;
+  return (uint32_t)id;
 }
 
-static inline void _stop_frame_time(weigand26_t * device)
+// Send completed frame to consumer.
+static void _frame_complete(weigand_t * ptr_dev, BaseType_t * ptr_task_woken)
 {
-  configASSERT(xTimerStop(device->timer, 0)); // Stop frame expiration timer
+  if (!ptr_dev->overflow &&
+      ptr_dev->frame_buffer.length >= WEIGAND_MIN_FRAME_SIZE &&
+      xStreamBufferIsFull(ptr_dev->consumer_buffer) == pdFALSE)
+  {
+    weigand_buff_item_t item_to_send = {
+        ptr_dev->id,
+        ptr_dev->frame_buffer
+    };
+
+    // Send data
+    size_t bytes_sent = xStreamBufferSendFromISR(
+        ptr_dev->consumer_buffer,
+        &item_to_send,
+        WEIGAND_BUFF_ITEM_SIZE,
+        ptr_task_woken);
+
+    //Stream buffer should have had enough space (we checked)
+    configASSERT(bytes_sent == WEIGAND_BUFF_ITEM_SIZE);
+  }
+  // Empty the frame buffer
+  _frame_reset(ptr_dev);
 }
 
-void weigand_int_handler(weigand26_t * device)
+static inline void _add_bit(weigand_t * ptr_dev, uint32_t timestamp, uint8_t bit)
 {
-	uint32_t int_states = Chip_GPIO_GetMaskedInts(LPC_GPIO, device->port);
-	//Clear int flag on all pins
-	Chip_GPIO_ClearInts(LPC_GPIO, device->port, 0xFFFFFFFF);
-
-	//Resolve pin
-	if (int_states & (1 << device->pin_d1)) // 1's
-	{
-		if (Chip_GPIO_ReadPortBit(LPC_GPIO, device->port, device->pin_d1) == 0)
-		{
-		  _refresh_frame_time(device);
-			device->frame_buffer_ptr--;
-			device->frame_buffer.value |= (1 << device->frame_buffer_ptr);
-		}
-	}
-	else if (int_states & (1 << device->pin_d0)) // 0's
-	{
-		if (Chip_GPIO_ReadPortBit(LPC_GPIO, device->port, device->pin_d0) == 0)
-		{
-			_refresh_frame_time(device);
-			device->frame_buffer_ptr--;
-			device->frame_buffer.value &= ~(1 << device->frame_buffer_ptr);
-		}
-	}
-	else
-	{
-		return;
-	}
-	//Whole frame received
-	if (device->frame_buffer_ptr == 0)
-	{
-		_stop_frame_time(device);
+  // Ringing on data line.
+  if (ptr_dev->frame_buffer.length > 0 && (timestamp - ptr_dev->last_edge) < WEIGAND_MIN_BIT_INTERVAL_US) return;
 
-	  BaseType_t pxHigherPriorityTaskWoken = pdFALSE;
+  ptr_dev->last_edge = timestamp;
 
-	  // Check if not full
-		if (xStreamBufferIsFull(device->consumer_buffer) == pdFALSE)
-		{
-		  weigand26_buff_item_t item_to_send = {
-		      device->id,
-		      device->frame_buffer
-		  };
+  if (ptr_dev->frame_buffer.length < WEIGAND_MAX_FRAME_SIZE)
+  {
+    ptr_dev->frame_buffer.value = (ptr_dev->frame_buffer.value << 1) | bit;
+    ptr_dev->frame_buffer.length++;
+  }
+  else
+  {
+    ptr_dev->overflow = true;
+  }
 
-		  // Send data
-      size_t bytes_sent = xStreamBufferSendFromISR(
-          device->consumer_buffer,
-          &item_to_send,
-          WEIGAND26_BUFF_ITEM_SIZE,
-          &pxHigherPriorityTaskWoken);
+  // Move end of frame.
+  Chip_TIMER_SetMatch(WEIGAND_TIMER, ptr_dev->id, timestamp + WEIGAND_FRAME_GAP_US);
+  Chip_TIMER_ClearMatch(WEIGAND_TIMER, ptr_dev->id);
+  Chip_TIMER_MatchEnableInt(WEIGAND_TIMER, ptr_dev->id);
+}
 
-      //Stream buffer should have had enough space (we checked)
-      configASSERT(bytes_sent == WEIGAND26_BUFF_ITEM_SIZE);
-		}
-		// Empty the frame buffer
-		device->frame_buffer_ptr = WEIGAND26_FRAME_SIZE;
-		device->frame_buffer.value = 0;
+static void weigand_int_handler(uint8_t port)
+{
+  uint32_t timestamp = Chip_TIMER_ReadCount(WEIGAND_TIMER);
+  uint32_t int_states = Chip_GPIO_GetMaskedInts(LPC_GPIO, port);
+  //Clear int flag on all pins
+  Chip_GPIO_ClearInts(LPC_GPIO, port, 0xFFFFFFFF);
 
-		// Wake potentially blocked higher priority task
-		portYIELD_FROM_ISR(pxHigherPriorityTaskWoken);
-	}
+  for (size_t i = 0; i < WEIGAND_DEVICE_LIMIT; ++i)
+  {
+    weigand_t * ptr_dev = &device[i];
+    if (ptr_dev->consumer_buffer == NULL || ptr_dev->port != port) continue;
+
+    //Resolve pin
+    if (int_states & (1 << ptr_dev->pin_d1)) // 1's
+    {
+      if (Chip_GPIO_ReadPortBit(LPC_GPIO, port, ptr_dev->pin_d1) == 0) _add_bit(ptr_dev, timestamp, 1);
+    }
+    else if (int_states & (1 << ptr_dev->pin_d0)) // 0's
+    {
+      if (Chip_GPIO_ReadPortBit(LPC_GPIO, port, ptr_dev->pin_d0) == 0) _add_bit(ptr_dev, timestamp, 0);
+    }
+  }
 }
 
+// End of frame handler.
+void TIMER32_1_IRQHandler(void)
+{
+  PROFILER_BEGIN(profiler_isr_weigand);
+  BaseType_t pxHigherPriorityTaskWoken = pdFALSE;
+
+  for (size_t i = 0; i < WEIGAND_DEVICE_LIMIT; ++i)
+  {
+    if (!Chip_TIMER_MatchPending(WEIGAND_TIMER, i)) continue;
+    Chip_TIMER_ClearMatch(WEIGAND_TIMER, i);
+
+    if (!(WEIGAND_TIMER->MCR & TIMER_INT_ON_MATCH(i))) continue;
+    Chip_TIMER_MatchDisableInt(WEIGAND_TIMER, i);
+
+    if (device[i].consumer_buffer != NULL) _frame_complete(&device[i], &pxHigherPriorityTaskWoken);
+  }
+
+  PROFILER_END(profiler_isr_weigand);
 
+  // Wake potentially blocked higher priority task
+  portYIELD_FROM_ISR(pxHigherPriorityTaskWoken);
+}
 
 //GPIO port 2 handler
 void PIOINT2_IRQHandler(void)
 {
-	NVIC_ClearPendingIRQ(EINT2_IRQn);
-  if (device[2].consumer_buffer != NULL)
-  {
-    weigand_int_handler(&device[2]);
-  }
+  PROFILER_BEGIN(profiler_isr_gpio);
+  NVIC_ClearPendingIRQ(EINT2_IRQn);
+  weigand_int_handler(2);
+  PROFILER_END(profiler_isr_gpio);
 }
 
 //GPIO port 3 handler
 void PIOINT3_IRQHandler(void)
 {
-	NVIC_ClearPendingIRQ(EINT3_IRQn);
-  if (device[3].consumer_buffer != NULL)
-  {
-    weigand_int_handler(&device[3]);
-  }
+  PROFILER_BEGIN(profiler_isr_gpio);
+  NVIC_ClearPendingIRQ(EINT3_IRQn);
+  weigand_int_handler(3);
+  PROFILER_END(profiler_isr_gpio);
 }
-
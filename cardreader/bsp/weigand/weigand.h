@@ -1,16 +1,27 @@
 /**
  *  @file
- *  @brief Wiegand26 interface driver.
+ *  @brief Wiegand interface driver.
  *
  *
  *  ~490 b/s transfer rate
  *  data pulse nominal 40us (standard 20-100us)
  *  data interval nominal 2ms (standard 200us-20ms)
  *
- *  Only Wiegand 26bit format
- *  Frame:
+ *  Edges are timestamped by free running hardware timer (CT32B1, 1MHz).
+ *  End of frame is detected by timer match (one match register for each device)
+ *  when no edge comes for WEIGAND_FRAME_GAP_US.
+ *
+ *  Supported formats (parity is checked by the consumer, see weigand_is_parity_ok):
+ *  26bit (H10301)
  *  | even parity (1b) | facility code (8b) | card number (16b) | odd parity (1b) |
- *  transmission duration ~52ms
+ *  34bit
+ *  | even parity (1b) | facility code (16b) | card number (16b) | odd parity (1b) |
+ *  35bit (Corporate 1000)
+ *  | odd parity (1b) | even parity (1b) | company code (12b) | card number (20b) | odd parity (1b) |
+ *  37bit (H10304)
+ *  | even parity (1b) | facility code (16b) | card number (19b) | odd parity (1b) |
+ *  other lengths (WEIGAND_MIN_FRAME_SIZE - WEIGAND_MAX_FRAME_SIZE)
+ *  | even parity (1b) | data | odd parity (1b) | (each parity covers half of the frame)
  *
  *  @author Petr Elexa
  *  @see LICENSE
@@ -26,30 +37,25 @@
 #include "task.h"
 #include "stream_buffer.h"
 
-#define WEIGAND26_FRAME_SIZE 26
-#define WEIGAND26_MAX_BIT_PERIOD 20  // Should be equal to upper limit of data interval.
+#define WEIGAND_MIN_FRAME_SIZE 8
+#define WEIGAND_MAX_FRAME_SIZE 64
+#define WEIGAND_FRAME_GAP_US 25000        // Longer than upper limit of data interval.
+#define WEIGAND_MIN_BIT_INTERVAL_US 150   // Shorter edge interval is treated as glitch.
 
-typedef union
+typedef struct
 {
-	struct
-	{
-		uint32_t odd_parity: 1;
-		uint32_t card_number : 16;
-		uint32_t facility_code : 8;
-		uint32_t even_parity: 1;
-		uint32_t : 6; //padding
-	};
-	uint32_t value;
-} weigand26_frame_t; // 4B
+  uint64_t value;  // Received bits (last received bit is LSB).
+  uint8_t length;  // Number of received bits.
+} weigand_frame_t;
 
 // Buffer item type required from consumer of this driver to be used
 typedef struct
 {
   uint8_t source; // =interface identification
-  weigand26_frame_t frame;
-} weigand26_buff_item_t;
+  weigand_frame_t frame;
+} weigand_buff_item_t;
 
-#define WEIGAND26_BUFF_ITEM_SIZE sizeof(weigand26_buff_item_t)
+#define WEIGAND_BUFF_ITEM_SIZE sizeof(weigand_buff_item_t)
 
 //
 /**
@@ -58,8 +64,8 @@ typedef struct
  * @note One buffer for each consumer is preferred.
  *
  * @param buffer ... Receive buffer for frames from RFID card/tags.
- *                   See weigand26_buff_item_t
- * @param id ... interface identification
+ *                   See weigand_buff_item_t
+ * @param id ... interface identification (less than WEIGAND_DEVICE_LIMIT)
  * @param dx_port ... Port number for data signals.
  * @param d0_pin ... Pin for 0's data signal.
  * @param d1_pin ... Pin for 1's data signal.
@@ -69,37 +75,29 @@ void weigand_init(StreamBufferHandle_t buffer, uint8_t id, uint8_t dx_port, uint
 /**
  * @brief Disable Wiegand driver.
  *
- * @param dx_port ... Port number for data signals.
- * @param d0_pin ... Pin for 0's data signal.
- * @param d1_pin ... Pin for 1's data signal.
+ * @param id ... interface identification
  */
-void weigand_disable(uint8_t dx_port, uint8_t d0_pin, uint8_t d1_pin);
+void weigand_disable(uint8_t id);
 
 /**
- * @brief Parse facility code from frame.
+ * @brief Check frame parity according to its format.
  *
- * @param frame ... Wiegand26 data frame.
+ * @param ptr_frame ... Wiegand data frame.
  *
- * @return facility code
+ * @return true if parity is valid
  */
-uint32_t weigand_get_facility(weigand26_frame_t frame);
+bool weigand_is_parity_ok(const weigand_frame_t * ptr_frame);
 
 /**
- * @brief Parse card number from frame.
- *
- * @param frame ... Wiegand26 data frame.
+ * @brief Get card identification from frame (without parity bits).
  *
- * @return card number
- */
-uint32_t weigand_get_card(weigand26_frame_t frame);
-
-/**
- * @brief Check frame parity.
+ *        Identifications longer than 32 bits are truncated (lower bits are kept).
+ *        For 26bit format it is (facility code << 16 | card number).
  *
- * @param frame ... Wiegand26 data frame.
+ * @param ptr_frame ... Wiegand data frame.
  *
- * @return true if parity is valid
+ * @return card identification
  */
-bool weigand_is_parity_ok(weigand26_frame_t frame);
+uint32_t weigand_get_id(const weigand_frame_t * ptr_frame);
 
 #endif /* BSP_WEIGAND_H_ */
@@ -0,0 +1,60 @@
+/**
+ *  @file
+ *  @brief Board definitions for host build.
+ *
+ *  Console is mapped to standard output, debug output is always enabled.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef __BOARD_H_
+#define __BOARD_H_
+
+#include "chip.h"
+
+#define DEBUG_ENABLE
+
+#include "terminal_config.h"
+
+#define BOARD_HOST
+
+/**
+ * IOCON pin definitions (not used by simulated IOCON).
+ */
+extern const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[][12];
+
+#include "board_api.h"
+
+/**
+ * @brief Back external storage (EEPROM) by file.
+ *
+ *        Storage starts erased when the file does not exist. Every write is
+ *        flushed to the file.
+ *
+ * @param path ... image file path
+ *
+ * @return true if succeeded
+ */
+bool Board_Storage_Open(const char * path);
+
+/**
+ * @brief Back application region of flash by file (see boot/fw_port.h).
+ *
+ *        Region starts erased when the file does not exist or path is NULL.
+ *
+ * @param path ... image file path or NULL
+ *
+ * @return true if succeeded
+ */
+bool Board_Firmware_Open(const char * path);
+
+/**
+ * @brief Set command line for Board_Reset (the process is executed again).
+ *
+ * @param argv ... arguments of main
+ */
+void Board_Set_Reset_Args(char * argv[]);
+
+#endif /* __BOARD_H_ */
@@ -0,0 +1,117 @@
+/**
+ *  @file
+ *  @brief Board functions for host build.
+ *
+ *  Console is standard output. Console input is not available (panel address
+ *  is always loaded from storage).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "board.h"
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+static bool _led_status = false;
+
+// Command line to execute on reset.
+static char ** _reset_argv = NULL;
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+uint32_t SystemCoreClock = 48000000;
+
+const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[4][12] = {{0}};
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void Board_SystemInit(void)
+{
+}
+
+void Board_Init(void)
+{
+  DEBUGINIT();
+  Board_LED_Set(BOARD_LED_STATUS, false);
+}
+
+void Board_Console_Init(void)
+{
+  setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+void Board_Print_Reset_Reason(void)
+{
+  DEBUGSTR("Reset reason: POR\n");
+}
+
+uint8_t Board_Get_Reset_Reason(void)
+{
+  return SYSCTL_RST_POR;
+}
+
+void Board_Set_Reset_Args(char * argv[])
+{
+  _reset_argv = argv;
+}
+
+void Board_Reset(void)
+{
+  DEBUGSTR("Reset\n");
+  fflush(stdout);
+
+  // Kernel port blocks signals in its threads - the mask is inherited.
+  sigset_t set;
+  sigemptyset(&set);
+  sigprocmask(SIG_SETMASK, &set, NULL);
+
+  if (_reset_argv != NULL) execv("/proc/self/exe", _reset_argv);
+  perror("execv");
+  _exit(1);
+}
+
+bool Board_Setup_Strap(void)
+{
+  return false; // Address is given on command line.
+}
+
+void Board_UARTPutChar(char ch)
+{
+  putchar(ch);
+}
+
+int Board_UARTGetChar(void)
+{
+  return EOF;
+}
+
+void Board_UARTPutSTR(char *str)
+{
+  fputs(str, stdout);
+}
+
+void Board_LED_Set(board_led_t led_number, bool on)
+{
+  if (led_number == BOARD_LED_STATUS) _led_status = on;
+}
+
+bool Board_LED_Test(board_led_t led_number)
+{
+  return led_number == BOARD_LED_STATUS && _led_status;
+}
+
+void Board_LED_Toggle(board_led_t led_number)
+{
+  Board_LED_Set(led_number, !Board_LED_Test(led_number));
+}
@@ -0,0 +1,444 @@
+/**
+ *  @file
+ *  @brief Static cache benchmark and consistency check (host build).
+ *
+ *  Cache engine is compiled into this program with configuration given by compile
+ *  definitions (STATIC_CACHE_ENGINE, STATIC_CACHE_SETS, STATIC_CACHE_SET_CAP,
+ *  STATIC_CACHE_CAPACITY, STATIC_CACHE_MAX_PROBE - see host/CMakeLists.txt).
+ *
+ *  For each key distribution and fill level the cache is filled, looked up, updated
+ *  and erased. Cost of each operation is given by counted engine events (see
+ *  STATIC_CACHE_COUNT) weighted by estimated Cortex-M0 cycles. Results are compared
+ *  with reference model and static_cache_check is called after each phase (walk of all
+ *  homes by static_cache_next must visit exactly the items found by lookup). User IDs
+ *  longer than the key are checked to be rejected by static_cache_key.
+ *
+ *  Churn replaces random users at high fill with and without compaction. Tombstones left
+ *  by erase must not reduce the kept items and all of them must be reclaimable.
+ *
+ *  Key distributions:
+ *  seq    ... runs of consecutive badges (26bit format, facility code | card number)
+ *  random ... uniformly distributed 24bit identifications
+ *  lowbit ... random identifications with the same low 8 bits (set selection collides)
+ *
+ *  Usage: cache-bench-<config> [seed]
+ *  Exit code is non-zero if any inconsistency is found.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "terminal_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Cache is compiled in regardless of panel configuration.
+#undef CACHING_ENABLED
+#define CACHING_ENABLED 1
+
+#define STATIC_CACHE_COUNT(event) (_events[(event)]++)
+#include "static_cache.h"
+
+static uint32_t _events[STATIC_CACHE_EV_COUNT];
+
+#include "static_cache.c"
+#include "static_cache_rh.c"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Estimated Cortex-M0 cycles (48 MHz, flash wait states included).
+#define CYCLES_CALL    24  // Call, prologue, set selection or home slot scaling, return.
+#define CYCLES_SEARCH  16  // Binary search step (mid, load, bit-field extract, compare).
+#define CYCLES_MOVE     8  // Item load and store with loop overhead.
+#define CYCLES_HASH    16  // Integer mixer (two single cycle multiplications).
+#define CYCLES_PROBE   14  // Slot load, empty and key compare, wrap around.
+
+static const uint16_t _event_cycles[STATIC_CACHE_EV_COUNT] =
+{
+  [STATIC_CACHE_EV_SEARCH] = CYCLES_SEARCH,
+  [STATIC_CACHE_EV_MOVE] = CYCLES_MOVE,
+  [STATIC_CACHE_EV_HASH] = CYCLES_HASH,
+  [STATIC_CACHE_EV_PROBE] = CYCLES_PROBE,
+};
+
+#define KEY_MASK     ((1UL << (32 - STATIC_CACHE_VALUE_BITS)) - 1)
+#define VALUE_MASK   ((1UL << STATIC_CACHE_VALUE_BITS) - 1)
+#define MAX_ITEMS    (STATIC_CACHE_CAPACITY * 2)
+#define SEQ_RUN_LEN  64
+
+// Churn of revoked and granted users (erase leaves tombstones, terminal task compacts them).
+#define CHURN_FILL   90
+#define CHURN_ROUNDS (STATIC_CACHE_CAPACITY * 8)
+#define CHURN_STEPS  8   // Compaction calls per round (CACHE_COMPACT_STEPS in terminal.c).
+
+typedef enum
+{
+  dist_seq,
+  dist_random,
+  dist_lowbit,
+  dist_count
+} key_dist_t;
+
+static const char * const _dist_names[dist_count] = {"seq", "random", "lowbit"};
+
+static const uint8_t _fill_percent[] = {25, 50, 75, 90, 100, 125};
+
+typedef struct
+{
+  uint64_t cycles;
+  uint32_t max;
+  uint32_t count;
+} op_stats_t;
+
+typedef enum
+{
+  op_insert,
+  op_hit,
+  op_miss,
+  op_update,
+  op_erase,
+  op_count
+} op_t;
+
+typedef struct
+{
+  uint32_t key;
+  uint32_t value;
+  bool erased;
+} model_item_t;
+
+// Reference model - items in order of insertion.
+static model_item_t _model[MAX_ITEMS];
+static uint32_t _model_len;
+
+static op_stats_t _stats[op_count];
+static uint32_t _violations;
+static uint32_t _rng_state;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static uint32_t _rand(void)
+{
+  // xorshift32
+  _rng_state ^= _rng_state << 13;
+  _rng_state ^= _rng_state >> 17;
+  _rng_state ^= _rng_state << 5;
+  return _rng_state;
+}
+
+static uint32_t _next_key(key_dist_t dist, uint32_t n)
+{
+  static uint32_t run_base;
+
+  switch (dist)
+  {
+    case dist_seq:
+      if (n % SEQ_RUN_LEN == 0) run_base = ((_rand() & 0xFF) << 16) | (_rand() & 0xFFFF);
+      return (run_base + n % SEQ_RUN_LEN) & 0xFFFFFF;
+    case dist_random:
+      return _rand() & 0xFFFFFF;
+    case dist_lowbit:
+    default:
+      return ((_rand() & 0xFFFF) << 8) | 0x5A;
+  }
+}
+
+static bool _model_contains(uint32_t key)
+{
+  for (uint32_t i = 0; i < _model_len; ++i)
+  {
+    if (_model[i].key == key) return true;
+  }
+  return false;
+}
+
+static inline void _events_reset(void)
+{
+  memset(_events, 0, sizeof(_events));
+}
+
+static void _account(op_t op)
+{
+  uint32_t cycles = CYCLES_CALL;
+  for (int i = 0; i < STATIC_CACHE_EV_COUNT; ++i) cycles += _events[i] * _event_cycles[i];
+
+  _stats[op].cycles += cycles;
+  _stats[op].count++;
+  if (cycles > _stats[op].max) _stats[op].max = cycles;
+}
+
+static void _violation(const char * what, uint32_t key)
+{
+  if (_violations < 10) fprintf(stderr, "  violation: %s (key 0x%06lX)\n", what, (unsigned long)key);
+  _violations++;
+}
+
+static void _check(const char * phase)
+{
+  if (!static_cache_check()) _violation(phase, 0);
+
+  // Walk visits every item once in order of homes and keys.
+  uint32_t walked = 0;
+  for (uint16_t home = 0; home < STATIC_CACHE_HOMES; ++home)
+  {
+    cache_item_t kv = static_cache_convert(0, 0);
+    uint32_t prev_key = 0;
+    while (static_cache_next(home, &kv))
+    {
+      cache_item_t found = kv;
+      if (kv.key <= prev_key || static_cache_home(kv) != home) _violation("walk order", kv.key);
+      if (!static_cache_get(&found) || found.scalar != kv.scalar) _violation("walk item not in cache", kv.key);
+      prev_key = kv.key;
+      walked++;
+    }
+  }
+
+  uint32_t present = 0;
+  for (uint32_t i = 0; i < _model_len; ++i)
+  {
+    cache_item_t kv = static_cache_convert(_model[i].key, 0);
+    if (!_model[i].erased && static_cache_get(&kv)) present++;
+  }
+  if (walked != present) _violation("walk count", walked);
+}
+
+static bool _get(uint32_t key, uint32_t * ptr_value, op_t op)
+{
+  cache_item_t kv = static_cache_convert(key, 0);
+  _events_reset();
+  bool found = static_cache_get(&kv);
+  _account(op);
+  if (found && kv.key != key) _violation("get returned other key", key);
+  *ptr_value = kv.value;
+  return found;
+}
+
+static void _run(key_dist_t dist, uint8_t fill)
+{
+  uint32_t n_items = (STATIC_CACHE_CAPACITY * fill) / 100;
+  uint32_t retained = 0;
+
+  memset(_stats, 0, sizeof(_stats));
+  static_cache_reset();
+  _model_len = 0;
+  _check("reset");
+
+  // Fill.
+  for (uint32_t n = 0; _model_len < n_items; ++n)
+  {
+    uint32_t key = _next_key(dist, n);
+    if (key == 0 || _model_contains(key)) continue;
+
+    uint32_t value = 1 + _rand() % VALUE_MASK;
+    _model[_model_len++] = (model_item_t){key, value, false};
+
+    _events_reset();
+    static_cache_insert(static_cache_convert(key, value));
+    _account(op_insert);
+  }
+  _check("insert");
+
+  // Lookup of present keys (evicted keys are allowed when full).
+  for (uint32_t i = 0; i < _model_len; ++i)
+  {
+    uint32_t value;
+    if (_get(_model[i].key, &value, op_hit))
+    {
+      retained++;
+      if (value != _model[i].value) _violation("wrong value", _model[i].key);
+    }
+  }
+
+  // Lookup of absent keys.
+  for (uint32_t i = 0; i < n_items; ++i)
+  {
+    uint32_t key = (_rand() & 0xFFFFFF) | 0x1000000; // Outside of generated keys.
+    uint32_t value;
+    if (_get(key & KEY_MASK, &value, op_miss)) _violation("absent key found", key);
+  }
+
+  // Update of every 8th item.
+  for (uint32_t i = 0; i < _model_len; i += 8)
+  {
+    uint32_t value;
+    bool present = _get(_model[i].key, &value, op_hit);
+
+    _model[i].value = (_model[i].value % VALUE_MASK) + 1;
+    _events_reset();
+    static_cache_insert(static_cache_convert(_model[i].key, _model[i].value));
+    _account(op_update);
+
+    if (present && (!_get(_model[i].key, &value, op_hit) || value != _model[i].value))
+    {
+      _violation("update lost", _model[i].key);
+    }
+  }
+  _check("update");
+
+  // Erase of every 4th item.
+  for (uint32_t i = 0; i < _model_len; i += 4)
+  {
+    _events_reset();
+    static_cache_erase(static_cache_convert(_model[i].key, 0));
+    _account(op_erase);
+    _model[i].erased = true;
+  }
+  _check("erase");
+
+  for (uint32_t i = 0; i < _model_len; ++i)
+  {
+    uint32_t value;
+    bool found = _get(_model[i].key, &value, op_hit);
+    if (_model[i].erased && found) _violation("erased key found", _model[i].key);
+    if (!_model[i].erased && found && value != _model[i].value) _violation("wrong value after erase", _model[i].key);
+  }
+
+  printf("%-7s %4u%% %5lu %5.1f%%", _dist_names[dist], fill, (unsigned long)n_items,
+         n_items ? (100.0 * retained) / n_items : 100.0);
+  for (int op = 0; op < op_count; ++op)
+  {
+    printf(" %6.1f/%-5lu", _stats[op].count ? (double)_stats[op].cycles / _stats[op].count : 0.0,
+           (unsigned long)_stats[op].max);
+  }
+  printf("\n");
+}
+
+// Replace random users at high fill (revoke and grant). With compaction the tombstones are
+// reclaimed as they appear, without it usable capacity shrinks until the cache is reset.
+static void _run_churn(key_dist_t dist, uint8_t compact_steps)
+{
+  uint32_t n_items = (STATIC_CACHE_CAPACITY * CHURN_FILL) / 100;
+  uint32_t max_tombstones = 0;
+  uint32_t compact_calls = 0;
+  uint64_t compact_cycles = 0;
+  uint32_t compact_max = 0;
+
+  static_cache_reset();
+  _model_len = 0;
+  for (uint32_t n = 0; _model_len < n_items; ++n)
+  {
+    uint32_t key = _next_key(dist, n);
+    if (key == 0 || _model_contains(key)) continue;
+    _model[_model_len++] = (model_item_t){key, 1 + _rand() % VALUE_MASK, false};
+    static_cache_insert(static_cache_convert(key, _model[_model_len - 1].value));
+  }
+
+  for (uint32_t round = 0, n = n_items; round < CHURN_ROUNDS; ++round)
+  {
+    model_item_t * ptr_item = &_model[_rand() % _model_len];
+    static_cache_erase(static_cache_convert(ptr_item->key, 0));
+
+    uint32_t key;
+    do key = _next_key(dist, n++); while (key == 0 || _model_contains(key));
+    *ptr_item = (model_item_t){key, 1 + _rand() % VALUE_MASK, false};
+    static_cache_insert(static_cache_convert(key, ptr_item->value));
+
+    for (uint8_t step = 0; step < compact_steps && static_cache_tombstones() > 0; ++step)
+    {
+      _events_reset();
+      (void)static_cache_compact();
+      uint32_t cycles = CYCLES_CALL;
+      for (int i = 0; i < STATIC_CACHE_EV_COUNT; ++i) cycles += _events[i] * _event_cycles[i];
+      compact_cycles += cycles;
+      compact_calls++;
+      if (cycles > compact_max) compact_max = cycles;
+    }
+    if (static_cache_tombstones() > max_tombstones) max_tombstones = static_cache_tombstones();
+  }
+  _check("churn");
+
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < _model_len; ++i)
+  {
+    uint32_t value;
+    if (_get(_model[i].key, &value, op_hit))
+    {
+      kept++;
+      if (value != _model[i].value) _violation("wrong value after churn", _model[i].key);
+    }
+  }
+  const uint32_t left = static_cache_tombstones();
+
+  // All tombstones can be reclaimed (each call scans part of the table).
+  for (uint32_t i = 0; i < STATIC_CACHE_CAPACITY && static_cache_tombstones() > 0; ++i)
+  {
+    (void)static_cache_compact();
+  }
+  if (static_cache_tombstones() != 0) _violation("tombstones not reclaimed", static_cache_tombstones());
+  _check("compact");
+
+  printf("%-7s %4u%% %5lu %5.1f%%  compact %u/round: tombstones max %lu left %lu, cycles %.1f/%lu\n",
+         _dist_names[dist], CHURN_FILL, (unsigned long)_model_len, (100.0 * kept) / _model_len, compact_steps,
+         (unsigned long)max_tombstones, (unsigned long)left,
+         compact_calls ? (double)compact_cycles / compact_calls : 0.0, (unsigned long)compact_max);
+}
+
+// User IDs which differ only in bits above the key must not share the cache item.
+static void _check_key_width(void)
+{
+  const uint32_t id = 0x00ABCDEFUL & STATIC_CACHE_KEY_MAX;
+  const uint32_t long_ids[] = {id | (STATIC_CACHE_KEY_MAX + 1), id | 0x80000000UL};
+  cache_item_t kv;
+
+  static_cache_reset();
+  if (!static_cache_key(id, &kv) || kv.key != id || kv.value != 0) _violation("key rejected", id);
+  kv.value = 1;
+  static_cache_insert(kv);
+
+  for (size_t i = 0; i < sizeof(long_ids) / sizeof(long_ids[0]); ++i)
+  {
+    if (static_cache_key(long_ids[i], &kv)) _violation("long key accepted", long_ids[i]);
+  }
+  if (static_cache_key(0, &kv)) _violation("reserved key accepted", 0);
+  if (!static_cache_key(STATIC_CACHE_KEY_MAX, &kv)) _violation("key rejected", STATIC_CACHE_KEY_MAX);
+
+  uint32_t value;
+  if (!_get(id, &value, op_hit) || value != 1) _violation("key lost", id);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+int main(int argc, char * argv[])
+{
+  _rng_state = (argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 0x2545F491UL);
+  if (_rng_state == 0) _rng_state = 1;
+
+#if STATIC_CACHE_ENGINE == STATIC_CACHE_ENGINE_SET_ASSOC
+  printf("set associative: %d sets x %d items (%lu B)\n", STATIC_CACHE_SETS, STATIC_CACHE_SET_CAP,
+         (unsigned long)STATIC_CACHE_CAPACITY * sizeof(cache_item_t));
+#else
+  printf("robin hood: %d slots, max probe %d (%lu B)\n", STATIC_CACHE_CAPACITY, STATIC_CACHE_MAX_PROBE,
+         (unsigned long)STATIC_CACHE_CAPACITY * sizeof(cache_item_t));
+#endif
+  printf("estimated Cortex-M0 cycles per operation (avg/max)\n");
+  printf("keys    fill  items  kept   insert       get hit      get miss     update       erase\n");
+
+  for (int dist = 0; dist < dist_count; ++dist)
+  {
+    for (size_t i = 0; i < sizeof(_fill_percent); ++i)
+    {
+      _run(dist, _fill_percent[i]);
+    }
+  }
+
+  printf("churn of %d users (erase and insert)\n", CHURN_ROUNDS);
+  for (int dist = 0; dist < dist_count; ++dist)
+  {
+    _run_churn(dist, 0);
+    _run_churn(dist, CHURN_STEPS);
+  }
+
+  _check_key_width();
+
+  if (_violations != 0) printf("%lu violations\n", (unsigned long)_violations);
+
+  return (_violations == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,255 @@
+/**
+ *  @file
+ *  @brief C_CAN ROM driver emulated on Linux SocketCAN.
+ *
+ *  Works with virtual (vcan) as well as real CAN interfaces. Bit timing is given by
+ *  the interface configuration, timing passed to init_can is ignored.
+ *
+ *  Received frame is stored in the first receive message object which matches its ID
+ *  (as message handler of C_CAN does). Transmission is completed immediately, CAN_tx
+ *  callback is called from the next isr call.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "chip.h"
+#include "FreeRTOS.h"
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define CCAN_MSG_OBJ_COUNT 32
+#define CCAN_EC_INDEX      2    // Error counter register offset 0x008.
+
+typedef struct
+{
+  uint32_t mode_id;       // Filter ID.
+  uint32_t mask;          // Filter mask.
+  CCAN_MSG_OBJ_T frame;   // Last received frame.
+  bool rx;                // Configured for reception.
+  bool new_data;          // Frame received and not read yet.
+} msg_obj_t;
+
+static msg_obj_t _msg_obj[CCAN_MSG_OBJ_COUNT];
+static uint32_t _tx_done = 0;  // Message objects with finished transmission.
+static CCAN_CALLBACKS_T _callbacks;
+static int _socket = -1;
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+volatile uint32_t host_can_regs[8];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static void _init_can(uint32_t * can_cfg, uint8_t isr_ena)
+{
+  (void)can_cfg;
+  (void)isr_ena;
+
+  memset(_msg_obj, 0, sizeof(_msg_obj));
+  memset(&_callbacks, 0, sizeof(_callbacks));
+  _tx_done = 0;
+  host_can_regs[CCAN_EC_INDEX] = 0;
+}
+
+static void _config_rxmsgobj(CCAN_MSG_OBJ_T * msg_obj)
+{
+  configASSERT(msg_obj->msgobj < CCAN_MSG_OBJ_COUNT);
+
+  _msg_obj[msg_obj->msgobj].mode_id = msg_obj->mode_id;
+  _msg_obj[msg_obj->msgobj].mask = msg_obj->mask;
+  _msg_obj[msg_obj->msgobj].rx = true;
+  _msg_obj[msg_obj->msgobj].new_data = false;
+}
+
+static uint8_t _can_receive(CCAN_MSG_OBJ_T * msg_obj)
+{
+  msg_obj_t * ptr_obj = &_msg_obj[msg_obj->msgobj % CCAN_MSG_OBJ_COUNT];
+
+  if (!ptr_obj->rx || !ptr_obj->new_data) return 0;
+
+  msg_obj->mode_id = ptr_obj->frame.mode_id;
+  msg_obj->dlc = ptr_obj->frame.dlc;
+  memcpy(msg_obj->data, ptr_obj->frame.data, sizeof(msg_obj->data));
+  ptr_obj->new_data = false;
+  return 1;
+}
+
+static void _can_transmit(CCAN_MSG_OBJ_T * msg_obj)
+{
+  configASSERT(msg_obj->msgobj < CCAN_MSG_OBJ_COUNT);
+
+  // Message object is reconfigured for transmission.
+  _msg_obj[msg_obj->msgobj].rx = false;
+
+  struct can_frame frame = {0};
+  if (msg_obj->mode_id & CAN_MSGOBJ_EXT)
+  {
+    frame.can_id = (msg_obj->mode_id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  }
+  else
+  {
+    frame.can_id = msg_obj->mode_id & CAN_SFF_MASK;
+  }
+  if (msg_obj->mode_id & CAN_MSGOBJ_RTR) frame.can_id |= CAN_RTR_FLAG;
+  frame.can_dlc = msg_obj->dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : msg_obj->dlc;
+  memcpy(frame.data, msg_obj->data, frame.can_dlc);
+
+  if (_socket < 0 || write(_socket, &frame, sizeof(frame)) != sizeof(frame))
+  {
+    // No acknowledge on the bus.
+    uint32_t tec = (host_can_regs[CCAN_EC_INDEX] & 0xFF) + 8;
+    host_can_regs[CCAN_EC_INDEX] = (host_can_regs[CCAN_EC_INDEX] & ~0xFFUL) | (tec > 0xFF ? 0xFF : tec);
+    return;
+  }
+
+  _tx_done |= (1UL << msg_obj->msgobj);
+}
+
+static void _receive_frame(const struct can_frame * ptr_frame)
+{
+  uint32_t id;
+  if (ptr_frame->can_id & CAN_EFF_FLAG) id = (ptr_frame->can_id & CAN_EFF_MASK) | CAN_MSGOBJ_EXT;
+  else id = ptr_frame->can_id & CAN_SFF_MASK;
+  if (ptr_frame->can_id & CAN_RTR_FLAG) id |= CAN_MSGOBJ_RTR;
+
+  for (uint8_t i = 0; i < CCAN_MSG_OBJ_COUNT; ++i)
+  {
+    msg_obj_t * ptr_obj = &_msg_obj[i];
+    if (!ptr_obj->rx) continue;
+    if (((id ^ ptr_obj->mode_id) & ptr_obj->mask) != 0) continue;
+
+    // Unread frame is overwritten (message lost as on target).
+    ptr_obj->frame.mode_id = id;
+    ptr_obj->frame.dlc = ptr_frame->can_dlc;
+    memcpy(ptr_obj->frame.data, ptr_frame->data, sizeof(ptr_obj->frame.data));
+    ptr_obj->new_data = true;
+
+    if (_callbacks.CAN_rx != NULL) _callbacks.CAN_rx(i);
+    return;
+  }
+}
+
+static void _receive_error(const struct can_frame * ptr_frame)
+{
+  uint32_t error_info = CAN_ERROR_NONE;
+
+  if (ptr_frame->can_id & CAN_ERR_BUSOFF) error_info |= CAN_ERROR_BOFF;
+  if (ptr_frame->can_id & CAN_ERR_ACK) error_info |= CAN_ERROR_ACK;
+  if (ptr_frame->can_id & CAN_ERR_CRTL)
+  {
+    if (ptr_frame->data[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE)) error_info |= CAN_ERROR_PASS;
+    if (ptr_frame->data[1] & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING)) error_info |= CAN_ERROR_WARN;
+  }
+  // Error counters are sent by most of controller drivers.
+  host_can_regs[CCAN_EC_INDEX] = ptr_frame->data[6] | ((uint32_t)(ptr_frame->data[7] & 0x7F) << 8) |
+                                 ((error_info & CAN_ERROR_PASS) ? (1UL << 15) : 0);
+
+  if (error_info != CAN_ERROR_NONE && _callbacks.CAN_error != NULL) _callbacks.CAN_error(error_info);
+}
+
+static void _isr(void)
+{
+  struct can_frame frame;
+
+  while (_socket >= 0 && recv(_socket, &frame, sizeof(frame), MSG_DONTWAIT) == sizeof(frame))
+  {
+    if (frame.can_id & CAN_ERR_FLAG) _receive_error(&frame);
+    else _receive_frame(&frame);
+  }
+
+  while (_tx_done != 0)
+  {
+    uint8_t msgobj = __builtin_ctz(_tx_done);
+    _tx_done &= ~(1UL << msgobj);
+    if (_callbacks.CAN_tx != NULL) _callbacks.CAN_tx(msgobj);
+  }
+}
+
+static void _config_calb(CCAN_CALLBACKS_T * callback_cfg)
+{
+  _callbacks = *callback_cfg;
+}
+
+static void _config_canopen(CCAN_CANOPENCFG_T * canopen_cfg)
+{
+  (void)canopen_cfg;
+}
+
+static void _canopen_handler(void)
+{
+}
+
+static const CCAN_API_T _ccan_api =
+{
+  .init_can = _init_can,
+  .isr = _isr,
+  .config_rxmsgobj = _config_rxmsgobj,
+  .can_receive = _can_receive,
+  .can_transmit = _can_transmit,
+  .config_canopen = _config_canopen,
+  .canopen_handler = _canopen_handler,
+  .config_calb = _config_calb,
+};
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+const LPC_ROM_API_T host_rom_api =
+{
+  .candApiBase = &_ccan_api,
+};
+
+bool host_can_open(const char * ifname)
+{
+  struct sockaddr_can addr = {0};
+  struct ifreq ifr = {0};
+
+  _socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (_socket < 0)
+  {
+    perror("socket");
+    return false;
+  }
+
+  strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+  if (ioctl(_socket, SIOCGIFINDEX, &ifr) < 0)
+  {
+    perror(ifname);
+    close(_socket);
+    _socket = -1;
+    return false;
+  }
+
+  can_err_mask_t err_mask = CAN_ERR_BUSOFF | CAN_ERR_CRTL | CAN_ERR_ACK;
+  setsockopt(_socket, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    perror("bind");
+    close(_socket);
+    _socket = -1;
+    return false;
+  }
+
+  return true;
+}
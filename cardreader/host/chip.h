@@ -0,0 +1,310 @@
+/**
+ *  @file
+ *  @brief Simulated LPC11C24 peripherals for host build.
+ *
+ *  Replaces LPCOpen chip.h. Only the part of the chip used by the panel is provided:
+ *  GPIO ports with edge interrupts, timers counting from host monotonic clock,
+ *  C_CAN ROM driver on top of SocketCAN (see ccan_vcan.c) and no-op clock, IOCON,
+ *  NVIC and watchdog.
+ *
+ *  Interrupt handlers are called by the simulator task (see sim.h) which has the
+ *  highest priority, so they are never preempted by the application tasks.
+ *  Disabled interrupts are mapped to kernel critical section.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef HOST_CHIP_H_
+#define HOST_CHIP_H_
+
+#include <stddef.h>
+#include "lpc_types.h"
+#include "ccand_11xx.h"
+
+#define CHIP_LPC11CXX
+
+extern uint32_t SystemCoreClock;
+
+/*****************************************************************************
+ * Interrupts
+ ****************************************************************************/
+
+typedef enum
+{
+  WDT_IRQn = 25,
+  TIMER_16_0_IRQn = 16,
+  TIMER_16_1_IRQn = 17,
+  TIMER_32_0_IRQn = 18,
+  TIMER_32_1_IRQn = 19,
+  UART0_IRQn = 21,
+  I2C0_IRQn = 15,
+  CAN_IRQn = 13,
+  EINT3_IRQn = 28,
+  EINT2_IRQn = 29,
+  EINT1_IRQn = 30,
+  EINT0_IRQn = 31,
+} IRQn_Type;
+
+static inline void NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_DisableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+static inline void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { (void)irq; (void)priority; }
+
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+
+/*****************************************************************************
+ * GPIO
+ ****************************************************************************/
+
+#define HOST_GPIO_PORTS 4
+
+typedef struct
+{
+  uint32_t data;   // Pin levels.
+  uint32_t dir;    // 1 = output
+  uint32_t ie;     // Interrupt enable.
+  uint32_t ris;    // Raw interrupt status.
+  uint32_t rise;   // Interrupt on rising edge.
+  uint32_t fall;   // Interrupt on falling edge.
+} LPC_GPIO_T;
+
+extern LPC_GPIO_T host_gpio[HOST_GPIO_PORTS];
+#define LPC_GPIO host_gpio
+
+#define GPIO_INT_ACTIVE_LOW_LEVEL  0x0
+#define GPIO_INT_ACTIVE_HIGH_LEVEL 0x1
+#define GPIO_INT_FALLING_EDGE      0x2
+#define GPIO_INT_RISING_EDGE       0x4
+#define GPIO_INT_BOTH_EDGES        0x6
+
+static inline void Chip_GPIO_Init(LPC_GPIO_T * ptr_gpio) { (void)ptr_gpio; }
+
+static inline void Chip_GPIO_SetPinDIROutput(LPC_GPIO_T * ptr_gpio, uint8_t port, uint8_t pin)
+{
+  ptr_gpio[port].dir |= (1UL << pin);
+}
+
+static inline void Chip_GPIO_SetPinDIRInput(LPC_GPIO_T * ptr_gpio, uint8_t port, uint8_t pin)
+{
+  ptr_gpio[port].dir &= ~(1UL << pin);
+}
+
+static inline void Chip_GPIO_SetPinState(LPC_GPIO_T * ptr_gpio, uint8_t port, uint8_t pin, bool setting)
+{
+  if (setting) ptr_gpio[port].data |= (1UL << pin);
+  else ptr_gpio[port].data &= ~(1UL << pin);
+}
+
+static inline bool Chip_GPIO_GetPinState(LPC_GPIO_T * ptr_gpio, uint8_t port, uint8_t pin)
+{
+  return (ptr_gpio[port].data >> pin) & 1;
+}
+
+static inline bool Chip_GPIO_ReadPortBit(LPC_GPIO_T * ptr_gpio, uint32_t port, uint8_t pin)
+{
+  return (ptr_gpio[port].data >> pin) & 1;
+}
+
+static inline void Chip_GPIO_SetupPinInt(LPC_GPIO_T * ptr_gpio, uint8_t port, uint8_t pin, uint32_t mode)
+{
+  ptr_gpio[port].fall = (mode & GPIO_INT_FALLING_EDGE) ? ptr_gpio[port].fall | (1UL << pin) : ptr_gpio[port].fall & ~(1UL << pin);
+  ptr_gpio[port].rise = (mode & GPIO_INT_RISING_EDGE) ? ptr_gpio[port].rise | (1UL << pin) : ptr_gpio[port].rise & ~(1UL << pin);
+}
+
+static inline void Chip_GPIO_EnableInt(LPC_GPIO_T * ptr_gpio, uint8_t port, uint32_t pinmask)
+{
+  ptr_gpio[port].ie |= pinmask;
+}
+
+static inline void Chip_GPIO_DisableInt(LPC_GPIO_T * ptr_gpio, uint8_t port, uint32_t pinmask)
+{
+  ptr_gpio[port].ie &= ~pinmask;
+}
+
+static inline uint32_t Chip_GPIO_GetMaskedInts(LPC_GPIO_T * ptr_gpio, uint8_t port)
+{
+  return ptr_gpio[port].ris & ptr_gpio[port].ie;
+}
+
+static inline void Chip_GPIO_ClearInts(LPC_GPIO_T * ptr_gpio, uint8_t port, uint32_t pinmask)
+{
+  ptr_gpio[port].ris &= ~pinmask;
+}
+
+/*****************************************************************************
+ * Timers
+ ****************************************************************************/
+
+typedef struct
+{
+  uint32_t IR;        // Pending matches.
+  uint32_t TCR;       // 1 = counting
+  uint32_t PR;        // Prescaler.
+  uint32_t MCR;       // Match control (only interrupt enable bits are used).
+  uint32_t MR[4];     // Match values.
+  uint32_t armed;     // Matches not reached since set.
+  uint64_t start_ns;  // Host time of counter zero.
+} LPC_TIMER_T;
+
+extern LPC_TIMER_T host_timer[4];
+#define LPC_TIMER16_0 (&host_timer[0])
+#define LPC_TIMER16_1 (&host_timer[1])
+#define LPC_TIMER32_0 (&host_timer[2])
+#define LPC_TIMER32_1 (&host_timer[3])
+
+#define TIMER_INT_ON_MATCH(n)   (1UL << ((n) * 3))
+#define TIMER_RESET_ON_MATCH(n) (1UL << (((n) * 3) + 1))
+#define TIMER_STOP_ON_MATCH(n)  (1UL << (((n) * 3) + 2))
+
+uint32_t Chip_TIMER_ReadCount(LPC_TIMER_T * ptr_timer);
+void Chip_TIMER_Reset(LPC_TIMER_T * ptr_timer);
+
+static inline void Chip_TIMER_Init(LPC_TIMER_T * ptr_timer) { (void)ptr_timer; }
+static inline void Chip_TIMER_DeInit(LPC_TIMER_T * ptr_timer) { ptr_timer->TCR = 0; }
+static inline void Chip_TIMER_Enable(LPC_TIMER_T * ptr_timer) { ptr_timer->TCR = 1; }
+static inline void Chip_TIMER_Disable(LPC_TIMER_T * ptr_timer) { ptr_timer->TCR = 0; }
+static inline void Chip_TIMER_PrescaleSet(LPC_TIMER_T * ptr_timer, uint32_t prescale) { ptr_timer->PR = prescale; }
+
+static inline void Chip_TIMER_SetMatch(LPC_TIMER_T * ptr_timer, int8_t match_num, uint32_t match_val)
+{
+  ptr_timer->MR[match_num] = match_val;
+  ptr_timer->armed |= (1UL << match_num);
+}
+
+static inline void Chip_TIMER_MatchEnableInt(LPC_TIMER_T * ptr_timer, int8_t match_num)
+{
+  ptr_timer->MCR |= TIMER_INT_ON_MATCH(match_num);
+}
+
+static inline void Chip_TIMER_MatchDisableInt(LPC_TIMER_T * ptr_timer, int8_t match_num)
+{
+  ptr_timer->MCR &= ~TIMER_INT_ON_MATCH(match_num);
+}
+
+static inline bool Chip_TIMER_MatchPending(LPC_TIMER_T * ptr_timer, int8_t match_num)
+{
+  return (ptr_timer->IR >> match_num) & 1;
+}
+
+static inline void Chip_TIMER_ClearMatch(LPC_TIMER_T * ptr_timer, int8_t match_num)
+{
+  ptr_timer->IR &= ~(1UL << match_num);
+}
+
+/*****************************************************************************
+ * System control, clocks, IOCON, watchdog
+ ****************************************************************************/
+
+typedef enum
+{
+  SYSCTL_CLOCK_I2C = 5,
+  SYSCTL_CLOCK_CT16B0 = 7,
+  SYSCTL_CLOCK_CT16B1 = 8,
+  SYSCTL_CLOCK_CT32B0 = 9,
+  SYSCTL_CLOCK_CT32B1 = 10,
+  SYSCTL_CLOCK_UART0 = 12,
+  SYSCTL_CLOCK_WDT = 15,
+  SYSCTL_CLOCK_CAN = 17,
+} CHIP_SYSCTL_CLOCK_T;
+
+typedef enum
+{
+  RESET_I2C0 = 1,
+  RESET_CAN0 = 3,
+} CHIP_SYSCTL_PERIPH_RESET_T;
+
+#define SYSCTL_RST_POR    (1 << 0)
+#define SYSCTL_RST_EXTRST (1 << 1)
+#define SYSCTL_RST_WDT    (1 << 2)
+#define SYSCTL_RST_BOD    (1 << 3)
+#define SYSCTL_RST_SYSRST (1 << 4)
+
+static inline void Chip_Clock_EnablePeriphClock(CHIP_SYSCTL_CLOCK_T clk) { (void)clk; }
+static inline void Chip_SYSCTL_DeassertPeriphReset(CHIP_SYSCTL_PERIPH_RESET_T periph) { (void)periph; }
+static inline uint32_t Chip_Clock_GetMainClockRate(void) { return SystemCoreClock; }
+static inline uint32_t Chip_Clock_GetSystemClockRate(void) { return SystemCoreClock; }
+
+typedef uint32_t CHIP_IOCON_PIO_T;
+typedef struct { uint32_t reserved; } LPC_IOCON_T;
+#define LPC_IOCON ((LPC_IOCON_T *)NULL)
+
+#define IOCON_FUNC0       0x0
+#define IOCON_FUNC1       0x1
+#define IOCON_FUNC2       0x2
+#define IOCON_MODE_INACT  (0x0 << 3)
+#define IOCON_MODE_PULLDOWN (0x1 << 3)
+#define IOCON_MODE_PULLUP (0x2 << 3)
+
+static inline void Chip_IOCON_PinMux(LPC_IOCON_T * ptr_iocon, CHIP_IOCON_PIO_T pin, uint32_t mode, uint8_t func)
+{
+  (void)ptr_iocon; (void)pin; (void)mode; (void)func;
+}
+
+typedef struct { uint32_t reserved; } LPC_WWDT_T;
+#define LPC_WWDT ((LPC_WWDT_T *)NULL)
+
+static inline void Chip_WWDT_Feed(LPC_WWDT_T * ptr_wwdt) { (void)ptr_wwdt; }
+
+/*****************************************************************************
+ * C_CAN (ROM driver emulated on SocketCAN)
+ ****************************************************************************/
+
+typedef struct
+{
+  const CCAN_API_T * candApiBase;
+} LPC_ROM_API_T;
+
+extern const LPC_ROM_API_T host_rom_api;
+#define LPC_ROM_API (&host_rom_api)
+
+// Only error counter register is read directly by the driver.
+extern volatile uint32_t host_can_regs[8];
+#define LPC_CAN0_BASE ((uintptr_t)host_can_regs)
+
+/**
+ * @brief Open CAN interface for emulated C_CAN.
+ *
+ *        Must be called before CAN_init.
+ *
+ * @param ifname ... SocketCAN interface name (e.g. vcan0)
+ *
+ * @return true if succeeded
+ */
+bool host_can_open(const char * ifname);
+
+/*****************************************************************************
+ * Simulation
+ ****************************************************************************/
+
+/**
+ * @brief Get host monotonic time.
+ *
+ * @return time in nanoseconds
+ */
+uint64_t host_time_ns(void);
+
+/**
+ * @brief Drive input pin from outside of the chip.
+ *
+ *        Edge sets interrupt status of the pin according to its interrupt setup.
+ *
+ * @param port ... GPIO port
+ * @param pin ... GPIO pin
+ * @param level ... new level of the pin
+ */
+void host_pin_input(uint8_t port, uint8_t pin, bool level);
+
+/**
+ * @brief Call interrupt handlers of all pending interrupts.
+ *
+ *        Polls CAN interface, GPIO interrupt status and timer matches.
+ *        Must be called from the highest priority task.
+ */
+void host_irq_dispatch(void);
+
+#endif /* HOST_CHIP_H_ */
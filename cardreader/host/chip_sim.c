@@ -0,0 +1,163 @@
+/**
+ *  @file
+ *  @brief Simulated LPC11C24 peripherals for host build.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "chip.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <time.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Interrupt handlers of the panel (see startup code of target).
+extern void CAN_IRQHandler(void);
+extern void PIOINT0_IRQHandler(void);
+extern void PIOINT1_IRQHandler(void);
+extern void PIOINT2_IRQHandler(void);
+extern void PIOINT3_IRQHandler(void);
+extern void TIMER32_1_IRQHandler(void);
+
+static void (* const _gpio_handler[HOST_GPIO_PORTS])(void) =
+{
+  PIOINT0_IRQHandler,
+  PIOINT1_IRQHandler,
+  PIOINT2_IRQHandler,
+  PIOINT3_IRQHandler,
+};
+
+// Timers with interrupt handler (CT16B0 is used only by OSDP which is not simulated).
+static void (* const _timer_handler[4])(void) =
+{
+  NULL,
+  NULL,
+  NULL,
+  TIMER32_1_IRQHandler,
+};
+
+static uint32_t _primask = 0;
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+LPC_GPIO_T host_gpio[HOST_GPIO_PORTS];
+LPC_TIMER_T host_timer[4];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static void _timer_check_match(LPC_TIMER_T * ptr_timer)
+{
+  if (ptr_timer->TCR == 0 || ptr_timer->armed == 0) return;
+
+  uint32_t count = Chip_TIMER_ReadCount(ptr_timer);
+  for (int i = 0; i < 4; ++i)
+  {
+    if ((ptr_timer->armed & (1UL << i)) && (int32_t)(count - ptr_timer->MR[i]) >= 0)
+    {
+      ptr_timer->armed &= ~(1UL << i);
+      ptr_timer->IR |= (1UL << i);
+    }
+  }
+}
+
+static bool _timer_int_pending(const LPC_TIMER_T * ptr_timer)
+{
+  for (int i = 0; i < 4; ++i)
+  {
+    if ((ptr_timer->IR & (1UL << i)) && (ptr_timer->MCR & TIMER_INT_ON_MATCH(i))) return true;
+  }
+  return false;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+void __disable_irq(void)
+{
+  if (_primask == 0)
+  {
+    portENTER_CRITICAL();
+    _primask = 1;
+  }
+}
+
+void __enable_irq(void)
+{
+  if (_primask != 0)
+  {
+    _primask = 0;
+    portEXIT_CRITICAL();
+  }
+}
+
+uint32_t __get_PRIMASK(void)
+{
+  return _primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+  if (primask) __disable_irq();
+  else __enable_irq();
+}
+
+uint64_t host_time_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+uint32_t Chip_TIMER_ReadCount(LPC_TIMER_T * ptr_timer)
+{
+  uint64_t tick_ns = (1000000000ULL * (ptr_timer->PR + 1)) / SystemCoreClock;
+  if (tick_ns == 0) tick_ns = 1;
+  return (uint32_t)((host_time_ns() - ptr_timer->start_ns) / tick_ns);
+}
+
+void Chip_TIMER_Reset(LPC_TIMER_T * ptr_timer)
+{
+  ptr_timer->start_ns = host_time_ns();
+}
+
+void host_pin_input(uint8_t port, uint8_t pin, bool level)
+{
+  uint32_t mask = (1UL << pin);
+  bool prev = (host_gpio[port].data & mask) != 0;
+
+  if (prev == level) return;
+
+  if (level) host_gpio[port].data |= mask;
+  else host_gpio[port].data &= ~mask;
+
+  if ((level && (host_gpio[port].rise & mask)) || (!level && (host_gpio[port].fall & mask)))
+  {
+    host_gpio[port].ris |= mask;
+  }
+}
+
+void host_irq_dispatch(void)
+{
+  CAN_IRQHandler();
+
+  for (uint8_t port = 0; port < HOST_GPIO_PORTS; ++port)
+  {
+    if (host_gpio[port].ris & host_gpio[port].ie) _gpio_handler[port]();
+  }
+
+  for (int i = 0; i < 4; ++i)
+  {
+    _timer_check_match(&host_timer[i]);
+    if (_timer_handler[i] != NULL && _timer_int_pending(&host_timer[i])) _timer_handler[i]();
+  }
+}
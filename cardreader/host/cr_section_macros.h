@@ -0,0 +1,17 @@
+/**
+ *  @file
+ *  @brief Section placement macros for host build (sections are not used).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef HOST_CR_SECTION_MACROS_H_
+#define HOST_CR_SECTION_MACROS_H_
+
+#define __BSS(bank)
+#define __DATA(bank)
+#define __NOINIT(bank)
+
+#endif /* HOST_CR_SECTION_MACROS_H_ */
@@ -0,0 +1,91 @@
+/**
+ *  @file
+ *  @brief Platform functions of firmware update for host build.
+ *
+ *         Application region is kept in memory and optionally mirrored to an image
+ *         file (host panel does not execute the image).
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "fw_port.h"
+#include "acs_can_protocol.h"
+#include "board.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+static uint8_t _image[FW_APP_SIZE];
+static FILE * _file = NULL;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static bool _flush(uint32_t offset, uint32_t len)
+{
+  if (_file == NULL) return true;
+
+  return fseek(_file, offset, SEEK_SET) == 0 &&
+         fwrite(&_image[offset], 1, len, _file) == len &&
+         fflush(_file) == 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool Board_Firmware_Open(const char * path)
+{
+  memset(_image, 0xFF, sizeof(_image));
+  if (path == NULL) return true;
+
+  _file = fopen(path, "r+b");
+  if (_file != NULL)
+  {
+    size_t n_got = fread(_image, 1, sizeof(_image), _file);
+    (void)n_got; // Shorter image is padded with erased bytes.
+    return true;
+  }
+
+  _file = fopen(path, "w+b");
+  return _file != NULL && _flush(0, sizeof(_image));
+}
+
+bool fw_port_erase(void)
+{
+  memset(_image, 0xFF, sizeof(_image));
+  return _flush(0, sizeof(_image));
+}
+
+bool fw_port_write(uint32_t offset, const uint8_t * data)
+{
+  if (offset + ACS_FW_WINDOW_SIZE > sizeof(_image)) return false;
+
+  memcpy(&_image[offset], data, ACS_FW_WINDOW_SIZE);
+  return _flush(offset, ACS_FW_WINDOW_SIZE);
+}
+
+const uint8_t * fw_port_image(void)
+{
+  return _image;
+}
+
+uint32_t fw_port_ms(void)
+{
+  // Receive loop polls the socket - give host CPU to other panels (frames wait in socket buffer).
+  usleep(100);
+
+  return (uint32_t)(host_time_ns() / 1000000ULL);
+}
+
+void fw_port_reset(void)
+{
+  Board_Reset();
+}
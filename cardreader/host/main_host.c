@@ -0,0 +1,155 @@
+/**
+ *  @file
+ *  @brief Main entry point of host build.
+ *
+ *  Usage: acs-panel-host -i <can_if> [-a <address>] [-s <script>] [-e <eeprom_image>] [-f <flash_image>]
+ *
+ *  Without address the panel uses address stored in EEPROM image.
+ *  Firmware update (FC_FW_UPDATE) is received to flash image, the panel is then
+ *  executed again as after reset.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "terminal.h"
+#include "board.h"
+#include "storage.h"
+#include "storage_service.h"
+#include "timer_wheel.h"
+#include "profiler.h"
+#include "sim.h"
+#include "diag.h"
+#include "fw_update.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Memory for kernel tasks (no heap is used).
+static StaticTask_t _idle_task_tcb;
+static StackType_t _idle_task_stack[configMINIMAL_STACK_SIZE];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static void _usage(const char * name)
+{
+  fprintf(stderr, "Usage: %s -i <can_if> [-a <address>] [-s <script>] [-e <eeprom_image>] [-f <flash_image>]\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+int main(int argc, char * argv[])
+{
+  uint64_t start_ns = host_time_ns();
+  const char * ifname = NULL;
+  const char * script_path = NULL;
+  const char * eeprom_path = NULL;
+  const char * flash_path = NULL;
+  long acs_addr = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:a:s:e:f:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'i':
+        ifname = optarg;
+        break;
+      case 'a':
+        acs_addr = strtol(optarg, NULL, 0);
+        break;
+      case 's':
+        script_path = optarg;
+        break;
+      case 'e':
+        eeprom_path = optarg;
+        break;
+      case 'f':
+        flash_path = optarg;
+        break;
+      default:
+        _usage(argv[0]);
+    }
+  }
+  if (ifname == NULL) _usage(argv[0]);
+
+  Board_Set_Reset_Args(argv);
+  Board_Init();
+
+  Board_Print_Reset_Reason();
+
+#if PROFILER_ENABLED
+  profiler_init();
+#endif
+
+  if (eeprom_path != NULL && !Board_Storage_Open(eeprom_path)) return EXIT_FAILURE;
+  if (!Board_Firmware_Open(flash_path)) return EXIT_FAILURE;
+
+  storage_init();
+  storage_service_init();
+  timer_wheel_init();
+
+  if (acs_addr >= 0 && !storage_write_word_le(PTR_READER_FIRST_ADDR, (uint16_t)acs_addr)) return EXIT_FAILURE;
+
+  if (!host_can_open(ifname)) return EXIT_FAILURE;
+
+  // Boot loader - host panel always has an application to run.
+  if (!fw_update_check(true)) fw_update_run(true);
+
+  if (!sim_init(script_path)) return EXIT_FAILURE;
+
+  terminal_init();
+
+  sim_start();
+
+  diag_boot_init((uint16_t)((host_time_ns() - start_ns) / 1000000ULL));
+
+  // Start the kernel. From here on, only tasks and simulated interrupts will run.
+  vTaskStartScheduler();
+
+  return EXIT_FAILURE;
+}
+
+void vAssertCalled(const char * file, unsigned long line)
+{
+  // Watchdog would reset the panel on target.
+  fprintf(stderr, "Assertion failed at %s:%lu\n", file, line);
+  abort();
+}
+
+/* Used for run time statistics (10 kHz as on target). */
+uint32_t ulGetRunTimeCounterValue(void)
+{
+  return (uint32_t)(host_time_ns() / 100000ULL);
+}
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize)
+{
+  *ppxIdleTaskTCBBuffer = &_idle_task_tcb;
+  *ppxIdleTaskStackBuffer = _idle_task_stack;
+  *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationTickHook(void)
+{
+  timer_wheel_tick();
+}
+
+void vApplicationIdleHook(void)
+{
+  // Give host CPU to other panels (tick signal interrupts the sleep).
+  usleep(1000);
+}
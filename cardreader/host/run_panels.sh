@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Run several host panels on one (virtual) CAN bus.
+#
+# Usage: run_panels.sh [-i can_if] [-n panels] [-a first_addr] [-d doors_per_panel] [-s script] [-b binary]
+#
+# Virtual interface is created when it does not exist (requires root).
+# Each panel keeps its EEPROM image in the working directory (panel_<addr>.eeprom).
+# Output of each panel is prefixed with its address.
+
+IFNAME=vcan0
+COUNT=2
+FIRST_ADDR=4
+DOORS=2
+SCRIPT=
+BIN=./build-host/host/acs-panel-host
+
+while getopts "i:n:a:d:s:b:" opt; do
+  case $opt in
+    i) IFNAME=$OPTARG ;;
+    n) COUNT=$OPTARG ;;
+    a) FIRST_ADDR=$OPTARG ;;
+    d) DOORS=$OPTARG ;;
+    s) SCRIPT=$OPTARG ;;
+    b) BIN=$OPTARG ;;
+    *) sed -n '5p' "$0"; exit 1 ;;
+  esac
+done
+
+if ! ip link show "$IFNAME" > /dev/null 2>&1; then
+  ip link add dev "$IFNAME" type vcan && ip link set up "$IFNAME" || exit 1
+fi
+
+trap 'kill 0' INT TERM EXIT
+
+i=0
+while [ "$i" -lt "$COUNT" ]; do
+  addr=$((FIRST_ADDR + i * DOORS))
+  if [ -n "$SCRIPT" ]; then
+    "$BIN" -i "$IFNAME" -a "$addr" -e "panel_$addr.eeprom" -s "$SCRIPT" 2>&1 | sed "s/^/[$addr] /" &
+  else
+    "$BIN" -i "$IFNAME" -a "$addr" -e "panel_$addr.eeprom" < /dev/null 2>&1 | sed "s/^/[$addr] /" &
+  fi
+  i=$((i + 1))
+done
+
+wait
@@ -0,0 +1,318 @@
+/**
+ *  @file
+ *  @brief Panel I/O simulator for host build.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "sim.h"
+#include "board.h"
+#include "weigand.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+#define SIM_TASK_PRIORITY   (configMAX_PRIORITIES - 1)
+#define SIM_TASK_STACK_SIZE configMINIMAL_STACK_SIZE
+#define SIM_LINE_MAX        128
+
+#ifdef DOOR_SENSOR_TYPE
+#if DOOR_SENSOR_TYPE == SENSOR_IS_NC
+#define SIM_SENSOR_OPEN LOG_LOW
+#else
+#define SIM_SENSOR_OPEN LOG_HIGH
+#endif
+#endif
+
+typedef struct
+{
+  uint8_t data_port;
+  uint8_t d0_pin;
+  uint8_t d1_pin;
+  uint8_t relay_port;
+  uint8_t relay_pin;
+  uint8_t sensor_port;
+  uint8_t sensor_pin;
+} sim_wiring_t;
+
+static const sim_wiring_t _wiring[ACS_READER_MAXCOUNT] =
+{
+  {ACS_READER_A_DATA_PORT, ACS_READER_A_D0_PIN, ACS_READER_A_D1_PIN,
+   ACS_READER_A_RELAY_PORT, ACS_READER_A_RELAY_PIN, ACS_READER_A_SENSOR_PORT, ACS_READER_A_SENSOR_PIN},
+#if ACS_READER_MAXCOUNT > 1
+  {ACS_READER_B_DATA_PORT, ACS_READER_B_D0_PIN, ACS_READER_B_D1_PIN,
+   ACS_READER_B_RELAY_PORT, ACS_READER_B_RELAY_PIN, ACS_READER_B_SENSOR_PORT, ACS_READER_B_SENSOR_PIN},
+#endif
+#if ACS_READER_MAXCOUNT > 2
+  {ACS_READER_C_DATA_PORT, ACS_READER_C_D0_PIN, ACS_READER_C_D1_PIN,
+   ACS_READER_C_RELAY_PORT, ACS_READER_C_RELAY_PIN, ACS_READER_C_SENSOR_PORT, ACS_READER_C_SENSOR_PIN},
+#endif
+#if ACS_READER_MAXCOUNT > 3
+  {ACS_READER_D_DATA_PORT, ACS_READER_D_D0_PIN, ACS_READER_D_D1_PIN,
+   ACS_READER_D_RELAY_PORT, ACS_READER_D_RELAY_PIN, ACS_READER_D_SENSOR_PORT, ACS_READER_D_SENSOR_PIN},
+#endif
+};
+
+// Card being sent (one bit every two ticks).
+typedef struct
+{
+  weigand_frame_t frame;
+  uint8_t reader_idx;
+  uint8_t sent;     // Sent bits.
+  bool pulse;       // Data line is low.
+  bool active;
+} sim_card_t;
+
+static sim_card_t _card;
+
+static StaticTask_t _sim_task_tcb;
+static StackType_t _sim_task_stack[SIM_TASK_STACK_SIZE];
+
+static int _script_fd = -1;
+static char _line[SIM_LINE_MAX];
+static size_t _line_len = 0;
+static TickType_t _wait_until = 0;
+
+static bool _relay_active[ACS_READER_MAXCOUNT];
+static uint64_t _start_ns;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static inline uint32_t _now_ms(void)
+{
+  return (uint32_t)((host_time_ns() - _start_ns) / 1000000ULL);
+}
+
+// Build frame which has the given identification and valid parity.
+static bool _card_encode(uint32_t id, uint8_t bits, weigand_frame_t * ptr_frame)
+{
+  if (bits < WEIGAND_MIN_FRAME_SIZE || bits > WEIGAND_MAX_FRAME_SIZE) return false;
+
+  ptr_frame->length = bits;
+  uint64_t data = (uint64_t)id << 1;
+  if (bits < 34) data &= (1ULL << (bits - 1)) - 1;
+
+  // Parity bits are at both ends of the frame (two leading bits for 35bit format).
+  for (uint8_t parity = 0; parity < 8; ++parity)
+  {
+    ptr_frame->value = data;
+    if (parity & 0x1) ptr_frame->value |= 1ULL;
+    if (parity & 0x2) ptr_frame->value |= 1ULL << (bits - 1);
+    if (parity & 0x4) ptr_frame->value ^= 1ULL << (bits - 2);
+
+    if (weigand_is_parity_ok(ptr_frame) && weigand_get_id(ptr_frame) == id) return true;
+  }
+  return false;
+}
+
+static void _card_step(void)
+{
+  if (!_card.active) return;
+
+  const sim_wiring_t * ptr_wiring = &_wiring[_card.reader_idx];
+
+  if (_card.pulse)
+  {
+    host_pin_input(ptr_wiring->data_port, ptr_wiring->d0_pin, LOG_HIGH);
+    host_pin_input(ptr_wiring->data_port, ptr_wiring->d1_pin, LOG_HIGH);
+    _card.pulse = false;
+    _card.active = (++_card.sent < _card.frame.length);
+  }
+  else
+  {
+    // MSB first.
+    bool bit = (_card.frame.value >> (_card.frame.length - 1 - _card.sent)) & 1;
+    host_pin_input(ptr_wiring->data_port, bit ? ptr_wiring->d1_pin : ptr_wiring->d0_pin, LOG_LOW);
+    _card.pulse = true;
+  }
+}
+
+static int _parse_door(const char * str)
+{
+  int idx;
+  if (str == NULL) return -1;
+  if (isalpha((unsigned char)str[0]) && str[1] == '\0') idx = toupper((unsigned char)str[0]) - 'A';
+  else idx = atoi(str);
+  return (idx >= 0 && idx < ACS_READER_MAXCOUNT) ? idx : -1;
+}
+
+static void _execute(char * line)
+{
+  char * cmd = strtok(line, " \t\r\n");
+  if (cmd == NULL || cmd[0] == '#') return;
+
+  char * arg1 = strtok(NULL, " \t\r\n");
+  char * arg2 = strtok(NULL, " \t\r\n");
+  char * arg3 = strtok(NULL, " \t\r\n");
+
+  if (strcmp(cmd, "wait") == 0 && arg1 != NULL)
+  {
+    _wait_until = xTaskGetTickCount() + pdMS_TO_TICKS(strtoul(arg1, NULL, 0));
+  }
+  else if (strcmp(cmd, "card") == 0 && _parse_door(arg1) >= 0 && arg2 != NULL)
+  {
+    uint8_t bits = arg3 != NULL ? (uint8_t)atoi(arg3) : 26;
+    if (!_card_encode(strtoul(arg2, NULL, 0), bits, &_card.frame))
+    {
+      printf("[%u] sim: card %s does not fit %u bits\n", _now_ms(), arg2, bits);
+      return;
+    }
+    _card.reader_idx = _parse_door(arg1);
+    _card.sent = 0;
+    _card.pulse = false;
+    _card.active = true;
+  }
+  else if (strcmp(cmd, "door") == 0 && _parse_door(arg1) >= 0 && arg2 != NULL)
+  {
+#ifdef DOOR_SENSOR_TYPE
+    const sim_wiring_t * ptr_wiring = &_wiring[_parse_door(arg1)];
+    bool open = (strcmp(arg2, "open") == 0);
+    host_pin_input(ptr_wiring->sensor_port, ptr_wiring->sensor_pin, open ? SIM_SENSOR_OPEN : !SIM_SENSOR_OPEN);
+#endif
+  }
+  else if (strcmp(cmd, "loop") == 0)
+  {
+    if (lseek(_script_fd, 0, SEEK_SET) < 0) printf("[%u] sim: script can not loop\n", _now_ms());
+    _line_len = 0;
+  }
+  else if (strcmp(cmd, "quit") == 0)
+  {
+    exit(EXIT_SUCCESS);
+  }
+  else
+  {
+    printf("[%u] sim: unknown command %s\n", _now_ms(), cmd);
+  }
+}
+
+// Read one command line without blocking.
+static bool _script_read_line(void)
+{
+  while (_script_fd >= 0)
+  {
+    char * end = memchr(_line, '\n', _line_len);
+    if (end != NULL)
+    {
+      *end = '\0';
+      return true;
+    }
+    if (_line_len == sizeof(_line) - 1)
+    {
+      _line[_line_len] = '\0'; // Too long line is split.
+      _line_len = 0;
+      return true;
+    }
+
+    ssize_t n_got = read(_script_fd, &_line[_line_len], sizeof(_line) - 1 - _line_len);
+    if (n_got <= 0)
+    {
+      if (n_got == 0 && _line_len > 0)
+      {
+        _line[_line_len] = '\0'; // Last line without newline.
+        _line_len = 0;
+        return true;
+      }
+      return false;
+    }
+    _line_len += n_got;
+  }
+  return false;
+}
+
+static void _script_step(void)
+{
+  if (_card.active || (int32_t)(xTaskGetTickCount() - _wait_until) < 0) return;
+
+  // Commands are executed until one of them takes time.
+  while (!_card.active && (int32_t)(xTaskGetTickCount() - _wait_until) >= 0 && _script_read_line())
+  {
+    char line[SIM_LINE_MAX];
+    strcpy(line, _line);
+
+    // Remove the line from buffer.
+    size_t used = strlen(_line) + 1;
+    if (used > _line_len) used = _line_len;
+    memmove(_line, &_line[used], _line_len - used);
+    _line_len -= used;
+
+    _execute(line);
+  }
+}
+
+static void _report_outputs(void)
+{
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    // Relay is active low.
+    bool active = !Chip_GPIO_GetPinState(LPC_GPIO, _wiring[idx].relay_port, _wiring[idx].relay_pin) &&
+                  (LPC_GPIO[_wiring[idx].relay_port].dir & (1UL << _wiring[idx].relay_pin));
+    if (active != _relay_active[idx])
+    {
+      _relay_active[idx] = active;
+      printf("[%u] door %c %s\n", _now_ms(), 'A' + idx, active ? "unlocked" : "locked");
+    }
+  }
+}
+
+static void _sim_task(void * pvParameters)
+{
+  (void)pvParameters;
+  TickType_t last_wake = xTaskGetTickCount();
+
+  for (;;)
+  {
+    _card_step();
+    _script_step();
+    host_irq_dispatch();
+    _report_outputs();
+    vTaskDelayUntil(&last_wake, 1);
+  }
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool sim_init(const char * script_path)
+{
+  _start_ns = host_time_ns();
+
+  for (uint8_t idx = 0; idx < ACS_READER_MAXCOUNT; ++idx)
+  {
+    // Data lines are pulled up.
+    host_pin_input(_wiring[idx].data_port, _wiring[idx].d0_pin, LOG_HIGH);
+    host_pin_input(_wiring[idx].data_port, _wiring[idx].d1_pin, LOG_HIGH);
+#ifdef DOOR_SENSOR_TYPE
+    host_pin_input(_wiring[idx].sensor_port, _wiring[idx].sensor_pin, !SIM_SENSOR_OPEN);
+#endif
+  }
+
+  _script_fd = (script_path != NULL ? open(script_path, O_RDONLY) : STDIN_FILENO);
+  if (_script_fd < 0)
+  {
+    perror(script_path);
+    return false;
+  }
+  fcntl(_script_fd, F_SETFL, fcntl(_script_fd, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+void sim_start(void)
+{
+  TaskHandle_t handle = xTaskCreateStatic(_sim_task, "sim", SIM_TASK_STACK_SIZE, NULL,
+                                          SIM_TASK_PRIORITY, _sim_task_stack, &_sim_task_tcb);
+  configASSERT(handle != NULL);
+}
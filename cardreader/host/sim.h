@@ -0,0 +1,46 @@
+/**
+ *  @file
+ *  @brief Panel I/O simulator for host build.
+ *
+ *  Simulator task runs with the highest priority every tick. It calls interrupt
+ *  handlers of the simulated chip (see host_irq_dispatch), executes script which
+ *  drives card readers and door sensors and reports changes of door locks.
+ *
+ *  Script (one command per line, '#' starts a comment):
+ *  wait <ms>                  ... pause the script
+ *  card <door> <id> [bits]    ... present card to Wiegand reader (default 26 bits)
+ *  door <door> open|close     ... change door sensor
+ *  loop                       ... restart script from the beginning (file only)
+ *  quit                       ... terminate panel
+ *
+ *  Door is a letter (A - D) or its index.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#ifndef HOST_SIM_H_
+#define HOST_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Initialize simulated inputs to idle state and open script.
+ *
+ *        Must be called before terminal_init (inputs are read on reader init).
+ *
+ * @param script_path ... script file, NULL for standard input
+ *
+ * @return true if succeeded
+ */
+bool sim_init(const char * script_path);
+
+/**
+ * @brief Create simulator task.
+ *
+ */
+void sim_start(void);
+
+#endif /* HOST_SIM_H_ */
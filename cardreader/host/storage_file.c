@@ -0,0 +1,102 @@
+/**
+ *  @file
+ *  @brief Storage implementation for host build.
+ *
+ *         EEPROM is kept in memory and optionally mirrored to an image file.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "storage.h"
+#include "FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+static uint8_t _image[STORE_SIZE];
+static FILE * _file = NULL;
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static bool _flush(uint16_t addr, uint16_t len)
+{
+  if (_file == NULL) return true;
+
+  return fseek(_file, addr, SEEK_SET) == 0 &&
+         fwrite(&_image[addr], 1, len, _file) == len &&
+         fflush(_file) == 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+bool Board_Storage_Open(const char * path)
+{
+  memset(_image, 0xFF, sizeof(_image));
+
+  _file = fopen(path, "r+b");
+  if (_file != NULL)
+  {
+    size_t n_got = fread(_image, 1, sizeof(_image), _file);
+    (void)n_got; // Shorter image is padded with erased bytes.
+    return true;
+  }
+
+  _file = fopen(path, "w+b");
+  return _file != NULL && _flush(0, sizeof(_image));
+}
+
+void storage_init(void)
+{
+  if (_file == NULL) memset(_image, 0xFF, sizeof(_image));
+}
+
+bool storage_read_word_le(const uint8_t addr, uint16_t * data)
+{
+  *data = _image[addr] | (uint16_t)(_image[addr + 1] << 8);
+  return true;
+}
+
+bool storage_write_word_le(const uint8_t addr, const uint16_t data)
+{
+  _image[addr] = (uint8_t)data;
+  _image[addr + 1] = (uint8_t)(data >> 8);
+  return _flush(addr, 2);
+}
+
+bool storage_read_byte(const uint8_t addr, uint8_t * data)
+{
+  *data = _image[addr];
+  return true;
+}
+
+bool storage_write_byte(const uint8_t addr, const uint8_t data)
+{
+  _image[addr] = data;
+  return _flush(addr, 1);
+}
+
+bool storage_read(const uint16_t addr, uint8_t * data, const uint8_t len)
+{
+  configASSERT(addr + len <= STORE_SIZE);
+
+  memcpy(data, &_image[addr], len);
+  return true;
+}
+
+bool storage_write_page(const uint16_t addr, const uint8_t * data, const uint8_t len)
+{
+  configASSERT(len <= STORE_PAGE_SIZE && addr + len <= STORE_SIZE);
+  configASSERT((addr / STORE_PAGE_SIZE) == ((addr + len - 1) / STORE_PAGE_SIZE));
+
+  memcpy(&_image[addr], data, len);
+  return _flush(addr, len);
+}
@@ -0,0 +1,611 @@
+/**
+ *  @file
+ *  @brief Wiegand decoder stress test with synthetic pulse trains (host build).
+ *
+ *  Driver is compiled into this program and its interrupt handlers are called by
+ *  event driven chip model with virtual time (1ns resolution, CT32B1 at 1MHz).
+ *  Each scenario sends frames of 26, 34, 35 and 37 bit formats with valid parity
+ *  and classifies every sent frame by what the consumer got:
+ *  ok       ... the frame itself
+ *  rejected ... frame with invalid parity (weigand_is_parity_ok)
+ *  misread  ... frame with valid parity but different content
+ *  lost     ... nothing
+ *
+ *  GPIO interrupt is taken with configurable latency (other interrupts or critical
+ *  sections), the handler reads data lines when it runs. Cost of each frame is
+ *  estimated from number of interrupts weighted by estimated Cortex-M0 cycles.
+ *
+ *  Before the scenarios, parity check is tested with all single bit errors.
+ *
+ *  Usage: weigand-bench [frames] [seed]
+ *  Exit code is non-zero if a scenario within the standard timing loses frames
+ *  or if a single bit error passes parity check.
+ *
+ *  @author Petr Elexa
+ *  @see LICENSE
+ *
+ */
+
+#include "terminal_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Interrupt sites are not profiled.
+#undef PROFILER_ENABLED
+#define PROFILER_ENABLED 0
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Consumer buffer is replaced by the bench (no scheduler is running).
+#undef portYIELD_FROM_ISR
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+#include "weigand.c"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+
+// Estimated Cortex-M0 cycles (48 MHz, flash wait states included).
+#define CYCLES_ISR_ENTRY    32  // Exception entry and return (stacking, tail chaining is ignored).
+#define CYCLES_GPIO_ISR    140  // Timer read, interrupt status, loop over devices, bit append, match move.
+#define CYCLES_TIMER_ISR    80  // Match status loop over devices.
+#define CYCLES_FRAME_SEND  260  // Stream buffer send (critical section, copy of the item).
+
+#define MAX_EDGES         4096
+#define MAX_RECEIVED        16
+#define FRAME_PAUSE_US  100000  // Between frames of one reader (longer than WEIGAND_FRAME_GAP_US).
+#define BENCH_READERS        3
+#define NS_PER_US         1000ULL
+
+typedef enum
+{
+  fault_none,
+  fault_drop,   // Pulse is missing.
+  fault_dup,    // Pulse is followed by another one on the same line (ringing, reflection).
+  fault_flip    // Pulse is on the other data line (crosstalk).
+} fault_t;
+
+typedef struct
+{
+  const char * name;
+  uint16_t pulse_min_us;
+  uint16_t pulse_max_us;
+  uint16_t interval_min_us;   // From falling edge to falling edge of the next bit.
+  uint16_t interval_max_us;
+  uint16_t latency_max_us;    // GPIO interrupt latency.
+  fault_t fault;
+  uint8_t faults_per_frame;   // 0 = every pulse.
+  uint16_t dup_delay_min_us;  // From falling edge of the pulse.
+  uint16_t dup_delay_max_us;
+  uint16_t dup_width_us;      // 0 = width of the pulse.
+  uint8_t readers;            // Mask of readers sending at the same time.
+  bool must_pass;             // Within the standard, every frame must be read.
+} scenario_t;
+
+// Reader wiring: A (port 3) and B (port 2) have separate ports, C shares port 2 with B.
+static const struct
+{
+  uint8_t port;
+  uint8_t d0_pin;
+  uint8_t d1_pin;
+} _wiring[BENCH_READERS] =
+{
+  {ACS_READER_A_DATA_PORT, ACS_READER_A_D0_PIN, ACS_READER_A_D1_PIN},
+  {ACS_READER_B_DATA_PORT, ACS_READER_B_D0_PIN, ACS_READER_B_D1_PIN},
+  {ACS_READER_C_DATA_PORT, ACS_READER_C_D0_PIN, ACS_READER_C_D1_PIN},
+};
+
+static const scenario_t _scenarios[] =
+{
+  // name         pulse      interval     lat  fault       n  dup delay   dup w readers must pass
+  {"nominal",     40,  40,   2000,  2000,   0, fault_none, 0,   0,    0,  0,  0x1, true},
+  {"minimum",     20,  20,    200,   200,   0, fault_none, 0,   0,    0,  0,  0x1, true},
+  {"maximum",    100, 100,  20000, 20000,   0, fault_none, 0,   0,    0,  0,  0x1, true},
+  {"jitter",      20, 100,    200, 20000,   0, fault_none, 0,   0,    0,  0,  0x1, true},
+  {"latency-10",  20, 100,    200,  2000,  10, fault_none, 0,   0,    0,  0,  0x1, true},
+  {"latency-50",  20, 100,    200,  2000,  50, fault_none, 0,   0,    0,  0,  0x1, false},
+  {"ringing",     40,  40,   2000,  2000,   0, fault_dup,  0,  42,  140,  2,  0x1, true},
+  {"reflection",  40,  40,   2000,  2000,   0, fault_dup,  1, 160, 1000,  0,  0x1, false},
+  {"dropped",     40,  40,   2000,  2000,   0, fault_drop, 1,   0,    0,  0,  0x1, false},
+  {"crosstalk",   40,  40,   2000,  2000,   0, fault_flip, 1,   0,    0,  0,  0x1, false},
+  {"two-ports",   20, 100,    200,  2000,   5, fault_none, 0,   0,    0,  0,  0x3, true},
+  {"shared-port", 20, 100,    200,  2000,   5, fault_none, 0,   0,    0,  0,  0x6, true},
+};
+
+static const uint8_t _frame_lengths[] = {26, 34, 35, 37};
+
+typedef struct
+{
+  uint64_t at_ns;
+  uint32_t seq;      // Insertion order (stable sort).
+  uint8_t reader;
+  uint8_t line;      // 0 = D0, 1 = D1
+  bool level;
+} edge_t;
+
+typedef struct
+{
+  weigand_frame_t frame;
+  uint32_t sent;     // Index of the frame being sent when it was received.
+} received_t;
+
+// Per reader state of one scenario.
+typedef struct
+{
+  weigand_frame_t frames[MAX_RECEIVED];  // Sent frames of current round.
+  uint32_t frames_sent;
+  received_t received[MAX_RECEIVED];
+  uint32_t received_count;
+} bench_reader_t;
+
+typedef struct
+{
+  uint32_t frames;
+  uint32_t ok;
+  uint32_t rejected;
+  uint32_t misread;
+  uint32_t lost;
+  uint32_t extra;       // Additional frames (split frames).
+  uint64_t gpio_isr;
+  uint64_t timer_isr;
+  uint64_t sent_items;
+} bench_stats_t;
+
+static edge_t _edges[MAX_EDGES];
+static uint32_t _edge_count;
+static bench_reader_t _readers[BENCH_READERS];
+static bench_stats_t _stats;
+static uint32_t _rng_state;
+
+// Simulated chip.
+static uint64_t _now_ns;
+static uint64_t _gpio_irq_at[HOST_GPIO_PORTS];  // Time of pending GPIO interrupt.
+static bool _gpio_irq_pending[HOST_GPIO_PORTS];
+static uint16_t _latency_max_us;
+
+/*****************************************************************************
+ * Public types/enumerations/variables
+ ****************************************************************************/
+
+uint32_t SystemCoreClock = 48000000;
+LPC_GPIO_T host_gpio[HOST_GPIO_PORTS];
+LPC_TIMER_T host_timer[4];
+const CHIP_IOCON_PIO_T CHIP_IOCON_PIO[][12] = {{0}};
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+
+static uint32_t _rand(void)
+{
+  // xorshift32
+  _rng_state ^= _rng_state << 13;
+  _rng_state ^= _rng_state >> 17;
+  _rng_state ^= _rng_state << 5;
+  return _rng_state;
+}
+
+static uint32_t _rand_range(uint32_t min, uint32_t max)
+{
+  return min + (max > min ? _rand() % (max - min + 1) : 0);
+}
+
+// Bit of frame (1 is the first sent bit).
+static inline uint8_t _bit(uint64_t value, uint8_t length, uint8_t pos)
+{
+  return (value >> (length - pos)) & 1;
+}
+
+static uint8_t _parity(uint64_t value, uint8_t length, uint8_t first, uint8_t last, uint8_t step_skip)
+{
+  uint8_t parity = 0;
+  for (uint8_t pos = first; pos <= last; ++pos)
+  {
+    if (step_skip != 0 && (pos % 3) == step_skip) continue;
+    parity ^= _bit(value, length, pos);
+  }
+  return parity;
+}
+
+// Random frame with parity computed by the format rules (independently of the driver).
+static weigand_frame_t _frame_random(uint8_t length)
+{
+  weigand_frame_t frame = {0, length};
+  uint64_t data = ((uint64_t)_rand() << 32) | _rand();
+  frame.value = data & (((1ULL << (length - 2)) - 1) << 1);  // Data bits only.
+
+  if (length == 35)
+  {
+    // Corporate 1000: bit 2 even parity, bit 35 odd parity, bit 1 odd parity of all.
+    frame.value &= ~(1ULL << (length - 2));
+    frame.value |= (uint64_t)_parity(frame.value, length, 3, 34, 2) << (length - 2);
+    frame.value |= (uint64_t)(1 ^ _parity(frame.value, length, 2, 33, 1));
+    frame.value |= (uint64_t)(1 ^ _parity(frame.value, length, 2, 35, 0)) << (length - 1);
+  }
+  else
+  {
+    // Even parity of the first half, odd parity of the second half.
+    frame.value |= (uint64_t)_parity(frame.value, length, 2, (length + 1) / 2, 0) << (length - 1);
+    frame.value |= (uint64_t)(1 ^ _parity(frame.value, length, length / 2 + 1, length - 1, 0));
+  }
+  return frame;
+}
+
+static bool _frame_equal(const weigand_frame_t * ptr_a, const weigand_frame_t * ptr_b)
+{
+  return ptr_a->length == ptr_b->length && ptr_a->value == ptr_b->value;
+}
+
+static uint32_t _check_parity(uint32_t rounds)
+{
+  uint32_t failures = 0;
+
+  for (size_t f = 0; f < sizeof(_frame_lengths); ++f)
+  {
+    uint32_t passed = 0;
+    for (uint32_t n = 0; n < rounds; ++n)
+    {
+      weigand_frame_t frame = _frame_random(_frame_lengths[f]);
+      if (!weigand_is_parity_ok(&frame)) failures++;
+
+      for (uint8_t pos = 0; pos < frame.length; ++pos)
+      {
+        weigand_frame_t corrupted = frame;
+        corrupted.value ^= 1ULL << pos;
+        if (weigand_is_parity_ok(&corrupted)) passed++;
+      }
+    }
+    printf("parity %ubit: %lu valid frames, %lu single bit errors passed\n", _frame_lengths[f],
+           (unsigned long)rounds, (unsigned long)passed);
+    failures += passed;
+  }
+  return failures;
+}
+
+static void _edge_add(uint64_t at_ns, uint8_t reader, uint8_t line, bool level)
+{
+  if (_edge_count >= MAX_EDGES) return;
+  _edges[_edge_count] = (edge_t){at_ns, _edge_count, reader, line, level};
+  _edge_count++;
+}
+
+static void _pulse_add(uint64_t at_ns, uint32_t width_us, uint8_t reader, uint8_t line)
+{
+  _edge_add(at_ns, reader, line, false);
+  _edge_add(at_ns + width_us * NS_PER_US, reader, line, true);
+}
+
+// Generate edges of one frame, returns time of its last edge.
+static uint64_t _frame_edges(const scenario_t * ptr_scen, uint8_t reader, const weigand_frame_t * ptr_frame,
+                             uint64_t start_ns)
+{
+  // Pulses with fault (all of them or given number of random ones).
+  uint64_t faulty = (ptr_scen->fault == fault_none ? 0 :
+                     ptr_scen->faults_per_frame == 0 ? UINT64_MAX : 0);
+  for (uint8_t n = 0; n < ptr_scen->faults_per_frame; ++n) faulty |= 1ULL << (_rand() % ptr_frame->length);
+
+  uint64_t at_ns = start_ns;
+  uint64_t last_ns = start_ns;
+  for (uint8_t pos = 1; pos <= ptr_frame->length; ++pos)
+  {
+    if (pos > 1) at_ns += _rand_range(ptr_scen->interval_min_us, ptr_scen->interval_max_us) * NS_PER_US;
+
+    uint8_t line = _bit(ptr_frame->value, ptr_frame->length, pos);
+    uint32_t width_us = _rand_range(ptr_scen->pulse_min_us, ptr_scen->pulse_max_us);
+    bool fault = (faulty >> (pos - 1)) & 1;
+
+    if (fault && ptr_scen->fault == fault_drop) continue;
+    if (fault && ptr_scen->fault == fault_flip) line ^= 1;
+
+    _pulse_add(at_ns, width_us, reader, line);
+    last_ns = at_ns + width_us * NS_PER_US;
+
+    if (fault && ptr_scen->fault == fault_dup)
+    {
+      uint64_t dup_ns = at_ns + _rand_range(ptr_scen->dup_delay_min_us, ptr_scen->dup_delay_max_us) * NS_PER_US;
+      uint32_t dup_width_us = (ptr_scen->dup_width_us != 0 ? ptr_scen->dup_width_us : width_us);
+      _pulse_add(dup_ns, dup_width_us, reader, line);
+      if (dup_ns + dup_width_us * NS_PER_US > last_ns) last_ns = dup_ns + dup_width_us * NS_PER_US;
+    }
+  }
+  return last_ns;
+}
+
+static int _edge_compare(const void * ptr_a, const void * ptr_b)
+{
+  const edge_t * ptr_ea = ptr_a;
+  const edge_t * ptr_eb = ptr_b;
+  if (ptr_ea->at_ns != ptr_eb->at_ns) return ptr_ea->at_ns < ptr_eb->at_ns ? -1 : 1;
+  return ptr_ea->seq < ptr_eb->seq ? -1 : 1;
+}
+
+static uint64_t _timer_tick_ns(const LPC_TIMER_T * ptr_timer)
+{
+  return (1000000000ULL * (ptr_timer->PR + 1)) / SystemCoreClock;
+}
+
+// Time of the next timer match with interrupt enabled.
+static bool _timer_next_match(const LPC_TIMER_T * ptr_timer, uint64_t * ptr_at_ns)
+{
+  bool found = false;
+  uint64_t tick_ns = _timer_tick_ns(ptr_timer);
+  uint32_t count = Chip_TIMER_ReadCount((LPC_TIMER_T *)ptr_timer);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    if (!(ptr_timer->armed & (1UL << i)) || !(ptr_timer->MCR & TIMER_INT_ON_MATCH(i))) continue;
+
+    int32_t ticks = (int32_t)(ptr_timer->MR[i] - count);
+    uint64_t at_ns = (ticks <= 0 ? _now_ns :
+                      ptr_timer->start_ns + ((_now_ns - ptr_timer->start_ns) / tick_ns + ticks) * tick_ns);
+    if (!found || at_ns < *ptr_at_ns) *ptr_at_ns = at_ns;
+    found = true;
+  }
+  return found;
+}
+
+static void _timer_fire(LPC_TIMER_T * ptr_timer)
+{
+  uint32_t count = Chip_TIMER_ReadCount(ptr_timer);
+  for (int i = 0; i < 4; ++i)
+  {
+    if ((ptr_timer->armed & (1UL << i)) && (int32_t)(count - ptr_timer->MR[i]) >= 0)
+    {
+      ptr_timer->armed &= ~(1UL << i);
+      ptr_timer->IR |= (1UL << i);
+    }
+  }
+}
+
+// Run interrupt handlers due until given time.
+static void _advance(uint64_t until_ns)
+{
+  for (;;)
+  {
+    uint64_t next_ns = until_ns;
+    int next_port = -1;
+    bool timer = false;
+
+    for (uint8_t port = 0; port < HOST_GPIO_PORTS; ++port)
+    {
+      if (_gpio_irq_pending[port] && _gpio_irq_at[port] <= next_ns)
+      {
+        next_ns = _gpio_irq_at[port];
+        next_port = port;
+      }
+    }
+
+    uint64_t match_ns = 0;
+    if (_timer_next_match(WEIGAND_TIMER, &match_ns) && match_ns <= next_ns)
+    {
+      next_ns = match_ns;
+      timer = true;
+      next_port = -1;
+    }
+
+    if (!timer && next_port < 0) break;
+    if (next_ns > _now_ns) _now_ns = next_ns;
+
+    if (timer)
+    {
+      _timer_fire(WEIGAND_TIMER);
+      _stats.timer_isr++;
+      TIMER32_1_IRQHandler();
+    }
+    else
+    {
+      _gpio_irq_pending[next_port] = false;
+      if (!(host_gpio[next_port].ris & host_gpio[next_port].ie)) continue;
+      _stats.gpio_isr++;
+      if (next_port == 2) PIOINT2_IRQHandler();
+      else if (next_port == 3) PIOINT3_IRQHandler();
+    }
+  }
+  if (until_ns > _now_ns) _now_ns = until_ns;
+}
+
+static void _pin_set(uint8_t port, uint8_t pin, bool level)
+{
+  uint32_t mask = (1UL << pin);
+  if (((host_gpio[port].data & mask) != 0) == level) return;
+
+  if (level) host_gpio[port].data |= mask;
+  else host_gpio[port].data &= ~mask;
+
+  if ((level && (host_gpio[port].rise & mask)) || (!level && (host_gpio[port].fall & mask)))
+  {
+    host_gpio[port].ris |= mask;
+    if ((host_gpio[port].ie & mask) && !_gpio_irq_pending[port])
+    {
+      _gpio_irq_pending[port] = true;
+      _gpio_irq_at[port] = _now_ns + _rand_range(0, _latency_max_us) * NS_PER_US;
+    }
+  }
+}
+
+static void _readers_init(uint8_t readers)
+{
+  memset(host_gpio, 0, sizeof(host_gpio));
+  memset(_gpio_irq_pending, 0, sizeof(_gpio_irq_pending));
+
+  for (uint8_t idx = 0; idx < BENCH_READERS; ++idx)
+  {
+    // Data lines are pulled up.
+    host_gpio[_wiring[idx].port].data |= (1UL << _wiring[idx].d0_pin) | (1UL << _wiring[idx].d1_pin);
+    weigand_disable(idx);
+    if (readers & (1U << idx))
+    {
+      weigand_init((StreamBufferHandle_t)&_readers[idx], idx, _wiring[idx].port, _wiring[idx].d0_pin,
+                   _wiring[idx].d1_pin);
+    }
+  }
+}
+
+// Classify frames of one round.
+static void _round_evaluate(uint8_t readers)
+{
+  for (uint8_t idx = 0; idx < BENCH_READERS; ++idx)
+  {
+    if (!(readers & (1U << idx))) continue;
+    bench_reader_t * ptr_reader = &_readers[idx];
+
+    for (uint32_t n = 0; n < ptr_reader->frames_sent; ++n)
+    {
+      bool ok = false, misread = false, rejected = false;
+      uint32_t got = 0;
+
+      for (uint32_t r = 0; r < ptr_reader->received_count; ++r)
+      {
+        const received_t * ptr_recv = &ptr_reader->received[r];
+        if (ptr_recv->sent != n) continue;
+        got++;
+
+        if (!weigand_is_parity_ok(&ptr_recv->frame)) rejected = true;
+        else if (_frame_equal(&ptr_recv->frame, &ptr_reader->frames[n])) ok = true;
+        else misread = true;
+      }
+
+      _stats.frames++;
+      if (ok) _stats.ok++;
+      else if (misread) _stats.misread++;
+      else if (rejected) _stats.rejected++;
+      else _stats.lost++;
+      if (got > 1) _stats.extra += got - 1;
+    }
+    ptr_reader->frames_sent = 0;
+    ptr_reader->received_count = 0;
+  }
+}
+
+static bool _run(const scenario_t * ptr_scen, uint32_t frames)
+{
+  memset(&_stats, 0, sizeof(_stats));
+  memset(_readers, 0, sizeof(_readers));
+  _latency_max_us = ptr_scen->latency_max_us;
+  _readers_init(ptr_scen->readers);
+
+  // Rounds of up to MAX_RECEIVED frames from each reader.
+  for (uint32_t done = 0; done < frames; done += MAX_RECEIVED)
+  {
+    uint32_t round = (frames - done < MAX_RECEIVED ? frames - done : MAX_RECEIVED);
+    uint64_t end_ns = _now_ns;
+    _edge_count = 0;
+
+    for (uint8_t idx = 0; idx < BENCH_READERS; ++idx)
+    {
+      if (!(ptr_scen->readers & (1U << idx))) continue;
+      uint64_t at_ns = _now_ns + _rand_range(1, 2000) * NS_PER_US;
+
+      for (uint32_t n = 0; n < round; ++n)
+      {
+        _readers[idx].frames[n] = _frame_random(_frame_lengths[_rand() % sizeof(_frame_lengths)]);
+        at_ns = _frame_edges(ptr_scen, idx, &_readers[idx].frames[n], at_ns) + FRAME_PAUSE_US * NS_PER_US;
+      }
+      if (at_ns > end_ns) end_ns = at_ns;
+    }
+    qsort(_edges, _edge_count, sizeof(edge_t), _edge_compare);
+
+    // Count started frames (to know which frame was being sent when consumer got one).
+    uint64_t frame_end_ns[BENCH_READERS] = {0};
+    for (uint32_t e = 0; e < _edge_count; ++e)
+    {
+      const edge_t * ptr_edge = &_edges[e];
+      bench_reader_t * ptr_reader = &_readers[ptr_edge->reader];
+
+      _advance(ptr_edge->at_ns);
+
+      // New frame starts after the pause.
+      if (ptr_reader->frames_sent == 0 ||
+          ptr_edge->at_ns > frame_end_ns[ptr_edge->reader] + (FRAME_PAUSE_US / 2) * NS_PER_US)
+      {
+        ptr_reader->frames_sent++;
+      }
+      frame_end_ns[ptr_edge->reader] = ptr_edge->at_ns;
+
+      uint8_t pin = (ptr_edge->line ? _wiring[ptr_edge->reader].d1_pin : _wiring[ptr_edge->reader].d0_pin);
+      _pin_set(_wiring[ptr_edge->reader].port, pin, ptr_edge->level);
+    }
+    _advance(end_ns);
+
+    _round_evaluate(ptr_scen->readers);
+  }
+
+  uint32_t total = _stats.frames;
+  printf("%-12s %6lu %6.1f%% %6.1f%% %6.1f%% %6.1f%% %6lu %8.1f %8.0f\n", ptr_scen->name, (unsigned long)total,
+         100.0 * _stats.ok / total, 100.0 * _stats.rejected / total, 100.0 * _stats.misread / total,
+         100.0 * _stats.lost / total, (unsigned long)_stats.extra, (double)_stats.gpio_isr / total,
+         (double)(_stats.gpio_isr * (CYCLES_ISR_ENTRY + CYCLES_GPIO_ISR) +
+                  _stats.timer_isr * (CYCLES_ISR_ENTRY + CYCLES_TIMER_ISR) +
+                  _stats.sent_items * CYCLES_FRAME_SEND) / total);
+
+  return !ptr_scen->must_pass || (_stats.ok == total && _stats.extra == 0);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+
+uint32_t Chip_TIMER_ReadCount(LPC_TIMER_T * ptr_timer)
+{
+  return (uint32_t)((_now_ns - ptr_timer->start_ns) / _timer_tick_ns(ptr_timer));
+}
+
+void Chip_TIMER_Reset(LPC_TIMER_T * ptr_timer)
+{
+  ptr_timer->start_ns = _now_ns;
+}
+
+BaseType_t xStreamBufferIsFull(StreamBufferHandle_t xStreamBuffer)
+{
+  bench_reader_t * ptr_reader = (bench_reader_t *)xStreamBuffer;
+  return ptr_reader->received_count >= MAX_RECEIVED ? pdTRUE : pdFALSE;
+}
+
+size_t xStreamBufferSendFromISR(StreamBufferHandle_t xStreamBuffer, const void * pvData, size_t xDataLengthBytes,
+                                BaseType_t * const pxHigherPriorityTaskWoken)
+{
+  bench_reader_t * ptr_reader = (bench_reader_t *)xStreamBuffer;
+  const weigand_buff_item_t * ptr_item = pvData;
+  (void)pxHigherPriorityTaskWoken;
+
+  configASSERT(xDataLengthBytes == WEIGAND_BUFF_ITEM_SIZE);
+  configASSERT(ptr_item->source < BENCH_READERS && &_readers[ptr_item->source] == ptr_reader);
+
+  // Frame belongs to the last frame which had an edge.
+  ptr_reader->received[ptr_reader->received_count].frame = ptr_item->frame;
+  ptr_reader->received[ptr_reader->received_count].sent = ptr_reader->frames_sent - 1;
+  ptr_reader->received_count++;
+  _stats.sent_items++;
+  return xDataLengthBytes;
+}
+
+void vAssertCalled(const char * file, unsigned long line)
+{
+  fprintf(stderr, "Assertion failed at %s:%lu\n", file, line);
+  abort();
+}
+
+int main(int argc, char * argv[])
+{
+  uint32_t frames = (argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 2000);
+  _rng_state = (argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x2545F491UL);
+  if (_rng_state == 0) _rng_state = 1;
+  if (frames == 0) frames = 1;
+
+  uint32_t failures = _check_parity(10000);
+
+  printf("estimated Cortex-M0 cycles per frame (all interrupts of all readers)\n");
+  printf("scenario     frames     ok  rejected misread   lost  extra  irq/frm  cyc/frm\n");
+
+  for (size_t i = 0; i < sizeof(_scenarios) / sizeof(_scenarios[0]); ++i)
+  {
+    if (!_run(&_scenarios[i], frames)) failures++;
+  }
+
+  if (failures != 0) printf("%lu failures\n", (unsigned long)failures);
+
+  return (failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}